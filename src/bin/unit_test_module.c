@@ -1079,6 +1079,8 @@ int main(int argc, char *argv[])
 	} else {
 		int i;
 		request_t *cached = request;
+		fr_time_t start = fr_time();
+		fr_time_delta_t elapsed;
 
 		for (i = 0; i < count; i++) {
 #ifndef NDEBUG
@@ -1116,6 +1118,14 @@ int main(int argc, char *argv[])
 #endif
 		}
 
+		/*
+		 *	Includes cloning and freeing the request, which
+		 *	is a fixed overhead when comparing policies.
+		 */
+		elapsed = fr_time_sub(fr_time(), start);
+		INFO("Ran %d requests in %pV (%" PRIu64 " ns/request)",
+		     count, fr_box_time_delta(elapsed), (uint64_t)(fr_time_delta_unwrap(elapsed) / count));
+
 		request = cached;
 	}
 
@@ -1296,6 +1306,7 @@ static NEVER_RETURNS void usage(main_config_t const *config, int status)
 	fprintf(output, "  -X                 Turn on full debugging.\n");
 	fprintf(output, "  -x                 Turn on additional debugging. (-xx gives more debugging).\n");
 	fprintf(output, "  -r <receipt_file>  Create the <receipt_file> as a 'success' exit.\n");
+	fprintf(output, "  -S <flag=value>    Set a migration or interpreter flag, e.g. flatten_unlang=yes.\n");
 
 	fr_exit_now(status);
 }
@@ -1117,6 +1117,14 @@ int fr_bio_fd_connect(fr_bio_t *bio)
 		return fr_bio_error(IO);
 	}
 
+	/*
+	 *	The connection attempt failed, e.g. ECONNREFUSED.
+	 */
+	if (error) {
+		fr_strerror_printf("Failed connecting socket: %s", fr_syserror(error));
+		goto fail;
+	}
+
 	/*
 	 *	The socket is connected, so initialize the normal IO handlers.
 	 */
@@ -84,6 +84,8 @@ static conf_parser_t reuse_curl_conn_config[] = {
 conf_parser_t fr_curl_conn_config[] = {
 	{ FR_CONF_OFFSET_SUBSECTION("reuse", 0, fr_curl_conn_config_t, reuse, reuse_curl_conn_config) },
 	{ FR_CONF_OFFSET("connect_timeout", fr_curl_conn_config_t, connect_timeout), .dflt = "3.0" },
+	{ FR_CONF_OFFSET("max_connections", fr_curl_conn_config_t, max_connections), .dflt = "0" },
+	{ FR_CONF_OFFSET("max_host_connections", fr_curl_conn_config_t, max_host_connections), .dflt = "0" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -35,7 +35,9 @@ extern "C" {
 #include <freeradius-devel/server/global_lib.h>
 #include <freeradius-devel/server/module.h>
 #include <freeradius-devel/server/request.h>
+#include <freeradius-devel/util/dlist.h>
 #include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/rb.h>
 #include <freeradius-devel/util/slab.h>
 #include <freeradius-devel/unlang/xlat.h>
 
@@ -93,8 +95,26 @@ typedef struct {
 	fr_event_timer_t const	*ev;			//!< Multi-Handle timer.
 	uint64_t		transfers;		//!< How many transfers are current in progress.
 	CURLM			*mandle;		//!< The multi handle.
+	fr_rb_tree_t		*endpoints;		//!< Per-origin statistics, of type #fr_curl_endpoint_t.
+	fr_dlist_head_t		warm;			//!< Handles keeping connections to upstreams established.
 } fr_curl_handle_t;
 
+/** Statistics for a single upstream (scheme://host[:port]) serviced by a multi-handle
+ *
+ * These are per-thread, so no locking is required to update or read them.
+ */
+typedef struct {
+	fr_rb_node_t		node;			//!< Entry in the multi-handle's endpoint tree.
+	char const		*origin;		//!< scheme://host[:port] of the upstream.
+	size_t			origin_len;		//!< Length of the origin string.
+
+	uint64_t		in_flight;		//!< Transfers currently in progress.
+	uint64_t		requests;		//!< Transfers completed (successfully or otherwise).
+	uint64_t		failed;			//!< Transfers which completed with a curl error.
+	fr_time_delta_t		latency;		//!< Exponentially weighted moving average of
+							///< transfer latency.
+} fr_curl_endpoint_t;
+
 /** Structure representing an individual request being passed to curl for processing
  *
  */
@@ -103,6 +123,8 @@ typedef struct {
 	CURLcode		result;			//!< Result of executing the request.
 	request_t		*request;		//!< Current request.
 	void			*uctx;			//!< Private data for the module using the API.
+	fr_curl_endpoint_t	*endpoint;		//!< Upstream this request is being sent to, if known.
+	fr_time_t		sent;			//!< When the request was enqueued.
 } fr_curl_io_request_t;
 
 typedef struct {
@@ -122,6 +144,8 @@ typedef struct {
 typedef struct {
 	fr_slab_config_t	reuse;
 	fr_time_delta_t		connect_timeout;
+	uint32_t		max_connections;	//!< Size of the multi-handle's connection cache.
+	uint32_t		max_host_connections;	//!< Maximum connections to a single upstream.
 } fr_curl_conn_config_t;
 
 extern conf_parser_t	 	fr_curl_tls_config[];
@@ -131,9 +155,21 @@ extern global_lib_autoinst_t	fr_curl_autoinst;
 int			fr_curl_io_request_enqueue(fr_curl_handle_t *mhandle,
 						   request_t *request, fr_curl_io_request_t *creq);
 
+void			fr_curl_io_request_cancel(fr_curl_handle_t *mhandle, fr_curl_io_request_t *randle);
+
+void			fr_curl_io_request_endpoint_set(fr_curl_handle_t *mhandle,
+							fr_curl_io_request_t *randle, char const *url);
+
+fr_curl_endpoint_t const *fr_curl_io_endpoint_find(fr_curl_handle_t *mhandle, char const *url);
+
 fr_curl_io_request_t	*fr_curl_io_request_alloc(TALLOC_CTX *ctx);
 
-fr_curl_handle_t	*fr_curl_io_init(TALLOC_CTX *ctx, fr_event_list_t *el, bool multiplex);
+int			fr_curl_io_warm(fr_curl_handle_t *mhandle, char const *url,
+					fr_curl_conn_config_t const *conn_config, fr_curl_tls_t const *tls,
+					long http_version, fr_time_delta_t interval);
+
+fr_curl_handle_t	*fr_curl_io_init(TALLOC_CTX *ctx, fr_event_list_t *el, bool multiplex,
+					 fr_curl_conn_config_t const *conn_config);
 
 int			fr_curl_response_certinfo(request_t *request, fr_curl_io_request_t *randle);
 
@@ -22,6 +22,7 @@
  * @copyright 2020 Arran Cudbard-Bell (a.cudbardb@freeradius.org)
  */
 #include <freeradius-devel/curl/base.h>
+#include <freeradius-devel/server/dependency.h>
 #include <freeradius-devel/server/module.h>
 #include <freeradius-devel/unlang/interpret.h>
 #include <freeradius-devel/util/debug.h>
@@ -43,6 +44,94 @@ do {\
 	}\
 } while (0)
 
+/** An easy handle used to keep a connection to an upstream established
+ *
+ */
+typedef struct {
+	fr_curl_handle_t	*mhandle;		//!< Multi-handle the connection belongs to.
+	fr_curl_io_request_t	*randle;		//!< Easy handle used to issue the probes.
+	char const		*url;			//!< URL we send HEAD requests to.
+	fr_time_delta_t		interval;		//!< How often to re-issue the probe.
+	fr_event_timer_t const	*ev;			//!< Timer for the next probe.
+	fr_dlist_t		entry;			//!< Entry in the multi-handle's list of warm handles.
+} fr_curl_warm_t;
+
+static void _fr_curl_io_warm_start(fr_event_list_t *el, fr_time_t now, void *uctx);
+
+/** Return the length of the scheme://host[:port] portion of a URL
+ *
+ */
+static inline size_t curl_url_origin_len(char const *url)
+{
+	char const *p;
+
+	p = strstr(url, "://");
+	if (!p) return strcspn(url, "/?#");
+
+	p += 3;
+	return (p - url) + strcspn(p, "/?#");
+}
+
+static int8_t _fr_curl_endpoint_cmp(void const *one, void const *two)
+{
+	fr_curl_endpoint_t const *a = one, *b = two;
+
+	MEMCMP_RETURN(a, b, origin, origin_len);
+	return 0;
+}
+
+/** Update endpoint statistics for a completed or cancelled transfer
+ *
+ * @param[in] randle	that's no longer in progress.
+ * @param[in] result	of the transfer.
+ */
+static inline void curl_endpoint_done(fr_curl_io_request_t *randle, CURLcode result)
+{
+	fr_curl_endpoint_t	*ep = randle->endpoint;
+	fr_time_delta_t		latency;
+
+	if (!ep) return;
+
+	fr_assert(ep->in_flight > 0);
+	ep->in_flight--;
+	ep->requests++;
+	if (result != CURLE_OK) ep->failed++;
+
+	/*
+	 *	EWMA with a weight of 1/8 for the new sample,
+	 *	the first sample seeds the average.
+	 */
+	latency = fr_time_sub(fr_time(), randle->sent);
+	if (ep->requests == 1) {
+		ep->latency = latency;
+	} else {
+		ep->latency = fr_time_delta_wrap(fr_time_delta_unwrap(ep->latency) +
+						 ((fr_time_delta_unwrap(latency) -
+						   fr_time_delta_unwrap(ep->latency)) / 8));
+	}
+
+	randle->endpoint = NULL;
+}
+
+/** Process the result of a connection warming probe, and schedule the next one
+ *
+ */
+static inline void curl_warm_done(fr_curl_handle_t *mhandle, fr_curl_io_request_t *randle, CURLcode result)
+{
+	fr_curl_warm_t	*warm = talloc_get_type_abort(randle->uctx, fr_curl_warm_t);
+
+	if (result != CURLE_OK) {
+		WARN("multi-handle %p - Failed warming connection to \"%s\": %s (%i)",
+		     mhandle->mandle, warm->url, curl_easy_strerror(result), result);
+	} else {
+		DEBUG3("multi-handle %p - Connection to \"%s\" is warm", mhandle->mandle, warm->url);
+	}
+
+	if (fr_event_timer_in(warm, mhandle->el, &warm->ev, warm->interval, _fr_curl_io_warm_start, warm) < 0) {
+		PERROR("multi-handle %p - Failed scheduling warming probe for \"%s\"", mhandle->mandle, warm->url);
+	}
+}
+
 /** De-queue curl requests and wake up the requests that initiated them
  *
  * @param[in] mhandle	containing the event loop and request counter.
@@ -85,6 +174,20 @@ static inline void _fr_curl_io_demux(fr_curl_handle_t *mhandle, CURLM *mandle)
 			}
 			request = randle->request;
 
+			/*
+			 *	Connection warming probes have no request
+			 */
+			if (!request) {
+				CURLcode	result = m->data.result;
+
+				/*
+				 *	Removing the handle invalidates m->data.result
+				 */
+				curl_multi_remove_handle(mandle, candle);
+				curl_warm_done(mhandle, randle, result);
+				continue;
+			}
+
 			REQUEST_VERIFY(request);
 
 			/*
@@ -95,6 +198,7 @@ static inline void _fr_curl_io_demux(fr_curl_handle_t *mhandle, CURLM *mandle)
 					curl_easy_strerror(m->data.result), m->data.result);
 			}
 			randle->result = m->data.result;
+			curl_endpoint_done(randle, m->data.result);
 
 			/*
 			 *	This needs to be done last, else m->data.result
@@ -527,12 +631,79 @@ int fr_curl_io_request_enqueue(fr_curl_handle_t *mhandle, request_t *request, fr
 		return -1;
 	}
 
+	if (randle->endpoint) {
+		randle->endpoint->in_flight++;
+		randle->sent = fr_time();
+	}
+
 	return 0;
 
 error:
 	return -1;
 }
 
+/** Remove a request from the multi-handle before it completes
+ *
+ * Used when the request that initiated the transfer is cancelled.
+ *
+ * @param[in] mhandle	the request was enqueued on.
+ * @param[in] randle	to remove.
+ */
+void fr_curl_io_request_cancel(fr_curl_handle_t *mhandle, fr_curl_io_request_t *randle)
+{
+	request_t	*request = randle->request;
+	CURLMcode	ret;
+
+	ret = curl_multi_remove_handle(mhandle->mandle, randle->candle);	/* Gracefully terminate the request */
+	if (ret != CURLM_OK) {
+		RERROR("Failed removing curl handle from multi-handle: %s (%i)", curl_multi_strerror(ret), ret);
+		/* Not much we can do */
+	}
+	mhandle->transfers--;
+
+	curl_endpoint_done(randle, CURLE_ABORTED_BY_CALLBACK);
+}
+
+/** Record which upstream a request is being sent to
+ *
+ * Must be called before #fr_curl_io_request_enqueue for the request to be
+ * included in the per-endpoint statistics.
+ *
+ * @param[in] mhandle	the request will be enqueued on.
+ * @param[in] randle	to associate with an endpoint.
+ * @param[in] url	the request will be sent to.  Only the scheme://host[:port]
+ *			portion is used.
+ */
+void fr_curl_io_request_endpoint_set(fr_curl_handle_t *mhandle, fr_curl_io_request_t *randle, char const *url)
+{
+	fr_curl_endpoint_t	*ep;
+
+	ep = UNCONST(fr_curl_endpoint_t *, fr_curl_io_endpoint_find(mhandle, url));
+	if (!ep) {
+		MEM(ep = talloc_zero(mhandle->endpoints, fr_curl_endpoint_t));
+		ep->origin_len = curl_url_origin_len(url);
+		MEM(ep->origin = talloc_bstrndup(ep, url, ep->origin_len));
+		fr_rb_insert(mhandle->endpoints, ep);
+	}
+
+	randle->endpoint = ep;
+}
+
+/** Return the statistics for the upstream a URL refers to
+ *
+ * @param[in] mhandle	to retrieve statistics from.
+ * @param[in] url	to find statistics for.  Only the scheme://host[:port]
+ *			portion is used.
+ * @return
+ *	- The endpoint's statistics.
+ *	- NULL if no requests have been sent to that endpoint.
+ */
+fr_curl_endpoint_t const *fr_curl_io_endpoint_find(fr_curl_handle_t *mhandle, char const *url)
+{
+	return fr_rb_find(mhandle->endpoints, &(fr_curl_endpoint_t){ .origin = url,
+								     .origin_len = curl_url_origin_len(url) });
+}
+
 static int _fr_curl_io_request_free(fr_curl_io_request_t *randle)
 {
 	curl_easy_cleanup(randle->candle);
@@ -561,11 +732,109 @@ fr_curl_io_request_t *fr_curl_io_request_alloc(TALLOC_CTX *ctx)
 	return randle;
 }
 
+/** Issue a HEAD request on a warm handle
+ *
+ * If libcurl already has an established connection to the upstream the probe is
+ * sent over it, which stops the connection being closed as idle.  Otherwise a new
+ * connection (and TLS session) is established and left in the multi-handle's
+ * connection cache for requests to use.
+ */
+static void _fr_curl_io_warm_start(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	fr_curl_warm_t		*warm = talloc_get_type_abort(uctx, fr_curl_warm_t);
+	fr_curl_handle_t	*mhandle = warm->mhandle;
+	CURLMcode		ret;
+
+	mhandle->transfers++;
+	ret = curl_multi_add_handle(mhandle->mandle, warm->randle->candle);
+	if (ret != CURLM_OK) {
+		mhandle->transfers--;
+		ERROR("multi-handle %p - Failed warming connection to \"%s\": %s (%i)",
+		      mhandle->mandle, warm->url, curl_multi_strerror(ret), ret);
+	}
+}
+
+static int _fr_curl_warm_free(fr_curl_warm_t *warm)
+{
+	fr_dlist_remove(&warm->mhandle->warm, warm);
+
+	return 0;
+}
+
+/** Keep a connection to an upstream established
+ *
+ * Issues a HEAD request to the URL immediately, and every interval after
+ * the previous one completes.  This means the first requests sent to the
+ * upstream don't pay for TCP/TLS establishment, and with HTTP/2 multiplexing
+ * can all share the pre-established connection.
+ *
+ * @note libcurl will only reuse the connection if the TLS and HTTP version
+ *	 options match those of the requests being sent.
+ *
+ * @param[in] mhandle		to keep the connection in.
+ * @param[in] url		to send probes to.
+ * @param[in] conn_config	Connection configuration.
+ * @param[in] tls		Configuration, should match that used for requests.
+ * @param[in] http_version	One of the CURL_HTTP_VERSION_* macros.
+ * @param[in] interval		How often to re-probe the upstream.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_curl_io_warm(fr_curl_handle_t *mhandle, char const *url,
+		    fr_curl_conn_config_t const *conn_config, fr_curl_tls_t const *tls,
+		    long http_version, fr_time_delta_t interval)
+{
+	fr_curl_warm_t		*warm;
+	fr_curl_io_request_t	*randle;
+
+	MEM(warm = talloc_zero(mhandle, fr_curl_warm_t));
+	warm->mhandle = mhandle;
+	warm->url = talloc_strdup(warm, url);
+	warm->interval = interval;
+
+	randle = warm->randle = fr_curl_io_request_alloc(warm);
+	if (!randle) {
+		ERROR("Failed allocating curl handle to warm \"%s\"", url);
+	error:
+		talloc_free(warm);
+		return -1;
+	}
+	randle->uctx = warm;
+
+	FR_CURL_SET_OPTION(CURLOPT_PRIVATE, randle);
+	FR_CURL_SET_OPTION(CURLOPT_URL, warm->url);
+	FR_CURL_SET_OPTION(CURLOPT_NOBODY, 1L);
+	FR_CURL_SET_OPTION(CURLOPT_NOSIGNAL, 1L);
+	FR_CURL_SET_OPTION(CURLOPT_USERAGENT, "FreeRADIUS " RADIUSD_VERSION_STRING);
+	FR_CURL_SET_OPTION(CURLOPT_CONNECTTIMEOUT_MS, fr_time_delta_to_msec(conn_config->connect_timeout));
+	if (http_version != CURL_HTTP_VERSION_NONE) FR_CURL_SET_OPTION(CURLOPT_HTTP_VERSION, http_version);
+#ifdef CURLPIPE_MULTIPLEX
+	FR_CURL_SET_OPTION(CURLOPT_PIPEWAIT, 1L);
+#endif
+	if (tls && (fr_curl_easy_tls_init(randle, tls) < 0)) goto error;
+
+	fr_dlist_insert_tail(&mhandle->warm, warm);
+	talloc_set_destructor(warm, _fr_curl_warm_free);
+
+	_fr_curl_io_warm_start(mhandle->el, fr_time(), warm);
+
+	return 0;
+}
+
 /** Free the multi-handle
  *
  */
 static int _mhandle_free(fr_curl_handle_t *mhandle)
 {
+	/*
+	 *	Warm handles are children of the mhandle
+	 *	so must be removed before the multi-handle
+	 *	is cleaned up.
+	 */
+	fr_dlist_foreach(&mhandle->warm, fr_curl_warm_t, warm) {
+		curl_multi_remove_handle(mhandle->mandle, warm->randle->candle);
+	}
 	curl_multi_cleanup(mhandle->mandle);
 
 	return 0;
@@ -577,6 +846,7 @@ static int _mhandle_free(fr_curl_handle_t *mhandle)
  * @param[in] el		to initial.
  * @param[in] multiplex		Run multiple requests over the same connection simultaneously.
  *				HTTP/2 only.
+ * @param[in] conn_config	Connection cache limits.
  * @return
  *	- 0 on success.
  *	- -1 on error.
@@ -586,7 +856,8 @@ fr_curl_handle_t *fr_curl_io_init(TALLOC_CTX *ctx,
 #ifndef CURLPIPE_MULTIPLEX
 				   UNUSED
 #endif
-				   bool multiplex)
+				   bool multiplex,
+				   fr_curl_conn_config_t const *conn_config)
 {
 	CURLMcode		ret;
 	CURLM			*mandle;
@@ -609,6 +880,9 @@ fr_curl_handle_t *fr_curl_io_init(TALLOC_CTX *ctx,
 	MEM(mhandle = talloc_zero(ctx, fr_curl_handle_t));
 	mhandle->el = el;
 	mhandle->mandle = mandle;
+	MEM(mhandle->endpoints = fr_rb_inline_talloc_alloc(mhandle, fr_curl_endpoint_t, node,
+							   _fr_curl_endpoint_cmp, NULL));
+	fr_dlist_talloc_init(&mhandle->warm, fr_curl_warm_t, entry);
 	talloc_set_destructor(mhandle, _mhandle_free);
 
 	SET_MOPTION(mandle, CURLMOPT_TIMERFUNCTION, _fr_curl_io_timer_modify);
@@ -621,6 +895,13 @@ fr_curl_handle_t *fr_curl_io_init(TALLOC_CTX *ctx,
 	SET_MOPTION(mandle, CURLMOPT_PIPELINING, multiplex ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
 #endif
 
+	if (conn_config) {
+		if (conn_config->max_connections) SET_MOPTION(mandle, CURLMOPT_MAXCONNECTS,
+							      (long)conn_config->max_connections);
+		if (conn_config->max_host_connections) SET_MOPTION(mandle, CURLMOPT_MAX_HOST_CONNECTIONS,
+								   (long)conn_config->max_host_connections);
+	}
+
 	return mhandle;
 
 error:
@@ -134,6 +134,10 @@ struct fr_worker_s {
 	fr_event_timer_t const	*ev_cleanup;	//!< timer for max_request_time
 
 	fr_worker_channel_t	*channel;	//!< list of channels
+
+#ifdef WITH_PERF
+	void const		*unlang_perf;	//!< per-instruction statistics for this thread
+#endif
 };
 
 typedef struct {
@@ -1365,6 +1369,9 @@ nomem:
 	worker->name = talloc_strdup(worker, name); /* thread locality */
 
 	unlang_thread_instantiate(worker);
+#ifdef WITH_PERF
+	worker->unlang_perf = unlang_perf_thread();
+#endif
 
 	if (config) worker->config = *config;
 
@@ -1728,6 +1735,28 @@ static int cmd_stats_worker(FILE *fp, UNUSED FILE *fp_err, void *ctx, fr_cmd_inf
 	return 0;
 }
 
+#ifdef WITH_PERF
+static int cmd_stats_worker_unlang(FILE *fp, UNUSED FILE *fp_err, void *ctx, fr_cmd_info_t const *info)
+{
+	fr_worker_t const	*worker = ctx;
+	unlang_perf_metric_t	metric = UNLANG_PERF_CPU;
+
+	if (info->argc > 0) {
+		if (strcmp(info->argv[0], "wait") == 0) {
+			metric = UNLANG_PERF_WAIT;
+		} else if (strcmp(info->argv[0], "count") == 0) {
+			metric = UNLANG_PERF_COUNT;
+		} else if (strcmp(info->argv[0], "yields") == 0) {
+			metric = UNLANG_PERF_YIELDS;
+		}
+	}
+
+	unlang_perf_folded(fp, worker->unlang_perf, metric);
+
+	return 0;
+}
+#endif
+
 fr_cmd_table_t cmd_worker_table[] = {
 	{
 		.parent = "stats",
@@ -1746,5 +1775,18 @@ fr_cmd_table_t cmd_worker_table[] = {
 		.read_only = true
 	},
 
+#ifdef WITH_PERF
+	{
+		.parent = "stats worker",
+		.add_name = true,
+		.name = "unlang",
+		.syntax = "[(cpu|wait|count|yields)]",
+		.func = cmd_stats_worker_unlang,
+		.help = "Show per-instruction statistics for a specific worker thread, as folded stacks.\n"
+			"cpu and wait are in nanoseconds.  The output can be passed to flamegraph.pl.",
+		.read_only = true
+	},
+#endif
+
 	CMD_TABLE_END
 };
@@ -361,6 +361,29 @@ typedef struct {
 	int			count;			//!< Number of values.
 } fr_ldap_result_t;
 
+#define FR_LDAP_REPLICA_UUID_LENGTH	16
+
+/** A local copy of directory entries, shared between LDAP sync listeners and modules
+ *
+ */
+typedef struct fr_ldap_replica_s fr_ldap_replica_t;
+
+/** A single entry copied out of a replica
+ *
+ */
+typedef struct fr_ldap_replica_entry_s fr_ldap_replica_entry_t;
+
+/** What answers a replica can currently give
+ *
+ */
+typedef enum {
+	FR_LDAP_REPLICA_UNAVAILABLE = 0,		//!< Replica has no data, or its data is too stale.
+	FR_LDAP_REPLICA_PARTIAL,			//!< Entries found may be used, but missing entries
+							///< may still exist in the directory.
+	FR_LDAP_REPLICA_COMPLETE			//!< Initial refresh has completed, missing entries
+							///< do not exist in the directory.
+} fr_ldap_replica_state_t;
+
 /** Result of expanding the RHS of a set of maps
  *
  * Used to store the array of attributes we'll be querying for.
@@ -383,6 +406,8 @@ typedef struct {
 	fr_trunk_conf_t		*bind_trunk_conf;	//!< Trunk config for bind auth trunk
 	fr_event_list_t		*el;		//!< Thread event list for callbacks / timeouts
 	fr_ldap_thread_trunk_t	*bind_trunk;	//!< LDAP trunk used for bind auths
+	fr_ldap_thread_trunk_t	**bind_servers;	//!< One bind auth trunk per configured server, used to
+						///< send simple binds to the server responding fastest.
 	fr_rb_tree_t		*binds;		//!< Tree of outstanding bind auths
 } fr_ldap_thread_t;
 
@@ -403,6 +428,8 @@ typedef struct fr_ldap_thread_trunk_s {
 	fr_trunk_t		*trunk;		//!< Connection trunk
 	fr_ldap_thread_t	*t;		//!< Thread this connection is associated with
 	fr_event_timer_t const	*ev;		//!< Event to close the thread when it has been idle.
+	fr_time_delta_t		bind_latency;	//!< Moving average of bind auth response times.
+	uint32_t		bind_pending;	//!< Bind auths enqueued which have not yet completed.
 } fr_ldap_thread_trunk_t;
 
 typedef struct fr_ldap_referral_s fr_ldap_referral_t;
@@ -608,6 +635,8 @@ typedef enum {
 typedef struct {
 	fr_rb_node_t		node;		//!< Entry in the tree of outstanding bind requests.
 	fr_ldap_thread_t	*thread;	//!< This bind is being run by.
+	fr_ldap_thread_trunk_t	*ttrunk;	//!< Trunk this bind was enqueued on.
+	fr_time_t		enqueued;	//!< When the bind was enqueued.
 	fr_trunk_request_t	*treq;		//!< Trunk request this bind is associated with.
 	int			msgid;		//!< libldap msgid for this bind.
 	request_t		*request;	//!< this bind relates to.
@@ -850,6 +879,44 @@ int		fr_ldap_map_expand(TALLOC_CTX *ctx, fr_ldap_map_exp_t *expanded, request_t
 int		fr_ldap_map_do(request_t *request,
 			       char const *valuepair_attr, fr_ldap_map_exp_t const *expanded, LDAPMessage *entry);
 
+int		fr_ldap_map_do_replica(request_t *request,
+				       char const *valuepair_attr, fr_ldap_map_exp_t const *expanded,
+				       fr_ldap_replica_entry_t const *entry);
+
+/*
+ *	replica.c - Local copy of directory entries fed by LDAP sync
+ */
+fr_ldap_replica_t	*fr_ldap_replica_alloc(TALLOC_CTX *ctx, char const *name);
+
+int		fr_ldap_replica_index_add(fr_ldap_replica_t *replica, char const *attr);
+
+int		fr_ldap_replica_upsert(fr_ldap_replica_t *replica, LDAP *handle,
+				       uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH], LDAPMessage *msg);
+
+void		fr_ldap_replica_delete(fr_ldap_replica_t *replica,
+				       uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH], char const *dn);
+
+void		fr_ldap_replica_feed_start(fr_ldap_replica_t *replica);
+
+void		fr_ldap_replica_feed_refreshed(fr_ldap_replica_t *replica);
+
+void		fr_ldap_replica_feed_stop(fr_ldap_replica_t *replica, bool refreshed);
+
+fr_ldap_replica_state_t	fr_ldap_replica_state(fr_ldap_replica_t *replica, fr_time_delta_t max_staleness);
+
+fr_ldap_replica_entry_t	*fr_ldap_replica_find_by_dn(TALLOC_CTX *ctx, fr_ldap_replica_t *replica, char const *dn);
+
+int		fr_ldap_replica_find_by_index(TALLOC_CTX *ctx, fr_ldap_replica_entry_t **out,
+					      fr_ldap_replica_t *replica,
+					      char const *attr, char const *value, size_t len);
+
+char const	*fr_ldap_replica_entry_dn(fr_ldap_replica_entry_t const *entry);
+
+struct berval	**fr_ldap_replica_entry_values(fr_ldap_replica_entry_t const *entry, char const *attr);
+
+int		fr_ldap_replica_entry_match(fr_ldap_replica_entry_t const *entry,
+					    char const *base, int scope, char const *filter);
+
 /*
  *	connection.c - Connection configuration functions
  */
@@ -872,6 +939,8 @@ fr_trunk_state_t fr_thread_ldap_trunk_state(fr_ldap_thread_t *thread, char const
 
 fr_ldap_thread_trunk_t	*fr_thread_ldap_bind_trunk_get(fr_ldap_thread_t *thread);
 
+fr_ldap_thread_trunk_t	*fr_thread_ldap_bind_trunk_select(fr_ldap_thread_t *thread);
+
 /*
  *	state.c - Connection state machine
  */
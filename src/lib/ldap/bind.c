@@ -242,6 +242,41 @@ static unlang_action_t ldap_async_auth_bind_start(UNUSED rlm_rcode_t *p_result,
 	return UNLANG_ACTION_YIELD;
 }
 
+/** Record the response time of a bind auth against the trunk it was sent on
+ *
+ * Binds which fail because of a connection error or timeout are recorded as
+ * taking several times longer than the current average, so the server is
+ * avoided until its other responses bring the average back down.
+ */
+static void ldap_async_auth_bind_latency(fr_ldap_bind_auth_ctx_t *bind_auth_ctx)
+{
+	fr_ldap_thread_trunk_t	*ttrunk = bind_auth_ctx->ttrunk;
+	int64_t			sample, avg;
+
+	if (!ttrunk) return;
+	bind_auth_ctx->ttrunk = NULL;
+
+	if (ttrunk->bind_pending > 0) ttrunk->bind_pending--;
+
+	sample = fr_time_delta_unwrap(fr_time_sub(fr_time(), bind_auth_ctx->enqueued));
+	avg = fr_time_delta_unwrap(ttrunk->bind_latency);
+
+	switch (bind_auth_ctx->ret) {
+	case LDAP_PROC_ERROR:
+	case LDAP_PROC_TIMEOUT:
+		sample = (avg > sample ? avg : sample) * 4;
+		break;
+
+	default:
+		break;
+	}
+
+	/*
+	 *	Exponentially weighted, each new sample counts for 1/8th.
+	 */
+	ttrunk->bind_latency = fr_time_delta_wrap(avg ? avg + ((sample - avg) / 8) : sample);
+}
+
 /** Handle the return code from parsed LDAP results to set the module rcode
  *
  */
@@ -251,6 +286,8 @@ static unlang_action_t ldap_async_auth_bind_results(rlm_rcode_t *p_result, UNUSE
 	fr_ldap_bind_ctx_t	*bind_ctx = bind_auth_ctx->bind_ctx;
 	rlm_rcode_t		rcode = RLM_MODULE_OK;
 
+	ldap_async_auth_bind_latency(bind_auth_ctx);
+
 	switch (bind_auth_ctx->ret) {
 	case LDAP_PROC_SUCCESS:
 		RDEBUG2("Bind as user \"%s\" was successful", bind_ctx->bind_dn);
@@ -302,11 +339,15 @@ static void ldap_async_auth_bind_cancel(request_t *request, UNUSED fr_signal_t a
 	fr_ldap_bind_auth_ctx_t	*bind_auth_ctx = talloc_get_type_abort(uctx, fr_ldap_bind_auth_ctx_t);
 
 	RWARN("Cancelling bind auth");
+	if (bind_auth_ctx->ttrunk && (bind_auth_ctx->ttrunk->bind_pending > 0)) bind_auth_ctx->ttrunk->bind_pending--;
 	if (bind_auth_ctx->msgid > 0) fr_rb_remove(bind_auth_ctx->thread->binds, bind_auth_ctx);
 	fr_trunk_request_signal_cancel(bind_auth_ctx->treq);
 }
 
 /** Initiate an async LDAP bind for authentication
+ *
+ * If multiple servers are configured, the bind is sent to the one which is
+ * currently responding fastest, see #fr_thread_ldap_bind_trunk_select.
  *
  * @param[in] request		this bind relates to.
  * @param[in] thread		whose connection the bind should be performed on.
@@ -320,7 +361,7 @@ unlang_action_t fr_ldap_bind_auth_async(request_t *request, fr_ldap_thread_t *th
 {
 	fr_ldap_bind_auth_ctx_t	*bind_auth_ctx;
 	fr_trunk_request_t	*treq;
-	fr_ldap_thread_trunk_t	*ttrunk = fr_thread_ldap_bind_trunk_get(thread);
+	fr_ldap_thread_trunk_t	*ttrunk = fr_thread_ldap_bind_trunk_select(thread);
 	fr_trunk_enqueue_t	ret;
 
 	if (!ttrunk) {
@@ -339,6 +380,8 @@ unlang_action_t fr_ldap_bind_auth_async(request_t *request, fr_ldap_thread_t *th
 		.treq = treq,
 		.request = request,
 		.thread = thread,
+		.ttrunk = ttrunk,
+		.enqueued = fr_time(),
 		.ret = LDAP_PROC_NO_RESULT
 	};
 
@@ -360,6 +403,7 @@ unlang_action_t fr_ldap_bind_auth_async(request_t *request, fr_ldap_thread_t *th
 		fr_trunk_request_free(&treq);
 		return UNLANG_ACTION_FAIL;
 	}
+	ttrunk->bind_pending++;
 
 	return unlang_function_push(request,
 				    ldap_async_auth_bind_start,
@@ -1355,24 +1355,22 @@ static void ldap_trunk_bind_auth_fail(request_t *request, void *preq, UNUSED voi
 	if (request) unlang_interpret_mark_runnable(request);
 }
 
-/** Find the thread specific trunk to use for LDAP bind auths
- *
- * If there is no current trunk then a new one is created.
+/** Allocate a trunk for LDAP bind auths
  *
- * @param[in] thread	to which the connection belongs
+ * @param[in] thread	to which the connection belongs.
+ * @param[in] uri	of the server(s) to connect to.
  * @return
- *	- an existing or new trunk.
- *	- NULL on failure
+ *	- a new trunk.
+ *	- NULL on failure.
  */
-fr_ldap_thread_trunk_t *fr_thread_ldap_bind_trunk_get(fr_ldap_thread_t *thread)
+static fr_ldap_thread_trunk_t *ldap_bind_trunk_alloc(fr_ldap_thread_t *thread, char const *uri)
 {
 	fr_ldap_thread_trunk_t	*ttrunk;
 
-	if (thread->bind_trunk) return (thread->bind_trunk);
-
 	MEM(ttrunk = talloc_zero(thread, fr_ldap_thread_trunk_t));
 	memcpy(&ttrunk->config, thread->config, sizeof(fr_ldap_config_t));
 
+	ttrunk->config.server = talloc_strdup(ttrunk, uri);
 	ttrunk->uri = ttrunk->config.server;
 	ttrunk->bind_dn = ttrunk->config.admin_identity;
 
@@ -1395,7 +1393,108 @@ fr_ldap_thread_trunk_t *fr_thread_ldap_bind_trunk_get(fr_ldap_thread_t *thread)
 	}
 
 	ttrunk->t = thread;
-	thread->bind_trunk = ttrunk;
 
 	return ttrunk;
 }
+
+/** Find the thread specific trunk to use for LDAP bind auths
+ *
+ * If there is no current trunk then a new one is created.
+ *
+ * @param[in] thread	to which the connection belongs
+ * @return
+ *	- an existing or new trunk.
+ *	- NULL on failure
+ */
+fr_ldap_thread_trunk_t *fr_thread_ldap_bind_trunk_get(fr_ldap_thread_t *thread)
+{
+	if (thread->bind_trunk) return (thread->bind_trunk);
+
+	thread->bind_trunk = ldap_bind_trunk_alloc(thread, thread->config->server);
+
+	return thread->bind_trunk;
+}
+
+/** Select the bind auth trunk of the server which is currently responding fastest
+ *
+ * When multiple servers are configured, each gets its own bind auth trunk, and
+ * simple binds are sent to the trunk with the lowest product of its moving average
+ * response time, and the number of binds waiting on it.  Servers without a response
+ * time are tried first.
+ *
+ * With a single server, this is the same as #fr_thread_ldap_bind_trunk_get.
+ *
+ * @param[in] thread	to which the connections belong.
+ * @return
+ *	- the selected trunk.
+ *	- NULL on failure.
+ */
+fr_ldap_thread_trunk_t *fr_thread_ldap_bind_trunk_select(fr_ldap_thread_t *thread)
+{
+	fr_ldap_thread_trunk_t	*best = NULL;
+	int64_t			best_score = 0;
+	size_t			i, count;
+
+	if (!thread->bind_servers) {
+		char const	*p = thread->config->server, *q;
+
+		/*
+		 *	The server string is a space separated list of URIs.
+		 *	With fewer than two there's nothing to select between,
+		 *	so leave the list empty and use the single bind trunk.
+		 */
+		MEM(thread->bind_servers = talloc_array(thread, fr_ldap_thread_trunk_t *, 0));
+
+		count = 0;
+		for (q = p; q && *q; q++) {
+			if ((*q != ' ') && ((q == p) || (q[-1] == ' '))) count++;
+		}
+		if (count < 2) p = NULL;
+
+		while (p && *p) {
+			char	*uri;
+
+			q = strchr(p, ' ');
+			if (!q) q = p + strlen(p);
+			if (q == p) {
+				p++;
+				continue;
+			}
+
+			MEM(uri = talloc_bstrndup(NULL, p, q - p));
+			count = talloc_array_length(thread->bind_servers);
+			MEM(thread->bind_servers = talloc_realloc(thread, thread->bind_servers,
+								  fr_ldap_thread_trunk_t *, count + 1));
+			thread->bind_servers[count] = ldap_bind_trunk_alloc(thread, uri);
+			talloc_free(uri);
+			if (!thread->bind_servers[count]) {
+				TALLOC_FREE(thread->bind_servers);
+				return NULL;
+			}
+
+			p = q;
+		}
+	}
+
+	count = talloc_array_length(thread->bind_servers);
+	if (count < 2) return fr_thread_ldap_bind_trunk_get(thread);
+
+	for (i = 0; i < count; i++) {
+		fr_ldap_thread_trunk_t	*ttrunk = thread->bind_servers[i];
+		int64_t			score;
+
+		if (!fr_time_delta_ispos(ttrunk->bind_latency)) {
+			if (ttrunk->bind_pending == 0) return ttrunk;
+			score = 0;
+		} else {
+			score = fr_time_delta_unwrap(ttrunk->bind_latency) * (ttrunk->bind_pending + 1);
+		}
+
+		if (!best || (score < best_score)) {
+			best = ttrunk;
+			best_score = score;
+		}
+	}
+
+	return best;
+}
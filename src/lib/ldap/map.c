@@ -305,23 +305,27 @@ int fr_ldap_map_expand(TALLOC_CTX *ctx, fr_ldap_map_exp_t *expanded, request_t *
 }
 
 
-/** Convert attribute map into valuepairs
+/** Retrieve the values of an attribute from an entry
  *
- * Use the attribute map built earlier to convert LDAP values into valuepairs and insert them into whichever
- * list they need to go into.
+ * Allows the same mapping code to be used for entries returned by the
+ * directory and entries held in a local replica.
  *
- * This is *NOT* atomic, but there's no condition for which we should error out...
- *
- * @param[in] request		Current request.
- * @param[in] valuepair_attr	Treat attribute with this name as holding complete AVP definitions.
- * @param[in] expanded		attributes (rhs of map).
- * @param[in] entry		to retrieve attributes from.
- * @return
- *	- Number of maps successfully applied.
- *	- -1 on failure.
+ * @return Values to be freed with ldap_value_free_len(), or NULL.
  */
-int fr_ldap_map_do(request_t *request,
-		   char const *valuepair_attr, fr_ldap_map_exp_t const *expanded, LDAPMessage *entry)
+typedef struct berval **(*ldap_map_values_t)(void const *entry, char const *attr);
+
+static struct berval **ldap_map_message_values(void const *entry, char const *attr)
+{
+	return ldap_get_values_len(fr_ldap_handle_thread_local(), UNCONST(LDAPMessage *, entry), attr);
+}
+
+static struct berval **ldap_map_replica_values(void const *entry, char const *attr)
+{
+	return fr_ldap_replica_entry_values(entry, attr);
+}
+
+static int ldap_map_do(request_t *request, char const *valuepair_attr, fr_ldap_map_exp_t const *expanded,
+		       ldap_map_values_t get_values, void const *entry)
 {
 	map_t const		*map = NULL;
 	unsigned int		total = 0;
@@ -329,7 +333,6 @@ int fr_ldap_map_do(request_t *request,
 
 	fr_ldap_result_t	result;
 	char const		*name;
-	LDAP			*handle = fr_ldap_handle_thread_local();
 
 	while ((map = map_list_next(expanded->maps, map))) {
 		int ret;
@@ -339,7 +342,7 @@ int fr_ldap_map_do(request_t *request,
 		/*
 		 *	Binary safe
 		 */
-		result.values = ldap_get_values_len(handle, entry, name);
+		result.values = get_values(entry, name);
 		if (!result.values) {
 			RDEBUG3("Attribute \"%s\" not found in LDAP object", name);
 
@@ -378,7 +381,7 @@ int fr_ldap_map_do(request_t *request,
 		struct berval	**values;
 		int		count, i;
 
-		values = ldap_get_values_len(handle, entry, valuepair_attr);
+		values = get_values(entry, valuepair_attr);
 		count = ldap_count_values_len(values);
 
 		for (i = 0; i < count; i++) {
@@ -419,3 +422,41 @@ int fr_ldap_map_do(request_t *request,
 
 	return applied;
 }
+
+/** Convert attribute map into valuepairs
+ *
+ * Use the attribute map built earlier to convert LDAP values into valuepairs and insert them into whichever
+ * list they need to go into.
+ *
+ * This is *NOT* atomic, but there's no condition for which we should error out...
+ *
+ * @param[in] request		Current request.
+ * @param[in] valuepair_attr	Treat attribute with this name as holding complete AVP definitions.
+ * @param[in] expanded		attributes (rhs of map).
+ * @param[in] entry		to retrieve attributes from.
+ * @return
+ *	- Number of maps successfully applied.
+ *	- -1 on failure.
+ */
+int fr_ldap_map_do(request_t *request,
+		   char const *valuepair_attr, fr_ldap_map_exp_t const *expanded, LDAPMessage *entry)
+{
+	return ldap_map_do(request, valuepair_attr, expanded, ldap_map_message_values, entry);
+}
+
+/** Convert attribute map into valuepairs, using an entry from a local replica
+ *
+ * @param[in] request		Current request.
+ * @param[in] valuepair_attr	Treat attribute with this name as holding complete AVP definitions.
+ * @param[in] expanded		attributes (rhs of map).
+ * @param[in] entry		copied out of the replica.
+ * @return
+ *	- Number of maps successfully applied.
+ *	- -1 on failure.
+ */
+int fr_ldap_map_do_replica(request_t *request,
+			   char const *valuepair_attr, fr_ldap_map_exp_t const *expanded,
+			   fr_ldap_replica_entry_t const *entry)
+{
+	return ldap_map_do(request, valuepair_attr, expanded, ldap_map_replica_values, entry);
+}
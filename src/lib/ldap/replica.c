@@ -0,0 +1,996 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file src/lib/ldap/replica.c
+ * @brief In-memory replica of directory entries, fed by LDAP sync.
+ *
+ * A replica is a named, process wide, store of directory entries.  It is
+ * written to by one or more ldap_sync listeners on the network side, and
+ * read by rlm_ldap instances in the workers, so that user and group lookups
+ * can be answered without a round trip to the directory.
+ *
+ * Every lookup returns a private copy of the entry, so callers never hold
+ * the replica lock while processing a request.
+ *
+ * @copyright 2024 The FreeRADIUS Server Project.
+ */
+RCSID("$Id$")
+
+USES_APPLE_DEPRECATED_API
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/ldap/base.h>
+
+#include <ctype.h>
+#include <pthread.h>
+
+/** A single attribute of a replicated entry
+ *
+ */
+typedef struct {
+	char			*name;			//!< Attribute name, as returned by the directory.
+	struct berval		*values;		//!< talloced array of values.
+} ldap_replica_attr_t;
+
+/** A replicated directory entry
+ *
+ */
+struct fr_ldap_replica_entry_s {
+	fr_rb_node_t		dn_node;		//!< Entry in the tree of entries keyed by DN.
+	fr_rb_node_t		uuid_node;		//!< Entry in the tree of entries keyed by UUID.
+
+	char			*dn;			//!< Normalised DN of the entry.
+	bool			has_uuid;		//!< Whether the entry was given a UUID by the directory.
+	uint8_t			uuid[FR_LDAP_REPLICA_UUID_LENGTH];	//!< entryUUID (RFC 4533 only).
+
+	ldap_replica_attr_t	*attrs;			//!< talloced array of attributes.
+};
+
+/** Entries sharing a value of an indexed attribute
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;			//!< Entry in the index tree.
+	struct berval		value;			//!< Indexed value.  Owned by this node.
+	fr_ldap_replica_entry_t	**entries;		//!< talloced array of entries having this value.
+} ldap_replica_index_node_t;
+
+/** An index of entries by the values of one attribute
+ *
+ */
+typedef struct {
+	char const		*attr;			//!< Attribute being indexed.
+	fr_rb_tree_t		*tree;			//!< Tree of #ldap_replica_index_node_t.
+} ldap_replica_index_t;
+
+/** Shared replica state
+ *
+ */
+struct fr_ldap_replica_s {
+	fr_rb_node_t		node;			//!< Entry in the global tree of replicas.
+	char const		*name;			//!< Name used by listeners and modules to find the replica.
+	uint32_t		refs;			//!< How many handles reference this replica.
+
+	pthread_rwlock_t	lock;			//!< Protects everything below.
+
+	fr_rb_tree_t		*by_dn;			//!< Entries keyed by DN.
+	fr_rb_tree_t		*by_uuid;		//!< Entries keyed by UUID.
+	ldap_replica_index_t	*indexes;		//!< talloced array of attribute indexes.
+
+	uint32_t		feeds;			//!< Number of syncs currently feeding the replica.
+	uint32_t		refreshing;		//!< Number of syncs still in their initial refresh.
+	bool			populated;		//!< At least one change has been applied.
+	bool			complete;		//!< Every feed has completed its refresh,
+							///< so absence of an entry is authoritative.
+	fr_time_t		detached;		//!< When the last feed went away.
+};
+
+static pthread_mutex_t	replica_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_rb_tree_t	*replica_tree;
+
+static int8_t replica_name_cmp(void const *one, void const *two)
+{
+	fr_ldap_replica_t const *a = one, *b = two;
+
+	return CMP(strcmp(a->name, b->name), 0);
+}
+
+static int8_t replica_dn_cmp(void const *one, void const *two)
+{
+	fr_ldap_replica_entry_t const *a = one, *b = two;
+
+	return CMP(strcasecmp(a->dn, b->dn), 0);
+}
+
+static int8_t replica_uuid_cmp(void const *one, void const *two)
+{
+	fr_ldap_replica_entry_t const *a = one, *b = two;
+
+	return CMP(memcmp(a->uuid, b->uuid, sizeof(a->uuid)), 0);
+}
+
+/** Compare index values, case insensitively, as most naming attributes are
+ *
+ * Orders by length first, then by the case folded value.
+ */
+static int8_t replica_index_cmp(void const *one, void const *two)
+{
+	ldap_replica_index_node_t const	*a = one, *b = two;
+	size_t				i;
+	int8_t				ret;
+
+	ret = CMP(a->value.bv_len, b->value.bv_len);
+	if (ret != 0) return ret;
+
+	for (i = 0; i < a->value.bv_len; i++) {
+		ret = CMP(tolower((uint8_t)a->value.bv_val[i]), tolower((uint8_t)b->value.bv_val[i]));
+		if (ret != 0) return ret;
+	}
+
+	return 0;
+}
+
+/** Find an attribute in an entry by name
+ *
+ */
+static ldap_replica_attr_t *replica_entry_attr(fr_ldap_replica_entry_t const *entry, char const *name)
+{
+	size_t i, num = talloc_array_length(entry->attrs);
+
+	for (i = 0; i < num; i++) {
+		if (strcasecmp(entry->attrs[i].name, name) == 0) return &entry->attrs[i];
+	}
+
+	return NULL;
+}
+
+/** Add an entry to a single attribute index
+ *
+ */
+static int replica_index_insert(ldap_replica_index_t *index, fr_ldap_replica_entry_t *entry)
+{
+	ldap_replica_attr_t	*attr;
+	size_t			i, num;
+
+	attr = replica_entry_attr(entry, index->attr);
+	if (!attr) return 0;
+
+	num = talloc_array_length(attr->values);
+	for (i = 0; i < num; i++) {
+		ldap_replica_index_node_t	find = { .value = attr->values[i] };
+		ldap_replica_index_node_t	*inode;
+		size_t				count;
+
+		inode = fr_rb_find(index->tree, &find);
+		if (!inode) {
+			MEM(inode = talloc_zero(index->tree, ldap_replica_index_node_t));
+			inode->value.bv_len = attr->values[i].bv_len;
+			MEM(inode->value.bv_val = talloc_memdup(inode, attr->values[i].bv_val, attr->values[i].bv_len));
+			MEM(inode->entries = talloc_array(inode, fr_ldap_replica_entry_t *, 0));
+			if (!fr_rb_insert(index->tree, inode)) {
+				talloc_free(inode);
+				return -1;
+			}
+		}
+
+		count = talloc_array_length(inode->entries);
+		MEM(inode->entries = talloc_realloc(inode, inode->entries, fr_ldap_replica_entry_t *, count + 1));
+		inode->entries[count] = entry;
+	}
+
+	return 0;
+}
+
+/** Remove an entry from a single attribute index
+ *
+ */
+static void replica_index_remove(ldap_replica_index_t *index, fr_ldap_replica_entry_t *entry)
+{
+	ldap_replica_attr_t	*attr;
+	size_t			i, num;
+
+	attr = replica_entry_attr(entry, index->attr);
+	if (!attr) return;
+
+	num = talloc_array_length(attr->values);
+	for (i = 0; i < num; i++) {
+		ldap_replica_index_node_t	find = { .value = attr->values[i] };
+		ldap_replica_index_node_t	*inode;
+		size_t				j, count;
+
+		inode = fr_rb_find(index->tree, &find);
+		if (!inode) continue;
+
+		count = talloc_array_length(inode->entries);
+		for (j = 0; j < count; j++) {
+			if (inode->entries[j] != entry) continue;
+
+			memmove(&inode->entries[j], &inode->entries[j + 1], (count - j - 1) * sizeof(inode->entries[0]));
+			count--;
+			break;
+		}
+
+		if (count == 0) {
+			fr_rb_remove_by_inline_node(index->tree, &inode->node);
+			talloc_free(inode);
+			continue;
+		}
+		MEM(inode->entries = talloc_realloc(inode, inode->entries, fr_ldap_replica_entry_t *, count));
+	}
+}
+
+/** Unlink an entry from all trees and indexes, and free it
+ *
+ * Must be called with the write lock held.
+ */
+static void replica_entry_remove(fr_ldap_replica_t *replica, fr_ldap_replica_entry_t *entry)
+{
+	size_t i, num = talloc_array_length(replica->indexes);
+
+	for (i = 0; i < num; i++) replica_index_remove(&replica->indexes[i], entry);
+
+	if (entry->has_uuid) fr_rb_remove_by_inline_node(replica->by_uuid, &entry->uuid_node);
+	fr_rb_remove_by_inline_node(replica->by_dn, &entry->dn_node);
+
+	talloc_free(entry);
+}
+
+static int _replica_free(fr_ldap_replica_t *replica)
+{
+	pthread_rwlock_destroy(&replica->lock);
+	return 0;
+}
+
+static int _replica_ref_free(fr_ldap_replica_t **ref)
+{
+	fr_ldap_replica_t *replica = *ref;
+
+	pthread_mutex_lock(&replica_mutex);
+	if (--replica->refs == 0) {
+		fr_rb_remove(replica_tree, replica);
+		talloc_free(replica);
+
+		if (fr_rb_num_elements(replica_tree) == 0) TALLOC_FREE(replica_tree);
+	}
+	pthread_mutex_unlock(&replica_mutex);
+
+	return 0;
+}
+
+/** Find or create a named replica
+ *
+ * Listeners feeding the replica and modules consulting it both call this
+ * function with the same name, and get back the same replica.
+ *
+ * The reference is released when ctx is freed.  The replica itself is
+ * freed when the last reference is released.
+ *
+ * @param[in] ctx	to bind the lifetime of the reference to.
+ * @param[in] name	of the replica.
+ * @return
+ *	- The replica on success.
+ *	- NULL on failure.
+ */
+fr_ldap_replica_t *fr_ldap_replica_alloc(TALLOC_CTX *ctx, char const *name)
+{
+	fr_ldap_replica_t	find = { .name = name };
+	fr_ldap_replica_t	*replica, **ref;
+
+	pthread_mutex_lock(&replica_mutex);
+	if (!replica_tree) {
+		replica_tree = fr_rb_inline_talloc_alloc(NULL, fr_ldap_replica_t, node, replica_name_cmp, NULL);
+		if (!replica_tree) {
+		error:
+			pthread_mutex_unlock(&replica_mutex);
+			return NULL;
+		}
+	}
+
+	replica = fr_rb_find(replica_tree, &find);
+	if (!replica) {
+		MEM(replica = talloc_zero(replica_tree, fr_ldap_replica_t));
+		replica->name = talloc_strdup(replica, name);
+		replica->by_dn = fr_rb_inline_talloc_alloc(replica, fr_ldap_replica_entry_t, dn_node,
+							   replica_dn_cmp, NULL);
+		replica->by_uuid = fr_rb_inline_talloc_alloc(replica, fr_ldap_replica_entry_t, uuid_node,
+							     replica_uuid_cmp, NULL);
+		MEM(replica->indexes = talloc_array(replica, ldap_replica_index_t, 0));
+		if (!replica->by_dn || !replica->by_uuid || (pthread_rwlock_init(&replica->lock, NULL) != 0)) {
+			fr_strerror_printf("Failed initialising LDAP replica \"%s\"", name);
+			talloc_free(replica);
+			goto error;
+		}
+		talloc_set_destructor(replica, _replica_free);
+		fr_rb_insert(replica_tree, replica);
+	}
+
+	MEM(ref = talloc(ctx, fr_ldap_replica_t *));
+	*ref = replica;
+	replica->refs++;
+	talloc_set_destructor(ref, _replica_ref_free);
+	pthread_mutex_unlock(&replica_mutex);
+
+	return replica;
+}
+
+/** Maintain an index on an attribute
+ *
+ * Entries already in the replica are added to the index immediately,
+ * entries added later are indexed as they arrive.
+ *
+ * @param[in] replica	to add the index to.
+ * @param[in] attr	to index entries by.
+ * @return
+ *	- 0 on success (including if the index already exists).
+ *	- -1 on failure.
+ */
+int fr_ldap_replica_index_add(fr_ldap_replica_t *replica, char const *attr)
+{
+	ldap_replica_index_t	*index;
+	fr_ldap_replica_entry_t	*entry;
+	fr_rb_iter_inorder_t	iter;
+	size_t			i, num;
+	int			ret = 0;
+
+	pthread_rwlock_wrlock(&replica->lock);
+	num = talloc_array_length(replica->indexes);
+	for (i = 0; i < num; i++) {
+		if (strcasecmp(replica->indexes[i].attr, attr) == 0) goto done;
+	}
+
+	MEM(replica->indexes = talloc_realloc(replica, replica->indexes, ldap_replica_index_t, num + 1));
+	index = &replica->indexes[num];
+	index->attr = talloc_strdup(replica->indexes, attr);
+	index->tree = fr_rb_inline_talloc_alloc(replica->indexes, ldap_replica_index_node_t, node,
+						replica_index_cmp, NULL);
+	if (!index->tree) {
+		MEM(replica->indexes = talloc_realloc(replica, replica->indexes, ldap_replica_index_t, num));
+		ret = -1;
+		goto done;
+	}
+
+	for (entry = fr_rb_iter_init_inorder(&iter, replica->by_dn);
+	     entry;
+	     entry = fr_rb_iter_next_inorder(&iter)) {
+		if (replica_index_insert(index, entry) < 0) ret = -1;
+	}
+
+done:
+	pthread_rwlock_unlock(&replica->lock);
+
+	return ret;
+}
+
+/** Add or replace an entry in the replica
+ *
+ * All attributes returned by the directory for the entry are stored,
+ * replacing any previous version of the entry with the same DN or UUID.
+ *
+ * @param[in] replica	to update.
+ * @param[in] handle	the entry was received on.
+ * @param[in] uuid	of the entry, may be NULL.
+ * @param[in] msg	containing the entry.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_ldap_replica_upsert(fr_ldap_replica_t *replica, LDAP *handle,
+			   uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH], LDAPMessage *msg)
+{
+	fr_ldap_replica_entry_t	*entry, *old;
+	BerElement		*ber = NULL;
+	char			*dn, *name;
+	size_t			i, num;
+	int			ret = 0;
+
+	dn = ldap_get_dn(handle, msg);
+	if (!dn) {
+		fr_strerror_const("Entry has no DN");
+		return -1;
+	}
+
+	/*
+	 *	Build the new entry without holding the lock
+	 */
+	MEM(entry = talloc_zero(NULL, fr_ldap_replica_entry_t));
+	MEM(entry->dn = talloc_strdup(entry, dn));
+	ldap_memfree(dn);
+	fr_ldap_util_normalise_dn(entry->dn, entry->dn);
+	if (uuid) {
+		memcpy(entry->uuid, uuid, sizeof(entry->uuid));
+		entry->has_uuid = true;
+	}
+	MEM(entry->attrs = talloc_array(entry, ldap_replica_attr_t, 0));
+
+	for (name = ldap_first_attribute(handle, msg, &ber);
+	     name;
+	     name = ldap_next_attribute(handle, msg, ber)) {
+		struct berval		**values;
+		ldap_replica_attr_t	*attr;
+		size_t			count, j;
+
+		values = ldap_get_values_len(handle, msg, name);
+		count = ldap_count_values_len(values);
+
+		num = talloc_array_length(entry->attrs);
+		MEM(entry->attrs = talloc_realloc(entry, entry->attrs, ldap_replica_attr_t, num + 1));
+		attr = &entry->attrs[num];
+		MEM(attr->name = talloc_strdup(entry->attrs, name));
+		MEM(attr->values = talloc_array(entry->attrs, struct berval, count));
+		for (j = 0; j < count; j++) {
+			attr->values[j].bv_len = values[j]->bv_len;
+			MEM(attr->values[j].bv_val = talloc_memdup(attr->values, values[j]->bv_val, values[j]->bv_len));
+		}
+
+		ldap_value_free_len(values);
+		ldap_memfree(name);
+	}
+	if (ber) ber_free(ber, 0);
+
+	pthread_rwlock_wrlock(&replica->lock);
+	talloc_steal(replica->by_dn, entry);
+
+	old = fr_rb_find(replica->by_dn, entry);
+	if (old) replica_entry_remove(replica, old);
+	if (entry->has_uuid) {
+		old = fr_rb_find(replica->by_uuid, entry);
+		if (old) replica_entry_remove(replica, old);	/* Entry was renamed */
+		fr_rb_insert(replica->by_uuid, entry);
+	}
+	fr_rb_insert(replica->by_dn, entry);
+
+	num = talloc_array_length(replica->indexes);
+	for (i = 0; i < num; i++) {
+		if (replica_index_insert(&replica->indexes[i], entry) < 0) ret = -1;
+	}
+	replica->populated = true;
+	pthread_rwlock_unlock(&replica->lock);
+
+	return ret;
+}
+
+/** Remove an entry from the replica
+ *
+ * @param[in] replica	to update.
+ * @param[in] uuid	of the entry to remove, may be NULL.
+ * @param[in] dn	of the entry to remove, used if uuid is NULL.
+ */
+void fr_ldap_replica_delete(fr_ldap_replica_t *replica,
+			    uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH], char const *dn)
+{
+	fr_ldap_replica_entry_t	find = { .dn = UNCONST(char *, dn) }, *entry = NULL;
+	char			*normalised = NULL;
+
+	if (uuid) {
+		memcpy(find.uuid, uuid, sizeof(find.uuid));
+	} else if (dn) {
+		MEM(normalised = talloc_strdup(NULL, dn));
+		fr_ldap_util_normalise_dn(normalised, normalised);
+		find.dn = normalised;
+	} else {
+		return;
+	}
+
+	pthread_rwlock_wrlock(&replica->lock);
+	entry = fr_rb_find(uuid ? replica->by_uuid : replica->by_dn, &find);
+	if (entry) replica_entry_remove(replica, entry);
+	pthread_rwlock_unlock(&replica->lock);
+
+	talloc_free(normalised);
+}
+
+/** Record that a sync has started feeding the replica
+ *
+ * Until every feed has finished its initial refresh the replica is
+ * incomplete, and only positive lookups should be trusted.
+ *
+ * @param[in] replica	being fed.
+ */
+void fr_ldap_replica_feed_start(fr_ldap_replica_t *replica)
+{
+	pthread_rwlock_wrlock(&replica->lock);
+	replica->feeds++;
+	replica->refreshing++;
+	replica->complete = false;
+	pthread_rwlock_unlock(&replica->lock);
+}
+
+/** Record that a sync feeding the replica has finished its initial refresh
+ *
+ * @param[in] replica	being fed.
+ */
+void fr_ldap_replica_feed_refreshed(fr_ldap_replica_t *replica)
+{
+	pthread_rwlock_wrlock(&replica->lock);
+	if (!fr_cond_assert(replica->refreshing > 0)) goto done;
+	if (--replica->refreshing == 0) {
+		replica->complete = true;
+		replica->populated = true;	/* An empty directory is still a valid replica */
+	}
+done:
+	pthread_rwlock_unlock(&replica->lock);
+}
+
+/** Record that a sync has stopped feeding the replica
+ *
+ * The entries are retained, and may be served until they become older
+ * than the staleness limit of the consumer.
+ *
+ * @param[in] replica	being fed.
+ * @param[in] refreshed	whether the sync had completed its initial refresh.
+ */
+void fr_ldap_replica_feed_stop(fr_ldap_replica_t *replica, bool refreshed)
+{
+	pthread_rwlock_wrlock(&replica->lock);
+	if (!fr_cond_assert(replica->feeds > 0)) goto done;
+	if (!refreshed && fr_cond_assert(replica->refreshing > 0)) replica->refreshing--;
+	if (--replica->feeds == 0) replica->detached = fr_time();
+done:
+	pthread_rwlock_unlock(&replica->lock);
+}
+
+/** Determine which answers the replica can currently give
+ *
+ * @param[in] replica		to check.
+ * @param[in] max_staleness	How long after the last feed has gone away
+ *				entries may still be used.
+ * @return
+ *	- FR_LDAP_REPLICA_UNAVAILABLE if the directory must be consulted.
+ *	- FR_LDAP_REPLICA_PARTIAL if entries found in the replica may be used.
+ *	- FR_LDAP_REPLICA_COMPLETE if absence from the replica is also authoritative.
+ */
+fr_ldap_replica_state_t fr_ldap_replica_state(fr_ldap_replica_t *replica, fr_time_delta_t max_staleness)
+{
+	fr_ldap_replica_state_t	state;
+
+	pthread_rwlock_rdlock(&replica->lock);
+	if (!replica->populated) {
+		state = FR_LDAP_REPLICA_UNAVAILABLE;
+
+	} else if ((replica->feeds == 0) &&
+		   fr_time_delta_gt(fr_time_sub(fr_time(), replica->detached), max_staleness)) {
+		state = FR_LDAP_REPLICA_UNAVAILABLE;
+
+	} else {
+		state = replica->complete ? FR_LDAP_REPLICA_COMPLETE : FR_LDAP_REPLICA_PARTIAL;
+	}
+	pthread_rwlock_unlock(&replica->lock);
+
+	return state;
+}
+
+/** Copy an entry out of the replica
+ *
+ */
+static fr_ldap_replica_entry_t *replica_entry_copy(TALLOC_CTX *ctx, fr_ldap_replica_entry_t const *in)
+{
+	fr_ldap_replica_entry_t	*out;
+	size_t			i, num = talloc_array_length(in->attrs);
+
+	MEM(out = talloc_zero(ctx, fr_ldap_replica_entry_t));
+	MEM(out->dn = talloc_strdup(out, in->dn));
+	out->has_uuid = in->has_uuid;
+	memcpy(out->uuid, in->uuid, sizeof(out->uuid));
+
+	MEM(out->attrs = talloc_array(out, ldap_replica_attr_t, num));
+	for (i = 0; i < num; i++) {
+		size_t j, count = talloc_array_length(in->attrs[i].values);
+
+		MEM(out->attrs[i].name = talloc_strdup(out->attrs, in->attrs[i].name));
+		MEM(out->attrs[i].values = talloc_array(out->attrs, struct berval, count));
+		for (j = 0; j < count; j++) {
+			out->attrs[i].values[j].bv_len = in->attrs[i].values[j].bv_len;
+			MEM(out->attrs[i].values[j].bv_val = talloc_memdup(out->attrs[i].values,
+									   in->attrs[i].values[j].bv_val,
+									   in->attrs[i].values[j].bv_len));
+		}
+	}
+
+	return out;
+}
+
+/** Find an entry by DN
+ *
+ * @param[in] ctx	to allocate the copy of the entry in.
+ * @param[in] replica	to search.
+ * @param[in] dn	of the entry.
+ * @return
+ *	- A copy of the entry.
+ *	- NULL if no entry has that DN.
+ */
+fr_ldap_replica_entry_t *fr_ldap_replica_find_by_dn(TALLOC_CTX *ctx, fr_ldap_replica_t *replica, char const *dn)
+{
+	fr_ldap_replica_entry_t	find, *entry, *out = NULL;
+
+	MEM(find.dn = talloc_strdup(NULL, dn));
+	fr_ldap_util_normalise_dn(find.dn, find.dn);
+
+	pthread_rwlock_rdlock(&replica->lock);
+	entry = fr_rb_find(replica->by_dn, &find);
+	if (entry) out = replica_entry_copy(ctx, entry);
+	pthread_rwlock_unlock(&replica->lock);
+
+	talloc_free(find.dn);
+
+	return out;
+}
+
+/** Find an entry by the value of an indexed attribute
+ *
+ * @param[in] ctx	to allocate the copy of the entry in.
+ * @param[in] replica	to search.
+ * @param[in] attr	indexed attribute, previously passed to #fr_ldap_replica_index_add.
+ * @param[in] value	to look for.
+ * @param[in] len	of value.
+ * @return
+ *	- 1 and a copy of the entry in out, if exactly one entry matched.
+ *	- 0 if no entry matched.
+ *	- -1 if multiple entries matched, or the attribute is not indexed.
+ */
+int fr_ldap_replica_find_by_index(TALLOC_CTX *ctx, fr_ldap_replica_entry_t **out, fr_ldap_replica_t *replica,
+				  char const *attr, char const *value, size_t len)
+{
+	ldap_replica_index_node_t	find = { .value = { .bv_val = UNCONST(char *, value), .bv_len = len } };
+	ldap_replica_index_node_t	*inode;
+	size_t				i, num;
+	int				ret = -1;
+
+	*out = NULL;
+
+	pthread_rwlock_rdlock(&replica->lock);
+	num = talloc_array_length(replica->indexes);
+	for (i = 0; i < num; i++) {
+		if (strcasecmp(replica->indexes[i].attr, attr) == 0) break;
+	}
+	if (i == num) {
+		fr_strerror_printf("Attribute \"%s\" is not indexed in replica \"%s\"", attr, replica->name);
+		goto done;
+	}
+
+	inode = fr_rb_find(replica->indexes[i].tree, &find);
+	if (!inode) {
+		ret = 0;
+		goto done;
+	}
+
+	if (talloc_array_length(inode->entries) > 1) {
+		fr_strerror_printf("Ambiguous result, %zu entries have %s=%pV", talloc_array_length(inode->entries),
+				   attr, fr_box_strvalue_len(value, len));
+		goto done;
+	}
+
+	*out = replica_entry_copy(ctx, inode->entries[0]);
+	ret = 1;
+
+done:
+	pthread_rwlock_unlock(&replica->lock);
+
+	return ret;
+}
+
+/** Return the DN of a replicated entry
+ *
+ */
+char const *fr_ldap_replica_entry_dn(fr_ldap_replica_entry_t const *entry)
+{
+	return entry->dn;
+}
+
+/** Return the values of an attribute in a replicated entry
+ *
+ * The result is allocated with the libldap allocator, in the same form as
+ * the result of ldap_get_values_len(), so callers can treat directory and
+ * replica entries identically.
+ *
+ * @param[in] entry	to retrieve values from.
+ * @param[in] attr	to retrieve.
+ * @return
+ *	- NULL terminated array of values, to be freed with ldap_value_free_len().
+ *	- NULL if the attribute is not present.
+ */
+struct berval **fr_ldap_replica_entry_values(fr_ldap_replica_entry_t const *entry, char const *attr)
+{
+	ldap_replica_attr_t const	*found;
+	struct berval			**values;
+	size_t				i, count;
+
+	found = replica_entry_attr(entry, attr);
+	if (!found) return NULL;
+
+	count = talloc_array_length(found->values);
+	if (count == 0) return NULL;
+
+	values = ber_memcalloc(count + 1, sizeof(struct berval *));
+	if (!values) return NULL;
+
+	for (i = 0; i < count; i++) {
+		values[i] = ber_dupbv(NULL, &found->values[i]);
+		if (!values[i]) {
+			ldap_value_free_len(values);
+			return NULL;
+		}
+	}
+
+	return values;
+}
+
+/** Compare an attribute value with a filter assertion value
+ *
+ * Values are compared case insensitively.  If the assertion is a DN
+ * both values are normalised first.
+ */
+static bool replica_value_eq(struct berval const *value, char const *assertion, size_t len)
+{
+	char	*a, *b;
+	bool	ret;
+
+	if (!fr_ldap_util_is_dn(assertion, len)) {
+		return (value->bv_len == len) && (strncasecmp(value->bv_val, assertion, len) == 0);
+	}
+
+	MEM(a = fr_ldap_berval_to_string(NULL, value));
+	MEM(b = talloc_bstrndup(NULL, assertion, len));
+	fr_ldap_util_normalise_dn(a, a);
+	fr_ldap_util_normalise_dn(b, b);
+	ret = (strcasecmp(a, b) == 0);
+	talloc_free(a);
+	talloc_free(b);
+
+	return ret;
+}
+
+/** Match an attribute value against a substring assertion
+ *
+ * @param[in] value	to check.
+ * @param[in] pattern	unescaped assertion, with each '*' in the filter replaced by '\0'.
+ * @param[in] len	of pattern.
+ */
+static bool replica_value_substr(struct berval const *value, char const *pattern, size_t len)
+{
+	char const	*v = value->bv_val, *v_end = value->bv_val + value->bv_len;
+	char const	*p = pattern, *p_end = pattern + len;
+	char const	*sep;
+	size_t		slen;
+	bool		first = true;
+
+	while (p <= p_end) {
+		sep = memchr(p, '\0', p_end - p);
+		if (!sep) sep = p_end;
+		slen = sep - p;
+
+		if (sep == p_end) {	/* final */
+			if (first) return ((size_t)(v_end - v) == slen) && (strncasecmp(v, p, slen) == 0);
+			if ((size_t)(v_end - v) < slen) return false;
+			return strncasecmp(v_end - slen, p, slen) == 0;
+		}
+
+		if (first) {		/* initial */
+			if ((size_t)(v_end - v) < slen) return false;
+			if (strncasecmp(v, p, slen) != 0) return false;
+			v += slen;
+		} else if (slen > 0) {	/* any */
+			while (((size_t)(v_end - v) >= slen) && (strncasecmp(v, p, slen) != 0)) v++;
+			if ((size_t)(v_end - v) < slen) return false;
+			v += slen;
+		}
+
+		first = false;
+		p = sep + 1;
+	}
+
+	return true;
+}
+
+static inline uint8_t replica_hex(char c)
+{
+	if (isdigit((uint8_t)c)) return c - '0';
+
+	return tolower((uint8_t)c) - 'a' + 10;
+}
+
+/** Evaluate one component of an RFC 4515 filter against an entry
+ *
+ * Equality, presence and substring assertions, combined with '&', '|' and '!'
+ * are supported.  Anything else, e.g. ordering or extensible matches, can't be
+ * evaluated locally.
+ *
+ * @param[in] entry	to evaluate filter against.
+ * @param[in,out] p_in	current position in the filter, must point at '('.
+ * @param[in] end	of the filter.
+ * @return
+ *	- 1 if the entry matches.
+ *	- 0 if the entry does not match.
+ *	- -1 if the filter is invalid, or can't be evaluated locally.
+ */
+static int replica_filter_eval(fr_ldap_replica_entry_t const *entry, char const **p_in, char const *end)
+{
+	char const		*p = *p_in, *attr_end, *value_end;
+	ldap_replica_attr_t	*attr;
+	char			*attr_name, *value, *q;
+	bool			substr = false, present;
+	size_t			i, count, len;
+	int			ret;
+
+	if ((p >= end) || (*p != '(')) return -1;
+	p++;
+	if (p >= end) return -1;
+
+	switch (*p) {
+	case '&':
+	case '|':
+	{
+		bool	is_and = (*p == '&');
+		int	result = is_and ? 1 : 0;
+
+		p++;
+		while ((p < end) && (*p == '(')) {
+			ret = replica_filter_eval(entry, &p, end);
+			if (ret < 0) return -1;
+			if (is_and && (ret == 0)) result = 0;
+			if (!is_and && (ret == 1)) result = 1;
+		}
+		if ((p >= end) || (*p != ')')) return -1;
+		*p_in = p + 1;
+		return result;
+	}
+
+	case '!':
+		p++;
+		ret = replica_filter_eval(entry, &p, end);
+		if (ret < 0) return -1;
+		if ((p >= end) || (*p != ')')) return -1;
+		*p_in = p + 1;
+		return !ret;
+
+	default:
+		break;
+	}
+
+	/*
+	 *	attr=value
+	 */
+	for (attr_end = p; (attr_end < end) && (*attr_end != '=') && (*attr_end != ')'); attr_end++) {
+		/*
+		 *	'~=', '>=', '<=' and extensible matches
+		 */
+		if ((*attr_end == '~') || (*attr_end == '>') || (*attr_end == '<') || (*attr_end == ':')) return -1;
+	}
+	if ((attr_end == p) || (attr_end >= end) || (*attr_end != '=')) return -1;
+
+	for (value_end = attr_end + 1; (value_end < end) && (*value_end != ')'); value_end++) {
+		if (*value_end == '(') return -1;
+	}
+	if (value_end >= end) return -1;
+
+	present = ((value_end - attr_end) == 2) && (attr_end[1] == '*');
+
+	/*
+	 *	Unescape the assertion value, marking wildcards with '\0'
+	 */
+	MEM(value = talloc_array(NULL, char, (value_end - attr_end) + 1));
+	for (p = attr_end + 1, q = value; p < value_end; p++) {
+		if (*p == '*') {
+			*q++ = '\0';
+			substr = true;
+			continue;
+		}
+		if (*p != '\\') {
+			*q++ = *p;
+			continue;
+		}
+		if (((value_end - p) < 3) || !isxdigit((uint8_t)p[1]) || !isxdigit((uint8_t)p[2]) ||
+		    ((p[1] == '0') && (p[2] == '0'))) {
+			talloc_free(value);
+			return -1;
+		}
+		*q++ = (char)((replica_hex(p[1]) << 4) | replica_hex(p[2]));
+		p += 2;
+	}
+	len = q - value;
+
+	MEM(attr_name = talloc_bstrndup(value, *p_in + 1, attr_end - (*p_in + 1)));
+	attr = replica_entry_attr(entry, attr_name);
+	count = attr ? talloc_array_length(attr->values) : 0;
+
+	ret = 0;
+	if (present) {
+		ret = (count > 0);
+	} else {
+		for (i = 0; (i < count) && !ret; i++) {
+			ret = substr ? replica_value_substr(&attr->values[i], value, len) :
+				       replica_value_eq(&attr->values[i], value, len);
+		}
+	}
+	talloc_free(value);
+
+	*p_in = value_end + 1;
+	return ret;
+}
+
+/** Check whether a DN is within a search base and scope
+ *
+ */
+static bool replica_dn_in_scope(char const *dn, char const *base, int scope)
+{
+	size_t		dn_len = strlen(dn), base_len = strlen(base);
+	char const	*p, *end;
+
+	if (base_len == 0) return (scope == LDAP_SCOPE_SUBTREE) || (dn_len == 0);	/* Root DSE */
+
+	if (dn_len == base_len) return (strcasecmp(dn, base) == 0) &&
+				       ((scope == LDAP_SCOPE_BASE) || (scope == LDAP_SCOPE_SUBTREE));
+
+	if ((scope == LDAP_SCOPE_BASE) || (dn_len <= base_len + 1) || (dn[dn_len - base_len - 1] != ',') ||
+	    (strcasecmp(dn + dn_len - base_len, base) != 0)) return false;
+
+	if (scope != LDAP_SCOPE_ONELEVEL) return true;
+
+	/*
+	 *	Only direct children of the base, i.e. a single RDN
+	 */
+	for (p = dn, end = dn + dn_len - base_len - 1; p < end; p++) {
+		if (*p == '\\') {
+			p++;
+			continue;
+		}
+		if (*p == ',') return false;
+	}
+
+	return true;
+}
+
+/** Check whether a replicated entry would be returned by a search
+ *
+ * @param[in] entry	to check.
+ * @param[in] base	DN of the search.
+ * @param[in] scope	of the search, one of the LDAP_SCOPE_* values.
+ * @param[in] filter	of the search, may be NULL.
+ * @return
+ *	- 1 if the search would return the entry.
+ *	- 0 if the search would not return the entry.
+ *	- -1 if the filter is invalid, or uses assertions which can't be evaluated locally.
+ */
+int fr_ldap_replica_entry_match(fr_ldap_replica_entry_t const *entry, char const *base, int scope, char const *filter)
+{
+	char		*normalised;
+	char const	*p, *end;
+	bool		in_scope;
+	int		ret;
+
+	MEM(normalised = talloc_strdup(NULL, base));
+	fr_ldap_util_normalise_dn(normalised, normalised);
+	in_scope = replica_dn_in_scope(entry->dn, normalised, scope);
+	talloc_free(normalised);
+	if (!in_scope) return 0;
+
+	if (!filter || !*filter) return 1;
+
+	p = filter;
+	end = filter + strlen(filter);
+	ret = replica_filter_eval(entry, &p, end);
+	if (ret < 0) {
+		fr_strerror_printf("Can't evaluate filter \"%s\" locally", filter);
+		return -1;
+	}
+	if (p != end) {
+		fr_strerror_printf("Trailing garbage in filter \"%s\"", filter);
+		return -1;
+	}
+
+	return ret;
+}
@@ -85,9 +85,13 @@
  *   indexes in the fr_redis_cluster_t.node array.  We use 8bit unsigned integers instead of
  *   pointers to save space.  Using pointers, the node[] array would need 784K, using IDs
  *   it uses 112K.  Still not light on memory, but a bit more acceptable.
- *   Currently the key_slot array is shadowed by key_slot_pending, used to stage new key_slot
- *   mappings.  This doubles the memory used.  We may want to consider allocating key_slot_pending
- *   only during remappings and freeing it after.
+ *   The key slot table is published as an immutable #cluster_slot_map_t snapshot.  Workers
+ *   load the live snapshot with a single atomic read and never take the cluster mutex to
+ *   resolve a key to a node.  Remaps build a complete new snapshot in one of the spare maps,
+ *   then atomically swap it in.  A snapshot replaced by a remap is retired, and is only
+ *   recycled once it's been retired for longer than SLOT_MAP_GRACE, which is far longer
+ *   than any worker holds a snapshot for.  Until then a worker holding an old snapshot only
+ *   risks using a stale route, which is corrected by the normal '-ASK'/'-MOVE' handling.
  *
  * Mapping/Remapping the cluster
  * -----------------------------
@@ -103,9 +107,9 @@
  *     4. Connecting to nodes that were in the result, but not in the tree.
  *        Note: If we can't connect to any of the masters, we count the map as invalid, roll
  *        back any newly connected nodes, and error out. Slave failure is OK.
- *     5. Mapping keyslot ranges to nodes in the key_slot_pending array.
+ *     5. Mapping keyslot ranges to nodes in the next spare #cluster_slot_map_t.
  *     6. Verifying there are no holes in the ranges (if there are, we roll back and error out).
- *     7. Applying the new keyslot ranges.
+ *     7. Publishing the new slot map, by atomically swapping the live map pointer.
  *     8. Removing nodes no longer used by the key slots, and adding them back to the free
  *        nodes queue.
  *
@@ -164,11 +168,20 @@
 #include <hiredis/hiredis_ssl.h>
 #endif
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
 #define KEY_SLOTS		16384			//!< Maximum number of keyslots (should not change).
 
 #define MAX_SLAVES		5			//!< Maximum number of slaves associated
 							//!< with a keyslot.
 
+#define SLOT_MAP_GRACE		fr_time_delta_from_sec(60)	//!< How long a retired key slot map is
+								//!< left untouched, before it's recycled.
+
 /*
  *	Periods and weights for live node selection
  */
@@ -240,6 +253,20 @@ struct fr_redis_cluster_key_slot_s {
 	uint8_t			master;			//!< R/W node (master) for this key slot.
 };
 
+/** An immutable snapshot of the key slot to node mappings
+ *
+ * Once published via fr_redis_cluster_t.live_map a snapshot is never
+ * modified until it's been retired for SLOT_MAP_GRACE, and is recycled.
+ */
+typedef struct {
+	fr_redis_cluster_key_slot_t	key_slot[KEY_SLOTS];	//!< Lookup table of slots to pools.
+	uint64_t			num_nodes;		//!< Number of nodes in use when the map
+								//!< was built.
+
+	fr_time_t			retired;		//!< When the snapshot was replaced.
+	fr_dlist_t			entry;			//!< Entry in the retired list.
+} cluster_slot_map_t;
+
 /** A redis cluster
  *
  * Holds all the structures and collections of nodes, to represent a Redis cluster.
@@ -268,8 +295,13 @@ struct fr_redis_cluster {
 	fr_fifo_t		*free_nodes;		//!< Queue of free nodes (or nodes waiting to be reused).
 	fr_rb_tree_t		*used_nodes;		//!< Tree of used nodes.
 
-	fr_redis_cluster_key_slot_t	key_slot[KEY_SLOTS];		//!< Lookup table of slots to pools.
-	fr_redis_cluster_key_slot_t	key_slot_pending[KEY_SLOTS];	//!< Pending key slot table.
+	_Atomic(cluster_slot_map_t *) live_map;		//!< Snapshot workers currently resolve keys with.
+	fr_dlist_head_t		retired_maps;		//!< Snapshots which have been replaced, oldest first.
+							//!< Protected by the mutex.
+
+	atomic_uint_fast64_t	remaps;			//!< Successful cluster remaps.
+	atomic_uint_fast64_t	moved;			//!< '-MOVE' redirects received.
+	atomic_uint_fast64_t	asked;			//!< '-ASK' redirects received.
 
 	pthread_mutex_t		mutex;			//!< Mutex to synchronise cluster operations.
 };
@@ -493,6 +525,32 @@ static fr_redis_cluster_rcode_t cluster_node_conf_from_redirect(uint16_t *key_sl
 	return FR_REDIS_CLUSTER_RCODE_SUCCESS;
 }
 
+/** Get a key slot map snapshot to build a new cluster map in
+ *
+ * Recycles the oldest retired snapshot if it's been retired for longer
+ * than SLOT_MAP_GRACE, so no worker can still be reading it.  Otherwise
+ * allocates a new one.
+ *
+ * @note Must be called with the cluster mutex held.
+ *
+ * @param[in] cluster	to get snapshot for.
+ * @return A zeroed snapshot.
+ */
+static cluster_slot_map_t *cluster_slot_map_alloc(fr_redis_cluster_t *cluster)
+{
+	cluster_slot_map_t *map;
+
+	map = fr_dlist_head(&cluster->retired_maps);
+	if (map && fr_time_delta_gteq(fr_time_sub(fr_time(), map->retired), SLOT_MAP_GRACE)) {
+		fr_dlist_remove(&cluster->retired_maps, map);
+		memset(map, 0, sizeof(*map));
+		return map;
+	}
+
+	MEM(map = talloc_zero(cluster, cluster_slot_map_t));
+	return map;
+}
+
 /** Apply a cluster map received from a cluster node
  *
  * @note Errors may be retrieved with fr_strerror().
@@ -537,6 +595,7 @@ static fr_redis_cluster_rcode_t cluster_map_apply(fr_redis_cluster_t *cluster, r
 	uint8_t		r = 0;
 
 	fr_redis_cluster_rcode_t	rcode;
+	cluster_slot_map_t		*pending, *previous;
 
 	uint8_t		rollback[UINT8_MAX];		// Set of nodes to re-add to the queue on failure.
 	bool		active[UINT8_MAX];		// Set of nodes active in the new cluster map.
@@ -583,9 +642,11 @@ do { \
 	cluster->remapping = true;
 
 	/*
-	 *	Must be cleared with the mutex held
+	 *	Build the new map in a snapshot no worker
+	 *	can be reading.  Must be allocated with the
+	 *	mutex held.
 	 */
-	memset(&cluster->key_slot_pending, 0, sizeof(cluster->key_slot_pending));
+	pending = cluster_slot_map_alloc(cluster);
 
 	/*
 	 *	Insert new nodes and markup the keyslot indexes
@@ -630,6 +691,8 @@ do { \
 		error:
 			cluster->remapping = false;
 			cluster->last_updated = fr_time();
+			/* Never published, so it can be reused immediately */
+			fr_dlist_insert_head(&cluster->retired_maps, pending);
 			/* Re-insert new nodes back into the free_nodes queue */
 			for (i = 0; i < r; i++) SET_INACTIVE(&cluster->node[rollback[i]]);
 			return rcode;
@@ -689,8 +752,7 @@ do { \
 		 *	specified by the range for this map.
 		 */
 		for (k = map->element[0]->integer; k <= map->element[1]->integer; k++) {
-			memcpy(&cluster->key_slot_pending[k], &tmpl_slot,
-			       sizeof(*(cluster->key_slot_pending)));
+			memcpy(&pending->key_slot[k], &tmpl_slot, sizeof(pending->key_slot[k]));
 		}
 	}
 
@@ -706,24 +768,13 @@ do { \
 	 *	error out.
 	 */
 	for (i = 0; i < KEY_SLOTS; i++) {
-		if (cluster->key_slot_pending[i].master == 0) {
+		if (pending->key_slot[i].master == 0) {
 			fr_strerror_printf("Cluster is misconfigured, no node assigned for key %zu", i);
 			rcode = FR_REDIS_CLUSTER_RCODE_BAD_INPUT;
 			goto error;
 		}
 	}
 
-	/*
-	 *	We have connections/pools for all the nodes in
-	 *	the new map, apply it to the live cluster.
-	 *
-	 *	Other workers may be using the key slot table,
-	 *	but that's ok. Nodes and pools are never freed,
-	 *	so the worst that will happen, is they'll hit
-	 *	the wrong node for the key, and get redirected.
-	 */
-	memcpy(&cluster->key_slot, &cluster->key_slot_pending, sizeof(cluster->key_slot));
-
 	/*
 	 *	Anything not in the active set of nodes gets
 	 *	added back into the queue, to be re-used.
@@ -755,6 +806,22 @@ do { \
 		}
 	}
 
+	/*
+	 *	We have connections/pools for all the nodes in
+	 *	the new map, publish it.
+	 *
+	 *	Other workers may still be using the previous
+	 *	snapshot, but that's ok.  It's not recycled until
+	 *	it's been retired for SLOT_MAP_GRACE, and nodes and
+	 *	pools are never freed, so the worst that will
+	 *	happen, is they'll hit the wrong node for the key,
+	 *	and get redirected.
+	 */
+	pending->num_nodes = fr_rb_num_elements(cluster->used_nodes);
+	previous = atomic_exchange_explicit(&cluster->live_map, pending, memory_order_acq_rel);
+	previous->retired = fr_time();
+	fr_dlist_insert_tail(&cluster->retired_maps, previous);
+
 	cluster->remapping = false;
 	cluster->last_updated = fr_time();
 
@@ -1090,7 +1157,10 @@ fr_redis_cluster_rcode_t fr_redis_cluster_remap(request_t *request, fr_redis_clu
 		goto too_soon;
 	}
 	ret = cluster_map_apply(cluster, map);
-	if (ret == FR_REDIS_CLUSTER_RCODE_SUCCESS) cluster->remap_needed = false;	/* Change on successful remap */
+	if (ret == FR_REDIS_CLUSTER_RCODE_SUCCESS) {
+		cluster->remap_needed = false;	/* Change on successful remap */
+		atomic_fetch_add_explicit(&cluster->remaps, 1, memory_order_relaxed);
+	}
 	pthread_mutex_unlock(&cluster->mutex);
 
 	fr_redis_reply_free(&map);	/* Free the map */
@@ -1582,28 +1652,45 @@ void *fr_redis_cluster_conn_create(TALLOC_CTX *ctx, void *instance, fr_time_delt
 	return conn;
 }
 
-/** Implements the key slot selection scheme used by freeradius
+/** Retrieve cluster map maintenance counters
  *
- * Like the scheme in the clustering specification but with some differences
- * if the key is NULL or zero length, then a random keyslot is chosen.
+ * Counters are read individually, so may not be consistent with each other.
  *
- * If there's only a single node in the cluster, then we avoid the CRC16
- * and just use key slot 0.
+ * @param[out] out	Where to write the counters.
+ * @param[in] cluster	to retrieve counters for.
+ */
+void fr_redis_cluster_stats(fr_redis_cluster_stats_t *out, fr_redis_cluster_t const *cluster)
+{
+	out->remaps = atomic_load_explicit(&cluster->remaps, memory_order_relaxed);
+	out->moved = atomic_load_explicit(&cluster->moved, memory_order_relaxed);
+	out->asked = atomic_load_explicit(&cluster->asked, memory_order_relaxed);
+}
+
+/** Load the current key slot map snapshot
  *
- * @param cluster to determine key slot for.
+ * Wait-free, pairs with the release store in #cluster_map_apply.
+ */
+static inline CC_HINT(always_inline) cluster_slot_map_t const *cluster_slot_map(fr_redis_cluster_t *cluster)
+{
+	return atomic_load_explicit(&cluster->live_map, memory_order_acquire);
+}
+
+/** Resolve a key to a key slot in a specific snapshot
+ *
+ * @param map to resolve key in.
  * @param request The current request.
  * @param key the key to resolve.
  * @param key_len the length of the key.
  * @return pointer to key slot key resolves to.
  */
-fr_redis_cluster_key_slot_t const *fr_redis_cluster_slot_by_key(fr_redis_cluster_t *cluster, request_t *request,
-								uint8_t const *key, size_t key_len)
+static fr_redis_cluster_key_slot_t const *cluster_slot_by_key(cluster_slot_map_t const *map, request_t *request,
+							      uint8_t const *key, size_t key_len)
 {
-	fr_redis_cluster_key_slot_t *key_slot;
+	fr_redis_cluster_key_slot_t const *key_slot;
 
 	if (!key || (key_len == 0)) {
-		key_slot = &cluster->key_slot[(uint16_t)(fr_rand() & (KEY_SLOTS - 1))];
-		ROPTIONAL(RDEBUG2, DEBUG2, "Key rand() -> slot %zu", key_slot - cluster->key_slot);
+		key_slot = &map->key_slot[(uint16_t)(fr_rand() & (KEY_SLOTS - 1))];
+		ROPTIONAL(RDEBUG2, DEBUG2, "Key rand() -> slot %zu", key_slot - map->key_slot);
 
 		return key_slot;
 	}
@@ -1612,16 +1699,39 @@ fr_redis_cluster_key_slot_t const *fr_redis_cluster_slot_by_key(fr_redis_cluster
 	 *	Avoid CRC16 if we're operating with one cluster node or
 	 *	without clustering.
 	 */
-	if (fr_rb_num_elements(cluster->used_nodes) > 1) {
-		key_slot = &cluster->key_slot[cluster_key_hash(key, key_len)];
+	if (map->num_nodes > 1) {
+		key_slot = &map->key_slot[cluster_key_hash(key, key_len)];
 		ROPTIONAL(RDEBUG2, DEBUG2, "Key \"%pV\" -> slot %zu",
-			  fr_box_strvalue_len((char const *)key, key_len), key_slot - cluster->key_slot);
+			  fr_box_strvalue_len((char const *)key, key_len), key_slot - map->key_slot);
 
 		return key_slot;
 	}
 	ROPTIONAL(RDEBUG3, DEBUG3, "Single node available, skipping key selection");
 
-	return &cluster->key_slot[0];
+	return &map->key_slot[0];
+}
+
+/** Implements the key slot selection scheme used by freeradius
+ *
+ * Like the scheme in the clustering specification but with some differences
+ * if the key is NULL or zero length, then a random keyslot is chosen.
+ *
+ * If there's only a single node in the cluster, then we avoid the CRC16
+ * and just use key slot 0.
+ *
+ * Does not take the cluster mutex.  The key slot returned remains valid
+ * for at least SLOT_MAP_GRACE, even if the cluster is remapped.
+ *
+ * @param cluster to determine key slot for.
+ * @param request The current request.
+ * @param key the key to resolve.
+ * @param key_len the length of the key.
+ * @return pointer to key slot key resolves to.
+ */
+fr_redis_cluster_key_slot_t const *fr_redis_cluster_slot_by_key(fr_redis_cluster_t *cluster, request_t *request,
+								uint8_t const *key, size_t key_len)
+{
+	return cluster_slot_by_key(cluster_slot_map(cluster), request, key, key_len);
 }
 
 /** Return the master node that would be used for a particular key
@@ -1739,9 +1849,9 @@ fr_redis_rcode_t fr_redis_cluster_state_init(fr_redis_cluster_state_t *state, fr
 					     uint8_t const *key, size_t key_len, bool read_only)
 {
 	fr_redis_cluster_node_t			*node;
+	cluster_slot_map_t const		*map;
 	fr_redis_cluster_key_slot_t const	*key_slot;
 	uint8_t					first, i;
-	uint64_t				used_nodes;
 
 	fr_assert(cluster);
 	fr_assert(state);
@@ -1750,14 +1860,19 @@ fr_redis_rcode_t fr_redis_cluster_state_init(fr_redis_cluster_state_t *state, fr
 	memset(state, 0, sizeof(*state));
 	*conn = NULL;	/* Better safe than exploding */
 
-	used_nodes = fr_rb_num_elements(cluster->used_nodes);
-	if (used_nodes == 0) {
+again:
+	/*
+	 *	Everything we need to route the key comes from
+	 *	a single snapshot, so we get a consistent view
+	 *	even if a remap is in progress.
+	 */
+	map = cluster_slot_map(cluster);
+	if (map->num_nodes == 0) {
 		ROPTIONAL(REDEBUG, ERROR, "No nodes in cluster");
 		return REDIS_RCODE_RECONNECT;
 	}
 
-again:
-	key_slot = fr_redis_cluster_slot_by_key(cluster, request, key, key_len);
+	key_slot = cluster_slot_by_key(map, request, key, key_len);
 
 	/*
 	 *	1. Try each of the slaves for the key slot
@@ -1773,7 +1888,7 @@ again:
 			*conn = fr_pool_connection_get(node->pool, request);
 			if (!*conn) {
 				ROPTIONAL(RDEBUG2, DEBUG2, "[%i] No connections available (key slot %zu slave %i)",
-					  node->id, key_slot - cluster->key_slot, (first + i) % key_slot->slave_num);
+					  node->id, key_slot - map->key_slot, (first + i) % key_slot->slave_num);
 				cluster->remap_needed = true;
 				continue;	/* Continue until we find a live pool */
 			}
@@ -1793,7 +1908,7 @@ again:
 	*conn = fr_pool_connection_get(node->pool, request);
 	if (!*conn) {
 		ROPTIONAL(RDEBUG2, DEBUG2, "[%i] No connections available (key slot %zu master)",
-			  node->id, key_slot - cluster->key_slot);
+			  node->id, key_slot - map->key_slot);
 		cluster->remap_needed = true;
 
 		if (cluster_node_find_live(&node, conn, request, cluster, node) < 0) return REDIS_RCODE_RECONNECT;
@@ -1982,6 +2097,7 @@ fr_redis_rcode_t fr_redis_cluster_state_next(fr_redis_cluster_state_t *state, fr
 	case REDIS_RCODE_MOVE:
 		fr_assert(*reply);
 
+		atomic_fetch_add_explicit(&cluster->moved, 1, memory_order_relaxed);
 		if (*conn && (fr_redis_cluster_remap(request, cluster, *conn) != FR_REDIS_CLUSTER_RCODE_SUCCESS)) {
 			ROPTIONAL(RPDEBUG2, PDEBUG2, "%s", "");
 		}
@@ -1994,6 +2110,8 @@ fr_redis_rcode_t fr_redis_cluster_state_next(fr_redis_cluster_state_t *state, fr
 	{
 		fr_redis_cluster_node_t *new;
 
+		if (status == REDIS_RCODE_ASK) atomic_fetch_add_explicit(&cluster->asked, 1, memory_order_relaxed);
+
 		fr_pool_connection_release(state->node->pool, request, *conn);	/* Always release the old connection */
 
 		if (!fr_cond_assert(*reply)) return REDIS_RCODE_ERROR;
@@ -2272,6 +2390,7 @@ fr_redis_cluster_t *fr_redis_cluster_alloc(TALLOC_CTX *ctx,
 
 	uint64_t		num_nodes;
 	fr_redis_cluster_t	*cluster;
+	cluster_slot_map_t	*slot_map;
 
 	fr_assert(triggers_enabled || !trigger_prefix);
 	fr_assert(triggers_enabled || (!trigger_args || fr_pair_list_empty(trigger_args)));
@@ -2384,6 +2503,12 @@ fr_redis_cluster_t *fr_redis_cluster_alloc(TALLOC_CTX *ctx,
 	cluster->conf = conf;
 
 	pthread_mutex_init(&cluster->mutex, NULL);
+	fr_dlist_talloc_init(&cluster->retired_maps, cluster_slot_map_t, entry);
+	MEM(slot_map = talloc_zero(cluster, cluster_slot_map_t));
+	atomic_init(&cluster->live_map, slot_map);
+	atomic_init(&cluster->remaps, 0);
+	atomic_init(&cluster->moved, 0);
+	atomic_init(&cluster->asked, 0);
 	talloc_set_destructor(cluster, _fr_redis_cluster_free);
 
 	/*
@@ -2551,7 +2676,9 @@ fr_redis_cluster_t *fr_redis_cluster_alloc(TALLOC_CTX *ctx,
 	 *	hopefully we'll get one when we start processing
 	 *	requests.
 	 */
-	for (s = 0; s < KEY_SLOTS; s++) cluster->key_slot[s].master = (s % (uint16_t) num_nodes) + 1;
+	slot_map = atomic_load_explicit(&cluster->live_map, memory_order_acquire);
+	for (s = 0; s < KEY_SLOTS; s++) slot_map->key_slot[s].master = (s % (uint16_t) num_nodes) + 1;
+	slot_map->num_nodes = num_nodes;
 
 	return cluster;
 }
@@ -73,11 +73,23 @@ typedef enum {
 	FR_REDIS_CLUSTER_RCODE_BAD_INPUT	= -3	//!< Validation error.
 } fr_redis_cluster_rcode_t;
 
+/** Counters for cluster map maintenance
+ *
+ * Populated by #fr_redis_cluster_stats.
+ */
+typedef struct {
+	uint64_t		remaps;		//!< Successful cluster remaps.
+	uint64_t		moved;		//!< '-MOVE' redirects received.
+	uint64_t		asked;		//!< '-ASK' redirects received.
+} fr_redis_cluster_stats_t;
+
 extern fr_table_num_sorted_t const fr_redis_cluster_rcodes_table[];
 extern size_t fr_redis_cluster_rcodes_table_len;
 
 fr_redis_cluster_rcode_t fr_redis_cluster_remap(request_t *request, fr_redis_cluster_t *cluster, fr_redis_conn_t *conn);
 
+void fr_redis_cluster_stats(fr_redis_cluster_stats_t *out, fr_redis_cluster_t const *cluster);
+
 /*
  *	Callback for the connection pool to create a new connection
  */
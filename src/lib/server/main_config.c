@@ -194,16 +194,18 @@ static const conf_parser_t migrate_config[] = {
 	CONF_PARSER_TERMINATOR
 };
 
-#ifndef NDEBUG
 /*
- *	Migration configuration.
+ *	Interpreter configuration.
  */
 static const conf_parser_t interpret_config[] = {
+	{ FR_CONF_OFFSET("flatten", main_config_t, flatten_unlang) },
+	{ FR_CONF_OFFSET("memoize_xlat", main_config_t, memoize_xlat) },
+#ifndef NDEBUG
 	{ FR_CONF_OFFSET_FLAGS("countup_instructions", CONF_FLAG_HIDDEN, main_config_t, ins_countup) },
 	{ FR_CONF_OFFSET_FLAGS("max_instructions", CONF_FLAG_HIDDEN, main_config_t, ins_max) },
+#endif
 	CONF_PARSER_TERMINATOR
 };
-#endif
 
 static const conf_parser_t server_config[] = {
 	/*
@@ -236,9 +238,7 @@ static const conf_parser_t server_config[] = {
 
 	{ FR_CONF_POINTER("migrate", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) migrate_config, .name2 = CF_IDENT_ANY },
 
-#ifndef NDEBUG
 	{ FR_CONF_POINTER("interpret", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) interpret_config, .name2 = CF_IDENT_ANY },
-#endif
 
 	CONF_PARSER_TERMINATOR
 };
@@ -1503,6 +1503,8 @@ void main_config_hup(main_config_t *config)
 static fr_table_num_ordered_t config_arg_table[] = {
 	{ L("rewrite_update"),		 offsetof(main_config_t, rewrite_update) },
 	{ L("forbid_update"),		 offsetof(main_config_t, forbid_update) },
+	{ L("flatten_unlang"),		 offsetof(main_config_t, flatten_unlang) },
+	{ L("memoize_xlat"),		 offsetof(main_config_t, memoize_xlat) },
 };
 static size_t config_arg_table_len = NUM_ELEMENTS(config_arg_table);
 
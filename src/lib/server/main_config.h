@@ -151,6 +151,12 @@ struct main_config_s {
 	uint32_t	max_workers;			//!< for the scheduler
 	fr_time_delta_t	stats_interval;			//!< for the scheduler
 
+	bool		flatten_unlang;			//!< Splice plain nested groups into their parent
+							///< when compiling unlang.
+
+	bool		memoize_xlat;			//!< Re-use the output of pure and cacheable xlat
+							///< functions called with the same arguments.
+
 #ifndef NDEBUG
 	uint32_t	ins_max;			//!< max instruction count
 	bool		ins_countup;			//!< count up to "max"
@@ -157,6 +157,10 @@ struct module_method_binding_s {
 
 	module_method_t				method;			//!< Module method to call
 	call_env_method_t const			*method_env;		//!< Method specific call_env.
+	bool					synchronous;		//!< Method always returns a result directly.
+									///< It never yields, pushes children, or
+									///< sets a resume function, so the
+									///< interpreter can call it inline.
 
 	fr_dlist_head_t				name2_list;		//!< List of bindings with the same name1.  Only initialised
 									///< for the the first name1 binding.
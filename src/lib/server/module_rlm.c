@@ -426,6 +426,34 @@ bool module_rlm_section_type_set(request_t *request, fr_dict_attr_t const *type_
 	}
 }
 
+/** Check whether a module method has been declared synchronous
+ *
+ * The same function may be bound to multiple sections, so every binding
+ * for the function must be marked synchronous.
+ *
+ * @param[in] mi	the module instance the method belongs to.
+ * @param[in] method	to check.
+ * @return
+ *	- true if the method never yields or pushes children.
+ *	- false if it may, or if the method isn't bound.
+ */
+bool module_rlm_method_is_synchronous(module_instance_t const *mi, module_method_t method)
+{
+	module_rlm_t const		*mrlm = module_rlm_from_module(mi->exported);
+	module_method_binding_t const	*mmb;
+	bool				found = false;
+
+	if (!mrlm->bindings) return false;
+
+	for (mmb = mrlm->bindings; mmb->section; mmb++) {
+		if (mmb->method != method) continue;
+		if (!mmb->synchronous) return false;
+		found = true;
+	}
+
+	return found;
+}
+
 /** Find an existing module instance and verify it implements the specified method
  *
  * Extracts the method from the module name where the format is @verbatim <module>.<method> @endverbatim
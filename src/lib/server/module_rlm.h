@@ -94,6 +94,8 @@ module_instance_t	*module_rlm_by_name_and_method(module_method_t *method, call_e
 
 module_instance_t	*module_rlm_static_by_name(module_instance_t const *parent, char const *asked_name);
 
+bool			module_rlm_method_is_synchronous(module_instance_t const *mi, module_method_t method);
+
 CONF_SECTION		*module_rlm_by_name_virtual(char const *asked_name);
 
 /** @} */
@@ -461,7 +461,15 @@ static int _request_free_list_free_on_exit(void *arg)
 
 static inline CC_HINT(always_inline) request_t *request_alloc_pool(TALLOC_CTX *ctx)
 {
-	request_t *request;
+	request_t	*request;
+	unsigned int	stack_objects;
+	size_t		stack_size;
+
+	/*
+	 *	Reserve enough room for the stack of the deepest
+	 *	section which was compiled.
+	 */
+	stack_size = unlang_interpret_stack_pool_size(&stack_objects);
 
 	/*
 	 *	Only allocate requests in the NULL
@@ -473,11 +481,10 @@ static inline CC_HINT(always_inline) request_t *request_alloc_pool(TALLOC_CTX *c
 	 *	and would have to be freed.
 	 */
 	MEM(request = talloc_pooled_object(ctx, request_t,
-					   1 + 					/* Stack pool */
-					   UNLANG_STACK_MAX + 			/* Stack Frames */
+					   stack_objects + 			/* Stack pool and frames */
 					   2 + 					/* packets */
 					   10,					/* extra */
-					   (UNLANG_FRAME_PRE_ALLOC * UNLANG_STACK_MAX) +	/* Stack memory */
+					   stack_size +				/* Stack memory */
 					   (sizeof(fr_pair_t) * 5) +		/* pair lists and root*/
 					   (sizeof(fr_packet_t) * 2) +	/* packets */
 					   128					/* extra */
@@ -28,6 +28,7 @@ RCSID("$Id$")
 
 #include <freeradius-devel/server/exec.h>
 #include <freeradius-devel/server/exec_legacy.h>
+#include <freeradius-devel/server/request_data.h>
 #include <freeradius-devel/server/tmpl.h>
 #include <freeradius-devel/server/tmpl_dcursor.h>
 #include <freeradius-devel/util/dlist.h>
@@ -64,6 +65,244 @@ static void *_tmpl_cursor_child_next(fr_dlist_head_t *list, void *curr, void *uc
 	return vp;
 }
 
+/** Minimum number of pairs a list must contain before we'll index it
+ *
+ * Below this walking the list is cheaper than building and searching the index.
+ */
+#define TMPL_PAIR_INDEX_MIN	32
+
+/** A pair in a list index
+ *
+ */
+typedef struct {
+	fr_dict_attr_t const	*da;		//!< Of the pair.
+	fr_pair_t		*vp;		//!< The pair.
+	unsigned int		pos;		//!< Of the pair in the list.
+} tmpl_pair_index_entry_t;
+
+/** Index of the pairs in a list, sorted by attribute
+ *
+ * Pairs with the same attribute are contiguous and remain in list order,
+ * so iterating over a bucket produces the same pairs, in the same order,
+ * as walking the list would.
+ */
+struct tmpl_pair_index_list_s {
+	TALLOC_CTX const	*list_ctx;	//!< List pair the index describes.
+	unsigned int		generation;	//!< Of the list when we last looked at it.
+	unsigned int		lookups;	//!< Since the list last changed.
+	bool			built;		//!< entries reflects the list at generation.
+	bool			unindexable;	//!< List contains unknown or raw attributes.
+	unsigned int		num;		//!< Number of entries.
+	tmpl_pair_index_entry_t	*entries;	//!< Sorted by da, then by position.
+};
+
+/** Indexes for a request's pair lists
+ *
+ * Only the request, reply and control lists are indexed.  Their list pairs
+ * live as long as the request does, so a list head is never freed and reused
+ * while we hold an index for it.
+ */
+typedef struct {
+	tmpl_pair_index_list_t	list[3];
+} tmpl_pair_index_t;
+
+static char const tmpl_pair_index_id = 0;
+
+static int tmpl_pair_index_entry_cmp(void const *one, void const *two)
+{
+	tmpl_pair_index_entry_t const *a = one, *b = two;
+	int8_t ret;
+
+	ret = CMP((uintptr_t)a->da, (uintptr_t)b->da);
+	if (ret != 0) return ret;
+
+	return CMP(a->pos, b->pos);
+}
+
+/** (Re)build the index for a list
+ *
+ * Lists containing unknown or raw attributes are left unindexed, as those
+ * compare by lineage rather than by pointer, and may match known attributes.
+ */
+static void tmpl_pair_index_build(tmpl_pair_index_t *pi, tmpl_pair_index_list_t *idx, fr_dlist_head_t *list)
+{
+	fr_pair_t	*vp = NULL;
+	unsigned int	i = 0;
+
+	if (talloc_array_length(idx->entries) < list->num_elements) {
+		talloc_free(idx->entries);
+		MEM(idx->entries = talloc_array(pi, tmpl_pair_index_entry_t, list->num_elements));
+	}
+
+	while ((vp = fr_dlist_next(list, vp))) {
+		if (vp->da->flags.is_unknown || vp->da->flags.is_raw) {
+			idx->unindexable = true;
+			return;
+		}
+
+		idx->entries[i] = (tmpl_pair_index_entry_t){
+			.da = vp->da,
+			.vp = vp,
+			.pos = i
+		};
+		i++;
+	}
+
+	qsort(idx->entries, i, sizeof(idx->entries[0]), tmpl_pair_index_entry_cmp);
+
+	idx->num = i;
+	idx->built = true;
+}
+
+/** Locate the bucket of pairs matching an attribute reference
+ *
+ * The index for a list is only built on the second lookup made against
+ * it without the list changing in between.  Lists which are only searched
+ * once, or which are modified between every search, never pay for it.
+ *
+ * @param[in] cc	Tracks state between cursor calls.
+ * @param[in] ns	to locate the bucket for.  ns->list_ctx must be set.
+ * @param[in] list	ns is iterating over.
+ * @return
+ *	- true if ns has been set up to iterate over a bucket.
+ *	- false if the list should be walked.
+ */
+static bool tmpl_pair_index_find(tmpl_dcursor_ctx_t *cc, tmpl_dcursor_nested_t *ns, fr_pair_list_t *list)
+{
+	request_t		*request = cc->request;
+	fr_dlist_head_t		*head = fr_pair_list_to_dlist(list);
+	fr_dict_attr_t const	*da = ns->ar->ar_da;
+	tmpl_pair_index_t	*pi;
+	tmpl_pair_index_list_t	*idx;
+	unsigned int		lo, hi, mid;
+
+	if (!request || (head->num_elements < TMPL_PAIR_INDEX_MIN)) return false;
+
+	if (da->flags.is_unknown || da->flags.is_raw) return false;
+
+	if (ns->list_ctx == request->request_ctx) {
+		mid = 0;
+	} else if (ns->list_ctx == request->reply_ctx) {
+		mid = 1;
+	} else if (ns->list_ctx == request->control_ctx) {
+		mid = 2;
+	} else {
+		return false;
+	}
+
+	pi = request_data_reference(request, &tmpl_pair_index_id, 0);
+	if (!pi) {
+		MEM(pi = talloc_zero(request, tmpl_pair_index_t));
+
+		if (request_data_talloc_add(request, &tmpl_pair_index_id, 0, tmpl_pair_index_t, pi, true, false, false) < 0) {
+			talloc_free(pi);
+			return false;
+		}
+	}
+	idx = &pi->list[mid];
+
+	/*
+	 *	The list has changed since we last looked at it,
+	 *	so anything we knew about it is stale.
+	 */
+	if ((idx->list_ctx != ns->list_ctx) || (idx->generation != head->generation)) {
+		idx->list_ctx = ns->list_ctx;
+		idx->generation = head->generation;
+		idx->lookups = 0;
+		idx->built = false;
+		idx->unindexable = false;
+	}
+
+	if (!idx->built) {
+		if (idx->unindexable || (++idx->lookups < 2)) return false;
+
+		tmpl_pair_index_build(pi, idx, head);
+		if (!idx->built) return false;
+	}
+
+	/*
+	 *	Find the first entry for the da...
+	 */
+	lo = 0;
+	hi = idx->num;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if ((uintptr_t)idx->entries[mid].da < (uintptr_t)da) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	ns->start = lo;
+
+	/*
+	 *	...and the first entry after it.
+	 */
+	hi = idx->num;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if ((uintptr_t)idx->entries[mid].da <= (uintptr_t)da) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	ns->end = lo;
+
+	ns->pos = ns->start;
+	ns->index = idx;
+	ns->generation = head->generation;
+
+	return true;
+}
+
+/** Traverse a bucket of attributes in a list index
+ *
+ * A dcursor iterator function which behaves identically to #_tmpl_cursor_child_next,
+ * but only visits pairs of the attribute being searched for.
+ *
+ * If the list is modified (by the caller, or a build callback) the bucket may no
+ * longer reflect the list, so we go back to walking the list from curr.
+ *
+ * @param[in] list	being traversed.
+ * @param[in] curr	item in the list to start tests from.
+ * @param[in] uctx	Context for evaluation - in this instance a #tmpl_dcursor_nested_t
+ * @return
+ *	- the next matching attribute
+ *	- NULL if none found
+ */
+static void *_tmpl_cursor_index_next(fr_dlist_head_t *list, void *curr, void *uctx)
+{
+	tmpl_dcursor_nested_t		*ns = uctx;
+	tmpl_pair_index_entry_t const	*entries = ns->index->entries;
+	unsigned int			i;
+
+	if (unlikely(list->generation != ns->generation)) return _tmpl_cursor_child_next(list, curr, uctx);
+
+	if (!curr) {
+		i = ns->start;
+	} else if ((ns->pos < ns->end) && (entries[ns->pos].vp == curr)) {
+		i = ns->pos + 1;
+	/*
+	 *	The cursor peeked at the next pair
+	 *	without advancing.
+	 */
+	} else if ((ns->pos > ns->start) && (ns->pos <= ns->end) && (entries[ns->pos - 1].vp == curr)) {
+		i = ns->pos;
+	/*
+	 *	Cursor was pointed at a pair we
+	 *	didn't return.
+	 */
+	} else {
+		return _tmpl_cursor_child_next(list, curr, uctx);
+	}
+
+	if (i >= ns->end) return NULL;
+
+	ns->pos = i;
+	return entries[i].vp;
+}
+
 static inline CC_HINT(always_inline) void tmpl_cursor_nested_push(tmpl_dcursor_ctx_t *cc, tmpl_dcursor_nested_t *ns)
 {
 	fr_dlist_insert_tail(&cc->nested, ns);
@@ -100,7 +339,9 @@ void _tmpl_cursor_pair_init(TALLOC_CTX *list_ctx, fr_pair_list_t *list, tmpl_att
 	 *	Iterates over attributes of a specific type
 	 */
 	if (ar_is_normal(ar)) {
-		fr_pair_dcursor_iter_init(&ns->cursor, list, _tmpl_cursor_child_next, ns);
+		fr_pair_dcursor_iter_init(&ns->cursor, list,
+					  tmpl_pair_index_find(cc, ns, list) ? _tmpl_cursor_index_next : _tmpl_cursor_child_next,
+					  ns);
 	/*
 	 *	Iterates over all attributes at this level
 	 */
@@ -27,6 +27,7 @@ extern "C" {
 
 typedef struct tmpl_dcursor_ctx_s tmpl_dcursor_ctx_t;
 typedef struct tmpl_dcursor_nested_s tmpl_dcursor_nested_t;
+typedef struct tmpl_pair_index_list_s tmpl_pair_index_list_t;
 
 /** Callback function for populating missing pair
  *
@@ -53,6 +54,14 @@ struct tmpl_dcursor_nested_s {
 
 	fr_dcursor_t		cursor;		//!< Cursor to track where we are in the list in case
 						///< we're doing counts.
+
+	tmpl_pair_index_list_t	*index;		//!< Attribute index for the list, if we're iterating
+						///< over a bucket instead of walking the list.
+	unsigned int		generation;	//!< Of the list when we located the bucket.  If the
+						///< list changes we go back to walking it.
+	unsigned int		start;		//!< First entry in the bucket.
+	unsigned int		end;		//!< One past the last entry in the bucket.
+	unsigned int		pos;		//!< Entry we last returned.
 };
 
 /** Maintains state between cursor calls
@@ -46,6 +46,12 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 
 #include <openssl/ssl.h>
 #include <openssl/kdf.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#  include <openssl/core_names.h>
+#endif
+
+#include <pthread.h>
 
 /** Retrieve session ID (in binary form) from the session
  *
@@ -160,6 +166,228 @@ void _tls_cache_clear_state_reset(request_t *request, fr_tls_cache_t *cache, cha
 }
 #define tls_cache_clear_state_reset(_request, _cache) _tls_cache_clear_state_reset(_request, _cache, __FUNCTION__)
 
+/** Number of independently locked partitions in the in-memory cache
+ *
+ * Must be a power of two.
+ */
+#define TLS_CACHE_MEMORY_STRIPES	16
+
+/** A serialised session held in the in-memory cache
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< Entry in the stripe's LRU list.
+	fr_time_t		expires;		//!< When the session can no longer be resumed.
+	uint8_t			*id;			//!< Session ID.
+	size_t			id_len;			//!< Length of the session ID.
+	uint8_t			*data;			//!< Session serialised with i2d_SSL_SESSION.
+} tls_cache_memory_entry_t;
+
+/** One partition of the in-memory cache
+ *
+ * Each stripe has its own lock, so workers resuming different
+ * sessions rarely contend.
+ */
+typedef struct {
+	pthread_mutex_t		mutex;			//!< Protects everything in this stripe.
+	fr_hash_table_t		*ht;			//!< Session ID -> tls_cache_memory_entry_t.
+	fr_dlist_head_t		lru;			//!< Most recently used at the head.
+} tls_cache_memory_stripe_t;
+
+struct fr_tls_cache_memory_s {
+	uint32_t			max_per_stripe;	//!< Entries allowed in each stripe before we evict.
+	tls_cache_memory_stripe_t	stripe[TLS_CACHE_MEMORY_STRIPES];
+};
+
+static uint32_t tls_cache_memory_hash(void const *data)
+{
+	tls_cache_memory_entry_t const *entry = data;
+
+	return fr_hash(entry->id, entry->id_len);
+}
+
+static int8_t tls_cache_memory_cmp(void const *one, void const *two)
+{
+	tls_cache_memory_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->id_len, b->id_len);
+	if (ret != 0) return ret;
+
+	ret = memcmp(a->id, b->id, a->id_len);
+	return CMP(ret, 0);
+}
+
+static inline CC_HINT(always_inline)
+tls_cache_memory_stripe_t *tls_cache_memory_stripe(fr_tls_cache_memory_t *mem, uint8_t const *id, size_t id_len)
+{
+	return &mem->stripe[fr_hash(id, id_len) & (TLS_CACHE_MEMORY_STRIPES - 1)];
+}
+
+/** Unlink and free an entry, the stripe must be locked
+ *
+ */
+static inline CC_HINT(always_inline)
+void tls_cache_memory_entry_free(tls_cache_memory_stripe_t *stripe, tls_cache_memory_entry_t *entry)
+{
+	fr_hash_table_remove(stripe->ht, entry);
+	fr_dlist_remove(&stripe->lru, entry);
+	talloc_free(entry);
+}
+
+/** Add a serialised session to the in-memory cache, replacing any existing entry with the same ID
+ *
+ * @param[in] mem	In-memory cache.
+ * @param[in] id	Session ID.
+ * @param[in] id_len	Length of the session ID.
+ * @param[in] data	Serialised session.
+ * @param[in] data_len	Length of the serialised session.
+ * @param[in] expires	When the session expires.
+ */
+static void tls_cache_memory_insert(fr_tls_cache_memory_t *mem,
+				    uint8_t const *id, size_t id_len,
+				    uint8_t const *data, size_t data_len, fr_time_t expires)
+{
+	tls_cache_memory_stripe_t	*stripe = tls_cache_memory_stripe(mem, id, id_len);
+	tls_cache_memory_entry_t	*entry, find = { .id = UNCONST(uint8_t *, id), .id_len = id_len };
+
+	pthread_mutex_lock(&stripe->mutex);
+	entry = fr_hash_table_find(stripe->ht, &find);
+	if (entry) tls_cache_memory_entry_free(stripe, entry);
+
+	/*
+	 *	Evict the least recently used session.
+	 */
+	if (fr_dlist_num_elements(&stripe->lru) >= mem->max_per_stripe) {
+		tls_cache_memory_entry_free(stripe, fr_dlist_tail(&stripe->lru));
+	}
+
+	/*
+	 *	Entries are parented by the hash table, which
+	 *	is only ever touched with the stripe locked.
+	 */
+	MEM(entry = talloc_zero(stripe->ht, tls_cache_memory_entry_t));
+	MEM(entry->id = talloc_memdup(entry, id, id_len));
+	entry->id_len = id_len;
+	MEM(entry->data = talloc_memdup(entry, data, data_len));
+	entry->expires = expires;
+
+	if (!fr_hash_table_insert(stripe->ht, entry)) {
+		talloc_free(entry);
+	} else {
+		fr_dlist_insert_head(&stripe->lru, entry);
+	}
+	pthread_mutex_unlock(&stripe->mutex);
+}
+
+/** Retrieve and deserialise a session from the in-memory cache
+ *
+ * @param[in] request	The current request.
+ * @param[in] mem	In-memory cache.
+ * @param[in] id	Session ID.
+ * @param[in] id_len	Length of the session ID.
+ * @return
+ *	- A new SSL_SESSION on hit.
+ *	- NULL if the session wasn't found, had expired, or couldn't be deserialised.
+ */
+static SSL_SESSION *tls_cache_memory_load(request_t *request, fr_tls_cache_memory_t *mem,
+					  uint8_t const *id, size_t id_len)
+{
+	tls_cache_memory_stripe_t	*stripe = tls_cache_memory_stripe(mem, id, id_len);
+	tls_cache_memory_entry_t	*entry, find = { .id = UNCONST(uint8_t *, id), .id_len = id_len };
+	SSL_SESSION			*sess = NULL;
+	uint8_t const			*p;
+
+	pthread_mutex_lock(&stripe->mutex);
+	entry = fr_hash_table_find(stripe->ht, &find);
+	if (!entry) goto done;
+
+	if (fr_time_lteq(entry->expires, fr_time())) {
+		RDEBUG3("Session ID %pV - In-memory session has expired", fr_box_octets(id, id_len));
+		tls_cache_memory_entry_free(stripe, entry);
+		goto done;
+	}
+
+	p = entry->data;	/* openssl will mutate p */
+	sess = d2i_SSL_SESSION(NULL, &p, talloc_array_length(entry->data));
+	if (!sess) {
+		fr_tls_log(request, "Failed loading in-memory session");
+		tls_cache_memory_entry_free(stripe, entry);
+		goto done;
+	}
+
+	fr_dlist_remove(&stripe->lru, entry);
+	fr_dlist_insert_head(&stripe->lru, entry);
+
+done:
+	pthread_mutex_unlock(&stripe->mutex);
+
+	return sess;
+}
+
+/** Remove a session from the in-memory cache
+ *
+ * @param[in] mem	In-memory cache.
+ * @param[in] id	Session ID.
+ * @param[in] id_len	Length of the session ID.
+ */
+static void tls_cache_memory_remove(fr_tls_cache_memory_t *mem, uint8_t const *id, size_t id_len)
+{
+	tls_cache_memory_stripe_t	*stripe = tls_cache_memory_stripe(mem, id, id_len);
+	tls_cache_memory_entry_t	*entry, find = { .id = UNCONST(uint8_t *, id), .id_len = id_len };
+
+	pthread_mutex_lock(&stripe->mutex);
+	entry = fr_hash_table_find(stripe->ht, &find);
+	if (entry) tls_cache_memory_entry_free(stripe, entry);
+	pthread_mutex_unlock(&stripe->mutex);
+}
+
+static int _tls_cache_memory_free(fr_tls_cache_memory_t *mem)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_ELEMENTS(mem->stripe); i++) pthread_mutex_destroy(&mem->stripe[i].mutex);
+
+	return 0;
+}
+
+/** Allocate an in-memory session cache
+ *
+ * The cache is allocated once per TLS configuration, and shared
+ * by the SSL_CTX of every worker using that configuration.
+ *
+ * @param[in] ctx		to allocate the cache in.
+ * @param[in] max_entries	Maximum number of sessions to hold.
+ * @return
+ *	- A new in-memory cache on success.
+ *	- NULL on failure.
+ */
+fr_tls_cache_memory_t *fr_tls_cache_memory_alloc(TALLOC_CTX *ctx, uint32_t max_entries)
+{
+	fr_tls_cache_memory_t	*mem;
+	size_t			i;
+
+	MEM(mem = talloc_zero(ctx, fr_tls_cache_memory_t));
+
+	mem->max_per_stripe = (max_entries + TLS_CACHE_MEMORY_STRIPES - 1) / TLS_CACHE_MEMORY_STRIPES;
+
+	for (i = 0; i < NUM_ELEMENTS(mem->stripe); i++) {
+		tls_cache_memory_stripe_t *stripe = &mem->stripe[i];
+
+		stripe->ht = fr_hash_table_alloc(mem, tls_cache_memory_hash, tls_cache_memory_cmp, NULL);
+		if (!stripe->ht) {
+			while (i-- > 0) pthread_mutex_destroy(&mem->stripe[i].mutex);
+			talloc_free(mem);
+			return NULL;
+		}
+		fr_dlist_talloc_init(&stripe->lru, tls_cache_memory_entry_t, entry);
+		pthread_mutex_init(&stripe->mutex, NULL);
+	}
+	talloc_set_destructor(mem, _tls_cache_memory_free);
+
+	return mem;
+}
+
 /** Serialize the session-state list and store it in the SSL_SESSION *
  *
  */
@@ -470,6 +698,50 @@ static unlang_action_t tls_cache_store_result(UNUSED rlm_rcode_t *p_result, UNUS
 	return UNLANG_ACTION_CALCULATE_RESULT;
 }
 
+/** Serialise a session so it can be stored
+ *
+ * @param[in] ctx		to allocate the buffer in.
+ * @param[in] request		The current request.
+ * @param[in] sess		to serialise.
+ * @return
+ *	- A talloced buffer containing the ASN.1 encoded session.
+ *	- NULL on failure.
+ */
+static uint8_t *tls_cache_serialise(TALLOC_CTX *ctx, request_t *request, SSL_SESSION *sess)
+{
+	int			len, ret;
+	uint8_t			*p, *data;
+
+	len = i2d_SSL_SESSION(sess, NULL);	/* find out what length data we need */
+	if (len < 1) {
+		fr_value_box_t	id;
+ 		fr_tls_cache_id_to_box_shallow(&id, sess);
+
+		/* something went wrong */
+		fr_tls_strerror_printf(NULL);	/* Drain the OpenSSL error stack */
+		RPWDEBUG("Session ID %pV - Serialisation failed, couldn't determine "
+			 "required buffer length", &id);
+		return NULL;
+	}
+
+	MEM(data = talloc_array(ctx, uint8_t, len));
+
+	/* openssl mutates &p */
+	p = data;
+	ret = i2d_SSL_SESSION(sess, &p);	/* Serialize as ASN.1 */
+	if (ret != len) {
+		fr_value_box_t	id;
+ 		fr_tls_cache_id_to_box_shallow(&id, sess);
+
+		fr_tls_strerror_printf(NULL);	/* Drain the OpenSSL error stack */
+		RPWDEBUG("Session ID %pV - Serialisation failed", &id);
+		talloc_free(data);
+		return NULL;
+	}
+
+	return data;
+}
+
 /** Push a `session store { ... }` call into the current request, using a subrequest
  *
  * @param[in] request		The current request.
@@ -484,9 +756,7 @@ static inline CC_HINT(always_inline)
 unlang_action_t tls_cache_store_push(request_t *request, fr_tls_conf_t *conf, fr_tls_session_t *tls_session)
 {
 	fr_tls_cache_t		*tls_cache = tls_session->cache;
-	size_t			len, ret;
-
-	uint8_t			*p, *data = NULL;
+	uint8_t			*data;
 
 	request_t		*child;
 	fr_pair_t		*vp;
@@ -512,6 +782,34 @@ unlang_action_t tls_cache_store_push(request_t *request, fr_tls_conf_t *conf, fr
 	 */
 	if (tls_cache_app_data_set(request, sess) < 0) return UNLANG_ACTION_FAIL;
 
+	/*
+	 *	Serialize the session
+	 */
+	data = tls_cache_serialise(NULL, request, sess);
+	if (!data) {
+		tls_cache_store_state_reset(request, tls_cache);
+		return UNLANG_ACTION_FAIL;
+	}
+
+	/*
+	 *	Make the session available to all workers
+	 *	without a round trip through the virtual server.
+	 */
+	if (conf->cache.memory) {
+		unsigned int	id_len;
+		uint8_t const	*id = SSL_SESSION_get_id(sess, &id_len);
+
+		tls_cache_memory_insert(conf->cache.memory, id, id_len, data, talloc_array_length(data), expires);
+		RDEBUG3("Session ID %pV - Stored in memory", fr_box_octets(id, id_len));
+
+		if (!conf->virtual_server) {
+			talloc_free(data);
+			tls_cache_store_state_reset(request, tls_cache);
+			tls_cache->store.state = FR_TLS_CACHE_STORE_PERSISTED;
+			return UNLANG_ACTION_CALCULATE_RESULT;
+		}
+	}
+
 	MEM(child = unlang_subrequest_alloc(request, dict_tls));
 	request = child;
 
@@ -535,47 +833,19 @@ unlang_action_t tls_cache_store_push(request_t *request, fr_tls_conf_t *conf, fr
 	MEM(pair_update_request(&vp, attr_tls_session_ttl) >= 0);
 	vp->vp_time_delta = fr_time_sub(expires, now);
 
-	/*
-	 *	Serialize the session
-	 */
-	len = i2d_SSL_SESSION(sess, NULL);	/* find out what length data we need */
-	if (len < 1) {
-		fr_value_box_t	id;
- 		fr_tls_cache_id_to_box_shallow(&id, sess);
-
-		/* something went wrong */
-		fr_tls_strerror_printf(NULL);	/* Drain the OpenSSL error stack */
-		RPWDEBUG("Session ID %pV - Serialisation failed, couldn't determine "
-			 "required buffer length", &id);
-	error:
-		tls_cache_store_state_reset(request, tls_cache);
-		talloc_free(child);
-		return UNLANG_ACTION_FAIL;
-	}
-
 	MEM(pair_update_request(&vp, attr_tls_session_data) >= 0);
-	MEM(data = talloc_array(vp, uint8_t, len));
-
-	/* openssl mutates &p */
-	p = data;
-	ret = i2d_SSL_SESSION(sess, &p);	/* Serialize as ASN.1 */
-	if (ret != len) {
-		fr_value_box_t	id;
- 		fr_tls_cache_id_to_box_shallow(&id, sess);
-
-		fr_tls_strerror_printf(NULL);	/* Drain the OpenSSL error stack */
-		RPWDEBUG("Session ID %pV - Serialisation failed", &id);
-		talloc_free(data);
-		goto error;
-	}
-	fr_pair_value_memdup_buffer_shallow(vp, data, true);
+	fr_pair_value_memdup_buffer_shallow(vp, talloc_steal(vp, data), true);
 
 	/*
 	 *	Allocate a child, and set it up to call
 	 *      the TLS virtual server.
 	 */
 	ua = fr_tls_call_push(child, tls_cache_store_result, conf, tls_session);
-	if (ua < 0) goto error;
+	if (ua < 0) {
+		tls_cache_store_state_reset(request, tls_cache);
+		talloc_free(child);
+		return UNLANG_ACTION_FAIL;
+	}
 
 	return ua;
 }
@@ -623,6 +893,14 @@ unlang_action_t tls_cache_clear_push(request_t *request, fr_tls_conf_t *conf, fr
 	fr_assert(tls_cache->clear.state == FR_TLS_CACHE_CLEAR_REQUESTED);
 	fr_assert(tls_cache->clear.id);
 
+	if (conf->cache.memory) {
+		tls_cache_memory_remove(conf->cache.memory, tls_cache->clear.id, talloc_array_length(tls_cache->clear.id));
+		if (!conf->virtual_server) {
+			tls_cache_clear_state_reset(request, tls_cache);
+			return UNLANG_ACTION_CALCULATE_RESULT;
+		}
+	}
+
 	MEM(child = unlang_subrequest_alloc(request, dict_tls));
 	request = child;
 
@@ -772,11 +1050,13 @@ static SSL_SESSION *tls_cache_load_cb(SSL *ssl,
 {
 	fr_tls_session_t	*tls_session;
 	fr_tls_cache_t		*tls_cache;
+	fr_tls_conf_t		*conf;
 	request_t		*request;
 
 	tls_session = fr_tls_session(ssl);
 	request = fr_tls_session_request(tls_session->ssl);
 	tls_cache = tls_session->cache;
+	conf = fr_tls_session_conf(ssl);
 
 	/*
 	 *	Request was cancelled, don't return any session and hopefully
@@ -807,6 +1087,32 @@ again:
 	case FR_TLS_CACHE_LOAD_INIT:
 		fr_assert(!tls_cache->load.id);
 
+		/*
+		 *	Another worker may already have stored this
+		 *	session in memory, in which case we can skip
+		 *	`session load { ... }` entirely.
+		 */
+		if (conf->cache.memory) {
+			SSL_SESSION *sess;
+
+			sess = tls_cache_memory_load(request, conf->cache.memory, key, key_len);
+			if (sess) {
+				RDEBUG3("Session ID %pV - Found in memory", fr_box_octets(key, key_len));
+
+				SSL_SESSION_set_ex_data(sess, FR_TLS_EX_INDEX_TLS_SESSION, tls_session);
+
+				MEM(tls_cache->load.id = talloc_typed_memdup(tls_cache, (uint8_t const *)key, key_len));
+				tls_cache->load.sess = sess;
+				tls_cache->load.state = FR_TLS_CACHE_LOAD_RETRIEVED;
+				goto again;
+			}
+
+			if (!conf->virtual_server) {
+				RDEBUG3("Session ID %pV - Not found in memory", fr_box_octets(key, key_len));
+				return NULL;
+			}
+		}
+
 		tls_cache->load.state = FR_TLS_CACHE_LOAD_REQUESTED;
 		MEM(tls_cache->load.id = talloc_typed_memdup(tls_cache, (uint8_t const *)key, key_len));
 
@@ -881,6 +1187,12 @@ again:
 			return NULL;
 		}
 
+		/*
+		 *	Without a virtual server there's nothing to
+		 *	re-validate the certificate with.
+		 */
+		if (!conf->virtual_server) goto resume;
+
 		/*
 		 *	This sets the validation state of the tls_session
 		 *	so that when we call ASYNC_pause_job(), and execution
@@ -922,6 +1234,8 @@ again:
 			RDEBUG2("Certificate re-validation failed, denying session resumption via session-id");
 			goto verify_error;
 		}
+
+	resume:
 		sess = tls_cache->load.sess;
 
 		/*
@@ -1354,6 +1668,169 @@ static SSL_TICKET_RETURN tls_cache_session_ticket_app_data_get(SSL *ssl, SSL_SES
 	return (status == SSL_TICKET_SUCCESS_RENEW) ? SSL_TICKET_RETURN_USE_RENEW : SSL_TICKET_RETURN_USE;
 }
 
+/** Derive session ticket key material from the configured session_ticket_key
+ *
+ * @param[out] out		Where to write the derived key material.
+ * @param[in] out_len		How much key material to derive.
+ * @param[in] cache_conf	containing the session_ticket_key.
+ * @param[in] epoch		Rotation period to derive keys for.
+ *				Ignored if key rotation is disabled.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int tls_cache_ticket_key_derive(uint8_t *out, size_t out_len,
+				       fr_tls_cache_conf_t const *cache_conf, uint64_t epoch)
+{
+	EVP_PKEY_CTX	*pkey_ctx = NULL;
+	uint8_t		epoch_buff[sizeof(uint64_t)];
+
+	if (unlikely((pkey_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL)) == NULL)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed initialising KDF");
+	error:
+		if (pkey_ctx) EVP_PKEY_CTX_free(pkey_ctx);
+		return -1;
+	}
+	if (unlikely(EVP_PKEY_derive_init(pkey_ctx) != 1)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed initialising KDF derivation ctx");
+		goto error;
+	}
+	if (unlikely(EVP_PKEY_CTX_set_hkdf_md(pkey_ctx, UNCONST(struct evp_md_st *, EVP_sha256())) != 1)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed setting KDF MD");
+		goto error;
+	}
+	if (unlikely(EVP_PKEY_CTX_set1_hkdf_key(pkey_ctx,
+						UNCONST(unsigned char *, cache_conf->session_ticket_key),
+						talloc_array_length(cache_conf->session_ticket_key)) != 1)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed setting KDF key");
+		goto error;
+	}
+	if (unlikely(EVP_PKEY_CTX_add1_hkdf_info(pkey_ctx,
+						 UNCONST(unsigned char *, "freeradius-session-ticket"),
+						 sizeof("freeradius-session-ticket") - 1) != 1)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed setting KDF label");
+		goto error;
+	}
+
+	/*
+	 *	Mix in the epoch so that every worker, and every
+	 *	server sharing the session_ticket_key, derives
+	 *	the same keys for the same period.
+	 */
+	if (fr_time_delta_ispos(cache_conf->session_ticket_key_rotation)) {
+		fr_nbo_from_uint64(epoch_buff, epoch);
+		if (unlikely(EVP_PKEY_CTX_add1_hkdf_info(pkey_ctx, epoch_buff, sizeof(epoch_buff)) != 1)) {
+			fr_tls_strerror_printf(NULL);
+			PERROR("Failed setting KDF epoch");
+			goto error;
+		}
+	}
+
+	if (EVP_PKEY_derive(pkey_ctx, out, &out_len) != 1) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed deriving session ticket key");
+		goto error;
+	}
+	EVP_PKEY_CTX_free(pkey_ctx);
+
+	return 0;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+/** Session ticket keys for a single rotation period
+ *
+ */
+typedef struct {
+	fr_tls_cache_conf_t const	*cache_conf;		//!< Configuration the keys were derived from.
+	uint64_t			epoch;			//!< Rotation period the keys are valid for.
+
+	uint8_t				name[16];		//!< Identifies the keys in the ticket.
+	uint8_t				hmac_key[32];		//!< Authenticates the ticket.
+	uint8_t				aes_key[32];		//!< Encrypts the ticket.
+} tls_cache_ticket_key_t;
+
+/** Keys for the current and previous rotation periods, indexed by (epoch & 0x01)
+ *
+ * Keys are a pure function of the session_ticket_key and the epoch, so
+ * each worker derives its own copy, and they all agree without locking.
+ */
+static _Thread_local tls_cache_ticket_key_t tls_cache_ticket_keys[2];
+
+/** Retrieve (deriving if needed) the session ticket keys for a given epoch
+ *
+ */
+static tls_cache_ticket_key_t *tls_cache_ticket_key(fr_tls_cache_conf_t const *cache_conf, uint64_t epoch)
+{
+	tls_cache_ticket_key_t	*key = &tls_cache_ticket_keys[epoch & 0x01];
+	uint8_t			buff[sizeof(key->name) + sizeof(key->hmac_key) + sizeof(key->aes_key)];
+
+	if ((key->cache_conf == cache_conf) && (key->epoch == epoch)) return key;
+
+	if (tls_cache_ticket_key_derive(buff, sizeof(buff), cache_conf, epoch) < 0) return NULL;
+
+	memcpy(key->name, buff, sizeof(key->name));
+	memcpy(key->hmac_key, buff + sizeof(key->name), sizeof(key->hmac_key));
+	memcpy(key->aes_key, buff + sizeof(key->name) + sizeof(key->hmac_key), sizeof(key->aes_key));
+	key->cache_conf = cache_conf;
+	key->epoch = epoch;
+
+	return key;
+}
+
+/** Encrypt or decrypt a session ticket using keys for the current rotation period
+ *
+ * Tickets issued during the previous period are still accepted, but
+ * are renewed so the client receives one encrypted with the current keys.
+ *
+ * @return
+ *	- -1 on error.
+ *	- 0 if no keys match the ticket (full handshake).
+ *	- 1 on success.
+ *	- 2 on success, with the ticket to be renewed.
+ */
+static int tls_cache_ticket_key_cb(SSL *ssl, unsigned char key_name[16], unsigned char iv[EVP_MAX_IV_LENGTH],
+				   EVP_CIPHER_CTX *cipher_ctx, EVP_MAC_CTX *mac_ctx, int enc)
+{
+	fr_tls_cache_conf_t const	*cache_conf = &fr_tls_session_conf(ssl)->cache;
+	uint64_t			epoch;
+	tls_cache_ticket_key_t		*key;
+	OSSL_PARAM			params[3];
+	size_t				i;
+
+	epoch = (uint64_t)time(NULL) / fr_time_delta_to_sec(cache_conf->session_ticket_key_rotation);
+
+	if (enc) {
+		key = tls_cache_ticket_key(cache_conf, epoch);
+		if (!key) return -1;
+
+		memcpy(key_name, key->name, sizeof(key->name));
+		if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1) return -1;
+		if (EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key->aes_key, iv) != 1) return -1;
+		i = 1;
+	} else {
+		for (i = 1; i <= 2; i++) {
+			key = tls_cache_ticket_key(cache_conf, epoch - (i - 1));
+			if (!key) return -1;
+			if (memcmp(key_name, key->name, sizeof(key->name)) == 0) break;
+		}
+		if (i > 2) return 0;
+		if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key->aes_key, iv) != 1) return -1;
+	}
+
+	params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key->hmac_key, sizeof(key->hmac_key));
+	params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, UNCONST(char *, "SHA256"), 0);
+	params[2] = OSSL_PARAM_construct_end();
+	if (EVP_MAC_CTX_set_params(mac_ctx, params) != 1) return -1;
+
+	return (int)i;
+}
+#endif
+
 /** Sets callbacks and flags on a SSL_CTX to enable/disable session resumption
  *
  * @param[in] ctx			to modify.
@@ -1406,10 +1883,28 @@ int fr_tls_cache_ctx_init(SSL_CTX *ctx, fr_tls_cache_conf_t const *cache_conf)
 	{
 		size_t key_len;
 		uint8_t *key_buff;
-		EVP_PKEY_CTX *pkey_ctx = NULL;
 
 		if (!(cache_conf->mode & FR_TLS_CACHE_STATEFUL)) tls_cache_disable_statefull_resumption(ctx);
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		/*
+		 *	Keys are derived per rotation period when
+		 *	tickets are issued or presented.
+		 */
+		if (fr_time_delta_ispos(cache_conf->session_ticket_key_rotation)) {
+			if (unlikely(SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, tls_cache_ticket_key_cb) != 1)) {
+				fr_tls_strerror_printf(NULL);
+				PERROR("Failed setting session ticket key callback");
+				return -1;
+			}
+			goto ticket_cb;
+		}
+#else
+		if (fr_time_delta_ispos(cache_conf->session_ticket_key_rotation)) {
+			WARN("session_ticket_key_rotation requires OpenSSL >= 3.0, keys will not be rotated");
+		}
+#endif
+
 		/*
 		 *	If keys is NULL, then OpenSSL returns the expected
 		 *	key length, which may be different across different
@@ -1421,53 +1916,16 @@ int fr_tls_cache_ctx_init(SSL_CTX *ctx, fr_tls_cache_conf_t const *cache_conf)
 		 */
 		key_len = SSL_CTX_set_tlsext_ticket_keys(ctx, NULL, 0);
 
-		if (unlikely((pkey_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL)) == NULL)) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed initialising KDF");
-		kdf_error:
-			if (pkey_ctx) EVP_PKEY_CTX_free(pkey_ctx);
-			return -1;
-		}
-		if (unlikely(EVP_PKEY_derive_init(pkey_ctx) != 1)) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed initialising KDF derivation ctx");
-			goto kdf_error;
-		}
-		if (unlikely(EVP_PKEY_CTX_set_hkdf_md(pkey_ctx, UNCONST(struct evp_md_st *, EVP_sha256())) != 1)) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed setting KDF MD");
-			goto kdf_error;
-		}
-		if (unlikely(EVP_PKEY_CTX_set1_hkdf_key(pkey_ctx,
-							UNCONST(unsigned char *, cache_conf->session_ticket_key),
-							talloc_array_length(cache_conf->session_ticket_key)) != 1)) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed setting KDF key");
-			goto kdf_error;
-		}
-		if (unlikely(EVP_PKEY_CTX_add1_hkdf_info(pkey_ctx,
-							 UNCONST(unsigned char *, "freeradius-session-ticket"),
-							 sizeof("freeradius-session-ticket") - 1) != 1)) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed setting KDF label");
-			goto kdf_error;
-		}
-
 		/*
 		 *	SSL_CTX_set_tlsext_ticket_keys memcpys its
 		 *	inputs so this is just a temporary buffer.
 		 */
 		MEM(key_buff = talloc_array(NULL, uint8_t, key_len));
-		if (EVP_PKEY_derive(pkey_ctx, key_buff, &key_len) != 1) {
-			fr_tls_strerror_printf(NULL);
-			PERROR("Failed deriving session ticket key");
-
+		if (tls_cache_ticket_key_derive(key_buff, key_len, cache_conf, 0) < 0) {
 			talloc_free(key_buff);
-			goto kdf_error;
+			return -1;
 		}
-		EVP_PKEY_CTX_free(pkey_ctx);
 
-		fr_assert(talloc_array_length(key_buff) == key_len);
 		/*
 		 *	Ensure the same keys are used across all threads
 		 */
@@ -1475,6 +1933,7 @@ int fr_tls_cache_ctx_init(SSL_CTX *ctx, fr_tls_cache_conf_t const *cache_conf)
 						   key_buff, key_len) != 1) {
 			fr_tls_strerror_printf(NULL);
 			PERROR("Failed setting session ticket keys");
+			talloc_free(key_buff);
 			return -1;
 		}
 
@@ -1482,6 +1941,9 @@ int fr_tls_cache_ctx_init(SSL_CTX *ctx, fr_tls_cache_conf_t const *cache_conf)
 		HEXDUMP3(key_buff, key_len, NULL);
 		talloc_free(key_buff);
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	ticket_cb:
+#endif
 		/*
 		 *	These callbacks embed and extract the
 		 *	session-state list from the session-ticket.
@@ -91,6 +91,11 @@ typedef struct {
 	} clear;
 } fr_tls_cache_t;
 
+/** In-memory session cache shared between all workers
+ *
+ */
+typedef struct fr_tls_cache_memory_s fr_tls_cache_memory_t;
+
 #ifdef __cplusplus
 }
 #endif
@@ -113,6 +118,8 @@ void		fr_tls_cache_session_alloc(fr_tls_session_t *tls_session);
 
 int		fr_tls_cache_ctx_init(SSL_CTX *ctx, fr_tls_cache_conf_t const *cache_conf);
 
+fr_tls_cache_memory_t	*fr_tls_cache_memory_alloc(TALLOC_CTX *ctx, uint32_t max_entries);
+
 #ifdef __cplusplus
 }
 #endif
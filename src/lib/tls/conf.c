@@ -81,6 +81,12 @@ static fr_table_num_sorted_t const verify_mode_table[] = {
 static size_t verify_mode_table_len = NUM_ELEMENTS(verify_mode_table);
 
 static conf_parser_t tls_cache_config[] = {
+	/*
+	 *	Must be parsed before "mode", as it changes
+	 *	whether a virtual_server is required.
+	 */
+	{ FR_CONF_OFFSET("memory_max_entries", fr_tls_cache_conf_t, memory_max_entries), .dflt = "0" },
+
 	{ FR_CONF_OFFSET("mode", fr_tls_cache_conf_t, mode),
 			 .func = tls_conf_parse_cache_mode,
 			 .uctx = &(cf_table_parse_ctx_t){
@@ -98,6 +104,7 @@ static conf_parser_t tls_cache_config[] = {
 #endif
 
 	{ FR_CONF_OFFSET("session_ticket_key", fr_tls_cache_conf_t, session_ticket_key) },
+	{ FR_CONF_OFFSET("session_ticket_key_rotation", fr_tls_cache_conf_t, session_ticket_key_rotation), .dflt = "0" },
 
 	/*
 	 *	Deprecated
@@ -263,7 +270,9 @@ static int tls_conf_parse_cache_mode(TALLOC_CTX *ctx, void *out, void *parent, C
 
 	case FR_TLS_CACHE_STATEFUL:
 		if (!conf->virtual_server) {
-			cf_log_err(ci, "A virtual_server must be set when cache.mode = \"stateful\"");
+			if (conf->cache.memory_max_entries > 0) goto check_version;
+
+			cf_log_err(ci, "A virtual_server or memory_max_entries must be set when cache.mode = \"stateful\"");
 		error:
 			return -1;
 		}
@@ -286,6 +295,7 @@ static int tls_conf_parse_cache_mode(TALLOC_CTX *ctx, void *out, void *parent, C
 			goto error;
 		}
 
+	check_version:
 		if (conf->tls_min_version >= (float)1.3) {
 			cf_log_err(ci, "cache.mode = \"stateful\" is not supported with tls_min_version >= 1.3");
 			goto error;
@@ -293,6 +303,12 @@ static int tls_conf_parse_cache_mode(TALLOC_CTX *ctx, void *out, void *parent, C
 		break;
 
 	case FR_TLS_CACHE_AUTO:
+		/*
+		 *	The in-memory cache is enough for stateful
+		 *	resumption on its own.
+		 */
+		if (!conf->virtual_server && (conf->cache.memory_max_entries > 0)) break;
+
 		if (!conf->virtual_server) {
 			WARN("A virtual_server must be provided for stateful caching. "
 			     "cache.mode = \"auto\" rewritten to cache.mode = \"stateless\"");
@@ -482,9 +498,7 @@ fr_tls_conf_t *fr_tls_conf_parse_server(CONF_SECTION *cs)
 
 	if ((cf_section_parse(conf, conf, cs) < 0) ||
 	    (cf_section_parse_pass2(conf, cs) < 0)) {
-#ifdef __APPLE__
 	error:
-#endif
 		talloc_free(conf);
 		return NULL;
 	}
@@ -496,6 +510,23 @@ fr_tls_conf_t *fr_tls_conf_parse_server(CONF_SECTION *cs)
 
 	FR_INTEGER_BOUND_CHECK("padding", conf->padding_block_size, <=, SSL3_RT_MAX_PLAIN_LENGTH);
 
+	if (fr_time_delta_ispos(conf->cache.session_ticket_key_rotation)) {
+		FR_TIME_DELTA_BOUND_CHECK("session.session_ticket_key_rotation",
+					  conf->cache.session_ticket_key_rotation, >=, fr_time_delta_from_sec(60));
+	}
+
+	/*
+	 *	Allocated here rather than per-thread so that
+	 *	every worker's SSL_CTX shares the same cache.
+	 */
+	if ((conf->cache.mode & FR_TLS_CACHE_STATEFUL) && (conf->cache.memory_max_entries > 0)) {
+		conf->cache.memory = fr_tls_cache_memory_alloc(conf, conf->cache.memory_max_entries);
+		if (!conf->cache.memory) {
+			ERROR("Failed allocating in-memory session cache");
+			goto error;
+		}
+	}
+
 #ifdef __APPLE__
 	if (conf_cert_admin_password(conf) < 0) goto error;
 #endif
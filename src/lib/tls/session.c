@@ -68,6 +68,23 @@ static char const *tls_version_str[] = {
 #endif
 };
 
+/** Per-thread handshake statistics
+ *
+ */
+typedef struct {
+	fr_time_t		started;			//!< When the first handshake on this thread started.
+	uint64_t		handshakes;			//!< Completed handshakes.
+	uint64_t		resumed;			//!< Of which were session resumptions.
+	uint64_t		crypto_waits;			//!< Times a handshake yielded to an async crypto provider.
+	fr_time_delta_t		stall;				//!< Time spent inside OpenSSL by this worker.
+	fr_time_delta_t		crypto_wait;			//!< Time handshakes spent yielded, waiting on crypto.
+} tls_session_stats_t;
+
+/** Handshake statistics for this worker thread
+ *
+ */
+static _Thread_local tls_session_stats_t tls_session_stats;
+
 static char const *tls_content_type_str[] = {
 	[SSL3_RT_CHANGE_CIPHER_SPEC]		= "change_cipher_spec",
 	[SSL3_RT_ALERT]				= "alert",
@@ -1177,6 +1194,19 @@ static unlang_action_t tls_session_async_handshake_done_round(UNUSED rlm_rcode_t
 
 		RDEBUG2("Cipher suite: %s", cipher_desc_clean);
 
+		tls_session_stats.handshakes++;
+		if (SSL_session_reused(tls_session->ssl)) tls_session_stats.resumed++;
+
+		RDEBUG2("Handshake took %pVs, of which %pVs was spent in OpenSSL",
+			fr_box_time_delta(fr_time_sub(fr_time(), tls_session->handshake_start)),
+			fr_box_time_delta(tls_session->handshake_stall));
+		RDEBUG3("Worker has completed %" PRIu64 " handshakes (%" PRIu64 " resumed, %.1f/s), "
+			"spent %pVs in OpenSSL, and waited %" PRIu64 " times (%pVs) for async crypto",
+			tls_session_stats.handshakes, tls_session_stats.resumed,
+			tls_session_stats.handshakes / (fr_time_delta_unwrap(fr_time_sub(fr_time(), tls_session_stats.started)) / (double)NSEC),
+			fr_box_time_delta(tls_session_stats.stall),
+			tls_session_stats.crypto_waits, fr_box_time_delta(tls_session_stats.crypto_wait));
+
 		RDEBUG2("Adding TLS session information to request");
 		vp = fr_pair_afrom_da(request->session_state_ctx, attr_tls_session_cipher_suite);
 		if (vp) {
@@ -1280,6 +1310,132 @@ static unlang_action_t tls_session_async_handshake_done_round(UNUSED rlm_rcode_t
 	return UNLANG_ACTION_CALCULATE_RESULT;
 }
 
+/** A handshake yielded while an async crypto provider does the expensive work
+ *
+ */
+typedef struct {
+	fr_tls_session_t	*tls_session;		//!< Session waiting on the provider.
+	request_t		*request;		//!< Request to resume.
+	fr_time_t		started;		//!< When we started waiting.
+	fr_event_timer_t const	*ev;			//!< Poll timer, if the provider has no wait fds.
+} tls_crypto_wait_t;
+
+/** Call SSL_read(), recording how long the worker was blocked for
+ *
+ */
+static inline CC_HINT(always_inline) int tls_session_ssl_read(fr_tls_session_t *tls_session)
+{
+	fr_time_t	start = fr_time();
+	fr_time_delta_t	stall;
+	int		ret;
+
+	ret = SSL_read(tls_session->ssl, tls_session->clean_out.data + tls_session->clean_out.used,
+		       sizeof(tls_session->clean_out.data) - tls_session->clean_out.used);
+
+	stall = fr_time_sub(fr_time(), start);
+	tls_session->handshake_stall = fr_time_delta_add(tls_session->handshake_stall, stall);
+	tls_session_stats.stall = fr_time_delta_add(tls_session_stats.stall, stall);
+
+	return ret;
+}
+
+/** The async crypto provider has finished, resume the handshake
+ *
+ */
+static void tls_session_async_crypto_resume(tls_crypto_wait_t *wait)
+{
+	request_t		*request = wait->request;
+	fr_tls_session_t	*tls_session = wait->tls_session;
+
+	tls_session_stats.crypto_wait = fr_time_delta_add(tls_session_stats.crypto_wait,
+							  fr_time_sub(fr_time(), wait->started));
+
+	RDEBUG3("Async crypto operation complete, resuming handshake");
+
+	TALLOC_FREE(tls_session->crypto_wait);	/* Removes the events */
+
+	unlang_interpret_mark_runnable(request);
+}
+
+static void _tls_session_async_crypto_fd(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	tls_session_async_crypto_resume(talloc_get_type_abort(uctx, tls_crypto_wait_t));
+}
+
+static void _tls_session_async_crypto_fd_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags,
+					       UNUSED int fd_errno, void *uctx)
+{
+	tls_session_async_crypto_resume(talloc_get_type_abort(uctx, tls_crypto_wait_t));
+}
+
+static void _tls_session_async_crypto_poll(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	tls_session_async_crypto_resume(talloc_get_type_abort(uctx, tls_crypto_wait_t));
+}
+
+/** Yield the request until an async crypto provider finishes
+ *
+ * OpenSSL paused the handshake job, but none of our callbacks asked it
+ * to.  That means an async capable provider or engine (configured via
+ * openssl.cnf) is performing a private key operation on our behalf,
+ * e.g. on a hardware accelerator or its own thread pool.
+ *
+ * Instead of spinning in SSL_read(), we wait for the provider to signal
+ * one of its wait fds, and let the worker process other requests in the
+ * meantime.  Providers which don't expose wait fds are polled.
+ */
+static unlang_action_t tls_session_async_crypto_wait(request_t *request, fr_tls_session_t *tls_session)
+{
+	fr_event_list_t		*el = unlang_interpret_event_list(request);
+	tls_crypto_wait_t	*wait;
+	OSSL_ASYNC_FD		fds[8];
+	size_t			numfds = 0, i;
+
+	fr_assert(!tls_session->crypto_wait);
+
+	if (!el) {
+		REDEBUG("Can't wait for async crypto operation - No event list");
+		return UNLANG_ACTION_FAIL;
+	}
+
+	MEM(wait = talloc_zero(tls_session, tls_crypto_wait_t));
+	wait->tls_session = tls_session;
+	wait->request = request;
+	wait->started = fr_time();
+	tls_session->crypto_wait = wait;
+
+	tls_session_stats.crypto_waits++;
+
+	if ((SSL_get_all_async_fds(tls_session->ssl, NULL, &numfds) != 1) ||
+	    (numfds == 0) || (numfds > NUM_ELEMENTS(fds)) ||
+	    (SSL_get_all_async_fds(tls_session->ssl, fds, &numfds) != 1)) {
+		RDEBUG3("Polling for async crypto operation to complete");
+
+		if (fr_event_timer_in(wait, el, &wait->ev, fr_time_delta_from_msec(1),
+				      _tls_session_async_crypto_poll, wait) < 0) {
+			RPERROR("Failed inserting async crypto poll timer");
+		error:
+			TALLOC_FREE(tls_session->crypto_wait);
+			return UNLANG_ACTION_FAIL;
+		}
+
+		return UNLANG_ACTION_YIELD;
+	}
+
+	RDEBUG3("Waiting on %zu fd(s) for async crypto operation to complete", numfds);
+
+	for (i = 0; i < numfds; i++) {
+		if (fr_event_fd_insert(wait, NULL, el, fds[i],
+				       _tls_session_async_crypto_fd, NULL,
+				       _tls_session_async_crypto_fd_error, wait) < 0) {
+			RPERROR("Failed inserting async crypto fd");
+			goto error;
+		}
+	}
+
+	return UNLANG_ACTION_YIELD;
+}
+
 /** Try very hard to get the SSL * into a consistent state where it's not yielded
  *
  * ...because if it's yielded, we'll probably leak thread contexts and all kinds of memory.
@@ -1311,6 +1467,8 @@ static void tls_session_async_handshake_signal(UNUSED request_t *request, UNUSED
 	 *	It'll get freed later when the request is
 	 *	freed.
 	 */
+	TALLOC_FREE(tls_session->crypto_wait);
+
 	for (ret = tls_session->last_ret;
 	     SSL_get_error(tls_session->ssl, ret) == SSL_ERROR_WANT_ASYNC;
 	     ret = SSL_read(tls_session->ssl, tls_session->clean_out.data + tls_session->clean_out.used,
@@ -1363,8 +1521,7 @@ static unlang_action_t tls_session_async_handshake_cont(rlm_rcode_t *p_result, i
 	 *	been called before this function.
 	 */
 	tls_session->can_pause = true;
-	tls_session->last_ret = SSL_read(tls_session->ssl, tls_session->clean_out.data + tls_session->clean_out.used,
-					 sizeof(tls_session->clean_out.data) - tls_session->clean_out.used);
+	tls_session->last_ret = tls_session_ssl_read(tls_session);
 	tls_session->can_pause = false;
 	if (tls_session->last_ret > 0) {
 		tls_session->clean_out.used += tls_session->last_ret;
@@ -1470,9 +1627,23 @@ DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 			IGNORE(unlang_function_clear(request), int);
 			goto error;
 
-		default:
+		case UNLANG_ACTION_PUSHED_CHILD:
 			return ua;
+
+		default:
+			break;
 		}
+
+		/*
+		 *	Nothing of ours is pending, so the job was
+		 *	paused by an async crypto provider.
+		 */
+		ua = tls_session_async_crypto_wait(request, tls_session);
+		if (ua == UNLANG_ACTION_FAIL) {
+			IGNORE(unlang_function_clear(request), int);
+			goto error;
+		}
+		return ua;
 	}
 
 	case SSL_ERROR_WANT_ASYNC_JOB:
@@ -1517,6 +1688,11 @@ static unlang_action_t tls_session_async_handshake(rlm_rcode_t *p_result, int *p
 
 	tls_session->result = FR_TLS_RESULT_IN_PROGRESS;
 
+	if (fr_time_eq(tls_session->handshake_start, fr_time_wrap(0))) {
+		tls_session->handshake_start = fr_time();
+		if (fr_time_eq(tls_session_stats.started, fr_time_wrap(0))) tls_session_stats.started = tls_session->handshake_start;
+	}
+
 	fr_tls_session_request_bind(tls_session->ssl, request);		/* May be unbound in this function or asynchronously */
 
 	/*
@@ -146,6 +146,11 @@ struct fr_tls_session_s {
 
 	fr_pair_list_t		extra_pairs;			//!< Pairs to add to cache and certificate validation
 								///< calls.  These will be duplicated for every call.
+
+	fr_time_t		handshake_start;		//!< When the first handshake round started.
+	fr_time_delta_t		handshake_stall;		//!< Time the worker spent inside OpenSSL
+								///< for this handshake.
+	TALLOC_CTX		*crypto_wait;			//!< Events waiting on an async crypto provider.
 };
 
 /** Return the tls config associated with a tls_session
@@ -41,7 +41,21 @@ int			unlang_global_init(void);
 int			unlang_thread_instantiate(TALLOC_CTX *ctx) CC_HINT(nonnull);
 
 #ifdef WITH_PERF
+/** Which per-instruction statistic to export
+ *
+ */
+typedef enum {
+	UNLANG_PERF_CPU = 0,				//!< Time spent running the instruction itself (ns).
+	UNLANG_PERF_WAIT,				//!< Time spent yielded, waiting on I/O (ns).
+	UNLANG_PERF_COUNT,				//!< Number of times the instruction was run.
+	UNLANG_PERF_YIELDS				//!< Number of times the instruction yielded.
+} unlang_perf_metric_t;
+
 void			unlang_perf_virtual_server(fr_log_t *log, char const *name);
+
+void			*unlang_perf_thread(void);
+
+void			unlang_perf_folded(FILE *fp, void const *thread, unlang_perf_metric_t metric);
 #endif
 
 #ifdef __cplusplus
@@ -50,6 +50,9 @@ struct call_env_parsed_s {
 	size_t				count;		//!< Number of CONF_PAIRs found, matching the #call_env_parser_t.
 	size_t				multi_index;	//!< Array index for this instance.
 	call_env_parser_t const		*rule;		//!< Used to produce this.
+
+	fr_value_box_t const		*value;		//!< Result of expanding a constant tmpl.  Expanded once
+							///< when the call env is parsed, and shared by all calls.
 };
 FR_DLIST_FUNCS(call_env_parsed, call_env_parsed_t, entry)
 
@@ -110,6 +113,33 @@ call_env_result_t call_env_result(TALLOC_CTX *ctx, request_t *request, void *out
 	return CALL_ENV_SUCCESS;
 }
 
+/** Write out the pre-expanded value of a constant tmpl
+ *
+ * The value is immutable, so value box results are shallow copies of it.
+ */
+static inline CC_HINT(always_inline)
+void call_env_value(TALLOC_CTX *ctx, void *out, call_env_parsed_t const *env)
+{
+	fr_value_box_t	*vb;
+
+	switch (env->rule->pair.type) {
+	case CALL_ENV_RESULT_TYPE_VALUE_BOX:
+		fr_value_box_copy_shallow(ctx, (fr_value_box_t *)(out), env->value);
+		break;
+
+	case CALL_ENV_RESULT_TYPE_VALUE_BOX_LIST:
+		if (!fr_value_box_list_initialised((fr_value_box_list_t *)out)) fr_value_box_list_init((fr_value_box_list_t *)out);
+		MEM(vb = fr_value_box_alloc_null(ctx));
+		fr_value_box_copy_shallow(vb, vb, env->value);
+		fr_value_box_list_insert_tail((fr_value_box_list_t *)out, vb);
+		break;
+
+	default:
+		fr_assert(0);
+		break;
+	}
+}
+
 /** Context to keep track of expansion of call environments
  *
  */
@@ -189,6 +219,16 @@ static unlang_action_t call_env_expand_start(UNUSED rlm_rcode_t *p_result, UNUSE
 			}
 		}
 
+		/*
+		 *	Constant tmpls were expanded when the call env was
+		 *	parsed, so there's nothing to push.
+		 */
+		if (env->value) {
+			call_env_value(*call_env_rctx->data,
+				       ((uint8_t *)*call_env_rctx->data) + env->rule->pair.offset, env);
+			continue;
+		}
+
 		/*
 		 *	If this is not parse_only, we need to expand the tmpl.
 		 */
@@ -298,6 +338,20 @@ unlang_action_t call_env_expand(TALLOC_CTX *ctx, request_t *request, call_env_re
 	call_env_rctx->call_env = call_env;
 	fr_value_box_list_init(&call_env_rctx->tmpl_expanded);
 
+	/*
+	 *	Nothing needs to be expanded at runtime, so fill
+	 *	in the env data now, without pushing any frames.
+	 */
+	if (!call_env->dynamic) {
+		unlang_action_t ua;
+
+		ua = call_env_expand_start(NULL, NULL, request, call_env_rctx);
+		fr_assert(ua == UNLANG_ACTION_CALCULATE_RESULT);
+		talloc_free(call_env_rctx);
+
+		return ua;
+	}
+
 	return unlang_function_push(request, call_env_expand_start, call_env_expand_repeat, NULL, 0, UNLANG_SUB_FRAME,
 				    call_env_rctx);
 }
@@ -703,6 +757,57 @@ void call_env_parsed_free(call_env_parsed_head_t *parsed, call_env_parsed_t *ptr
 	talloc_free(ptr);
 }
 
+/** Expand constant tmpls, and record whether anything is left to expand per call
+ *
+ * Literals (including any configuration references, which have already been
+ * substituted) produce the same value for every call, so they're expanded
+ * once here, rather than by pushing a tmpl for each call.
+ *
+ * Tmpls with escape functions are left alone, as the escape functions may
+ * need the request.  So are multi-pair options, which need their output
+ * arrays allocating per call.
+ *
+ * @param[in] call_env	to pre-expand.
+ */
+static void call_env_pre_expand(call_env_t *call_env)
+{
+	call_env_parsed_t	*env = NULL;
+
+	while ((env = call_env_parsed_next(&call_env->parsed, env))) {
+		fr_value_box_list_t	list;
+		tmpl_t const		*vpt;
+
+		if ((env->rule->pair.parsed.type != CALL_ENV_PARSE_TYPE_TMPL) || call_env_parse_only(env->rule->flags)) continue;
+
+		vpt = env->data.tmpl;
+		if (!tmpl_is_data(vpt) || vpt->rules.escape.func || call_env_multi(env->rule->flags)) {
+		dynamic:
+			call_env->dynamic = true;
+			continue;
+		}
+
+		fr_value_box_list_init(&list);
+		if (tmpl_eval(env, &list, NULL, vpt) < 0) {
+			fr_value_box_list_talloc_free(&list);
+			goto dynamic;	/* Report the error when it's called */
+		}
+
+		/*
+		 *	Concatenate multiple boxes if needed
+		 */
+		if ((fr_value_box_list_num_elements(&list) > 1) &&
+		    (!call_env_concat(env->rule->flags) ||
+		     (fr_value_box_list_concat_in_place(fr_value_box_list_head(&list), fr_value_box_list_head(&list), &list,
+							env->rule->pair.cast_type, FR_VALUE_BOX_LIST_FREE, true, SIZE_MAX) < 0))) {
+			fr_value_box_list_talloc_free(&list);
+			goto dynamic;
+		}
+
+		env->value = fr_value_box_list_pop_head(&list);
+		if (!env->value) goto dynamic;
+	}
+}
+
 /** Given a call_env_method, parse all call_env_pair_t in the context of a specific call to an xlat or module method
  *
  * @param[in] ctx		to allocate the call_env_t in.
@@ -753,5 +858,7 @@ call_env_t *call_env_alloc(TALLOC_CTX *ctx, char const *name, call_env_method_t
 		return NULL;
 	}
 
+	call_env_pre_expand(call_env);
+
 	return call_env;
 }
@@ -228,6 +228,9 @@ struct call_env_method_s {
 struct call_env_s {
 	call_env_parsed_head_t		parsed;			//!< The per call parsed call environment.
 	call_env_method_t const		*method;		//!< The method this call env is for.
+	bool				dynamic;		//!< At least one tmpl must be expanded per call.
+								///< If false, the call env is expanded without
+								///< pushing any frames.
 };
 
 /** Where we're specifying a parsing phase output field, determine its type
@@ -74,6 +74,14 @@ static _Thread_local unlang_thread_t *unlang_thread_array;
  */
 static fr_rb_tree_t *unlang_instruction_tree = NULL;
 
+/*
+ *	The deepest nesting, and the most frame state needed along
+ *	any one path, of all the sections compiled so far.  Used to
+ *	size the stack pools of requests.
+ */
+static unsigned int unlang_stack_depth_max = 0;
+static size_t unlang_stack_state_max = 0;
+
 /* Here's where we recognize all of our keywords: first the rcodes, then the
  * actions */
 fr_table_num_sorted_t const mod_rcode_table[] = {
@@ -311,6 +319,7 @@ static void unlang_dump(unlang_t *instruction, int depth)
 			break;
 
 		case UNLANG_TYPE_MODULE:
+		case UNLANG_TYPE_MODULE_SYNC:
 		{
 			unlang_module_t *single = unlang_generic_to_module(c);
 
@@ -2078,10 +2087,95 @@ static bool compile_action_subsection(unlang_t *c, CONF_SECTION *cs, CONF_SECTIO
 }
 
 
+/** Resolve where each "if" and "elsif" jumps to when its condition is taken
+ *
+ * This means the interpreter doesn't need to walk over the remaining
+ * "elsif" and "else" nodes at run-time.
+ *
+ * @param[in] g		whose children should be updated.
+ */
+static void compile_cond_chains(unlang_group_t *g)
+{
+	unlang_t	*c, *next;
+
+	for (c = g->children; c; c = c->next) {
+		if ((c->type != UNLANG_TYPE_IF) && (c->type != UNLANG_TYPE_ELSIF)) continue;
+
+		for (next = c->next;
+		     next && ((next->type == UNLANG_TYPE_ELSE) || (next->type == UNLANG_TYPE_ELSIF));
+		     next = next->next);
+
+		unlang_group_to_cond(unlang_generic_to_group(c))->chain_next = next;
+	}
+}
+
+/** Whether an edit only contains literal assignments to attributes in one list
+ *
+ * Only ":=" and "=" are allowed.  Other operators such as "+=" and "-="
+ * can fail at run time (overflow, missing values), and a failure aborts
+ * the whole edit list, which would also undo the edits merged before it.
+ */
+static bool compile_edit_is_literal(unlang_edit_t const *edit, fr_dict_attr_t const *list)
+{
+	map_t *map = NULL;
+
+	if (!cf_item_is_pair(edit->self.ci)) return false;
+
+	while ((map = map_list_next(&edit->maps, map))) {
+		if (!tmpl_is_attr(map->lhs) || !map->rhs || !tmpl_is_data(map->rhs)) return false;
+
+		if ((map->op != T_OP_SET) && (map->op != T_OP_EQ)) return false;
+
+		if (map_list_num_elements(&map->child) > 0) return false;
+
+		if (tmpl_list(map->lhs) != list) return false;
+	}
+
+	return true;
+}
+
+/** Merge an edit into the previous instruction, if they both edit the same list
+ *
+ * @param[in] prev	the previous instruction in the section.
+ * @param[in] c		the instruction which was just compiled.
+ * @return
+ *	- true if the maps were moved to "prev", and "c" was freed.
+ *	- false if nothing was done.
+ */
+static bool compile_edit_merge(unlang_t *prev, unlang_t *c)
+{
+	unlang_edit_t	*prev_edit, *edit;
+	fr_dict_attr_t const *list;
+	map_t		*map;
+
+	if ((prev->type != UNLANG_TYPE_EDIT) || (c->type != UNLANG_TYPE_EDIT)) return false;
+
+	if (memcmp(prev->actions.actions, c->actions.actions, sizeof(c->actions.actions)) != 0) return false;
+
+	prev_edit = unlang_generic_to_edit(prev);
+	edit = unlang_generic_to_edit(c);
+
+	map = map_list_head(&prev_edit->maps);
+	if (!map || !tmpl_is_attr(map->lhs)) return false;
+	list = tmpl_list(map->lhs);
+
+	if (!compile_edit_is_literal(prev_edit, list) || !compile_edit_is_literal(edit, list)) return false;
+
+	cf_log_debug_prefix(c->ci, "Merging '%s' into previous edit '%s'", c->debug_name, prev->debug_name);
+
+	while ((map = map_list_pop_head(&edit->maps))) {
+		talloc_steal(prev_edit, map);
+		map_list_insert_tail(&prev_edit->maps, map);
+	}
+
+	talloc_free(c);
+	return true;
+}
+
 static unlang_t *compile_children(unlang_group_t *g, unlang_compile_t *unlang_ctx_in, bool set_action_defaults)
 {
 	CONF_ITEM	*ci = NULL;
-	unlang_t	*c, *single;
+	unlang_t	*c, *single, *last = NULL;
 	bool		was_if = false;
 	char const	*skip_else = NULL;
 	unlang_compile_t *unlang_ctx;
@@ -2257,6 +2351,12 @@ static unlang_t *compile_children(unlang_group_t *g, unlang_compile_t *unlang_ct
 	add_child:
 		if (single == UNLANG_IGNORE) continue;
 
+		/*
+		 *	Adjacent edits of the same list are run as one
+		 *	instruction.
+		 */
+		if (last && compile_edit_merge(last, single)) continue;
+
 		/*
 		 *	Do optimizations for "if" and "elsif"
 		 *	conditions.
@@ -2309,6 +2409,7 @@ static unlang_t *compile_children(unlang_group_t *g, unlang_compile_t *unlang_ct
 		*g->tail = single;
 		g->tail = &single->next;
 		g->num_children++;
+		last = single;
 
 		/*
 		 *	If it's not possible to execute statement
@@ -2322,6 +2423,8 @@ static unlang_t *compile_children(unlang_group_t *g, unlang_compile_t *unlang_ct
 		}
 	}
 
+	compile_cond_chains(g);
+
 	/*
 	 *	Set the default actions, if they haven't already been
 	 *	set by an "actions" section above.
@@ -2660,6 +2763,77 @@ static int case_to_key(uint8_t **out, size_t *outlen, void const *data)
 
 static unlang_t *compile_case(unlang_t *parent, unlang_compile_t *unlang_ctx, CONF_SECTION *cs);
 
+/** Find the 'case' statement which matches a constant 'switch'
+ *
+ * @param[in] gext	of the switch.
+ * @return
+ *	- the matching 'case'.
+ *	- NULL if no 'case' (other than the 'default') matches.
+ */
+static unlang_t *compile_switch_constant_find(unlang_switch_t *gext)
+{
+	unlang_case_t		my_case = (unlang_case_t) {
+					.group = (unlang_group_t) {
+						.self = (unlang_t) {
+							.type = UNLANG_TYPE_CASE,
+						},
+					},
+					.vpt = gext->vpt,
+				};
+
+	return fr_htrie_find(gext->ht, &my_case);
+}
+
+/** Remove all of the 'case' statements which can't match a constant 'switch'
+ *
+ * Only the matching 'case' (or the 'default') is kept, so that the
+ * remaining ones don't take up any memory at run-time.
+ *
+ * @param[in] g		the switch to prune.
+ * @return
+ *	- true if a 'case' statement was kept.
+ *	- false if nothing matches, and the caller should ignore the switch.
+ *	  The switch has been freed.
+ */
+static bool compile_switch_constant(unlang_group_t *g)
+{
+	unlang_switch_t		*gext = unlang_group_to_switch(g);
+	unlang_t		*found, *child, *next;
+
+	found = compile_switch_constant_find(gext);
+	if (!found) found = gext->default_case;
+
+	if (!found) {
+		cf_log_debug_prefix(g->cs, "Skipping '%s' as no 'case' matches its constant value",
+				    g->self.debug_name);
+		talloc_free(g);
+		return false;
+	}
+
+	for (child = g->children; child; child = next) {
+		unlang_case_t *case_gext = unlang_group_to_case(unlang_generic_to_group(child));
+
+		next = child->next;
+		if (child == found) continue;
+
+		cf_log_debug_prefix(unlang_generic_to_group(child)->cs,
+				    "Skipping contents of '%s' as it never matches constant '%s'",
+				    child->debug_name, g->self.debug_name);
+
+		if (case_gext->vpt) (void) fr_htrie_delete(gext->ht, child);
+		talloc_free(child);
+	}
+
+	if (found != gext->default_case) gext->default_case = NULL;
+
+	found->next = NULL;
+	g->children = found;
+	g->tail = &found->next;
+	g->num_children = 1;
+
+	return true;
+}
+
 static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx, CONF_SECTION *cs)
 {
 	CONF_ITEM		*ci;
@@ -2671,6 +2845,7 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 
 	unlang_t		*c;
 	ssize_t			slen;
+	CONF_SECTION		*default_cs = NULL;
 
 	tmpl_rules_t		t_rules;
 
@@ -2749,12 +2924,11 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 		goto error;
 	}
 
-	if (tmpl_is_data(gext->vpt)) {
-		cf_log_err(cs, "Cannot use constant data for 'switch' statement");
-		goto error;
-	}
-
-	if (!tmpl_is_attr(gext->vpt)) {
+	/*
+	 *	Constant data (usually a feature flag from the
+	 *	configuration) is resolved at compile time, below.
+	 */
+	if (!tmpl_is_attr(gext->vpt) && !tmpl_is_data(gext->vpt)) {
 		if (tmpl_cast_set(gext->vpt, FR_TYPE_STRING) < 0) {
 			cf_log_perr(cs, "Failed setting cast type");
 			goto error;
@@ -2767,6 +2941,9 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 
 	} else if (tmpl_is_attr(gext->vpt)) {
 		type = tmpl_attr_tail_da(gext->vpt)->type;
+
+	} else if (tmpl_is_data(gext->vpt)) {
+		type = tmpl_value_type(gext->vpt);
 	}
 
 	htype = fr_htrie_hint(type);
@@ -2826,10 +3003,20 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 		name2 = cf_section_name2(subcs);
 		if (!name2) {
 		handle_default:
-			if (gext->default_case) {
+			if (gext->default_case || default_cs) {
 				cf_log_err(ci, "Cannot have two 'default' case statements");
 				goto error;
 			}
+
+			/*
+			 *	The 'default' of a constant 'switch' is
+			 *	compiled after all of the 'case' statements,
+			 *	as it's only used if none of them match.
+			 */
+			if (tmpl_is_data(gext->vpt)) {
+				default_cs = subcs;
+				continue;
+			}
 		}
 
 		/*
@@ -2866,6 +3053,28 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 		g->num_children++;
 	}
 
+	/*
+	 *	Don't compile the contents of a 'default' which
+	 *	can never be used, so that they can reference
+	 *	things which don't exist.
+	 */
+	if (default_cs) {
+		unlang_t *single;
+
+		if (compile_switch_constant_find(gext)) cf_section_free_children(default_cs);
+
+		single = compile_case(c, unlang_ctx, default_cs);
+		if (!single) goto error;
+
+		gext->default_case = single;
+
+		*g->tail = single;
+		g->tail = &single->next;
+		g->num_children++;
+	}
+
+	if (tmpl_is_data(gext->vpt) && !compile_switch_constant(g)) return UNLANG_IGNORE;
+
 	compile_action_defaults(c, unlang_ctx);
 
 	return c;
@@ -2958,6 +3167,9 @@ static unlang_t *compile_case(unlang_t *parent, unlang_compile_t *unlang_ctx, CO
  			if (tmpl_is_attr(switch_gext->vpt)) da = tmpl_attr_tail_da(switch_gext->vpt);
 
 			if (fr_type_is_null(cast_type) && da) cast_type = da->type;
+			if (fr_type_is_null(cast_type) && tmpl_is_data(switch_gext->vpt)) {
+				cast_type = tmpl_value_type(switch_gext->vpt);
+			}
 
 			if (tmpl_cast_in_place(vpt, cast_type, da) < 0) {
 				cf_log_perr(cs, "Invalid argument for 'case' statement");
@@ -2971,6 +3183,18 @@ static unlang_t *compile_case(unlang_t *parent, unlang_compile_t *unlang_ctx, CO
 			cf_log_err(cs, "arguments to 'case' statements MUST be static data.");
 			return NULL;
 		}
+
+		/*
+		 *	The 'switch' is constant, and this 'case' can never
+		 *	match.  Don't compile the contents, so that they can
+		 *	reference things which don't exist.  The 'case' is
+		 *	removed by compile_switch_constant().  The 'default'
+		 *	is handled by compile_switch().
+		 */
+		if (tmpl_is_data(switch_gext->vpt) &&
+		    (fr_value_box_cmp(tmpl_value(vpt), tmpl_value(switch_gext->vpt)) != 0)) {
+			cf_section_free_children(cs);
+		}
 	} /* else it's a default 'case' statement */
 
 	/*
@@ -3698,6 +3922,16 @@ static unlang_t *compile_load_balance_subsection(unlang_t *parent, unlang_compil
 		if (strcmp(cf_section_name1(cf_item_to_section(cf_parent(cs))), "modules") == 0) name2 = NULL;
 	}
 
+	/*
+	 *	"least-latency" isn't a key, it's a policy which
+	 *	picks children by how quickly they've responded.
+	 */
+	if (name2 && (cf_section_name2_quote(cs) == T_BARE_WORD) && (strcmp(name2, "least-latency") == 0)) {
+		gext = unlang_group_to_load_balance(g);
+		gext->least_latency = true;
+		name2 = NULL;
+	}
+
 	if (name2) {
 		fr_token_t type;
 		ssize_t slen;
@@ -3781,6 +4015,7 @@ static unlang_t *compile_parallel(unlang_t *parent, unlang_compile_t *unlang_ctx
 
 	bool				clone = true;
 	bool				detach = false;
+	bool				shared = false;
 
 	static unlang_ext_t const 	parallel_ext = {
 						.type = UNLANG_TYPE_PARALLEL,
@@ -3804,6 +4039,10 @@ static unlang_t *compile_parallel(unlang_t *parent, unlang_compile_t *unlang_ctx
 		} else if (strcmp(name2, "detach") == 0) {
 			detach = true;
 
+		} else if (strcmp(name2, "shared") == 0) {
+			clone = false;
+			shared = true;
+
 		} else {
 			cf_log_err(cs, "Invalid argument '%s'", name2);
 			return NULL;
@@ -3826,6 +4065,7 @@ static unlang_t *compile_parallel(unlang_t *parent, unlang_compile_t *unlang_ctx
 	gext = unlang_group_to_parallel(g);
 	gext->clone = clone;
 	gext->detach = detach;
+	gext->shared = shared;
 
 	return c;
 }
@@ -4489,6 +4729,17 @@ static unlang_t *compile_module(unlang_t *parent, unlang_compile_t *unlang_ctx,
 	    !unlang_compile_actions(&c->actions, cf_item_to_section(ci),
 				    (inst->exported->flags & MODULE_TYPE_RETRY) != 0)) goto error;
 
+	/*
+	 *	Methods which never yield can be called inline,
+	 *	without frame state.  Expanding a dynamic call_env
+	 *	needs a frame, as does retrying.
+	 */
+	if ((!single->call_env || !single->call_env->dynamic) && !fr_time_delta_ispos(c->actions.retry.irt) &&
+	    module_rlm_method_is_synchronous(inst, method)) {
+		cf_log_debug(ci, "Calling synchronous method of %s inline", inst->name);
+		c->type = UNLANG_TYPE_MODULE_SYNC;
+	}
+
 	return c;
 }
 
@@ -4746,6 +4997,207 @@ fail:
 	return NULL;
 }
 
+/** Whether an instruction type has children which are run as a list
+ *
+ */
+static inline bool unlang_has_children(unlang_t const *c)
+{
+	switch (c->type) {
+	case UNLANG_TYPE_CALL:
+	case UNLANG_TYPE_CALLER:
+	case UNLANG_TYPE_CASE:
+	case UNLANG_TYPE_FOREACH:
+	case UNLANG_TYPE_ELSE:
+	case UNLANG_TYPE_ELSIF:
+	case UNLANG_TYPE_GROUP:
+	case UNLANG_TYPE_IF:
+	case UNLANG_TYPE_LOAD_BALANCE:
+	case UNLANG_TYPE_PARALLEL:
+	case UNLANG_TYPE_POLICY:
+	case UNLANG_TYPE_REDUNDANT:
+	case UNLANG_TYPE_REDUNDANT_LOAD_BALANCE:
+	case UNLANG_TYPE_SUBREQUEST:
+	case UNLANG_TYPE_SWITCH:
+	case UNLANG_TYPE_TIMEOUT:
+	case UNLANG_TYPE_LIMIT:
+	case UNLANG_TYPE_TRANSACTION:
+	case UNLANG_TYPE_TRY:
+	case UNLANG_TYPE_CATCH:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/** Whether a nested group can be spliced into its parent without changing the result
+ *
+ * The parent must run its children sequentially, and the group must be a plain
+ * "group" with no local variables or retries.  Every child of the group must
+ * use the group's own actions, so the result a child produces is treated
+ * identically whether it's evaluated in the group's frame or the parent's.
+ *
+ * @param[in] parent	the group is a child of.
+ * @param[in] c		group to check.
+ * @return true if the group can be spliced into the parent.
+ */
+static bool compile_flatten_allowed(unlang_t const *parent, unlang_t const *c)
+{
+	unlang_group_t const	*g;
+	unlang_t const		*child;
+	int			i;
+
+	switch (parent->type) {
+	case UNLANG_TYPE_CASE:
+	case UNLANG_TYPE_ELSE:
+	case UNLANG_TYPE_ELSIF:
+	case UNLANG_TYPE_FOREACH:
+	case UNLANG_TYPE_GROUP:
+	case UNLANG_TYPE_IF:
+	case UNLANG_TYPE_POLICY:
+		break;
+
+	default:
+		return false;
+	}
+
+	if (c->type != UNLANG_TYPE_GROUP) return false;
+
+	g = unlang_generic_to_group(c);
+	if (g->variables) return false;
+	if (c->actions.retry.mrc || fr_time_delta_ispos(c->actions.retry.mrd)) return false;
+
+	for (i = 0; i < RLM_MODULE_NUMCODES; i++) {
+		if ((c->actions.actions[i] == MOD_ACTION_REJECT) ||
+		    (c->actions.actions[i] == MOD_ACTION_RETRY)) return false;
+	}
+
+	for (child = g->children; child; child = child->next) {
+		if (memcmp(child->actions.actions, c->actions.actions, sizeof(c->actions.actions)) != 0) return false;
+	}
+
+	return true;
+}
+
+/** Splice plain nested groups into their parents
+ *
+ * Each group the interpreter enters costs a stack frame push and pop, so removing
+ * groups which only exist for syntactic reasons shortens the path through the policy.
+ *
+ * The group nodes themselves are left allocated, as they own their children.
+ *
+ * @param[in] c		to flatten, along with all of its descendants.
+ */
+static void compile_flatten(unlang_t *c)
+{
+	unlang_group_t	*g;
+	unlang_t	**prev, *child;
+	bool		spliced = false;
+
+	if (!unlang_has_children(c)) return;
+
+	g = unlang_generic_to_group(c);
+
+	/*
+	 *	Bottom up, so groups nested inside a group
+	 *	are spliced before the group itself is.
+	 */
+	for (child = g->children; child; child = child->next) compile_flatten(child);
+
+	prev = &g->children;
+	while ((child = *prev)) {
+		unlang_group_t	*cg;
+		unlang_t	*gc, *last = NULL;
+
+		if (!compile_flatten_allowed(c, child)) {
+			prev = &child->next;
+			continue;
+		}
+
+		cg = unlang_generic_to_group(child);
+
+		cf_log_debug(child->ci, "Flattening '%s' into '%s'", child->debug_name, c->debug_name);
+
+		for (gc = cg->children; gc; gc = gc->next) {
+			gc->parent = c;
+			last = gc;
+		}
+
+		/*
+		 *	Empty group, just unlink it.
+		 */
+		if (!last) {
+			*prev = child->next;
+			if (g->tail == &child->next) g->tail = prev;
+			g->num_children--;
+			child->next = NULL;
+			spliced = true;
+			continue;
+		}
+
+		last->next = child->next;
+		*prev = cg->children;
+		if (g->tail == &child->next) g->tail = &last->next;
+		g->num_children += cg->num_children - 1;
+
+		cg->children = NULL;
+		cg->tail = &cg->children;
+		cg->num_children = 0;
+		child->next = NULL;
+
+		prev = &last->next;
+		spliced = true;
+	}
+
+	if (spliced) compile_cond_chains(g);
+}
+
+/** Find how deep the interpreter stack can get for a compiled section
+ *
+ * Each instruction the interpreter enters gets a frame, and most get
+ * frame state allocated from the stack pool.  Record the deepest path,
+ * and the largest sum of frame state along any path, so that request
+ * pools can be sized for what the policy actually needs.
+ *
+ * @param[in] c		first instruction in a list of siblings.
+ * @param[in] depth	of the parent of c.
+ * @param[in] state	allocated by the parent of c, and its ancestors.
+ */
+static void compile_stack_size(unlang_t const *c, unsigned int depth, size_t state)
+{
+	ssize_t		hdr_size = talloc_hdr_size();
+
+	if (hdr_size < 0) hdr_size = 0;
+
+	depth++;
+	if (depth > unlang_stack_depth_max) unlang_stack_depth_max = depth;
+
+	for (; c; c = c->next) {
+		unlang_op_t const	*op = &unlang_ops[c->type];
+		size_t			size = state;
+
+		if (op->frame_state_size || op->frame_state_pool_size) {
+			size += op->frame_state_size + op->frame_state_pool_size +
+				(hdr_size * (1 + op->frame_state_pool_objects));
+		}
+		if (size > unlang_stack_state_max) unlang_stack_state_max = size;
+
+		if (unlang_has_children(c)) compile_stack_size(unlang_generic_to_group(c)->children, depth, size);
+	}
+}
+
+/** Return how deep, and how much frame state, the compiled sections need
+ *
+ * @param[out] depth		the deepest nesting of any compiled section.
+ *				0 if nothing has been compiled.
+ * @param[out] state_size	the most frame state needed along any path.
+ */
+void unlang_compile_stack_size(unsigned int *depth, size_t *state_size)
+{
+	*depth = unlang_stack_depth_max;
+	*state_size = unlang_stack_state_max;
+}
+
 /** Compile an unlang section for a virtual server
  *
  * @param[in] vs		Virtual server to compile section for.
@@ -4806,6 +5258,10 @@ int unlang_compile(virtual_server_t const *vs,
 			    cs, &group_ext);
 	if (!c) return -1;
 
+	if (main_config && main_config->flatten_unlang) compile_flatten(c);
+
+	compile_stack_size(c, 0, 0);
+
 	if (DEBUG_ENABLED4) unlang_dump(c, 2);
 
 	/*
@@ -4913,6 +5369,17 @@ void *unlang_thread_instance(unlang_t const *instruction)
 }
 
 #ifdef WITH_PERF
+/** Add to a counter which is read by other threads
+ *
+ * Only the owning thread writes the counter, so a load and store is enough,
+ * and is much cheaper than an atomic read-modify-write.
+ */
+static inline CC_HINT(always_inline) void unlang_perf_add(atomic_uint_fast64_t *counter, uint64_t value,
+							   memory_order order)
+{
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, order);
+}
+
 void unlang_frame_perf_init(unlang_stack_frame_t *frame)
 {
 	unlang_thread_t *t;
@@ -4925,7 +5392,17 @@ void unlang_frame_perf_init(unlang_stack_frame_t *frame)
 
 	t = &unlang_thread_array[instruction->number];
 
-	t->use_count++;
+	/*
+	 *	Only instructions with thread-specific instance data
+	 *	are recorded when the thread is instantiated.  Record
+	 *	the rest the first time they're run.
+	 *
+	 *	The release store of use_count publishes the pointer
+	 *	to threads reading the counters.
+	 */
+	if (!t->instruction) t->instruction = instruction;
+
+	unlang_perf_add(&t->use_count, 1, memory_order_release);
 	t->yielded++;			// everything starts off as yielded
 	now = fr_time();
 
@@ -4947,6 +5424,22 @@ void unlang_frame_perf_yield(unlang_stack_frame_t *frame)
 	fr_time_tracking_yield(&frame->tracking, fr_time());
 }
 
+/** Record that a frame yielded back to the scheduler
+ *
+ * Unlike #unlang_frame_perf_yield, which is also called when a frame pushes
+ * children, this is only called when the request is suspended.
+ */
+void unlang_frame_perf_suspend(unlang_stack_frame_t *frame)
+{
+	unlang_t const *instruction = frame->instruction;
+
+	if (!instruction->number || !unlang_thread_array) return;
+
+	unlang_perf_add(&unlang_thread_array[instruction->number].yield_count, 1, memory_order_relaxed);
+
+	unlang_frame_perf_yield(frame);
+}
+
 void unlang_frame_perf_resume(unlang_stack_frame_t *frame)
 {
 	unlang_t const *instruction = frame->instruction;
@@ -4982,8 +5475,8 @@ void unlang_frame_perf_cleanup(unlang_stack_frame_t *frame)
 	}
 
 	fr_time_tracking_end(NULL, &frame->tracking, fr_time());
-	t->tracking.running_total = fr_time_delta_add(t->tracking.running_total, frame->tracking.running_total);
-	t->tracking.waiting_total = fr_time_delta_add(t->tracking.waiting_total, frame->tracking.waiting_total);
+	unlang_perf_add(&t->running_total, fr_time_delta_unwrap(frame->tracking.running_total), memory_order_relaxed);
+	unlang_perf_add(&t->waiting_total, fr_time_delta_unwrap(frame->tracking.waiting_total), memory_order_relaxed);
 }
 
 
@@ -5024,7 +5517,14 @@ static void unlang_perf_dump(fr_log_t *log, unlang_t const *instruction, int dep
 	t = &unlang_thread_array[instruction->number];
 
 	fr_log(log, L_DBG, file, line, "count=%" PRIu64 " cpu_time=%" PRIu64 " yielded_time=%" PRIu64 ,
-	       t->use_count, fr_time_delta_unwrap(t->tracking.running_total), fr_time_delta_unwrap(t->tracking.waiting_total));
+	       (uint64_t) atomic_load_explicit(&t->use_count, memory_order_relaxed),
+	       (uint64_t) atomic_load_explicit(&t->running_total, memory_order_relaxed),
+	       (uint64_t) atomic_load_explicit(&t->waiting_total, memory_order_relaxed));
+
+	if ((instruction->type == UNLANG_TYPE_LOAD_BALANCE) ||
+	    (instruction->type == UNLANG_TYPE_REDUNDANT_LOAD_BALANCE)) {
+		unlang_load_balance_perf_dump(log, instruction, file, line);
+	}
 
 	if (g->children) {
 		unlang_t *child;
@@ -5043,6 +5543,113 @@ static void unlang_perf_dump(fr_log_t *log, unlang_t const *instruction, int dep
 	}
 }
 
+/** Return the current thread's instruction statistics
+ *
+ * The pointer is opaque, and is only valid for as long as the thread is running.
+ * It allows another thread (i.e. the one servicing radmin) to export the stats with
+ * #unlang_perf_folded.
+ */
+void *unlang_perf_thread(void)
+{
+	return unlang_thread_array;
+}
+
+/** Print the name of an instruction, and all of its parents, in folded stack format
+ *
+ */
+static void unlang_perf_folded_name(FILE *fp, unlang_t const *instruction)
+{
+	char const *p;
+
+	if (instruction->parent) {
+		unlang_perf_folded_name(fp, instruction->parent);
+		fputc(';', fp);
+
+	/*
+	 *	Top level sections are prefixed with
+	 *	the virtual server they belong to.
+	 */
+	} else if (instruction->ci) {
+		CONF_SECTION *server_cs = cf_item_to_section(cf_parent(instruction->ci));
+
+		if (server_cs && cf_section_name2(server_cs)) {
+			fprintf(fp, "%s %s;", cf_section_name1(server_cs), cf_section_name2(server_cs));
+		}
+	}
+
+	/*
+	 *	';' separates frames, and is common in policies...
+	 */
+	for (p = instruction->debug_name; *p; p++) fputc((*p == ';') ? ',' : *p, fp);
+}
+
+/** Write per-instruction statistics for a thread as folded stacks
+ *
+ * The output is one line per instruction, consisting of the path from the
+ * top level section to the instruction, separated by ';', followed by the
+ * value of the metric.  It can be passed directly to flamegraph.pl.
+ *
+ * Time for sections only includes the time spent in the section itself,
+ * so values can be summed up the stack without double counting.
+ *
+ * @note Each counter is read atomically, but they're not read as a set, so
+ *	 the values may be slightly inconsistent if the thread is processing
+ *	 requests.
+ *
+ * @param[in] fp	to write to.
+ * @param[in] thread	as returned by #unlang_perf_thread.
+ * @param[in] metric	to write.
+ */
+void unlang_perf_folded(FILE *fp, void const *thread, unlang_perf_metric_t metric)
+{
+	unlang_thread_t const	*array = thread;
+	size_t			i, len;
+
+	if (!array) return;
+
+	len = talloc_array_length(array);
+	for (i = 1; i < len; i++) {
+		unlang_thread_t const	*t = &array[i];
+		uint64_t		use_count, value;
+
+		/*
+		 *	Pairs with the release store in
+		 *	unlang_frame_perf_init().
+		 */
+		use_count = atomic_load_explicit(&t->use_count, memory_order_acquire);
+		if (!use_count || !t->instruction) continue;
+
+		switch (metric) {
+		default:
+		case UNLANG_PERF_CPU:
+			value = atomic_load_explicit(&t->running_total, memory_order_relaxed);
+			break;
+
+		/*
+		 *	A section is "waiting" whenever its children
+		 *	are running, so only count the leaves.
+		 */
+		case UNLANG_PERF_WAIT:
+			if (unlang_ops[t->instruction->type].debug_braces) continue;
+			value = atomic_load_explicit(&t->waiting_total, memory_order_relaxed);
+			break;
+
+		case UNLANG_PERF_COUNT:
+			value = use_count;
+			break;
+
+		case UNLANG_PERF_YIELDS:
+			value = atomic_load_explicit(&t->yield_count, memory_order_relaxed);
+			break;
+		}
+
+		if (!value) continue;
+
+		unlang_perf_folded_name(fp, t->instruction);
+		fprintf(fp, " %" PRIu64 "\n", value);
+	}
+}
+
 void unlang_perf_virtual_server(fr_log_t *log, char const *name)
 {
 
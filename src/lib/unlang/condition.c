@@ -36,6 +36,7 @@ typedef struct {
 
 static unlang_action_t unlang_if_resume(rlm_rcode_t *p_result, request_t *request, unlang_stack_frame_t *frame)
 {
+	unlang_cond_t			*gext = unlang_group_to_cond(unlang_generic_to_group(frame->instruction));
 	unlang_frame_state_cond_t	*state = talloc_get_type_abort(frame->state, unlang_frame_state_cond_t);
 	fr_value_box_t			*box = fr_value_box_list_head(&state->out);
 	bool				value;
@@ -58,12 +59,10 @@ static unlang_action_t unlang_if_resume(rlm_rcode_t *p_result, request_t *reques
 	/*
 	 *	Tell the main interpreter to skip over the else /
 	 *	elsif blocks, as this "if" condition was taken.
+	 *
+	 *	The end of the chain is resolved at compile time.
 	 */
-	while (frame->next &&
-	       ((frame->next->type == UNLANG_TYPE_ELSE) ||
-		(frame->next->type == UNLANG_TYPE_ELSIF))) {
-		frame->next = frame->next->next;
-	}
+	if (frame->next) frame->next = gext->chain_next;
 
 	/*
 	 *	We took the "if".  Go recurse into its' children.
@@ -678,7 +678,7 @@ unlang_frame_action_t frame_eval(request_t *request, unlang_stack_frame_t *frame
 				      "Instruction %s returned UNLANG_ACTION_YIELD, but pushed additional "
 				      "frames for evaluation.  Instruction should return UNLANG_ACTION_PUSHED_CHILD "
 				      "instead", instruction->name);
-			unlang_frame_perf_yield(frame);
+			unlang_frame_perf_suspend(frame);
 			yielded_set(frame);
 			RDEBUG4("** [%i] %s - yielding with current (%s %d)", stack->depth, __FUNCTION__,
 				fr_table_str_by_value(mod_rcode_table, frame->result, "<invalid>"),
@@ -1036,6 +1036,51 @@ int unlang_interpret_push_instruction(request_t *request, void *instruction, rlm
 	return 0;
 }
 
+/** Work out how much memory to pre-allocate for frame state
+ *
+ * Uses the deepest nesting, and the most frame state along any path, of
+ * all the sections compiled so far.  Frames pushed at runtime are covered
+ * by #UNLANG_STACK_SLACK frames of #UNLANG_FRAME_PRE_ALLOC bytes each.
+ *
+ * If nothing has been compiled yet, room is left for a full stack.
+ *
+ * @param[out] num_frames	the number of frames to pre-allocate state for.
+ * @return the number of bytes to pre-allocate for frame state.
+ */
+static size_t unlang_interpret_frame_state_size(unsigned int *num_frames)
+{
+	unsigned int	depth;
+	size_t		state_size;
+
+	unlang_compile_stack_size(&depth, &state_size);
+	if (!depth) {
+		*num_frames = UNLANG_STACK_MAX;
+		return UNLANG_FRAME_PRE_ALLOC * UNLANG_STACK_MAX;
+	}
+
+	depth += UNLANG_STACK_SLACK;
+	if (depth > UNLANG_STACK_MAX) depth = UNLANG_STACK_MAX;
+
+	*num_frames = depth;
+	return state_size + (UNLANG_FRAME_PRE_ALLOC * UNLANG_STACK_SLACK);
+}
+
+/** Return how much memory a request pool should reserve for its stack
+ *
+ * @param[out] num_objects	the number of talloc chunks the stack will use.
+ * @return the number of bytes to reserve.
+ */
+size_t unlang_interpret_stack_pool_size(unsigned int *num_objects)
+{
+	unsigned int	num_frames;
+	size_t		size;
+
+	size = unlang_interpret_frame_state_size(&num_frames);
+	*num_objects = num_frames + 1;
+
+	return sizeof(unlang_stack_t) + size;
+}
+
 /** Allocate a new unlang stack
  *
  * @param[in] ctx	to allocate stack in.
@@ -1045,22 +1090,29 @@ int unlang_interpret_push_instruction(request_t *request, void *instruction, rlm
  */
 void *unlang_interpret_stack_alloc(TALLOC_CTX *ctx)
 {
-	unlang_stack_t *stack;
+	unlang_stack_t	*stack;
+
+	unsigned int	num_frames;
+	size_t		size;
 
 	/*
 	 *	If we have talloc_pooled_object allocate the
-	 *	stack as a combined chunk/pool, with memory
-	 *	to hold at mutable data for at least a quarter
-	 *	of the maximum number of stack frames.
+	 *	stack as a combined chunk/pool, with enough
+	 *	memory to hold the mutable data for the deepest
+	 *	section that was compiled.
 	 *
 	 *	Having a dedicated pool for mutable stack data
 	 *	means we don't have memory fragmentations issues
 	 *	as we would if request were used as the pool.
 	 *
-	 *	This number is pretty arbitrary, but it seems
-	 *	like too low level to make into a tuneable.
+	 *	Frames are pushed and popped in LIFO order, and
+	 *	talloc reclaims the last chunk in a pool when
+	 *	it's freed, so the pool is reused as the stack
+	 *	grows and shrinks.  If it's ever exhausted,
+	 *	talloc falls back to malloc.
 	 */
-	MEM(stack = talloc_zero_pooled_object(ctx, unlang_stack_t, UNLANG_STACK_MAX, 128));	/* 128 bytes per state */
+	size = unlang_interpret_frame_state_size(&num_frames);
+	MEM(stack = talloc_zero_pooled_object(ctx, unlang_stack_t, num_frames, size));
 	stack->result = RLM_MODULE_NOT_SET;
 
 	return stack;
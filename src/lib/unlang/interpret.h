@@ -37,6 +37,8 @@ extern "C" {
 
 #define UNLANG_STACK_MAX (64)		//!< The maximum depth of the stack.
 #define UNLANG_FRAME_PRE_ALLOC (128)	//!< How much memory we pre-alloc for each frame.
+#define UNLANG_STACK_SLACK (8)		//!< Frames reserved for things pushed at runtime
+					///< (xlats, module resume functions, call).
 
 /** Interpreter handle
  *
@@ -146,6 +148,8 @@ rlm_rcode_t		unlang_interpret(request_t *request) CC_HINT(hot);
 
 rlm_rcode_t		unlang_interpret_synchronous(fr_event_list_t *el, request_t *request);
 
+size_t			unlang_interpret_stack_pool_size(unsigned int *num_objects);
+
 void			*unlang_interpret_stack_alloc(TALLOC_CTX *ctx);
 
 bool			unlang_request_is_scheduled(request_t const *request);
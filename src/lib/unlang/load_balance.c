@@ -30,6 +30,120 @@
 
 #define unlang_redundant_load_balance unlang_load_balance
 
+/** Find the response time stats for a child of a "least-latency" section
+ *
+ */
+static unlang_load_balance_child_t *load_balance_child_stats(unlang_group_t *g, unlang_t const *child)
+{
+	unlang_thread_load_balance_t	*t;
+	unlang_t			*c;
+	int				i;
+
+	t = unlang_thread_instance(unlang_group_to_generic(g));
+	if (!t || !t->children) return NULL;
+
+	for (c = g->children, i = 0; c != NULL; c = c->next, i++) {
+		if (c == child) return &t->children[i];
+	}
+
+	return NULL;
+}
+
+/** Remember that we're waiting on a child of a "least-latency" section
+ *
+ */
+static void load_balance_latency_start(unlang_frame_state_redundant_t *redundant, unlang_group_t *g,
+				       unlang_t const *child)
+{
+	unlang_load_balance_child_t	*lbc;
+
+	fr_assert(!redundant->running);
+
+	lbc = load_balance_child_stats(g, child);
+	if (!lbc) return;
+
+	lbc->active++;
+	redundant->running = lbc;
+	redundant->started = fr_time();
+}
+
+/** Record how long a child of a "least-latency" section took to respond
+ *
+ * Children which fail are recorded as taking several times longer than
+ * their current average, so that they are avoided until successful
+ * responses bring the average back down.
+ */
+static void load_balance_latency_end(unlang_frame_state_redundant_t *redundant, rlm_rcode_t rcode)
+{
+	unlang_load_balance_child_t	*lbc = redundant->running;
+	fr_time_t			now;
+	int64_t				sample, avg;
+
+	if (!lbc) return;
+	redundant->running = NULL;
+
+	if (lbc->active > 0) lbc->active--;
+
+	now = fr_time();
+	fr_time_elapsed_update(&lbc->elapsed, redundant->started, now);
+
+	sample = fr_time_delta_unwrap(fr_time_sub(now, redundant->started));
+	if (sample <= 0) sample = 1;
+	avg = fr_time_delta_unwrap(lbc->latency);
+
+	if (rcode == RLM_MODULE_FAIL) sample = (avg > sample ? avg : sample) * 4;
+
+	/*
+	 *	Exponentially weighted, each new sample counts for 1/8th.
+	 */
+	lbc->latency = fr_time_delta_wrap(avg ? avg + ((sample - avg) / 8) : sample);
+}
+
+/** Score a child, lower is better
+ *
+ * The average response time, scaled by the number of requests already
+ * waiting on the child.  Children we haven't heard from yet score zero,
+ * so that they are tried.
+ */
+static inline int64_t load_balance_score(unlang_load_balance_child_t const *lbc)
+{
+	if (!fr_time_delta_ispos(lbc->latency)) return 0;
+
+	return fr_time_delta_unwrap(lbc->latency) * (lbc->active + 1);
+}
+
+/** Choose a child using the "power of two choices"
+ *
+ * Pick two children at random, and use the one with the better score.
+ * This avoids the herding which happens when every request goes to the
+ * single best child, and stale stats are corrected as a side effect.
+ */
+static unlang_t *load_balance_least_latency(request_t *request, unlang_group_t *g)
+{
+	unlang_thread_load_balance_t	*t;
+	unlang_t			*child;
+	int				a, b, i;
+
+	t = unlang_thread_instance(unlang_group_to_generic(g));
+	if (!t || !t->children) return NULL;
+
+	if (g->num_children == 1) return g->children;
+
+	a = fr_rand() % g->num_children;
+	b = fr_rand() % (g->num_children - 1);
+	if (b >= a) b++;
+
+	RDEBUG3("load-balance comparing child %d (latency %pVs, active %u) and child %d (latency %pVs, active %u)",
+		a, fr_box_time_delta(t->children[a].latency), t->children[a].active,
+		b, fr_box_time_delta(t->children[b].latency), t->children[b].active);
+
+	if (load_balance_score(&t->children[b]) < load_balance_score(&t->children[a])) a = b;
+
+	for (child = g->children, i = 0; i < a; child = child->next, i++);
+
+	return child;
+}
+
 static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t *request,
 						unlang_stack_frame_t *frame)
 {
@@ -54,12 +168,16 @@ static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t
 		 *	back to the found one, then we're done.
 		 */
 		if (redundant->child == redundant->found) {
+			load_balance_latency_end(redundant, *p_result);
+
 			/* DON'T change p_result, as it is taken from the child */
 			return UNLANG_ACTION_CALCULATE_RESULT;
 		}
 
 		RDEBUG4("%s resuming", frame->instruction->debug_name);
 
+		load_balance_latency_end(redundant, *p_result);
+
 		/*
 		 *	We are in a resumed frame.  The module we
 		 *	chose failed, so we have to go through the
@@ -86,6 +204,8 @@ static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t
 		return UNLANG_ACTION_STOP_PROCESSING;
 	}
 
+	load_balance_latency_start(redundant, g, redundant->child);
+
 	/*
 	 *	Now that we've pushed this child, make the next call
 	 *	use the next child, wrapping around to the beginning.
@@ -104,6 +224,32 @@ static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t
 	return UNLANG_ACTION_PUSHED_CHILD;
 }
 
+static unlang_action_t unlang_load_balance_done(rlm_rcode_t *p_result, UNUSED request_t *request,
+						unlang_stack_frame_t *frame)
+{
+	unlang_frame_state_redundant_t	*redundant = talloc_get_type_abort(frame->state, unlang_frame_state_redundant_t);
+
+	load_balance_latency_end(redundant, *p_result);
+
+	/* DON'T change p_result, as it is taken from the child */
+	return UNLANG_ACTION_CALCULATE_RESULT;
+}
+
+/** Stop waiting on a child if the request is cancelled
+ *
+ */
+static void unlang_load_balance_signal(UNUSED request_t *request, unlang_stack_frame_t *frame, fr_signal_t action)
+{
+	unlang_frame_state_redundant_t	*redundant = talloc_get_type_abort(frame->state, unlang_frame_state_redundant_t);
+
+	if (action != FR_SIGNAL_CANCEL) return;
+
+	if (!redundant->running) return;
+
+	if (redundant->running->active > 0) redundant->running->active--;
+	redundant->running = NULL;
+}
+
 static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *request, unlang_stack_frame_t *frame)
 {
 	unlang_frame_state_redundant_t	*redundant;
@@ -124,7 +270,11 @@ static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *req
 	redundant = talloc_get_type_abort(frame->state,
 					  unlang_frame_state_redundant_t);
 
-	if (gext && gext->vpt) {
+	if (gext->least_latency) {
+		redundant->found = load_balance_least_latency(request, g);
+		if (!redundant->found) goto randomly_choose;
+
+	} else if (gext->vpt) {
 		uint32_t hash, start;
 		ssize_t slen;
 		char const *p = NULL;
@@ -231,6 +381,12 @@ static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *req
 			*p_result = RLM_MODULE_FAIL;
 			return UNLANG_ACTION_STOP_PROCESSING;
 		}
+
+		if (gext->least_latency) {
+			load_balance_latency_start(redundant, g, redundant->found);
+			frame_repeat(frame, unlang_load_balance_done);
+		}
+
 		return UNLANG_ACTION_PUSHED_CHILD;
 	}
 
@@ -245,25 +401,78 @@ static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *req
 	return unlang_load_balance_next(p_result, request, frame);
 }
 
+/** Allocate per-child response time stats for "least-latency" sections
+ *
+ */
+static int unlang_load_balance_thread_instantiate(unlang_t const *instruction, void *thread_inst)
+{
+	unlang_group_t			*g = unlang_generic_to_group(instruction);
+	unlang_load_balance_t		*gext = unlang_group_to_load_balance(g);
+	unlang_thread_load_balance_t	*t = thread_inst;
+
+	if (!gext->least_latency || !g->num_children) return 0;
+
+	MEM(t->children = talloc_zero_array(t, unlang_load_balance_child_t, g->num_children));
+
+	return 0;
+}
+
+#ifdef WITH_PERF
+/** Log the response time stats for the children of a "least-latency" section
+ *
+ * Called from unlang_perf_dump().  The histogram buckets are upper bounds
+ * of 1us, 10us, 100us, 1ms, 10ms, 100ms, 1s, and everything slower.
+ */
+void unlang_load_balance_perf_dump(fr_log_t *log, unlang_t const *instruction, char const *file, int line)
+{
+	unlang_group_t			*g = unlang_generic_to_group(instruction);
+	unlang_thread_load_balance_t	*t;
+	unlang_t			*child;
+	int				i;
+
+	t = unlang_thread_instance(instruction);
+	if (!t || !t->children) return;
+
+	for (child = g->children, i = 0; child != NULL; child = child->next, i++) {
+		uint64_t const *h = t->children[i].elapsed.array;
+
+		fr_log(log, L_DBG, file, line, "# %s latency=%" PRIu64 " active=%u "
+		       "elapsed=%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+		       child->debug_name, fr_time_delta_unwrap(t->children[i].latency), t->children[i].active,
+		       h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
+	}
+}
+#endif
+
 void unlang_load_balance_init(void)
 {
 	unlang_register(UNLANG_TYPE_LOAD_BALANCE,
 			   &(unlang_op_t){
 				.name = "load-balance group",
 				.interpret = unlang_load_balance,
+				.signal = unlang_load_balance_signal,
 				.rcode_set = true,
 				.debug_braces = true,
 			        .frame_state_size = sizeof(unlang_frame_state_redundant_t),
 				.frame_state_type = "unlang_frame_state_redundant_t",
+
+				.thread_instantiate = unlang_load_balance_thread_instantiate,
+				.thread_inst_size = sizeof(unlang_thread_load_balance_t),
+				.thread_inst_type = "unlang_thread_load_balance_t",
 			   });
 
 	unlang_register(UNLANG_TYPE_REDUNDANT_LOAD_BALANCE,
 			   &(unlang_op_t){
 				.name = "redundant-load-balance group",
 				.interpret = unlang_redundant_load_balance,
+				.signal = unlang_load_balance_signal,
 				.rcode_set = true,
 				.debug_braces = true,
 			        .frame_state_size = sizeof(unlang_frame_state_redundant_t),
 				.frame_state_type = "unlang_frame_state_redundant_t",
+
+				.thread_instantiate = unlang_load_balance_thread_instantiate,
+				.thread_inst_size = sizeof(unlang_thread_load_balance_t),
+				.thread_inst_type = "unlang_thread_load_balance_t",
 			   });
 }
@@ -32,14 +32,34 @@ extern "C" {
 typedef struct {
 	unlang_group_t	group;
 	tmpl_t		*vpt;
+	bool		least_latency;	//!< Pick children by observed response time.
 } unlang_load_balance_t;
 
+/** Response times for one child of a "least-latency" load-balance section
+ *
+ */
+typedef struct {
+	fr_time_delta_t		latency;	//!< Moving average of response times.
+	uint32_t		active;		//!< Requests currently running this child.
+	fr_time_elapsed_t	elapsed;	//!< Histogram of response times.
+} unlang_load_balance_child_t;
+
+/** Per-thread data for a load-balance section
+ *
+ */
+typedef struct {
+	unlang_load_balance_child_t	*children;	//!< One per child, only for "least-latency".
+} unlang_thread_load_balance_t;
+
 /** State of a redundant operation
  *
  */
 typedef struct {
-	unlang_t 		*child;
-	unlang_t		*found;
+	unlang_t 			*child;
+	unlang_t			*found;
+
+	unlang_load_balance_child_t	*running;	//!< Stats for the child we're waiting on.
+	fr_time_t			started;	//!< When we pushed that child.
 } unlang_frame_state_redundant_t;
 
 /** Cast a group structure to the load_balance keyword extension
@@ -58,6 +78,10 @@ static inline unlang_group_t *unlang_load_balance_to_group(unlang_load_balance_t
 	return (unlang_group_t *)load_balance;
 }
 
+#ifdef WITH_PERF
+void unlang_load_balance_perf_dump(fr_log_t *log, unlang_t const *instruction, char const *file, int line);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -1063,6 +1063,93 @@ done:
 	return ua;
 }
 
+/** Call a module method which was declared synchronous
+ *
+ * The method always returns a result directly, so there's no need to
+ * allocate frame state, or to set up for resumption, signals and retries.
+ */
+static unlang_action_t unlang_module_sync(rlm_rcode_t *p_result, request_t *request, unlang_stack_frame_t *frame)
+{
+	unlang_module_t			*mc = unlang_generic_to_module(frame->instruction);
+	module_thread_instance_t	*thread;
+	char const			*previous_module = request->module;
+	void				*env_data = NULL;
+	rlm_rcode_t			rcode = RLM_MODULE_NOOP;
+	unlang_action_t			ua;
+
+	RDEBUG4("[%i] %s - %s (%s)", stack_depth_current(request), __FUNCTION__,
+		mc->mi->module->exported->name, mc->mi->name);
+
+	/*
+	 *	Return administratively configured return code
+	 */
+	if (mc->mi->force) {
+		rcode = mc->mi->code;
+		ua = UNLANG_ACTION_CALCULATE_RESULT;
+		goto done;
+	}
+
+	/*
+	 *	The call_env only contains constants, so it's
+	 *	filled in without pushing any frames.
+	 */
+	if (mc->call_env) {
+		call_env_result_t	env_result;
+
+		if ((call_env_expand(request, request, &env_result, &env_data, mc->call_env) != UNLANG_ACTION_CALCULATE_RESULT) ||
+		    (env_result != CALL_ENV_SUCCESS)) {
+			talloc_free(env_data);
+			rcode = RLM_MODULE_FAIL;
+			ua = UNLANG_ACTION_CALCULATE_RESULT;
+			goto done;
+		}
+	}
+
+	thread = module_thread(mc->mi);
+	fr_assert(thread != NULL);
+
+	thread->total_calls++;
+
+	request->module = mc->mi->name;
+	safe_lock(mc->mi);	/* Noop unless instance->mutex set */
+	ua = mc->method(&rcode, MODULE_CTX(mc->mi, thread->data, env_data, NULL), request);
+	safe_unlock(mc->mi);
+	request->module = previous_module;
+	talloc_free(env_data);
+
+	if (request->master_state == REQUEST_STOP_PROCESSING) {
+		RWARN("Module %s became unblocked", mc->mi->name);
+		*p_result = rcode;
+		return UNLANG_ACTION_STOP_PROCESSING;
+	}
+
+	switch (ua) {
+	case UNLANG_ACTION_CALCULATE_RESULT:
+	case UNLANG_ACTION_UNWIND:
+		break;
+
+	case UNLANG_ACTION_FAIL:
+		rcode = RLM_MODULE_FAIL;
+		break;
+
+	default:
+		fr_assert_msg(0, "Synchronous method of module %s returned action %u", mc->mi->name, ua);
+		rcode = RLM_MODULE_FAIL;
+		ua = UNLANG_ACTION_CALCULATE_RESULT;
+		break;
+	}
+
+done:
+	fr_assert(rcode >= RLM_MODULE_REJECT);
+	fr_assert(rcode < RLM_MODULE_NOT_SET);
+
+	RDEBUG("%s (%s)", frame->instruction->name ? frame->instruction->name : "",
+	       fr_table_str_by_value(mod_rcode_table, rcode, "<invalid>"));
+
+	*p_result = rcode;
+	return ua;
+}
+
 void unlang_module_init(void)
 {
 	unlang_register(UNLANG_TYPE_MODULE,
@@ -1074,4 +1161,11 @@ void unlang_module_init(void)
 				.frame_state_size = sizeof(unlang_frame_state_module_t),
 				.frame_state_type = "unlang_frame_state_module_t",
 			   });
+
+	unlang_register(UNLANG_TYPE_MODULE_SYNC,
+			   &(unlang_op_t){
+				.name = "module",
+				.interpret = unlang_module_sync,
+				.rcode_set = true
+			   });
 }
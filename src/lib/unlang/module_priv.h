@@ -88,7 +88,7 @@ typedef struct {
 
 static inline unlang_module_t *unlang_generic_to_module(unlang_t const *p)
 {
-	fr_assert(p->type == UNLANG_TYPE_MODULE);
+	fr_assert((p->type == UNLANG_TYPE_MODULE) || (p->type == UNLANG_TYPE_MODULE_SYNC));
 	return UNCONST(unlang_module_t *, talloc_get_type_abort_const(p, unlang_module_t));
 }
 
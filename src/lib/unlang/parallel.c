@@ -31,6 +31,56 @@ RCSID("$Id$")
 #include "subrequest_priv.h"
 
 
+/** Give a child back its own pair lists
+ *
+ * Must be called before a child which was using its parent's lists is freed,
+ * otherwise freeing the child would free the parent's session-state.
+ */
+static inline CC_HINT(always_inline) void unlang_parallel_child_unshare(unlang_parallel_child_t *child)
+{
+	if (!child->pair_root || !child->request) return;
+
+	child->request->pair_root = child->pair_root;
+	child->request->pair_list = child->pair_list;
+	child->pair_root = NULL;
+}
+
+/** Hide the parent's session-state and local variables from "shared" children
+ *
+ * The children navigate the parent's pair_root, so they're given empty
+ * session-state and local lists in place of the parent's.  Only the request,
+ * reply, and control lists are shared, as with "clone", nothing else is.
+ */
+static void unlang_parallel_share(request_t *request, unlang_parallel_state_t *state)
+{
+	fr_pair_t *local;
+
+	state->parent_state = request_state_replace(request, NULL);
+
+	MEM(local = fr_pair_afrom_da(request->pair_root, request_attr_local));
+	state->parent_local = request->local_ctx;
+	fr_pair_remove(&request->pair_root->children, state->parent_local);
+	fr_pair_append(&request->pair_root->children, local);
+	request->local_ctx = local;
+}
+
+/** Give the parent back its own session-state and local variables
+ *
+ * Must be called after all of the "shared" children have been unshared.
+ */
+static void unlang_parallel_unshare(request_t *request, unlang_parallel_state_t *state)
+{
+	if (!state->parent_state) return;
+
+	talloc_free(request_state_replace(request, state->parent_state));
+	state->parent_state = NULL;
+
+	fr_pair_delete(&request->pair_root->children, request->local_ctx);
+	fr_pair_append(&request->pair_root->children, state->parent_local);
+	request->local_ctx = state->parent_local;
+	state->parent_local = NULL;
+}
+
 /** Cancel a specific child
  *
  */
@@ -47,6 +97,7 @@ static inline CC_HINT(always_inline) void unlang_parallel_cancel_child(unlang_pa
 
 	case CHILD_EXITED:
 		state->children[i].state = CHILD_CANCELLED;
+		unlang_parallel_child_unshare(&state->children[i]);
 		TALLOC_FREE(state->children[i].request);
 		break;
 
@@ -63,6 +114,7 @@ static inline CC_HINT(always_inline) void unlang_parallel_cancel_child(unlang_pa
 		/*
 		 *	Free it.
 		 */
+		unlang_parallel_child_unshare(&state->children[i]);
 		TALLOC_FREE(state->children[i].request);
 		break;
 
@@ -72,6 +124,7 @@ static inline CC_HINT(always_inline) void unlang_parallel_cancel_child(unlang_pa
 		/*
 		 *	Completed children just get freed
 		 */
+		unlang_parallel_child_unshare(&state->children[i]);
 		TALLOC_FREE(state->children[i].request);
 		break;
 
@@ -123,6 +176,12 @@ static void unlang_parallel_child_signal(request_t *request, UNUSED fr_signal_t
 		request->name,
 		child->num + 1, state->num_children);
 
+	/*
+	 *	The child outlives the parallel section, so it
+	 *	can't keep using the parent's lists.
+	 */
+	unlang_parallel_child_unshare(child);
+
 	child->state = CHILD_DETACHED;
 	child->request = NULL;
 	state->num_complete++;
@@ -240,9 +299,12 @@ static unlang_action_t unlang_parallel_resume(rlm_rcode_t *p_result, request_t *
 		if (!state->children[i].request) continue;
 
 		fr_assert(!fr_heap_entry_inserted(state->children[i].request->runnable_id));
+		unlang_parallel_child_unshare(&state->children[i]);
 		TALLOC_FREE(state->children[i].request);
 	}
 
+	unlang_parallel_unshare(request, state);
+
 	*p_result = state->result;
 	return UNLANG_ACTION_CALCULATE_RESULT;
 }
@@ -266,6 +328,8 @@ static unlang_action_t unlang_parallel_process(rlm_rcode_t *p_result, request_t
 		state->result = RLM_MODULE_NOOP;
 	}
 
+	if (state->shared) unlang_parallel_share(request, state);
+
 	/*
 	 *	Loop over all the children.
 	 *
@@ -282,7 +346,28 @@ static unlang_action_t unlang_parallel_process(rlm_rcode_t *p_result, request_t
 			child->name,
 			i + 1, state->num_children);
 
-		if (state->clone) {
+		/*
+		 *	The child uses the parent's lists directly, so
+		 *	nothing needs to be copied, and edits made by
+		 *	the child are visible to the parent (and its
+		 *	siblings) immediately.
+		 *
+		 *	Only one child runs at a time, so there are no
+		 *	races, but the order of edits made by children
+		 *	which yield depends on when they resume.
+		 *
+		 *	The parent's session-state and local variables
+		 *	were swapped out by unlang_parallel_share().
+		 */
+		if (state->shared) {
+			state->children[i].pair_root = child->pair_root;
+			state->children[i].pair_list = child->pair_list;
+			state->children[i].request = child;
+
+			child->pair_root = request->pair_root;
+			child->pair_list = request->pair_list;
+
+		} else if (state->clone) {
 			/*
 			 *	Note that we do NOT copy the
 			 *	Session-State list!  That
@@ -311,6 +396,7 @@ static unlang_action_t unlang_parallel_process(rlm_rcode_t *p_result, request_t
 					 *
 					 *	Should also free detached children
 					 */
+					unlang_parallel_child_unshare(&state->children[i]);
 					unlang_interpret_request_done(child);
 
 					/*
@@ -320,6 +406,7 @@ static unlang_action_t unlang_parallel_process(rlm_rcode_t *p_result, request_t
 					for (--i; i >= 0; i--) unlang_interpret_request_done(child);
 				}
 
+				unlang_parallel_unshare(request, state);
 				RETURN_MODULE_FAIL;
 			}
 		}
@@ -418,7 +505,7 @@ static unlang_action_t unlang_parallel_process(rlm_rcode_t *p_result, request_t
 /** Send a signal from parent request to all of it's children
  *
  */
-static void unlang_parallel_signal(UNUSED request_t *request,
+static void unlang_parallel_signal(request_t *request,
 				   unlang_stack_frame_t *frame, fr_signal_t action)
 {
 	unlang_parallel_state_t	*state = talloc_get_type_abort(frame->state, unlang_parallel_state_t);
@@ -427,6 +514,7 @@ static void unlang_parallel_signal(UNUSED request_t *request,
 	if (action == FR_SIGNAL_CANCEL) {
 		for (i = 0; i < state->num_children; i++) unlang_parallel_cancel_child(state, i);
 
+		unlang_parallel_unshare(request, state);
 		return;
 	}
 
@@ -476,6 +564,7 @@ static unlang_action_t unlang_parallel(rlm_rcode_t *p_result, request_t *request
 	state->priority = -1;				/* as-yet unset */
 	state->detach = gext->detach;
 	state->clone = gext->clone;
+	state->shared = gext->shared;
 	state->num_children = g->num_children;
 
 	/*
@@ -54,6 +54,10 @@ typedef struct {
 	request_t			*request; 	//!< Child request.
 	char				*name;		//!< Cache the request name.
 	unlang_t const			*instruction;	//!< broken out of g->children
+
+	fr_pair_t			*pair_root;	//!< The child's own pair root, while it's using
+							///< the parent's lists.
+	request_pair_lists_t		pair_list;	//!< The child's own pair lists.
 } unlang_parallel_child_t;
 
 typedef struct {
@@ -65,6 +69,12 @@ typedef struct {
 
 	bool				detach;		//!< are we creating the child detached
 	bool				clone;		//!< are the children cloned
+	bool				shared;		//!< do the children use the parent's lists
+
+	fr_pair_t			*parent_state;	//!< The parent's session-state, while the
+							///< children are using the parent's lists.
+	fr_pair_t			*parent_local;	//!< The parent's local variables, while the
+							///< children are using the parent's lists.
 
 	unlang_parallel_child_t		children[];	//!< Array of children.
 } unlang_parallel_state_t;
@@ -73,6 +83,7 @@ typedef struct {
 	unlang_group_t			group;
 	bool				detach;		//!< are we creating the child detached
 	bool				clone;
+	bool				shared;		//!< children use the parent's lists instead of copies
 } unlang_parallel_t;
 
 /** Cast a group structure to the parallel keyword extension
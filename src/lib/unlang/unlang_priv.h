@@ -32,6 +32,14 @@
 #include <freeradius-devel/unlang/base.h>
 #include <freeradius-devel/io/listen.h>
 
+#ifdef WITH_PERF
+#  ifdef HAVE_STDATOMIC_H
+#    include <stdatomic.h>
+#  else
+#    include <freeradius-devel/util/stdatomic.h>
+#  endif
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -74,6 +82,7 @@ typedef enum {
 	UNLANG_TYPE_XLAT,			//!< Represents one level of an xlat expansion.
 	UNLANG_TYPE_TMPL,			//!< asynchronously expand a tmpl_t
 	UNLANG_TYPE_EDIT,			//!< edit VPs in place.  After 20 years!
+	UNLANG_TYPE_MODULE_SYNC,		//!< Module method which never yields, called inline.
 	UNLANG_TYPE_MAX
 } unlang_type_t;
 
@@ -233,10 +242,16 @@ typedef struct {
 	unlang_t const		*instruction;			//!< instruction which we're executing
 	void			*thread_inst;			//!< thread-specific instance data
 #ifdef WITH_PERF
-	uint64_t		use_count;			//!< how many packets it has processed
+	/*
+	 *	The totals are only written by the thread which owns them,
+	 *	but are read by other threads, i.e. the one servicing radmin.
+	 */
+	atomic_uint_fast64_t	use_count;			//!< how many packets it has processed
 	uint64_t		running;			//!< currently running this instruction
 	uint64_t		yielded;			//!< currently yielded
-	fr_time_tracking_t	tracking;			//!< tracking cpu time
+	atomic_uint_fast64_t	yield_count;			//!< how many times it has yielded to the scheduler
+	atomic_uint_fast64_t	running_total;			//!< cpu time, in nanoseconds
+	atomic_uint_fast64_t	waiting_total;			//!< time spent yielded, in nanoseconds
 #endif
 } unlang_thread_t;
 
@@ -245,11 +260,13 @@ void	*unlang_thread_instance(unlang_t const *instruction);
 #ifdef WITH_PERF
 void		unlang_frame_perf_init(unlang_stack_frame_t *frame);
 void		unlang_frame_perf_yield(unlang_stack_frame_t *frame);
+void		unlang_frame_perf_suspend(unlang_stack_frame_t *frame);
 void		unlang_frame_perf_resume(unlang_stack_frame_t *frame);
 void		unlang_frame_perf_cleanup(unlang_stack_frame_t *frame);
 #else
 #define		unlang_frame_perf_init(_x)
 #define		unlang_frame_perf_yield(_x)
+#define		unlang_frame_perf_suspend(_x)
 #define		unlang_frame_perf_resume(_x)
 #define		unlang_frame_perf_cleanup(_x)
 #endif
@@ -568,6 +585,8 @@ int		unlang_op_init(void);
 
 void		unlang_op_free(void);
 
+void		unlang_compile_stack_size(unsigned int *depth, size_t *state_size);
+
 /** @} */
 
 /** @name io shims
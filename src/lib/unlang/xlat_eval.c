@@ -772,6 +772,242 @@ static xlat_action_t xlat_null_resume(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_
 	return XLAT_ACTION_DONE;
 }
 
+/** A memoised call to an xlat function
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;		//!< Entry in the per-request tree.
+	fr_dlist_t		entry;		//!< Entry in the pending list, while the function is running.
+
+	xlat_exp_t const	*exp;		//!< The function call.
+	uint32_t		hash;		//!< Of the arguments.
+	fr_value_box_list_t const *key;		//!< Arguments to compare, points to "args" once inserted.
+	fr_value_box_list_t	args;		//!< Copy of the arguments the function was called with.
+
+	fr_value_box_list_t	out;		//!< What the function returned.
+	bool			done;		//!< Whether "out" is valid.
+} xlat_memo_entry_t;
+
+/** Per-request memoisation table
+ *
+ */
+typedef struct {
+	request_t		*request;	//!< The table belongs to.
+	fr_rb_tree_t		*tree;		//!< Of xlat_memo_entry_t.
+	fr_dlist_head_t		pending;	//!< Functions which have yielded, and are still running.
+	uint64_t		hits;		//!< Number of function calls avoided.
+	uint64_t		misses;		//!< Number of function calls made.
+} xlat_memo_t;
+
+static char const xlat_memo_id = 0;
+
+/** Say how useful the table was, when the request is done with it
+ *
+ */
+static int _xlat_memo_free(xlat_memo_t *memo)
+{
+	request_t *request = memo->request;
+
+	if (memo->hits || memo->misses) {
+		RDEBUG2("Memoised xlat calls - hits %" PRIu64 ", misses %" PRIu64, memo->hits, memo->misses);
+	}
+
+	return 0;
+}
+
+static uint32_t xlat_memo_hash(fr_value_box_list_t const *list, uint32_t hash)
+{
+	fr_value_box_list_foreach(list, vb) {
+		uint32_t value;
+
+		hash = fr_hash_update(&vb->type, sizeof(vb->type), hash);
+
+		if (fr_type_is_group(vb->type)) {
+			hash = xlat_memo_hash(&vb->vb_group, hash);
+			continue;
+		}
+
+		value = fr_value_box_hash(vb);
+		hash = fr_hash_update(&value, sizeof(value), hash);
+	}
+
+	return hash;
+}
+
+static int8_t xlat_memo_list_cmp(fr_value_box_list_t const *a, fr_value_box_list_t const *b)
+{
+	fr_value_box_t const	*vb_a, *vb_b;
+	int8_t			ret;
+
+	ret = CMP(fr_value_box_list_num_elements(a), fr_value_box_list_num_elements(b));
+	if (ret != 0) return ret;
+
+	for (vb_a = fr_value_box_list_head(a), vb_b = fr_value_box_list_head(b);
+	     vb_a && vb_b;
+	     vb_a = fr_value_box_list_next(a, vb_a), vb_b = fr_value_box_list_next(b, vb_b)) {
+		CMP_RETURN(vb_a, vb_b, type);
+		CMP_RETURN(vb_a, vb_b, tainted);
+		CMP_RETURN(vb_a, vb_b, safe_for);
+
+		if (fr_type_is_group(vb_a->type)) {
+			ret = xlat_memo_list_cmp(&vb_a->vb_group, &vb_b->vb_group);
+		} else if (fr_type_is_null(vb_a->type)) {
+			ret = 0;
+		} else {
+			ret = fr_value_box_cmp(vb_a, vb_b);
+
+			/*
+			 *	Not comparable, so never equal.
+			 */
+			if (ret < -1) ret = CMP(vb_a, vb_b);
+		}
+		if (ret != 0) return ret;
+	}
+
+	return 0;
+}
+
+static int8_t xlat_memo_cmp(void const *one, void const *two)
+{
+	xlat_memo_entry_t const *a = one, *b = two;
+
+	CMP_RETURN(a, b, exp);
+	CMP_RETURN(a, b, hash);
+
+	return xlat_memo_list_cmp(a->key, b->key);
+}
+
+/** Whether the results of a function call can be re-used within a request
+ *
+ * Functions with a call_env are excluded, as their inputs aren't only their arguments.
+ */
+static inline CC_HINT(always_inline) bool xlat_memo_enabled(xlat_exp_t const *node)
+{
+	if (!main_config || !main_config->memoize_xlat) return false;
+
+	if (node->type != XLAT_FUNC) return false;
+
+	if (node->call.func->call_env_method) return false;
+
+	return node->call.func->flags.pure || node->call.func->cacheable;
+}
+
+/** Find the memoised result of a function call, or start tracking a new one
+ *
+ * @param[out] out	the entry.  If "done" is set, the function doesn't need to be called.
+ *			Otherwise the caller should call the function, and then
+ *			#xlat_memo_done with the entry.
+ * @param[in] request	the current request.
+ * @param[in] node	the function call.
+ * @param[in] args	the processed arguments to the function.
+ */
+static void xlat_memo_find(xlat_memo_entry_t **out, request_t *request, xlat_exp_t const *node,
+			   fr_value_box_list_t const *args)
+{
+	xlat_memo_t		*memo;
+	xlat_memo_entry_t	*entry, find;
+
+	*out = NULL;
+
+	memo = request_data_reference(request, &xlat_memo_id, 0);
+	if (!memo) {
+		MEM(memo = talloc_zero(request, xlat_memo_t));
+		memo->request = request;
+		talloc_set_destructor(memo, _xlat_memo_free);
+		MEM(memo->tree = fr_rb_inline_talloc_alloc(memo, xlat_memo_entry_t, node, xlat_memo_cmp, NULL));
+		fr_dlist_talloc_init(&memo->pending, xlat_memo_entry_t, entry);
+
+		if (request_data_talloc_add(request, &xlat_memo_id, 0, xlat_memo_t, memo, true, false, false) < 0) {
+			talloc_free(memo);
+			return;
+		}
+	}
+
+	find.exp = node;
+	find.hash = xlat_memo_hash(args, 0);
+	find.key = args;
+
+	entry = fr_rb_find(memo->tree, &find);
+	if (entry) {
+		if (entry->done) {
+			memo->hits++;
+			*out = entry;
+			return;
+		}
+
+		/*
+		 *	A previous call failed, or was cancelled.
+		 */
+		fr_rb_delete(memo->tree, entry);
+		if (fr_dlist_entry_in_list(&entry->entry)) fr_dlist_remove(&memo->pending, entry);
+		talloc_free(entry);
+	}
+
+	memo->misses++;
+
+	MEM(entry = talloc_zero(memo, xlat_memo_entry_t));
+	entry->exp = node;
+	entry->hash = find.hash;
+	entry->key = &entry->args;
+	fr_value_box_list_init(&entry->args);
+	fr_value_box_list_init(&entry->out);
+
+	if (fr_value_box_list_acopy(entry, &entry->args, args) < 0) {
+		talloc_free(entry);
+		return;
+	}
+
+	fr_rb_insert(memo->tree, entry);
+	fr_dlist_insert_tail(&memo->pending, entry);
+
+	*out = entry;
+}
+
+/** Record the output of a function call
+ *
+ * @param[in] entry	as returned by #xlat_memo_find.
+ * @param[in] list	the function wrote its output to.
+ * @param[in] first	box the function returned, or NULL if it returned nothing.
+ */
+static void xlat_memo_done(xlat_memo_entry_t *entry, fr_value_box_list_t const *list, fr_value_box_t const *first)
+{
+	xlat_memo_t		*memo = talloc_get_type_abort(talloc_parent(entry), xlat_memo_t);
+	fr_value_box_t const	*vb;
+
+	if (fr_dlist_entry_in_list(&entry->entry)) fr_dlist_remove(&memo->pending, entry);
+
+	for (vb = first; vb; vb = fr_value_box_list_next(list, vb)) {
+		fr_value_box_t *copy;
+
+		MEM(copy = fr_value_box_alloc_null(entry));
+		if (unlikely(fr_value_box_copy(copy, copy, vb) < 0)) {
+			fr_value_box_list_talloc_free(&entry->out);
+			return;
+		}
+		fr_value_box_list_insert_tail(&entry->out, copy);
+	}
+
+	entry->done = true;
+}
+
+/** Find the most recent call to a function which yielded
+ *
+ */
+static xlat_memo_entry_t *xlat_memo_pending(request_t *request, xlat_exp_t const *node)
+{
+	xlat_memo_t		*memo;
+	xlat_memo_entry_t	*entry = NULL;
+
+	memo = request_data_reference(request, &xlat_memo_id, 0);
+	if (!memo) return NULL;
+
+	while ((entry = fr_dlist_prev(&memo->pending, entry))) {
+		if (entry->exp == node) return entry;
+	}
+
+	return NULL;
+}
+
 /** Call an xlat's resumption method
  *
  * @param[in] ctx		to allocate value boxes in.
@@ -833,6 +1069,12 @@ xlat_action_t xlat_frame_eval_resume(TALLOC_CTX *ctx, fr_dcursor_t *out,
 					 fr_dcursor_current(out))) return XLAT_ACTION_FAIL;
 		}
 
+		if (xlat_memo_enabled(node)) {
+			xlat_memo_entry_t *entry = xlat_memo_pending(request, node);
+
+			if (entry) xlat_memo_done(entry, (fr_value_box_list_t *)out->dlist, fr_dcursor_current(out));
+		}
+
 		/*
 		 *	It's easier if we get xlat_frame_eval to continue evaluating the frame.
 		 */
@@ -880,6 +1122,7 @@ xlat_action_t xlat_frame_eval_repeat(TALLOC_CTX *ctx, fr_dcursor_t *out,
 		xlat_action_t		xa;
 		xlat_thread_inst_t	*t;
 		fr_value_box_list_t	result_copy;
+		xlat_memo_entry_t	*memo = NULL;
 
 		t = xlat_thread_instance_find(node);
 		fr_assert(t);
@@ -909,6 +1152,42 @@ xlat_action_t xlat_frame_eval_repeat(TALLOC_CTX *ctx, fr_dcursor_t *out,
 		}
 
 		VALUE_BOX_LIST_VERIFY(result);
+
+		/*
+		 *	The same function has already been called with
+		 *	the same arguments.  Re-use its output.
+		 */
+		if (xlat_memo_enabled(node)) {
+			xlat_memo_find(&memo, request, node, result);
+			if (memo && memo->done) {
+				fr_value_box_list_foreach(&memo->out, vb) {
+					fr_value_box_t *copy;
+
+					MEM(copy = fr_value_box_alloc_null(ctx));
+					if (unlikely(fr_value_box_copy(copy, copy, vb) < 0)) {
+						talloc_free(copy);
+						fr_value_box_list_talloc_free(&result_copy);
+						return XLAT_ACTION_FAIL;
+					}
+					fr_dcursor_append(out, copy);
+				}
+
+				if (RDEBUG_ENABLED2) {
+					REXDENT();
+					xlat_debug_log_expansion(request, *in, &result_copy, __LINE__);
+					RINDENT();
+				}
+				fr_value_box_list_talloc_free(&result_copy);
+
+				fr_dcursor_next(out);
+				REXDENT();
+				RDEBUG2("| (memoised)");
+				xlat_debug_log_result(request, *in, fr_dcursor_current(out));
+				RINDENT();
+				break;
+			}
+		}
+
 		xa = node->call.func->func(ctx, out,
 					   XLAT_CTX(node->call.inst->data, t->data, t->mctx, env_data, NULL),
 					   request, result);
@@ -944,6 +1223,7 @@ xlat_action_t xlat_frame_eval_repeat(TALLOC_CTX *ctx, fr_dcursor_t *out,
 			if (!xlat_process_return(request, node->call.func,
 						 (fr_value_box_list_t *)out->dlist,
 						 fr_dcursor_current(out))) return XLAT_ACTION_FAIL;
+			if (memo) xlat_memo_done(memo, (fr_value_box_list_t *)out->dlist, fr_dcursor_current(out));
 			RINDENT();
 			break;
 		}
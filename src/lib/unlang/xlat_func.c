@@ -407,6 +407,7 @@ void xlat_func_flags_set(xlat_t *x, xlat_func_flags_t flags)
 {
 	x->flags.pure = flags & XLAT_FUNC_FLAG_PURE;
 	x->internal = flags & XLAT_FUNC_FLAG_INTERNAL;
+	x->cacheable = flags & XLAT_FUNC_FLAG_CACHEABLE;
 }
 
 /** Set a print routine for an xlat function.
@@ -36,7 +36,9 @@ DIAG_OFF(attributes)
 typedef enum CC_HINT(flag_enum) {
 	XLAT_FUNC_FLAG_NONE = 0x00,
 	XLAT_FUNC_FLAG_PURE = 0x01,
-	XLAT_FUNC_FLAG_INTERNAL = 0x02
+	XLAT_FUNC_FLAG_INTERNAL = 0x02,
+	XLAT_FUNC_FLAG_CACHEABLE = 0x04		//!< Not pure, but calls with the same arguments
+						///< return the same output for the life of a request.
 } xlat_func_flags_t;
 DIAG_ON(attributes)
 
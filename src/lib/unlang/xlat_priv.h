@@ -61,6 +61,8 @@ typedef struct xlat_s {
 	xlat_func_t		func;			//!< async xlat function (async unsafe).
 
 	bool			internal;		//!< If true, cannot be redefined.
+	bool			cacheable;		//!< Output only depends on the arguments, so it can be
+							///< re-used within a request.
 	fr_token_t		token;			//!< for expressions
 
 	module_inst_ctx_t const	*mctx;			//!< Original module instantiation ctx if this
@@ -58,6 +58,9 @@ typedef struct {
 
 	unsigned int	num_elements;	//!< Number of elements contained within the dlist.
 
+	unsigned int	generation;	//!< Incremented whenever elements are added, removed
+					///< or reordered.  Lets callers detect stale indexes.
+
 	char const	*type;		//!< of items contained within the list.  Used for talloc
 					///< validation.
 } fr_dlist_head_t;
@@ -286,6 +289,7 @@ static inline void _fr_dlist_init(fr_dlist_head_t *list_head, size_t offset, cha
 	list_head->offset = offset;
 	list_head->type = type;
 	list_head->num_elements = 0;
+	list_head->generation = 0;
 }
 
 /** Efficiently remove all elements in a dlist
@@ -296,6 +300,7 @@ static inline void fr_dlist_clear(fr_dlist_head_t *list_head)
 {
 	fr_dlist_entry_init(&list_head->entry);
 	list_head->num_elements = 0;
+	list_head->generation++;
 }
 
 /** Verify we're not going to overflow the element count
@@ -358,6 +363,7 @@ static inline CC_HINT(nonnull) int fr_dlist_insert_head(fr_dlist_head_t *list_he
 	head->next = entry;
 
 	list_head->num_elements++;
+	list_head->generation++;
 
 	return 0;
 }
@@ -398,6 +404,7 @@ static inline CC_HINT(nonnull) int fr_dlist_insert_tail(fr_dlist_head_t *list_he
 	head->prev = entry;
 
 	list_head->num_elements++;
+	list_head->generation++;
 
 	return 0;
 }
@@ -434,6 +441,7 @@ static inline CC_HINT(nonnull(1,3)) int fr_dlist_insert_after(fr_dlist_head_t *l
 	fr_dlist_entry_link_after(pos_entry, entry);
 
 	list_head->num_elements++;
+	list_head->generation++;
 
 	return 0;
 }
@@ -470,6 +478,7 @@ static inline CC_HINT(nonnull(1,3)) int fr_dlist_insert_before(fr_dlist_head_t *
 	fr_dlist_entry_link_before(pos_entry, entry);
 
 	list_head->num_elements++;
+	list_head->generation++;
 
 	return 0;
 }
@@ -656,6 +665,7 @@ static inline CC_HINT(nonnull(1)) void *fr_dlist_remove(fr_dlist_head_t *list_he
 	entry->prev = entry->next = entry;
 
 	list_head->num_elements--;
+	list_head->generation++;
 
 	if (prev == head) return NULL;	/* Works with fr_dlist_next so that the next item is the list HEAD */
 
@@ -720,6 +730,7 @@ static inline void *fr_dlist_replace(fr_dlist_head_t *list_head, void *item, voi
 	ptr_entry = fr_dlist_item_to_entry(list_head->offset, ptr);
 
 	fr_dlist_entry_replace(item_entry, ptr_entry);
+	list_head->generation++;
 
 	return item;
 }
@@ -796,9 +807,11 @@ static inline CC_HINT(nonnull) int fr_dlist_move(fr_dlist_head_t *list_dst, fr_d
 	dst->prev = src->prev;
 
 	list_dst->num_elements += list_src->num_elements;
+	list_dst->generation++;
 
 	fr_dlist_entry_init(src);
 	list_src->num_elements = 0;
+	list_src->generation++;
 
 	return 0;
 }
@@ -840,9 +853,11 @@ static inline CC_HINT(nonnull) int fr_dlist_move_head(fr_dlist_head_t *list_dst,
 	dst->next = src->next;
 
 	list_dst->num_elements += list_src->num_elements;
+	list_dst->generation++;
 
 	fr_dlist_entry_init(src);
 	list_src->num_elements = 0;
+	list_src->generation++;
 
 	return 0;
 }
@@ -1068,6 +1083,7 @@ static inline void fr_dlist_sort(fr_dlist_head_t *list, fr_cmp_t cmp)
 
 	if (fr_dlist_num_elements(list) <= 1) return;
 
+	list->generation++;
 	head = fr_dlist_head(list);
 	/* NULL terminate existing list */
 	list->entry.prev->next = NULL;
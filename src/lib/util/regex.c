@@ -37,6 +37,170 @@ RCSID("$Id$")
 #endif
 #endif
 
+#if defined(HAVE_REGEX_PCRE2) || defined(HAVE_REGEX_PCRE)
+/*
+ *	Characters which have a special meaning outside of
+ *	a character class, or which end one.
+ */
+static bool const regex_meta[UINT8_MAX + 1] = {
+	['\\'] = true, ['^'] = true, ['$'] = true, ['.'] = true,
+	['['] = true, ['|'] = true, ['('] = true, [')'] = true,
+	['?'] = true, ['*'] = true, ['+'] = true, ['{'] = true,
+	['}'] = true, [']'] = true
+};
+
+/*
+ *	Escapes which consume the characters after them, such as
+ *	"\x41", "\101", "\cA" or "\pL".  Scanning backwards from
+ *	the '$' can't tell where these end.
+ */
+static bool const regex_escape_multi[UINT8_MAX + 1] = {
+	['0'] = true, ['1'] = true, ['2'] = true, ['3'] = true,
+	['4'] = true, ['5'] = true, ['6'] = true, ['7'] = true,
+	['8'] = true, ['9'] = true, ['c'] = true, ['g'] = true,
+	['k'] = true, ['N'] = true, ['o'] = true, ['p'] = true,
+	['P'] = true, ['x'] = true
+};
+
+/** Whether the character at p[i] is escaped by a preceding backslash
+ *
+ */
+static inline bool regex_is_escaped(char const *p, size_t i)
+{
+	size_t count = 0;
+
+	while ((i > 0) && (p[i - 1] == '\\')) {
+		count++;
+		i--;
+	}
+
+	return (count & 0x01) != 0;
+}
+
+/** Extract literal strings which any subject must start or end with
+ *
+ * Many policy regexes are anchored literals, such as realm checks of the
+ * form `/@example\.com$/`.  Checking the literal first is much cheaper
+ * than allocating match data and running the matcher, and rejects most
+ * subjects in long `if` / `elsif` chains of those expressions.
+ *
+ * Only simple patterns are examined.  Anything with alternation, inline
+ * options, start of pattern verbs such as (*CRLF), quoting, or flags
+ * which change how literals match, is left to the matcher.
+ *
+ * @param[in] preg	to add the literals to.
+ * @param[in] pattern	the regex was compiled from.
+ * @param[in] len	of the pattern.
+ * @param[in] flags	the regex was compiled with.  May be NULL.
+ */
+static void regex_prefilter_init(regex_t *preg, char const *pattern, size_t len, fr_regex_flags_t const *flags)
+{
+	char	buffer[256];
+	size_t	i, used;
+	bool	check_suffix = true;
+
+	if (flags && (flags->ignore_case || flags->multiline || flags->extended)) return;
+
+	for (i = 0; i < len; i++) {
+		if (pattern[i] == '\0') return;
+
+		if (regex_is_escaped(pattern, i)) {
+			if (pattern[i] == 'Q') return;		/* \Q...\E */
+			if (regex_escape_multi[(uint8_t) pattern[i]]) check_suffix = false;
+			continue;
+		}
+
+		if (pattern[i] == '|') return;
+		if ((pattern[i] == '(') && ((i + 1) < len) &&
+		    ((pattern[i + 1] == '?') || (pattern[i + 1] == '*'))) return;	/* (?i) or (*CRLF) */
+	}
+
+	/*
+	 *	^literal...
+	 */
+	if (pattern[0] == '^') {
+		used = 0;
+		for (i = 1; (i < len) && (used < sizeof(buffer)); i++) {
+			char c = pattern[i];
+
+			if (c == '\\') {
+				if (((i + 1) >= len) || isalnum((uint8_t) pattern[i + 1])) break;
+				c = pattern[++i];
+			} else if (regex_meta[(uint8_t) c]) {
+				break;
+			}
+
+			buffer[used++] = c;
+		}
+
+		/*
+		 *	The last character is optional.
+		 */
+		if ((used > 0) && (i < len) &&
+		    ((pattern[i] == '*') || (pattern[i] == '?') || (pattern[i] == '{'))) used--;
+
+		if (used > 0) {
+			preg->prefix = talloc_memdup(preg, buffer, used);
+			preg->prefix_len = used;
+		}
+	}
+
+	/*
+	 *	...literal$
+	 */
+	if (check_suffix && (len > 1) && (pattern[len - 1] == '$') && !regex_is_escaped(pattern, len - 1)) {
+		i = len - 1;
+		used = 0;
+
+		while ((i > 0) && (used < sizeof(buffer))) {
+			char c = pattern[i - 1];
+
+			if (regex_is_escaped(pattern, i - 1)) {
+				if (isalnum((uint8_t) c)) break;
+				i -= 2;
+			} else if (regex_meta[(uint8_t) c]) {
+				break;
+			} else {
+				i--;
+			}
+
+			buffer[sizeof(buffer) - ++used] = c;
+		}
+
+		if (used > 0) {
+			preg->suffix = talloc_memdup(preg, buffer + sizeof(buffer) - used, used);
+			preg->suffix_len = used;
+		}
+	}
+}
+
+/** Check a subject against the literals extracted by #regex_prefilter_init
+ *
+ * @return
+ *	- true if the subject may match.
+ *	- false if the subject cannot match.
+ */
+static inline CC_HINT(always_inline) bool regex_prefilter_match(regex_t const *preg, char const *subject, size_t len)
+{
+	if (preg->prefix &&
+	    ((len < preg->prefix_len) || (memcmp(subject, preg->prefix, preg->prefix_len) != 0))) return false;
+
+	if (preg->suffix) {
+		/*
+		 *	'$' also matches before a trailing newline.
+		 */
+		if ((len > 0) && (subject[len - 1] == '\n') &&
+		    ((len - 1) >= preg->suffix_len) &&
+		    (memcmp(subject + len - 1 - preg->suffix_len, preg->suffix, preg->suffix_len) == 0)) return true;
+
+		if ((len < preg->suffix_len) ||
+		    (memcmp(subject + len - preg->suffix_len, preg->suffix, preg->suffix_len) != 0)) return false;
+	}
+
+	return true;
+}
+#endif
+
 /*
  *######################################
  *#      FUNCTIONS FOR LIBPCRE2        #
@@ -252,6 +416,8 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 		return -(ssize_t)offset;
 	}
 
+	regex_prefilter_init(preg, pattern, len, flags);
+
 	if (!runtime) {
 		preg->precompiled = true;
 
@@ -302,6 +468,11 @@ int regex_exec(regex_t *preg, char const *subject, size_t len, fr_regmatch_t *re
 	bool			dup_subject = true;
 	pcre2_match_data	*match_data;
 
+	if (!regex_prefilter_match(preg, subject, len)) {
+		if (regmatch) regmatch->used = 0;
+		return 0;
+	}
+
 	/*
 	 *	Thread local initialisation
 	 */
@@ -836,6 +1007,8 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 		return -(ssize_t)offset;
 	}
 
+	regex_prefilter_init(preg, pattern, len, flags);
+
 	if (!runtime) {
 		preg->precompiled = true;
 		preg->extra = pcre_study(preg->compiled, fr_pcre_study_flags, &error);
@@ -925,6 +1098,11 @@ int regex_exec(regex_t *preg, char const *subject, size_t len, fr_regmatch_t *re
 
 	if (unlikely(pcre_tls_init() < 0)) return -1;
 
+	if (!regex_prefilter_match(preg, subject, len)) {
+		if (regmatch) regmatch->used = 0;
+		return 0;
+	}
+
 	/*
 	 *	Disable capturing
 	 */
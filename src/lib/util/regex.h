@@ -69,6 +69,13 @@ typedef struct {
 	bool			precompiled;	//!< Whether this regex was precompiled,
 						///< or compiled for one off evaluation.
 	bool			jitd;		//!< Whether JIT data is available.
+
+	char			*prefix;	//!< Literal the subject must start with, if the
+						///< pattern is anchored with '^'.
+	size_t			prefix_len;	//!< Length of the prefix.
+	char			*suffix;	//!< Literal the subject must end with, if the
+						///< pattern is anchored with '$'.
+	size_t			suffix_len;	//!< Length of the suffix.
 } regex_t;
 /*
  *######################################
@@ -114,6 +121,11 @@ typedef struct {
 
 	bool			precompiled;	//!< Whether this regex was precompiled, or compiled for one off evaluation.
 	bool			jitd;		//!< Whether JIT data is available.
+
+	char			*prefix;	//!< Literal the subject must start with.
+	size_t			prefix_len;	//!< Length of the prefix.
+	char			*suffix;	//!< Literal the subject must end with.
+	size_t			suffix_len;	//!< Length of the suffix.
 } regex_t;
 /*
  *######################################
@@ -226,7 +226,7 @@ int persistent_sync_search_entry(sync_state_t *sync, LDAPMessage *msg, LDAPContr
 	}
 	if (!ctrls[i]) goto missing_control;
 
-	if (sync->phase == SYNC_PHASE_INIT) sync->phase = SYNC_PHASE_DONE;
+	if (sync->phase == SYNC_PHASE_INIT) ldap_sync_refresh_done(sync, !sync->config->changes_only);
 
 	/*
 	 *  Get the value of the control.
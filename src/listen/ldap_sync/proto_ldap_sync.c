@@ -44,6 +44,8 @@ static conf_parser_t const ldap_sync_search_config[] = {
 	/* For persistent search directories, setting this to "no" will load the whole directory. */
 	{ FR_CONF_OFFSET("changes_only", sync_config_t, changes_only), .dflt = "yes" },
 
+	{ FR_CONF_OFFSET("replica", sync_config_t, replica_name) },
+
 	CONF_PARSER_TERMINATOR
 };
 
@@ -317,7 +319,21 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		sync_conf->attrs = talloc_array(sync_conf, char const *, 1);
 		sync_conf->attrs[0] = NULL;
 
+		/*
+		 *	Entries are copied into the replica whole, so
+		 *	request all user attributes.
+		 */
+		if (sync_conf->replica_name) {
+			sync_conf->replica = fr_ldap_replica_alloc(sync_conf, sync_conf->replica_name);
+			if (!sync_conf->replica) {
+				cf_log_perr(sync_cs, "Failed allocating replica");
+				return -1;
+			}
+			ldap_sync_conf_attr_add(sync_conf, "*");
+		}
+
 		if (map_list_empty(&sync_conf->entry_map)) {
+			if (sync_conf->replica) continue;
 			cf_log_warn(conf, "LDAP sync specified without update map");
 			continue;
 		}
@@ -129,6 +129,9 @@ struct sync_config_s {
 
 	char const		*root_dn;		//!< The root DN for the directory.
 
+	char const		*replica_name;		//!< Name of the local replica to copy entries into.
+	fr_ldap_replica_t	*replica;		//!< Local replica fed by this sync, may be NULL.
+
 	CONF_SECTION		*cs;			//!< Config section where this sync was defined.
 							//!< Used for logging.
 
@@ -165,6 +165,8 @@ static int sync_state_free(sync_state_t *sync)
 
 	trigger_exec(NULL, sync->config->cs, "ldap_sync.stop", true, &sync->trigger_args);
 
+	if (sync->config->replica) fr_ldap_replica_feed_stop(sync->config->replica, sync->replica_refreshed);
+
 	if (!sync->conn->handle) return 0;	/* Handled already closed? */
 
 	/*
@@ -200,6 +202,8 @@ sync_state_t *sync_state_alloc(TALLOC_CTX *ctx, fr_ldap_connection_t *conn, prot
 
 	fr_dlist_talloc_init(&sync->pending, sync_packet_ctx_t, entry);
 
+	if (config->replica) fr_ldap_replica_feed_start(config->replica);
+
 	/*
 	 *	Create arguments to pass to triggers
 	 */
@@ -403,6 +407,79 @@ static fr_ldap_sync_packet_code_t const sync_packet_code_table[4] = {
 	FR_LDAP_SYNC_CODE_DELETE
 };
 
+/** Record that the initial refresh phase of a sync is complete
+ *
+ * @param[in] sync	which has completed its refresh.
+ * @param[in] full	whether the refresh included every entry in scope, rather than
+ *			only changes.  Only then can the replica answer negative lookups.
+ */
+void ldap_sync_refresh_done(sync_state_t *sync, bool full)
+{
+	proto_ldap_sync_ldap_thread_t	*thread;
+
+	if (sync->phase == SYNC_PHASE_DONE) return;
+
+	sync->phase = SYNC_PHASE_DONE;
+
+	if (!full || !sync->config->replica || sync->replica_refreshed) return;
+
+	DEBUG2("Replica \"%s\" refreshed from base dn \"%s\"", sync->config->replica_name, sync->config->base_dn);
+	fr_ldap_replica_feed_refreshed(sync->config->replica);
+	sync->replica_refreshed = true;
+
+	thread = talloc_get_type_abort(sync->config->user_ctx, proto_ldap_sync_ldap_thread_t);
+	thread->replica_loaded[sync->sync_no] = true;
+}
+
+/** Copy an entry change into the replica fed by the sync
+ *
+ */
+static void ldap_sync_replica_update(sync_state_t *sync, uint8_t const uuid[SYNC_UUID_LENGTH],
+				     struct berval *orig_dn, LDAPMessage *msg, sync_op_t op)
+{
+	fr_ldap_replica_t	*replica = sync->config->replica;
+
+	/*
+	 *	Entry was renamed, and there's no UUID to tie the
+	 *	old and new versions together.
+	 */
+	if (!uuid && orig_dn && (orig_dn->bv_len > 0)) {
+		char *old_dn = fr_ldap_berval_to_string(NULL, orig_dn);
+
+		fr_ldap_replica_delete(replica, NULL, old_dn);
+		talloc_free(old_dn);
+	}
+
+	switch (op) {
+	case SYNC_OP_ADD:
+	case SYNC_OP_MODIFY:
+	case SYNC_OP_PRESENT:
+		/*
+		 *	RFC 4533 "present" notifications for unchanged
+		 *	entries carry no entry.
+		 */
+		if (!msg) return;
+
+		if (fr_ldap_replica_upsert(replica, sync->conn->handle, uuid, msg) < 0) {
+			PERROR("Failed updating replica \"%s\"", sync->config->replica_name);
+		}
+		return;
+
+	case SYNC_OP_DELETE:
+	{
+		char *dn = NULL;
+
+		if (!uuid && msg) dn = ldap_get_dn(sync->conn->handle, msg);
+		fr_ldap_replica_delete(replica, uuid, dn);
+		if (dn) ldap_memfree(dn);
+	}
+		return;
+
+	default:
+		return;
+	}
+}
+
 /** Enqueue a new entry change packet.
  *
  * @param[in] sync	notification has arrived for.
@@ -437,6 +514,8 @@ int ldap_sync_entry_send(sync_state_t *sync, uint8_t const uuid[SYNC_UUID_LENGTH
 		return -1;
 	}
 
+	if (sync->config->replica) ldap_sync_replica_update(sync, uuid, orig_dn, msg, op);
+
 	pcode = sync_packet_code_table[op];
 
 	fr_pair_list_append_by_da(sync_packet_ctx, vp, pairs, attr_packet_type, (uint32_t)pcode, false);
@@ -929,6 +1008,16 @@ static ssize_t proto_ldap_child_mod_write(fr_listen_t *li, void *packet_ctx, UNU
 		vp = fr_pair_find_by_da_nested(&tmp, NULL, attr_ldap_sync_cookie);
 		if (vp) cookie = talloc_memdup(inst, vp->vp_octets, vp->vp_length);
 
+		/*
+		 *	A stored cookie would only get us the changes since it
+		 *	was issued.  An empty replica needs the whole directory.
+		 */
+		if (cookie && inst->parent->sync_config[packet_id]->replica && !thread->replica_loaded[packet_id]) {
+			DEBUG2("Ignoring stored cookie, replica \"%s\" requires a full refresh",
+			       inst->parent->sync_config[packet_id]->replica_name);
+			TALLOC_FREE(cookie);
+		}
+
 		if (inst->parent->sync_config[packet_id]->init(thread->conn->h, packet_id, inst->parent, cookie) < 0) {
 			ret = -1;
 			goto finish;
@@ -1268,6 +1357,7 @@ static void mod_event_list_set(fr_listen_t *li, fr_event_list_t *el, void *nr)
 	thread->el = el;
 	thread->nr = nr;
 	thread->inst = inst;
+	MEM(thread->replica_loaded = talloc_zero_array(thread, bool, talloc_array_length(inst->parent->sync_config)));
 
 	/*
 	 *	Initialise the connection
@@ -56,6 +56,9 @@ struct sync_state_s {
 
 	sync_phases_t			phase;		//!< Phase this sync is in.
 
+	bool				replica_refreshed;	//!< The replica has received a complete
+								///< copy of the entries from this sync.
+
 	fr_dlist_head_t			*filter;	//!< Parsed filter to be applied on the network side
 							//!< before passing packets to the worker.
 							//!< Predominantly to overcome Active Directory's lack
@@ -121,6 +124,9 @@ typedef struct {
 	fr_event_timer_t const		*conn_retry_ev;		//!< When to retry re-establishing the conn.
 
 	fr_connection_t			*conn;			//!< Our connection to the LDAP directory.
+
+	bool				*replica_loaded;	//!< Per sync, whether a full refresh has been copied
+								//!< into its replica, so stored cookies may be used.
 } proto_ldap_sync_ldap_thread_t;
 
 typedef enum {
@@ -168,3 +174,5 @@ int ldap_sync_cookie_send(sync_packet_ctx_t *sync_packet_ctx);
 
 int ldap_sync_entry_send(sync_state_t *sync, uint8_t const uuid[SYNC_UUID_LENGTH], struct berval *orig_dn,
 			LDAPMessage *msg, sync_op_t op);
+
+void ldap_sync_refresh_done(sync_state_t *sync, bool full);
@@ -549,7 +549,7 @@ int rfc4533_sync_intermediate(sync_state_t *sync, LDAPMessage *msg, UNUSED LDAPC
 			goto error;
 		}
 
-		if (refresh_done) sync->phase = SYNC_PHASE_DONE;
+		if (refresh_done) ldap_sync_refresh_done(sync, true);
 		break;
 
 	/*
@@ -594,7 +594,7 @@ int rfc4533_sync_intermediate(sync_state_t *sync, LDAPMessage *msg, UNUSED LDAPC
 			ERROR("Malformed refreshPresent sequence");
 			goto error;
 		}
-		if (refresh_done) sync->phase = SYNC_PHASE_DONE;
+		if (refresh_done) ldap_sync_refresh_done(sync, true);
 		break;
 
 	/*
@@ -94,12 +94,14 @@ fr_dict_autoload_t proto_radius_dict[] = {
 	{ NULL }
 };
 
+static fr_dict_attr_t const *attr_original_request_authenticator;
 static fr_dict_attr_t const *attr_packet_type;
 static fr_dict_attr_t const *attr_user_name;
 static fr_dict_attr_t const *attr_state;
 
 extern fr_dict_attr_autoload_t proto_radius_dict_attr[];
 fr_dict_attr_autoload_t proto_radius_dict_attr[] = {
+	{ .out = &attr_original_request_authenticator, .name = "Vendor-Specific.FreeRADIUS.Original-Request-Authenticator", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
 	{ .out = &attr_packet_type, .name = "Packet-Type", .type = FR_TYPE_UINT32, .dict = &dict_radius},
 	{ .out = &attr_user_name, .name = "User-Name", .type = FR_TYPE_STRING, .dict = &dict_radius},
 	{ .out = &attr_state, .name = "State", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
@@ -292,8 +294,9 @@ static int mod_decode(UNUSED void const *instance, request_t *request, uint8_t *
 	return 0;
 }
 
-static ssize_t mod_encode(UNUSED void const *instance, request_t *request, uint8_t *buffer, size_t buffer_len)
+static ssize_t mod_encode(void const *instance, request_t *request, uint8_t *buffer, size_t buffer_len)
 {
+	proto_radius_t const	*inst = talloc_get_type_abort_const(instance, proto_radius_t);
 	fr_io_track_t		*track = talloc_get_type_abort(request->async->packet_ctx, fr_io_track_t);
 	fr_io_address_t const  	*address = track->address;
 	ssize_t			data_len;
@@ -360,6 +363,23 @@ static ssize_t mod_encode(UNUSED void const *instance, request_t *request, uint8
 		request->reply->socket.inet.src_ipaddr = client->src_ipaddr;
 	}
 
+	/*
+	 *	The client can track multiple packets with the same
+	 *	ID, so tell it which one we're replying to.  This is
+	 *	only done when the listener tracks packets by Request
+	 *	Authenticator, otherwise packets reusing an ID are
+	 *	treated as duplicates or conflicts, and the client
+	 *	must not rely on it.
+	 */
+	if ((inst->accept_conflicting_packets || client->dedup_authenticator) &&
+	    fr_pair_find_by_da(&request->request_pairs, NULL, attr_original_request_authenticator) &&
+	    !fr_pair_find_by_da(&request->reply_pairs, NULL, attr_original_request_authenticator)) {
+		fr_pair_t *vp;
+
+		MEM(pair_append_reply(&vp, attr_original_request_authenticator) >= 0);
+		fr_pair_value_memdup(vp, request->packet->data + 4, RADIUS_AUTH_VECTOR_LENGTH, false);
+	}
+
 	data_len = fr_radius_encode(buffer, buffer_len, request->packet->data,
 				    client->secret, talloc_array_length(client->secret) - 1,
 				    request->reply->code, request->reply->id, &request->reply_pairs);
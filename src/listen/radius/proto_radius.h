@@ -36,6 +36,9 @@ typedef struct {
 	uint32_t			num_messages;			//!< for message ring buffer.
 
 	bool				tunnel_password_zeros;		//!< check for trailing zeroes in Tunnel-Password.
+	bool				accept_conflicting_packets;	//!< Set by the transport when it tracks packets by
+									///< Request Authenticator, so Original-Request-Authenticator
+									///< can be echoed.
 
 	uint32_t			priorities[FR_RADIUS_CODE_MAX];	//!< priorities for individual packets
 
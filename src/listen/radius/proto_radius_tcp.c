@@ -433,6 +433,7 @@ static char const *mod_name(fr_listen_t *li)
 static int mod_instantiate(module_inst_ctx_t const *mctx)
 {
 	proto_radius_tcp_t	*inst = talloc_get_type_abort(mctx->mi->data, proto_radius_tcp_t);
+	proto_radius_t		*parent_inst = talloc_get_type_abort(mctx->mi->parent->data, proto_radius_t);
 	CONF_SECTION		*conf = mctx->mi->conf;
 	size_t			i, num;
 	CONF_ITEM		*ci;
@@ -621,6 +622,12 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		}
 	}
 
+	/*
+	 *	proto_radius needs to know if it can echo
+	 *	Original-Request-Authenticator in replies.
+	 */
+	parent_inst->accept_conflicting_packets = inst->dedup_authenticator;
+
 	ci = cf_section_to_item(mctx->mi->parent->conf); /* listen { ... } */
 	fr_assert(ci != NULL);
 	ci = cf_parent(ci);
@@ -192,7 +192,7 @@ module_rlm_t rlm_always = {
 		.detach		= mod_detach
 	},
 	.bindings = (module_method_binding_t[]){
-		{ .section = SECTION_NAME(CF_IDENT_ANY, CF_IDENT_ANY), .method = mod_always_return },
+		{ .section = SECTION_NAME(CF_IDENT_ANY, CF_IDENT_ANY), .method = mod_always_return, .synchronous = true },
 		MODULE_BINDING_TERMINATOR
 	}
 };
@@ -389,8 +389,8 @@ module_rlm_t rlm_chap = {
 		.instantiate	= mod_instantiate
 	},
 	.bindings = (module_method_binding_t[]){
-		{ .section = SECTION_NAME("authenticate", CF_IDENT_ANY), .method = mod_authenticate, .method_env = &chap_auth_method_env },
-		{ .section = SECTION_NAME("recv", "access-request"), .method = mod_authorize, .method_env = &chap_autz_method_env },
+		{ .section = SECTION_NAME("authenticate", CF_IDENT_ANY), .method = mod_authenticate, .method_env = &chap_auth_method_env, .synchronous = true },
+		{ .section = SECTION_NAME("recv", "access-request"), .method = mod_authorize, .method_env = &chap_autz_method_env, .synchronous = true },
 		MODULE_BINDING_TERMINATOR
 	}
 };
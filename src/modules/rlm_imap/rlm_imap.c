@@ -253,7 +253,7 @@ static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 		return -1;
 	}
 
-	mhandle = fr_curl_io_init(t, mctx->el, false);
+	mhandle = fr_curl_io_init(t, mctx->el, false, &inst->conn_config);
 	if (!mhandle) return -1;
 
 	t->mhandle = mhandle;
@@ -0,0 +1,417 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file group_cache.c
+ * @brief Cache of group names and memberships shared by all workers.
+ *
+ * Resolving the groups a user belongs to usually means one search per group DN
+ * to find the group's name, or one search of the group objects using the
+ * membership filter.  The results change rarely, so they're kept here for
+ * a configurable lifetime, and served to every worker thread.
+ *
+ * Failed resolutions (dangling group DNs, users with no memberships) are cached
+ * too, with their own, usually shorter, lifetime.
+ *
+ * @copyright 2024 The FreeRADIUS Server Project.
+ */
+RCSID("$Id$")
+
+USES_APPLE_DEPRECATED_API
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/rb.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+#define LOG_PREFIX "rlm_ldap group cache"
+
+#include "rlm_ldap.h"
+
+/** A cached DN to name resolution, or a cached set of group memberships
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;			//!< Entry in the dn2name or membership tree.
+	fr_dlist_t		lru;			//!< Entry in the least recently used list.
+	fr_rb_tree_t		*tree;			//!< Tree this entry lives in.
+
+	char			*key;			//!< Normalised group DN, or expanded membership filter.
+	char			*base_dn;		//!< Normalised base DN a membership filter was searched under.
+	int			scope;			//!< Scope a membership filter was searched with.
+	char			*user_dn;		//!< Normalised DN of the user a set of memberships belongs to.
+	fr_time_t		expires;		//!< When this entry should no longer be used.
+
+	char			**values;		//!< Group name, or group names/DNs the user is a member of.
+							///< NULL for a negative entry.
+} ldap_group_cache_entry_t;
+
+struct rlm_ldap_group_cache_s {
+	pthread_mutex_t		mutex;			//!< Protects the trees and the LRU list.
+	fr_rb_tree_t		*dn2name;		//!< Group DN to group name.
+	fr_rb_tree_t		*membership;		//!< Base DN, scope and membership filter to group list.
+	fr_dlist_head_t		lru;			//!< Least recently used entries at the head.
+
+	fr_time_delta_t		lifetime;		//!< How long positive entries are kept.
+	fr_time_delta_t		negative_lifetime;	//!< How long negative entries are kept.
+	uint32_t		max_entries;		//!< Maximum number of entries across both trees.
+
+	atomic_uint_fast64_t	saved;			//!< Directory searches avoided.
+	atomic_uint_fast64_t	misses;			//!< Lookups which had to go to the directory.
+	atomic_uint_fast64_t	evictions;		//!< Entries removed to make room for new ones.
+};
+
+static int8_t group_cache_dn_cmp(void const *one, void const *two)
+{
+	ldap_group_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = strcasecmp(a->key, b->key);
+	return CMP(ret, 0);
+}
+
+static int8_t group_cache_membership_cmp(void const *one, void const *two)
+{
+	ldap_group_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->scope, b->scope);
+	if (ret != 0) return ret;
+
+	ret = strcasecmp(a->base_dn, b->base_dn);
+	if (ret != 0) return CMP(ret, 0);
+
+	ret = strcmp(a->key, b->key);
+	return CMP(ret, 0);
+}
+
+/** Produce a normalised copy of a DN, suitable for use as a key
+ *
+ */
+static char *group_cache_dn(TALLOC_CTX *ctx, char const *dn)
+{
+	char *out;
+
+	MEM(out = talloc_strdup(ctx, dn));
+	fr_ldap_util_normalise_dn(out, out);
+
+	return out;
+}
+
+/** Remove an entry from its tree and the LRU list, and free it
+ *
+ * @note Must be called with the mutex held.
+ */
+static void group_cache_entry_free(rlm_ldap_group_cache_t *cache, ldap_group_cache_entry_t *entry)
+{
+	fr_rb_remove_by_inline_node(entry->tree, &entry->node);
+	fr_dlist_remove(&cache->lru, entry);
+	talloc_free(entry);
+}
+
+/** Find an unexpired entry, and mark it as recently used
+ *
+ * @note Must be called with the mutex held.
+ */
+static ldap_group_cache_entry_t *group_cache_find(rlm_ldap_group_cache_t *cache, fr_rb_tree_t *tree,
+						  ldap_group_cache_entry_t const *find)
+{
+	ldap_group_cache_entry_t	*entry;
+
+	entry = fr_rb_find(tree, find);
+	if (!entry) return NULL;
+
+	if (fr_time_lteq(entry->expires, fr_time())) {
+		group_cache_entry_free(cache, entry);
+		return NULL;
+	}
+
+	fr_dlist_remove(&cache->lru, entry);
+	fr_dlist_insert_tail(&cache->lru, entry);
+
+	return entry;
+}
+
+/** Insert an entry, replacing any existing entry with the same key
+ *
+ * @note Must be called with the mutex held.
+ */
+static void group_cache_insert(rlm_ldap_group_cache_t *cache, fr_rb_tree_t *tree, ldap_group_cache_entry_t *entry)
+{
+	ldap_group_cache_entry_t	*old;
+
+	old = fr_rb_find(tree, entry);
+	if (old) group_cache_entry_free(cache, old);
+
+	while (cache->max_entries && (fr_dlist_num_elements(&cache->lru) >= cache->max_entries)) {
+		group_cache_entry_free(cache, fr_dlist_head(&cache->lru));
+		atomic_fetch_add_explicit(&cache->evictions, 1, memory_order_relaxed);
+	}
+
+	entry->tree = tree;
+	entry->expires = fr_time_add(fr_time(), entry->values ? cache->lifetime : cache->negative_lifetime);
+	fr_rb_insert(tree, entry);
+	fr_dlist_insert_tail(&cache->lru, entry);
+}
+
+/** Look up the name of a group in the cache
+ *
+ * @param[in] ctx	to allocate the name in.
+ * @param[out] out	Where to write the group name.  NULL if the DN is known not to resolve.
+ * @param[in] cache	to search in.
+ * @param[in] dn	of the group.
+ * @return
+ *	- 1 if the DN was found in the cache.
+ *	- 0 if the DN was not found, and must be resolved using the directory.
+ */
+int rlm_ldap_group_cache_dn2name_find(TALLOC_CTX *ctx, char **out, rlm_ldap_group_cache_t *cache, char const *dn)
+{
+	ldap_group_cache_entry_t	*entry;
+	char				*key;
+
+	key = group_cache_dn(NULL, dn);
+
+	pthread_mutex_lock(&cache->mutex);
+	entry = group_cache_find(cache, cache->dn2name, &(ldap_group_cache_entry_t){ .key = key });
+	if (!entry) {
+		pthread_mutex_unlock(&cache->mutex);
+		talloc_free(key);
+		atomic_fetch_add_explicit(&cache->misses, 1, memory_order_relaxed);
+		return 0;
+	}
+	*out = entry->values ? talloc_typed_strdup(ctx, entry->values[0]) : NULL;
+	pthread_mutex_unlock(&cache->mutex);
+
+	talloc_free(key);
+	atomic_fetch_add_explicit(&cache->saved, 1, memory_order_relaxed);
+
+	return 1;
+}
+
+/** Record the result of resolving a group DN to a name
+ *
+ * @param[in] cache	to insert into.
+ * @param[in] dn	of the group.
+ * @param[in] name	of the group, or NULL if the DN did not resolve to an object.
+ * @param[in] len	of name.
+ */
+void rlm_ldap_group_cache_dn2name_insert(rlm_ldap_group_cache_t *cache, char const *dn, char const *name, size_t len)
+{
+	ldap_group_cache_entry_t	*entry;
+
+	MEM(entry = talloc_zero(NULL, ldap_group_cache_entry_t));
+	entry->key = group_cache_dn(entry, dn);
+	if (name) {
+		MEM(entry->values = talloc_array(entry, char *, 1));
+		MEM(entry->values[0] = talloc_bstrndup(entry->values, name, len));
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+	group_cache_insert(cache, cache->dn2name, entry);
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/** Look up the groups a membership search matched
+ *
+ * @param[in] ctx	to allocate the group array in.
+ * @param[out] out	A talloced array of group names and/or DNs.  NULL if the
+ *			filter matched no group objects.
+ * @param[in] cache	to search in.
+ * @param[in] base_dn	the group objects were searched under.
+ * @param[in] scope	of the search.
+ * @param[in] filter	the expanded membership filter.
+ * @return
+ *	- 1 if the search was found in the cache.
+ *	- 0 if the search was not found, and the group objects must be searched.
+ */
+int rlm_ldap_group_cache_membership_find(TALLOC_CTX *ctx, char ***out, rlm_ldap_group_cache_t *cache,
+					 char const *base_dn, int scope, char const *filter)
+{
+	ldap_group_cache_entry_t	*entry;
+	char				*base;
+	size_t				i;
+
+	base = group_cache_dn(NULL, base_dn);
+
+	pthread_mutex_lock(&cache->mutex);
+	entry = group_cache_find(cache, cache->membership,
+				 &(ldap_group_cache_entry_t){ .key = UNCONST(char *, filter),
+							      .base_dn = base, .scope = scope });
+	talloc_free(base);
+	if (!entry) {
+		pthread_mutex_unlock(&cache->mutex);
+		atomic_fetch_add_explicit(&cache->misses, 1, memory_order_relaxed);
+		return 0;
+	}
+
+	*out = NULL;
+	if (entry->values) {
+		MEM(*out = talloc_array(ctx, char *, talloc_array_length(entry->values)));
+		for (i = 0; i < talloc_array_length(entry->values); i++) {
+			MEM((*out)[i] = talloc_typed_strdup(*out, entry->values[i]));
+		}
+	}
+	pthread_mutex_unlock(&cache->mutex);
+
+	atomic_fetch_add_explicit(&cache->saved, 1, memory_order_relaxed);
+
+	return 1;
+}
+
+/** Record the groups a membership search matched
+ *
+ * @param[in] cache	to insert into.
+ * @param[in] base_dn	the group objects were searched under.
+ * @param[in] scope	of the search.
+ * @param[in] filter	the expanded membership filter.
+ * @param[in] user_dn	the filter was built for.  Used for invalidation, may be NULL.
+ * @param[in] groups	talloced array of group names and/or DNs.  NULL or empty if
+ *			the filter matched no group objects.
+ */
+void rlm_ldap_group_cache_membership_insert(rlm_ldap_group_cache_t *cache, char const *base_dn, int scope,
+					    char const *filter, char const *user_dn, char * const *groups)
+{
+	ldap_group_cache_entry_t	*entry;
+	size_t				i, count = groups ? talloc_array_length(groups) : 0;
+
+	MEM(entry = talloc_zero(NULL, ldap_group_cache_entry_t));
+	MEM(entry->key = talloc_typed_strdup(entry, filter));
+	entry->base_dn = group_cache_dn(entry, base_dn);
+	entry->scope = scope;
+	if (user_dn) entry->user_dn = group_cache_dn(entry, user_dn);
+	if (count) {
+		MEM(entry->values = talloc_array(entry, char *, count));
+		for (i = 0; i < count; i++) MEM(entry->values[i] = talloc_typed_strdup(entry->values, groups[i]));
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+	group_cache_insert(cache, cache->membership, entry);
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/** Remove entries which refer to a DN
+ *
+ * Removes the DN to name resolution for the DN, the memberships of the user
+ * with the DN, and any memberships which include the DN as a group.
+ *
+ * @param[in] cache	to remove entries from.
+ * @param[in] dn	to remove entries for.  If NULL all entries are removed.
+ * @return The number of entries removed.
+ */
+uint64_t rlm_ldap_group_cache_invalidate(rlm_ldap_group_cache_t *cache, char const *dn)
+{
+	ldap_group_cache_entry_t	*entry, *next;
+	char				*key = NULL;
+	uint64_t			count = 0;
+	size_t				i;
+
+	if (dn) key = group_cache_dn(NULL, dn);
+
+	pthread_mutex_lock(&cache->mutex);
+	for (entry = fr_dlist_head(&cache->lru); entry; entry = next) {
+		next = fr_dlist_next(&cache->lru, entry);
+
+		if (!key) goto remove;
+
+		if (entry->tree == cache->dn2name) {
+			if (strcasecmp(entry->key, key) == 0) goto remove;
+			continue;
+		}
+
+		if (entry->user_dn && (strcasecmp(entry->user_dn, key) == 0)) goto remove;
+
+		for (i = 0; entry->values && (i < talloc_array_length(entry->values)); i++) {
+			if (strcasecmp(entry->values[i], key) == 0) goto remove;
+		}
+		continue;
+
+	remove:
+		group_cache_entry_free(cache, entry);
+		count++;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+
+	talloc_free(key);
+
+	return count;
+}
+
+/** Retrieve the cache's counters
+ *
+ * @param[out] stats	Where to write the counters.
+ * @param[in] cache	to retrieve counters for.
+ */
+void rlm_ldap_group_cache_stats(rlm_ldap_group_cache_stats_t *stats, rlm_ldap_group_cache_t *cache)
+{
+	stats->saved = atomic_load_explicit(&cache->saved, memory_order_relaxed);
+	stats->misses = atomic_load_explicit(&cache->misses, memory_order_relaxed);
+	stats->evictions = atomic_load_explicit(&cache->evictions, memory_order_relaxed);
+
+	pthread_mutex_lock(&cache->mutex);
+	stats->entries = fr_dlist_num_elements(&cache->lru);
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+static int _group_cache_free(rlm_ldap_group_cache_t *cache)
+{
+	ldap_group_cache_entry_t	*entry;
+
+	while ((entry = fr_dlist_head(&cache->lru))) group_cache_entry_free(cache, entry);
+	pthread_mutex_destroy(&cache->mutex);
+
+	return 0;
+}
+
+/** Allocate a group cache
+ *
+ * @param[in] ctx		to allocate the cache in.
+ * @param[in] lifetime		of positive entries.
+ * @param[in] negative_lifetime	of negative entries.
+ * @param[in] max_entries	maximum number of entries, 0 for no limit.
+ * @return
+ *	- A new group cache.
+ *	- NULL on error.
+ */
+rlm_ldap_group_cache_t *rlm_ldap_group_cache_alloc(TALLOC_CTX *ctx, fr_time_delta_t lifetime,
+						   fr_time_delta_t negative_lifetime, uint32_t max_entries)
+{
+	rlm_ldap_group_cache_t	*cache;
+	int			ret;
+
+	MEM(cache = talloc_zero(ctx, rlm_ldap_group_cache_t));
+	if ((ret = pthread_mutex_init(&cache->mutex, NULL)) != 0) {
+		fr_strerror_printf("Failed initialising mutex: %s", fr_syserror(ret));
+		talloc_free(cache);
+		return NULL;
+	}
+
+	MEM(cache->dn2name = fr_rb_inline_talloc_alloc(cache, ldap_group_cache_entry_t, node, group_cache_dn_cmp, NULL));
+	MEM(cache->membership = fr_rb_inline_talloc_alloc(cache, ldap_group_cache_entry_t, node, group_cache_membership_cmp, NULL));
+	fr_dlist_talloc_init(&cache->lru, ldap_group_cache_entry_t, lru);
+
+	cache->lifetime = lifetime;
+	cache->negative_lifetime = negative_lifetime;
+	cache->max_entries = max_entries;
+	talloc_set_destructor(cache, _group_cache_free);
+
+	return cache;
+}
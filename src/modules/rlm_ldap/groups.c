@@ -65,6 +65,11 @@ typedef struct {
 	char const		*attrs[2];				//!< For retrieving the group name.
 	fr_ldap_query_t		*query;					//!< Current query performing group lookup.
 	void			*uctx;					//!< Optional context for use in results parsing.
+	char const		*user_dn;				//!< DN of the user memberships are being found for.
+	char			**groups;				//!< Memberships found, to add to the shared cache,
+									///< or retrieved from it.
+	bool			cached;					//!< Memberships were retrieved from the shared cache.
+	bool			replica;				//!< Membership was determined from the local replica.
 } ldap_group_groupobj_ctx_t;
 
 /** Context to use when evaluating group membership from the user object in an xlat
@@ -295,6 +300,9 @@ static unlang_action_t ldap_group_dn2name_resume(rlm_rcode_t *p_result, UNUSED i
 	case LDAP_RESULT_NO_RESULT:
 	case LDAP_RESULT_BAD_DN:
 		REDEBUG("Group DN \"%s\" did not resolve to an object", *group_ctx->dn);
+		if (inst->group.shared_cache.handle) {
+			rlm_ldap_group_cache_dn2name_insert(inst->group.shared_cache.handle, *group_ctx->dn, NULL, 0);
+		}
 		rcode = (inst->group.allow_dangling_refs ? RLM_MODULE_NOOP : RLM_MODULE_INVALID);
 		goto finish;
 
@@ -323,6 +331,11 @@ static unlang_action_t ldap_group_dn2name_resume(rlm_rcode_t *p_result, UNUSED i
 	fr_pair_append(&group_ctx->groups, vp);
 	RDEBUG2("Group DN \"%s\" resolves to name \"%pV\"", *group_ctx->dn, &vp->data);
 
+	if (inst->group.shared_cache.handle) {
+		rlm_ldap_group_cache_dn2name_insert(inst->group.shared_cache.handle, *group_ctx->dn,
+						    values[0]->bv_val, values[0]->bv_len);
+	}
+
 finish:
 	/*
 	 *	Walk the pointer to the DN being resolved forward
@@ -444,7 +457,6 @@ unlang_action_t rlm_ldap_cacheable_userobj(rlm_rcode_t *p_result, request_t *req
 					   char const *attr)
 {
 	rlm_ldap_t const		*inst = autz_ctx->inst;
-	LDAPMessage			*entry = autz_ctx->entry;
 	fr_ldap_thread_trunk_t		*ttrunk = autz_ctx->ttrunk;
 	ldap_group_userobj_ctx_t	*group_ctx;
 	struct berval			**values;
@@ -453,13 +465,13 @@ unlang_action_t rlm_ldap_cacheable_userobj(rlm_rcode_t *p_result, request_t *req
 	fr_pair_t			*vp;
 	int				is_dn, i, count, name2dn = 0, dn2name = 0;
 
-	fr_assert(entry);
+	fr_assert(autz_ctx->entry || autz_ctx->replica_entry);
 	fr_assert(attr);
 
 	/*
 	 *	Parse the membership information we got in the initial user query.
 	 */
-	values = ldap_get_values_len(fr_ldap_handle_thread_local(), entry, attr);
+	values = rlm_ldap_autz_values(autz_ctx, attr);
 	if (!values) {
 		RDEBUG2("No cacheable group memberships found in user object");
 
@@ -530,11 +542,35 @@ unlang_action_t rlm_ldap_cacheable_userobj(rlm_rcode_t *p_result, request_t *req
 			 *	this to a name.  Store group DNs which need resolving to names.
 			 */
 			} else {
+				char	*dn = fr_ldap_berval_to_string(group_ctx, values[i]);
+				char	*name;
+
+				/*
+				 *	Another request may already have resolved this DN.
+				 */
+				if (inst->group.shared_cache.handle &&
+				    rlm_ldap_group_cache_dn2name_find(group_ctx, &name, inst->group.shared_cache.handle, dn)) {
+					if (!name) {
+						RDEBUG2("Group DN \"%s\" is cached as not resolving to an object", dn);
+						if (!inst->group.allow_dangling_refs) goto invalid;
+						talloc_free(dn);
+						continue;
+					}
+
+					RDEBUG2("Group DN \"%s\" resolves to cached name \"%s\"", dn, name);
+					MEM(vp = fr_pair_afrom_da(group_ctx->list_ctx, inst->group.cache_da));
+					fr_pair_value_strdup(vp, name, true);
+					fr_pair_append(&group_ctx->groups, vp);
+					talloc_free(name);
+					talloc_free(dn);
+					continue;
+				}
+
 				if (++dn2name > LDAP_MAX_CACHEABLE) {
 					REDEBUG("Too many groups require DN to name resolution");
 					goto invalid;
 				}
-				*dn_p++ = fr_ldap_berval_to_string(group_ctx, values[i]);
+				*dn_p++ = dn;
 			}
 		}
 	}
@@ -582,6 +618,17 @@ static unlang_action_t ldap_cacheable_groupobj_start(rlm_rcode_t *p_result, UNUS
 
 	if (filter->type != FR_TYPE_STRING) RETURN_MODULE_FAIL;
 
+	/*
+	 *	Another request may already have performed this search.
+	 */
+	if (inst->group.shared_cache.handle &&
+	    rlm_ldap_group_cache_membership_find(group_ctx, &group_ctx->groups, inst->group.shared_cache.handle,
+						 group_ctx->base_dn->vb_strvalue, inst->group.obj_scope,
+						 filter->vb_strvalue)) {
+		group_ctx->cached = true;
+		RETURN_MODULE_OK;
+	}
+
 	group_ctx->attrs[0] = inst->group.obj_name_attr;
 	return fr_ldap_trunk_search(group_ctx, &group_ctx->query, request, group_ctx->ttrunk,
 				    group_ctx->base_dn->vb_strvalue, inst->group.obj_scope,
@@ -603,6 +650,31 @@ static void ldap_group_groupobj_cancel(UNUSED request_t *request, UNUSED fr_sign
 	fr_trunk_request_signal_cancel(group_ctx->query->treq);
 }
 
+/** Add a group object membership to the control list
+ *
+ * Also records the membership so it can be added to the shared cache.
+ */
+static void ldap_cacheable_groupobj_add(request_t *request, ldap_group_groupobj_ctx_t *group_ctx,
+					char const *value, size_t len)
+{
+	rlm_ldap_t const	*inst = group_ctx->inst;
+	fr_pair_t		*vp;
+	size_t			count;
+
+	MEM(pair_append_control(&vp, inst->group.cache_da) == 0);
+	fr_pair_value_bstrndup(vp, value, len, true);
+
+	RINDENT();
+	RDEBUG2("&control.%pP", vp);
+	REXDENT();
+
+	if (!inst->group.shared_cache.handle || group_ctx->cached) return;
+
+	count = group_ctx->groups ? talloc_array_length(group_ctx->groups) : 0;
+	MEM(group_ctx->groups = talloc_realloc(group_ctx, group_ctx->groups, char *, count + 1));
+	MEM(group_ctx->groups[count] = talloc_bstrndup(group_ctx->groups, value, len));
+}
+
 /** Process the results of a group object lookup.
  *
  * @param[out] p_result		Result of processing group lookup.
@@ -621,7 +693,25 @@ static unlang_action_t ldap_cacheable_groupobj_resume(rlm_rcode_t *p_result, UNU
 	LDAPMessage			*entry;
 	int				ldap_errno;
 	char				*dn;
-	fr_pair_t			*vp;
+	size_t				i;
+
+	/*
+	 *	Memberships were retrieved from the shared cache, no search was performed.
+	 */
+	if (group_ctx->cached) {
+		if (!group_ctx->groups) {
+			RDEBUG2("No cacheable group memberships found in group objects (cached)");
+			rcode = RLM_MODULE_NOTFOUND;
+			goto finish;
+		}
+
+		RDEBUG2("Adding cached group object memberships");
+		for (i = 0; i < talloc_array_length(group_ctx->groups); i++) {
+			ldap_cacheable_groupobj_add(request, group_ctx, group_ctx->groups[i],
+						    talloc_array_length(group_ctx->groups[i]) - 1);
+		}
+		goto finish;
+	}
 
 	switch (query->ret) {
 	case LDAP_SUCCESS:
@@ -631,7 +721,7 @@ static unlang_action_t ldap_cacheable_groupobj_resume(rlm_rcode_t *p_result, UNU
 	case LDAP_RESULT_BAD_DN:
 		RDEBUG2("No cacheable group memberships found in group objects");
 		rcode = RLM_MODULE_NOTFOUND;
-		goto finish;
+		goto store;
 
 	default:
 		rcode = RLM_MODULE_FAIL;
@@ -658,12 +748,7 @@ static unlang_action_t ldap_cacheable_groupobj_resume(rlm_rcode_t *p_result, UNU
 			}
 			fr_ldap_util_normalise_dn(dn, dn);
 
-			MEM(pair_append_control(&vp, inst->group.cache_da) == 0);
-			fr_pair_value_strdup(vp, dn, false);
-
-			RINDENT();
-			RDEBUG2("&control.%pP", vp);
-			REXDENT();
+			ldap_cacheable_groupobj_add(request, group_ctx, dn, strlen(dn));
 			ldap_memfree(dn);
 		}
 
@@ -673,17 +758,20 @@ static unlang_action_t ldap_cacheable_groupobj_resume(rlm_rcode_t *p_result, UNU
 			values = ldap_get_values_len(query->ldap_conn->handle, entry, inst->group.obj_name_attr);
 			if (!values) continue;
 
-			MEM(pair_append_control(&vp, inst->group.cache_da) == 0);
-			fr_pair_value_bstrndup(vp, values[0]->bv_val, values[0]->bv_len, true);
-
-			RINDENT();
-			RDEBUG2("&control.%pP", vp);
-			REXDENT();
+			ldap_cacheable_groupobj_add(request, group_ctx, values[0]->bv_val, values[0]->bv_len);
 
 			ldap_value_free_len(values);
 		}
 	} while ((entry = ldap_next_entry(query->ldap_conn->handle, entry)));
 
+store:
+	if (inst->group.shared_cache.handle) {
+		rlm_ldap_group_cache_membership_insert(inst->group.shared_cache.handle,
+						       group_ctx->base_dn->vb_strvalue, inst->group.obj_scope,
+						       fr_value_box_list_head(&group_ctx->expanded_filter)->vb_strvalue,
+						       group_ctx->user_dn, group_ctx->groups);
+	}
+
 finish:
 	talloc_free(group_ctx);
 
@@ -716,6 +804,7 @@ unlang_action_t rlm_ldap_cacheable_groupobj(rlm_rcode_t *p_result, request_t *re
 	group_ctx->inst = inst;
 	group_ctx->ttrunk = autz_ctx->ttrunk;
 	group_ctx->base_dn = &autz_ctx->call_env->group_base;
+	group_ctx->user_dn = rlm_find_user_dn_cached(request);
 	fr_value_box_list_init(&group_ctx->expanded_filter);
 
 	if (unlang_function_push(request, ldap_cacheable_groupobj_start, ldap_cacheable_groupobj_resume,
@@ -730,6 +819,91 @@ unlang_action_t rlm_ldap_cacheable_groupobj(rlm_rcode_t *p_result, request_t *re
 	return UNLANG_ACTION_PUSHED_CHILD;
 }
 
+/** Determine group membership from the group object held in the local replica
+ *
+ * A group object present in the replica is a complete copy, so it can always
+ * be checked against the search base and filter.  A group missing from the
+ * replica is only treated as non-existent once the replica has completed its
+ * initial refresh.
+ *
+ * @param request	Current request.
+ * @param group_ctx	Group lookup context.
+ * @param filter	Expanded search filter, including the membership filter.
+ * @return
+ *	- true if membership was determined, with found set in the xlat ctx.
+ *	- false if the directory must be searched.
+ */
+static bool ldap_check_groupobj_replica(request_t *request, ldap_group_groupobj_ctx_t *group_ctx, char const *filter)
+{
+	ldap_memberof_xlat_ctx_t	*xlat_ctx = talloc_get_type_abort(group_ctx->uctx, ldap_memberof_xlat_ctx_t);
+	rlm_ldap_t const		*inst = group_ctx->inst;
+	fr_ldap_replica_state_t		state;
+	fr_ldap_replica_entry_t		*group = NULL;
+	int				ret;
+
+	state = fr_ldap_replica_state(inst->replica.handle, inst->replica.max_staleness);
+	if (state == FR_LDAP_REPLICA_UNAVAILABLE) return false;
+
+	if (fr_ldap_util_is_dn(xlat_ctx->group->vb_strvalue, xlat_ctx->group->vb_length)) {
+		group = fr_ldap_replica_find_by_dn(group_ctx, inst->replica.handle, xlat_ctx->group->vb_strvalue);
+	} else if (fr_ldap_replica_find_by_index(group_ctx, &group, inst->replica.handle, inst->group.obj_name_attr,
+						 xlat_ctx->group->vb_strvalue, xlat_ctx->group->vb_length) < 0) {
+		RPDEBUG2("Group lookup in replica failed");
+		return false;
+	}
+
+	if (!group) {
+		if (state != FR_LDAP_REPLICA_COMPLETE) return false;
+
+		RDEBUG2("Group \"%pV\" not found in replica", xlat_ctx->group);
+		return true;
+	}
+
+	ret = fr_ldap_replica_entry_match(group, group_ctx->base_dn->vb_strvalue, inst->group.obj_scope, filter);
+	if (ret < 0) {
+		RPDEBUG2("Group lookup in replica failed");
+		talloc_free(group);
+		return false;
+	}
+
+	if (ret == 1) {
+		RDEBUG2("User found in replica group object \"%s\"", fr_ldap_replica_entry_dn(group));
+		xlat_ctx->found = true;
+	} else {
+		RDEBUG2("Replica group object \"%s\" does not match membership filter", fr_ldap_replica_entry_dn(group));
+	}
+	talloc_free(group);
+
+	return true;
+}
+
+/** Check group membership in the local replica, before searching the directory
+ *
+ * The shared membership cache is not consulted, the filter here checks for a single
+ * group, and its results are never cached.
+ */
+static unlang_action_t ldap_check_groupobj_start(rlm_rcode_t *p_result, UNUSED int *priority, request_t *request,
+						 void *uctx)
+{
+	ldap_group_groupobj_ctx_t	*group_ctx = talloc_get_type_abort(uctx, ldap_group_groupobj_ctx_t);
+	rlm_ldap_t const		*inst = group_ctx->inst;
+	fr_value_box_t			*filter;
+
+	filter = fr_value_box_list_head(&group_ctx->expanded_filter);
+
+	if (filter->type != FR_TYPE_STRING) RETURN_MODULE_FAIL;
+
+	if (inst->replica.handle && ldap_check_groupobj_replica(request, group_ctx, filter->vb_strvalue)) {
+		group_ctx->replica = true;
+		RETURN_MODULE_OK;
+	}
+
+	group_ctx->attrs[0] = inst->group.obj_name_attr;
+	return fr_ldap_trunk_search(group_ctx, &group_ctx->query, request, group_ctx->ttrunk,
+				    group_ctx->base_dn->vb_strvalue, inst->group.obj_scope,
+				    filter->vb_strvalue, group_ctx->attrs, NULL, NULL);
+}
+
 /** Process the results of a group object lookup.
  *
  * @param[out] p_result		Result of processing group lookup.
@@ -746,6 +920,11 @@ static unlang_action_t ldap_check_groupobj_resume(rlm_rcode_t *p_result, UNUSED
 	fr_ldap_query_t			*query = group_ctx->query;
 	rlm_rcode_t			rcode = RLM_MODULE_OK;
 
+	if (group_ctx->replica) {
+		if (!xlat_ctx->found) rcode = RLM_MODULE_NOTFOUND;
+		goto finish;
+	}
+
 	switch (query->ret) {
 	case LDAP_SUCCESS:
 		xlat_ctx->found = true;
@@ -771,6 +950,7 @@ static unlang_action_t ldap_check_groupobj_resume(rlm_rcode_t *p_result, UNUSED
 		break;
 	}
 
+finish:
 	talloc_free(group_ctx);
 	RETURN_MODULE_RCODE(rcode);
 }
@@ -839,7 +1019,7 @@ unlang_action_t rlm_ldap_check_groupobj_dynamic(rlm_rcode_t *p_result, request_t
 		group_ctx->base_dn = &xlat_ctx->env_data->group_base;
 	}
 
-	if (unlang_function_push(request, ldap_cacheable_groupobj_start, ldap_check_groupobj_resume,
+	if (unlang_function_push(request, ldap_check_groupobj_start, ldap_check_groupobj_resume,
 				 ldap_group_groupobj_cancel, ~FR_SIGNAL_CANCEL,
 				 UNLANG_SUB_FRAME, group_ctx) < 0) {
 	error:
@@ -885,6 +1065,36 @@ static void ldap_dn2name_cancel(UNUSED request_t *request, UNUSED fr_signal_t ac
 	fr_trunk_request_signal_cancel(group_ctx->query->treq);
 }
 
+/** Look up the group DN being resolved to a name in the shared cache
+ *
+ * @param[in] request		Current request.
+ * @param[in] group_ctx		Group membership evaluation context.
+ * @param[out] out		Where to write the group name.
+ * @return
+ *	- 1 if the name was found in the cache.
+ *	- 0 if the DN must be resolved using the directory.
+ *	- -1 if the DN is cached as not resolving to an object.
+ */
+static int ldap_dn2name_cached(request_t *request, ldap_group_userobj_dyn_ctx_t *group_ctx, char **out)
+{
+	rlm_ldap_t const	*inst = group_ctx->xlat_ctx->inst;
+
+	*out = NULL;
+	if (!inst->group.shared_cache.handle ||
+	    !rlm_ldap_group_cache_dn2name_find(group_ctx, out, inst->group.shared_cache.handle,
+					       group_ctx->lookup_dn)) return 0;
+
+	if (!*out) {
+		REDEBUG("Group DN \"%pV\" did not resolve to an object (cached)",
+			fr_box_strvalue_buffer(group_ctx->lookup_dn));
+		return -1;
+	}
+
+	RDEBUG2("Group DN \"%pV\" resolves to cached name \"%s\"", fr_box_strvalue_buffer(group_ctx->lookup_dn), *out);
+
+	return 1;
+}
+
 /** Initiate a user lookup to check membership.
  *
  * Used when the user's DN is already known but cached group membership has not been stored
@@ -957,6 +1167,10 @@ static unlang_action_t ldap_check_userobj_resume(rlm_rcode_t *p_result, UNUSED i
 		case LDAP_RESULT_BAD_DN:
 			REDEBUG("Group DN \"%pV\" did not resolve to an object",
 				fr_box_strvalue_buffer(group_ctx->lookup_dn));
+			if (inst->group.shared_cache.handle) {
+				rlm_ldap_group_cache_dn2name_insert(inst->group.shared_cache.handle,
+								    group_ctx->lookup_dn, NULL, 0);
+			}
 			RETURN_MODULE_INVALID;
 
 		default:
@@ -981,6 +1195,11 @@ static unlang_action_t ldap_check_userobj_resume(rlm_rcode_t *p_result, UNUSED i
 			fr_box_strvalue_len(values[0]->bv_val, values[0]->bv_len));
 		ldap_value_free_len(values);
 
+		if (inst->group.shared_cache.handle) {
+			rlm_ldap_group_cache_dn2name_insert(inst->group.shared_cache.handle, group_ctx->lookup_dn,
+							    buff, talloc_array_length(buff) - 1);
+		}
+
 		if (group_ctx->resolving_value) {
 			value_name = buff;
 		} else {
@@ -1059,6 +1278,12 @@ static unlang_action_t ldap_check_userobj_resume(rlm_rcode_t *p_result, UNUSED i
 			if (!group_ctx->group_name) {
 				group_ctx->lookup_dn = group->vb_strvalue;
 
+				if (ldap_dn2name_cached(request, group_ctx, &group_ctx->group_name) < 0) {
+					RETURN_MODULE_INVALID;
+				}
+			}
+
+			if (!group_ctx->group_name) {
 				if (unlang_function_repeat_set(request, ldap_check_userobj_resume) < 0) RETURN_MODULE_FAIL;
 
 				return unlang_function_push(request, ldap_dn2name_start, NULL, ldap_dn2name_cancel,
@@ -1084,6 +1309,17 @@ static unlang_action_t ldap_check_userobj_resume(rlm_rcode_t *p_result, UNUSED i
 			group_ctx->lookup_dn = fr_ldap_berval_to_string(group_ctx, value);
 			group_ctx->resolving_value = true;
 
+			switch (ldap_dn2name_cached(request, group_ctx, &value_name)) {
+			case 1:
+				continue;
+
+			case -1:
+				RETURN_MODULE_INVALID;
+
+			default:
+				break;
+			}
+
 			if (unlang_function_repeat_set(request, ldap_check_userobj_resume) < 0) RETURN_MODULE_FAIL;
 
 			return unlang_function_push(request, ldap_dn2name_start, NULL, ldap_dn2name_cancel,
@@ -32,6 +32,7 @@ RCSID("$Id$")
 USES_APPLE_DEPRECATED_API
 
 #include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/sha1.h>
 #include <freeradius-devel/util/table.h>
 #include <freeradius-devel/util/uri.h>
 #include <freeradius-devel/util/value.h>
@@ -113,6 +114,16 @@ static conf_parser_t user_config[] = {
 	CONF_PARSER_TERMINATOR
 };
 
+/*
+ *	Group cache shared between workers
+ */
+static conf_parser_t group_shared_cache_config[] = {
+	{ FR_CONF_OFFSET("lifetime", rlm_ldap_t, group.shared_cache.lifetime), .dflt = "0" },
+	{ FR_CONF_OFFSET("negative_lifetime", rlm_ldap_t, group.shared_cache.negative_lifetime), .dflt = "30" },
+	{ FR_CONF_OFFSET("max_entries", rlm_ldap_t, group.shared_cache.max_entries), .dflt = "16384" },
+	CONF_PARSER_TERMINATOR
+};
+
 /*
  *	Group configuration
  */
@@ -130,6 +141,26 @@ static conf_parser_t group_config[] = {
 	{ FR_CONF_OFFSET("group_attribute", rlm_ldap_t, group.attribute) },
 	{ FR_CONF_OFFSET("allow_dangling_group_ref", rlm_ldap_t, group.allow_dangling_refs), .dflt = "no" },
 	{ FR_CONF_OFFSET("skip_on_suspend", rlm_ldap_t, group.skip_on_suspend), .dflt = "yes"},
+	{ FR_CONF_POINTER("shared_cache", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) group_shared_cache_config },
+	CONF_PARSER_TERMINATOR
+};
+
+/*
+ *	Local replica configuration
+ */
+static conf_parser_t replica_config[] = {
+	{ FR_CONF_OFFSET("name", rlm_ldap_t, replica.name) },
+	{ FR_CONF_OFFSET("user_attribute", rlm_ldap_t, replica.user_attr) },
+	{ FR_CONF_OFFSET("max_staleness", rlm_ldap_t, replica.max_staleness), .dflt = "60" },
+	CONF_PARSER_TERMINATOR
+};
+
+/*
+ *	Cache of rejected credentials
+ */
+static conf_parser_t reject_cache_config[] = {
+	{ FR_CONF_OFFSET("lifetime", rlm_ldap_t, reject_cache.lifetime), .dflt = "0" },
+	{ FR_CONF_OFFSET("max_entries", rlm_ldap_t, reject_cache.max_entries), .dflt = "16384" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -175,10 +206,14 @@ static const conf_parser_t module_config[] = {
 
 	{ FR_CONF_POINTER("profile", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) profile_config },
 
+	{ FR_CONF_POINTER("replica", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) replica_config },
+
 	{ FR_CONF_OFFSET_SUBSECTION("pool", 0, rlm_ldap_t, trunk_conf, fr_trunk_config ) },
 
 	{ FR_CONF_OFFSET_SUBSECTION("bind_pool", 0, rlm_ldap_t, bind_trunk_conf, fr_trunk_config ) },
 
+	{ FR_CONF_POINTER("reject_cache", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) reject_cache_config },
+
 	CONF_PARSER_TERMINATOR
 };
 
@@ -244,6 +279,12 @@ static const call_env_method_t authorize_method_env = {
 								.pair.dflt = "(&)", .pair.dflt_quote = T_SINGLE_QUOTED_STRING },	//!< Correct filter for when the DN is known.
 						CALL_ENV_TERMINATOR
 					 } )) },
+		{ FR_CALL_ENV_SUBSECTION("replica", NULL, CALL_ENV_FLAG_NONE,
+					 ((call_env_parser_t[]) {
+						{ FR_CALL_ENV_OFFSET("user", FR_TYPE_STRING, CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_NULLABLE,
+								     ldap_autz_call_env_t, replica_user) },
+						CALL_ENV_TERMINATOR
+					 } )) },
 		CALL_ENV_TERMINATOR
 	}
 };
@@ -1001,6 +1042,95 @@ static xlat_action_t ldap_profile_xlat_resume(TALLOC_CTX *ctx, fr_dcursor_t *out
 	return XLAT_ACTION_DONE;
 }
 
+static xlat_arg_parser_t const ldap_group_cache_stats_xlat_arg[] = {
+	{ .required = true, .single = true, .type = FR_TYPE_STRING },
+	XLAT_ARG_PARSER_TERMINATOR
+};
+
+/** Return one of the shared group cache counters
+ *
+ * Valid counters are "saved" (directory searches avoided), "misses", "hit_ratio"
+ * (percentage of lookups served from the cache), "evictions" and "entries".
+ *
+@verbatim
+%ldap.group_cache_stats(<counter>)
+@endverbatim
+ *
+ * @ingroup xlat_functions
+ */
+static xlat_action_t ldap_group_cache_stats_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
+						 xlat_ctx_t const *xctx,
+						 request_t *request, fr_value_box_list_t *in)
+{
+	rlm_ldap_t const		*inst = talloc_get_type_abort_const(xctx->mctx->mi->data, rlm_ldap_t);
+	rlm_ldap_group_cache_stats_t	stats = {};
+	fr_value_box_t			*name = fr_value_box_list_head(in);
+	fr_value_box_t			*vb;
+	uint64_t			value;
+
+	if (inst->group.shared_cache.handle) rlm_ldap_group_cache_stats(&stats, inst->group.shared_cache.handle);
+
+	if (strcmp(name->vb_strvalue, "saved") == 0) {
+		value = stats.saved;
+	} else if (strcmp(name->vb_strvalue, "misses") == 0) {
+		value = stats.misses;
+	} else if (strcmp(name->vb_strvalue, "hit_ratio") == 0) {
+		value = (stats.saved + stats.misses) ? (stats.saved * 100) / (stats.saved + stats.misses) : 0;
+	} else if (strcmp(name->vb_strvalue, "evictions") == 0) {
+		value = stats.evictions;
+	} else if (strcmp(name->vb_strvalue, "entries") == 0) {
+		value = stats.entries;
+	} else {
+		REDEBUG("Unknown counter \"%s\", expected one of \"saved\", \"misses\", \"hit_ratio\", "
+			"\"evictions\" or \"entries\"", name->vb_strvalue);
+		return XLAT_ACTION_FAIL;
+	}
+
+	MEM(vb = fr_value_box_alloc(ctx, FR_TYPE_UINT64, NULL));
+	vb->vb_uint64 = value;
+	fr_dcursor_append(out, vb);
+
+	return XLAT_ACTION_DONE;
+}
+
+static xlat_arg_parser_t const ldap_group_cache_invalidate_xlat_arg[] = {
+	{ .concat = true, .type = FR_TYPE_STRING },
+	XLAT_ARG_PARSER_TERMINATOR
+};
+
+/** Remove entries from the shared group cache
+ *
+ * Removes the cached name of the group with the given DN, the cached memberships
+ * of the user with the given DN, and any cached memberships which include the DN.
+ * With no arguments, all entries are removed.  Returns the number of entries removed.
+ *
+ * Intended to be called from an ldap_sync virtual server when objects change.
+ *
+@verbatim
+%ldap.group_cache_invalidate([<dn>])
+@endverbatim
+ *
+ * @ingroup xlat_functions
+ */
+static xlat_action_t ldap_group_cache_invalidate_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
+						      xlat_ctx_t const *xctx,
+						      request_t *request, fr_value_box_list_t *in)
+{
+	rlm_ldap_t const	*inst = talloc_get_type_abort_const(xctx->mctx->mi->data, rlm_ldap_t);
+	fr_value_box_t		*dn = fr_value_box_list_head(in);
+	fr_value_box_t		*vb;
+
+	MEM(vb = fr_value_box_alloc(ctx, FR_TYPE_UINT64, NULL));
+	if (inst->group.shared_cache.handle) {
+		vb->vb_uint64 = rlm_ldap_group_cache_invalidate(inst->group.shared_cache.handle,
+								dn ? dn->vb_strvalue : NULL);
+		RDEBUG2("Removed %" PRIu64 " shared group cache entries", vb->vb_uint64);
+	}
+	fr_dcursor_append(out, vb);
+
+	return XLAT_ACTION_DONE;
+}
+
 static int ldap_xlat_profile_ctx_free(ldap_xlat_profile_ctx_t *to_free)
 {
 	if (to_free->url) {
@@ -1361,6 +1491,147 @@ static unlang_action_t mod_map_proc(rlm_rcode_t *p_result, void const *mod_inst,
 				    NULL, NULL);
 }
 
+/** A set of credentials the directory recently rejected
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;				//!< Entry in the tree of rejected credentials.
+	fr_dlist_t		lru;				//!< Entry in the least recently used list.
+	uint8_t			digest[SHA1_DIGEST_LENGTH];	//!< HMAC of the bind DN and password.
+	fr_time_t		expires;			//!< When the entry should no longer be used.
+} ldap_reject_entry_t;
+
+struct rlm_ldap_reject_cache_s {
+	pthread_mutex_t		mutex;				//!< Protects the tree and the LRU list.
+	fr_rb_tree_t		*tree;				//!< Rejected credentials, keyed by digest.
+	fr_dlist_head_t		lru;				//!< Least recently used entries at the head.
+	uint8_t			key[SHA1_DIGEST_LENGTH];	//!< Random key, so digests of common passwords
+								///< can't be computed in advance.
+};
+
+static int8_t ldap_reject_entry_cmp(void const *one, void const *two)
+{
+	ldap_reject_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = memcmp(a->digest, b->digest, sizeof(a->digest));
+	return CMP(ret, 0);
+}
+
+/** Produce the key for a set of credentials
+ *
+ * Passwords are never stored, only an HMAC of the bind DN and password.
+ */
+static void ldap_reject_digest(uint8_t digest[static SHA1_DIGEST_LENGTH], rlm_ldap_reject_cache_t const *cache,
+			       char const *dn, char const *password)
+{
+	fr_sha1_ctx	ctx;
+	uint8_t		inner[SHA1_DIGEST_LENGTH];
+
+	fr_sha1_init(&ctx);
+	fr_sha1_update(&ctx, (uint8_t const *)dn, strlen(dn) + 1);
+	fr_sha1_update(&ctx, (uint8_t const *)password, strlen(password));
+	fr_sha1_final(inner, &ctx);
+
+	fr_hmac_sha1(digest, inner, sizeof(inner), cache->key, sizeof(cache->key));
+}
+
+/** Check whether the directory recently rejected a set of credentials
+ *
+ */
+static bool ldap_reject_cache_find(rlm_ldap_reject_cache_t *cache, char const *dn, char const *password)
+{
+	ldap_reject_entry_t	find, *entry;
+	bool			found = false;
+
+	ldap_reject_digest(find.digest, cache, dn, password);
+
+	pthread_mutex_lock(&cache->mutex);
+	entry = fr_rb_find(cache->tree, &find);
+	if (entry) {
+		if (fr_time_lteq(entry->expires, fr_time())) {
+			fr_rb_remove_by_inline_node(cache->tree, &entry->node);
+			fr_dlist_remove(&cache->lru, entry);
+			talloc_free(entry);
+		} else {
+			found = true;
+		}
+	}
+	pthread_mutex_unlock(&cache->mutex);
+
+	return found;
+}
+
+/** Remember a set of credentials the directory rejected
+ *
+ */
+static void ldap_reject_cache_insert(rlm_ldap_t const *inst, char const *dn, char const *password)
+{
+	rlm_ldap_reject_cache_t	*cache = inst->reject_cache.handle;
+	ldap_reject_entry_t	*entry, *old;
+
+	MEM(entry = talloc_zero(NULL, ldap_reject_entry_t));
+	ldap_reject_digest(entry->digest, cache, dn, password);
+	entry->expires = fr_time_add(fr_time(), inst->reject_cache.lifetime);
+
+	pthread_mutex_lock(&cache->mutex);
+	old = fr_rb_find(cache->tree, entry);
+	if (old) {
+		fr_rb_remove_by_inline_node(cache->tree, &old->node);
+		fr_dlist_remove(&cache->lru, old);
+		talloc_free(old);
+	}
+
+	while (inst->reject_cache.max_entries &&
+	       (fr_dlist_num_elements(&cache->lru) >= inst->reject_cache.max_entries)) {
+		old = fr_dlist_head(&cache->lru);
+		fr_rb_remove_by_inline_node(cache->tree, &old->node);
+		fr_dlist_remove(&cache->lru, old);
+		talloc_free(old);
+	}
+
+	fr_rb_insert(cache->tree, entry);
+	fr_dlist_insert_tail(&cache->lru, entry);
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+static int _ldap_reject_cache_free(rlm_ldap_reject_cache_t *cache)
+{
+	ldap_reject_entry_t	*entry;
+
+	while ((entry = fr_dlist_pop_head(&cache->lru))) {
+		fr_rb_remove_by_inline_node(cache->tree, &entry->node);
+		talloc_free(entry);
+	}
+	pthread_mutex_destroy(&cache->mutex);
+
+	return 0;
+}
+
+/** Allocate the cache of rejected credentials
+ *
+ */
+static rlm_ldap_reject_cache_t *ldap_reject_cache_alloc(TALLOC_CTX *ctx)
+{
+	rlm_ldap_reject_cache_t	*cache;
+	size_t			i;
+	int			ret;
+
+	MEM(cache = talloc_zero(ctx, rlm_ldap_reject_cache_t));
+	if ((ret = pthread_mutex_init(&cache->mutex, NULL)) != 0) {
+		fr_strerror_printf("Failed initialising mutex: %s", fr_syserror(ret));
+		talloc_free(cache);
+		return NULL;
+	}
+
+	MEM(cache->tree = fr_rb_inline_talloc_alloc(cache, ldap_reject_entry_t, node, ldap_reject_entry_cmp, NULL));
+	fr_dlist_talloc_init(&cache->lru, ldap_reject_entry_t, lru);
+	for (i = 0; i < sizeof(cache->key); i++) cache->key[i] = fr_rand() & 0xff;
+	talloc_set_destructor(cache, _ldap_reject_cache_free);
+
+	return cache;
+}
+
 /** Perform async lookup of user DN if required for authentication
  *
  */
@@ -1379,6 +1650,22 @@ static unlang_action_t mod_authenticate_start(rlm_rcode_t *p_result, UNUSED int
 					&auth_ctx->call_env->user_filter, ttrunk, NULL, NULL);
 }
 
+/** Remember credentials the directory rejected
+ *
+ */
+static unlang_action_t mod_authenticate_result(rlm_rcode_t *p_result, UNUSED int *priority,
+					       request_t *request, void *uctx)
+{
+	ldap_auth_ctx_t	*auth_ctx = talloc_get_type_abort(uctx, ldap_auth_ctx_t);
+
+	if (*p_result == RLM_MODULE_REJECT) {
+		RDEBUG2("Remembering rejected credentials for %pVs", fr_box_time_delta(auth_ctx->inst->reject_cache.lifetime));
+		ldap_reject_cache_insert(auth_ctx->inst, auth_ctx->dn, auth_ctx->password);
+	}
+
+	return UNLANG_ACTION_CALCULATE_RESULT;
+}
+
 /** Initiate async LDAP bind to authenticate user
  *
  */
@@ -1422,6 +1709,18 @@ static unlang_action_t mod_authenticate_resume(rlm_rcode_t *p_result, UNUSED int
 
 	RDEBUG2("Login attempt as \"%s\"", auth_ctx->dn);
 
+	/*
+	 *	Don't send the directory credentials it has just rejected.
+	 */
+	if (auth_ctx->inst->reject_cache.handle) {
+		if (ldap_reject_cache_find(auth_ctx->inst->reject_cache.handle, auth_ctx->dn, auth_ctx->password)) {
+			RDEBUG2("Bind as user \"%s\" rejected (cached)", auth_ctx->dn);
+			RETURN_MODULE_REJECT;
+		}
+
+		if (unlang_function_repeat_set(request, mod_authenticate_result) < 0) RETURN_MODULE_FAIL;
+	}
+
 	return fr_ldap_bind_auth_async(request, auth_ctx->thread, auth_ctx->dn, auth_ctx->password);
 }
 
@@ -1531,6 +1830,11 @@ static unlang_action_t mod_authorize_resume(rlm_rcode_t *p_result, UNUSED int *p
 
 	switch (autz_ctx->status) {
 	case LDAP_AUTZ_FIND:
+		/*
+		 *	User object was found in the replica, no search was performed.
+		 */
+		if (autz_ctx->replica_entry) goto check_access;
+
 		/*
 		 *	If a user entry has been found the current rcode will be OK
 		 */
@@ -1544,11 +1848,13 @@ static unlang_action_t mod_authorize_resume(rlm_rcode_t *p_result, UNUSED int *p
 			goto finish;
 		}
 
+	check_access:
+
 		/*
 		 *	Check for access.
 		 */
 		if (inst->user.obj_access_attr) {
-			autz_ctx->access_state = rlm_ldap_check_access(inst, request, autz_ctx->entry);
+			autz_ctx->access_state = rlm_ldap_check_access(inst, request, autz_ctx);
 			switch (autz_ctx->access_state) {
 			case LDAP_ACCESS_ALLOWED:
 				break;
@@ -1658,8 +1964,11 @@ static unlang_action_t mod_authorize_resume(rlm_rcode_t *p_result, UNUSED int *p
 		if (!map_list_empty(call_env->user_map) || inst->valuepair_attr) {
 			RDEBUG2("Processing user attributes");
 			RINDENT();
-			if (fr_ldap_map_do(request, inst->valuepair_attr,
-					   &autz_ctx->expanded, autz_ctx->entry) > 0) rcode = RLM_MODULE_UPDATED;
+			if (autz_ctx->replica_entry) {
+				if (fr_ldap_map_do_replica(request, inst->valuepair_attr,
+							   &autz_ctx->expanded, autz_ctx->replica_entry) > 0) rcode = RLM_MODULE_UPDATED;
+			} else if (fr_ldap_map_do(request, inst->valuepair_attr,
+						  &autz_ctx->expanded, autz_ctx->entry) > 0) rcode = RLM_MODULE_UPDATED;
 			REXDENT();
 			rlm_ldap_check_reply(request, inst, autz_ctx->dlinst->name, call_env->expect_password->vb_bool, autz_ctx->ttrunk);
 		}
@@ -1705,7 +2014,7 @@ static unlang_action_t mod_authorize_resume(rlm_rcode_t *p_result, UNUSED int *p
 			if (inst->profile_attr) {
 				int count;
 
-				autz_ctx->profile_values = ldap_get_values_len(handle, autz_ctx->entry, inst->profile_attr);
+				autz_ctx->profile_values = rlm_ldap_autz_values(autz_ctx, inst->profile_attr);
 				count = ldap_count_values_len(autz_ctx->profile_values);
 				if (count > 0) {
 					RDEBUG2("Processing %i profile(s) found in attribute \"%s\"", count, inst->profile_attr);
@@ -1724,7 +2033,7 @@ static unlang_action_t mod_authorize_resume(rlm_rcode_t *p_result, UNUSED int *p
 			if (inst->profile_attr_suspend) {
 				int count;
 
-				autz_ctx->profile_values = ldap_get_values_len(handle, autz_ctx->entry, inst->profile_attr_suspend);
+				autz_ctx->profile_values = rlm_ldap_autz_values(autz_ctx, inst->profile_attr_suspend);
 				count = ldap_count_values_len(autz_ctx->profile_values);
 				if (count > 0) {
 					RDEBUG2("Processing %i suspension profile(s) found in attribute \"%s\"", count, inst->profile_attr_suspend);
@@ -1805,6 +2114,71 @@ static int autz_ctx_free(ldap_autz_ctx_t *autz_ctx)
 	return 0;
 }
 
+/** Look for the user object in the local replica
+ *
+ * @return
+ *	- 1 if the user object was found, and added to autz_ctx.
+ *	- 0 if the directory should be searched.
+ *	- -1 if the replica is complete, and the user does not exist.
+ */
+static int mod_authorize_replica(request_t *request, rlm_ldap_t const *inst, ldap_autz_ctx_t *autz_ctx)
+{
+	ldap_autz_call_env_t	*call_env = autz_ctx->call_env;
+	fr_ldap_replica_state_t	state;
+	fr_pair_t		*vp;
+	int			ret;
+
+	if (!inst->replica.user_attr || (call_env->replica_user.type != FR_TYPE_STRING)) return 0;
+
+	state = fr_ldap_replica_state(inst->replica.handle, inst->replica.max_staleness);
+	if (state == FR_LDAP_REPLICA_UNAVAILABLE) {
+		RDEBUG2("Replica \"%s\" is unavailable, searching directory", inst->replica.name);
+		return 0;
+	}
+
+	ret = fr_ldap_replica_find_by_index(autz_ctx, &autz_ctx->replica_entry, inst->replica.handle,
+					    inst->replica.user_attr, call_env->replica_user.vb_strvalue,
+					    call_env->replica_user.vb_length);
+	if (ret < 0) {
+		RPWDEBUG("User lookup in replica failed, searching directory");
+		return 0;
+	}
+
+	if (ret == 0) {
+		if (state != FR_LDAP_REPLICA_COMPLETE) return 0;
+
+		RDEBUG2("User object with %s=%pV not found in replica", inst->replica.user_attr, &call_env->replica_user);
+		return -1;
+	}
+
+	/*
+	 *	The directory search would only return the entry if it's
+	 *	within the user base_dn and matches the user filter.
+	 *	If not, another entry might match, so search the directory.
+	 */
+	ret = fr_ldap_replica_entry_match(autz_ctx->replica_entry, call_env->user_base.vb_strvalue,
+					  inst->user.obj_scope,
+					  call_env->user_filter.type == FR_TYPE_STRING ?
+					  call_env->user_filter.vb_strvalue : NULL);
+	if (ret <= 0) {
+		if (ret < 0) {
+			RPWDEBUG("User lookup in replica failed, searching directory");
+		} else {
+			RDEBUG2("User object \"%s\" in replica is not within base_dn or doesn't match filter, "
+				"searching directory", fr_ldap_replica_entry_dn(autz_ctx->replica_entry));
+		}
+		TALLOC_FREE(autz_ctx->replica_entry);
+		return 0;
+	}
+
+	RDEBUG2("User object found in replica at DN \"%s\"", fr_ldap_replica_entry_dn(autz_ctx->replica_entry));
+
+	MEM(pair_update_control(&vp, attr_ldap_userdn) >= 0);
+	fr_pair_value_strdup(vp, fr_ldap_replica_entry_dn(autz_ctx->replica_entry), false);
+
+	return 1;
+}
+
 static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_ldap_t const 	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_ldap_t);
@@ -1863,7 +2237,17 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, mod
 	autz_ctx->call_env = call_env;
 	autz_ctx->status = LDAP_AUTZ_FIND;
 
-	if (unlang_function_push(request, mod_authorize_start, mod_authorize_resume, mod_authorize_cancel,
+	if (inst->replica.handle && (mod_authorize_replica(request, inst, autz_ctx) < 0)) {
+		talloc_free(autz_ctx);
+		RETURN_MODULE_NOTFOUND;
+	}
+
+	/*
+	 *	If the user object came from the replica, skip straight
+	 *	to processing it.
+	 */
+	if (unlang_function_push(request, autz_ctx->replica_entry ? NULL : mod_authorize_start,
+				 mod_authorize_resume, mod_authorize_cancel,
 				 ~FR_SIGNAL_CANCEL, UNLANG_SUB_FRAME, autz_ctx) < 0) RETURN_MODULE_FAIL;
 
 	return UNLANG_ACTION_PUSHED_CHILD;
@@ -2186,6 +2570,9 @@ static int mod_detach(module_detach_ctx_t const *mctx)
 
 	if (inst->user.obj_sort_ctrl) ldap_control_free(inst->user.obj_sort_ctrl);
 
+	talloc_free(inst->reject_cache.handle);
+	talloc_free(inst->group.shared_cache.handle);
+
 	return 0;
 }
 
@@ -2403,6 +2790,28 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 
 	inst->handle_config.name = talloc_typed_asprintf(inst, "rlm_ldap (%s)", mctx->mi->name);
 
+	/*
+	 *	Attach to the replica fed by ldap_sync, and ask it to
+	 *	index the attributes we look up users and groups by.
+	 */
+	if (inst->replica.name) {
+		inst->replica.handle = fr_ldap_replica_alloc(inst, inst->replica.name);
+		if (!inst->replica.handle) {
+			cf_log_perr(conf, "Failed attaching to replica");
+			goto error;
+		}
+
+		if (inst->replica.user_attr &&
+		    (fr_ldap_replica_index_add(inst->replica.handle, inst->replica.user_attr) < 0)) {
+		index_error:
+			cf_log_perr(conf, "Failed indexing replica");
+			goto error;
+		}
+
+		if (inst->group.obj_name_attr &&
+		    (fr_ldap_replica_index_add(inst->replica.handle, inst->group.obj_name_attr) < 0)) goto index_error;
+	}
+
 	/*
 	 *	Trunks used for bind auth can only have one request in flight per connection.
 	 */
@@ -2594,6 +3003,34 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		}
 	}
 
+	/*
+	 *	The reject and group caches are written to after the
+	 *	instance data is protected, so they're not parented
+	 *	by the instance, and are freed in mod_detach.
+	 */
+	if (fr_time_delta_ispos(inst->reject_cache.lifetime)) {
+		inst->reject_cache.handle = ldap_reject_cache_alloc(NULL);
+		if (!inst->reject_cache.handle) {
+			cf_log_perr(conf, "Failed allocating reject cache");
+			goto error;
+		}
+	}
+
+	/*
+	 *	Group names and memberships are cached at the instance
+	 *	level so every worker benefits from another's lookups.
+	 */
+	if (fr_time_delta_ispos(inst->group.shared_cache.lifetime)) {
+		inst->group.shared_cache.handle = rlm_ldap_group_cache_alloc(NULL, inst->group.shared_cache.lifetime,
+									     inst->group.shared_cache.negative_lifetime,
+									     inst->group.shared_cache.max_entries);
+		if (!inst->group.shared_cache.handle) {
+			cf_log_perr(conf, "Failed allocating shared group cache");
+			TALLOC_FREE(inst->reject_cache.handle);
+			goto error;
+		}
+	}
+
 	return 0;
 
 error:
@@ -2665,6 +3102,7 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 
 	xlat = xlat_func_register_module(mctx->mi->boot, mctx, NULL, ldap_xlat, FR_TYPE_STRING);
 	xlat_func_args_set(xlat, ldap_xlat_arg);
+	xlat_func_flags_set(xlat, XLAT_FUNC_FLAG_CACHEABLE);	/* Searches only */
 
 	if (unlikely(!(xlat = xlat_func_register_module(mctx->mi->boot, mctx, "memberof", ldap_memberof_xlat,
 							FR_TYPE_BOOL)))) return -1;
@@ -2676,6 +3114,14 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 	xlat_func_args_set(xlat, ldap_xlat_arg);
 	xlat_func_call_env_set(xlat, &xlat_profile_method_env);
 
+	if (unlikely(!(xlat = xlat_func_register_module(mctx->mi->boot, mctx, "group_cache_stats",
+							ldap_group_cache_stats_xlat, FR_TYPE_UINT64)))) return -1;
+	xlat_func_args_set(xlat, ldap_group_cache_stats_xlat_arg);
+
+	if (unlikely(!(xlat = xlat_func_register_module(mctx->mi->boot, mctx, "group_cache_invalidate",
+							ldap_group_cache_invalidate_xlat, FR_TYPE_UINT64)))) return -1;
+	xlat_func_args_set(xlat, ldap_group_cache_invalidate_xlat_arg);
+
 	map_proc_register(mctx->mi->boot, inst, mctx->mi->name, mod_map_proc, ldap_map_verify, 0, LDAP_URI_SAFE_FOR);
 
 	return 0;
@@ -17,6 +17,10 @@
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/ldap/base.h>
 
+typedef struct rlm_ldap_group_cache_s rlm_ldap_group_cache_t;
+
+typedef struct rlm_ldap_reject_cache_s rlm_ldap_reject_cache_t;
+
 typedef struct {
 	CONF_SECTION	*cs;				//!< Section configuration.
 
@@ -94,6 +98,14 @@ typedef struct {
 								///< from a user object.
 
 		bool		skip_on_suspend;		//!< Don't process groups if the user is suspended.
+
+		struct {
+			fr_time_delta_t		lifetime;		//!< How long group names and memberships are cached.
+									///< Zero disables the shared cache.
+			fr_time_delta_t		negative_lifetime;	//!< How long failed resolutions are cached.
+			uint32_t		max_entries;		//!< Maximum number of cache entries.
+			rlm_ldap_group_cache_t	*handle;		//!< Cache shared by all workers, NULL if disabled.
+		} shared_cache;
 	} group;
 
 	char const	*valuepair_attr;		//!< Generic dynamic mapping attribute, contains a RADIUS
@@ -124,6 +136,27 @@ typedef struct {
 							//!< to perform additional authorisation checks.
 #endif
 
+	/*
+	 *	Local replica fed by ldap_sync
+	 */
+	struct {
+		char const		*name;			//!< Name of the replica, as set in the ldap_sync listener.
+		char const		*user_attr;		//!< Indexed attribute used to find user objects.
+		fr_time_delta_t		max_staleness;		//!< How long entries may be used after the
+								///< replica stops receiving updates.
+		fr_ldap_replica_t	*handle;		//!< Replica to consult, NULL if none is configured.
+	} replica;
+
+	/*
+	 *	Recently rejected credentials
+	 */
+	struct {
+		fr_time_delta_t		lifetime;		//!< How long rejected credentials are remembered.
+								///< Zero disables the cache.
+		uint32_t		max_entries;		//!< Maximum number of credentials remembered.
+		rlm_ldap_reject_cache_t	*handle;		//!< Cache shared by all workers, NULL if disabled.
+	} reject_cache;
+
 	fr_ldap_config_t handle_config;			//!< Connection configuration instance.
 	fr_trunk_conf_t	trunk_conf;			//!< Trunk configuration
 	fr_trunk_conf_t	bind_trunk_conf;		//!< Trunk configuration for trunk used for bind auths
@@ -149,6 +182,9 @@ typedef struct {
 
 	fr_value_box_t 	const *expect_password;		//!< True if the user_map included a mapping between an LDAP
 							//!< attribute and one of our password reference attributes.
+
+	fr_value_box_t	replica_user;			//!< Value of the replica's user attribute identifying
+							///< the user object.
 } ldap_autz_call_env_t;
 
 /** Call environment used in group membership xlat
@@ -198,6 +234,7 @@ typedef struct {
 	fr_ldap_thread_trunk_t	*ttrunk;
 	ldap_autz_call_env_t	*call_env;
 	LDAPMessage		*entry;
+	fr_ldap_replica_entry_t	*replica_entry;		//!< User object found in the replica, used instead of entry.
 	ldap_autz_status_t	status;
 	struct berval		**profile_values;
 	int			value_idx;
@@ -256,12 +293,23 @@ static inline char const *rlm_find_user_dn_cached(request_t *request)
 	return vp->vp_strvalue;
 }
 
+/** Retrieve attribute values from the user object being processed
+ *
+ * @return Values to be freed with ldap_value_free_len(), or NULL.
+ */
+static inline struct berval **rlm_ldap_autz_values(ldap_autz_ctx_t const *autz_ctx, char const *attr)
+{
+	if (autz_ctx->replica_entry) return fr_ldap_replica_entry_values(autz_ctx->replica_entry, attr);
+
+	return ldap_get_values_len(fr_ldap_handle_thread_local(), autz_ctx->entry, attr);
+}
+
 unlang_action_t rlm_ldap_find_user_async(TALLOC_CTX *ctx, rlm_ldap_t const *inst, request_t *request,
 					 fr_value_box_t *base, fr_value_box_t *filter_box,
 					 fr_ldap_thread_trunk_t *ttrunk, char const *attrs[],
 					 fr_ldap_query_t **query_out);
 
-ldap_access_state_t rlm_ldap_check_access(rlm_ldap_t const *inst, request_t *request, LDAPMessage *entry);
+ldap_access_state_t rlm_ldap_check_access(rlm_ldap_t const *inst, request_t *request, ldap_autz_ctx_t const *autz_ctx);
 
 void rlm_ldap_check_reply(request_t *request, rlm_ldap_t const *inst, char const *inst_name, bool expect_password, fr_ldap_thread_trunk_t const *ttrunk);
 
@@ -282,6 +330,36 @@ unlang_action_t rlm_ldap_check_userobj_dynamic(rlm_rcode_t *p_result, request_t
 unlang_action_t rlm_ldap_check_cached(rlm_rcode_t *p_result,
 				      rlm_ldap_t const *inst, request_t *request, fr_value_box_t const *check);
 
+/*
+ *	group_cache.c - Shared cache of group names and memberships.
+ */
+typedef struct {
+	uint64_t	saved;				//!< Directory searches avoided by using the cache.
+	uint64_t	misses;				//!< Lookups not satisfied by the cache.
+	uint64_t	evictions;			//!< Entries removed to make room for new ones.
+	uint64_t	entries;			//!< Entries currently in the cache.
+} rlm_ldap_group_cache_stats_t;
+
+rlm_ldap_group_cache_t *rlm_ldap_group_cache_alloc(TALLOC_CTX *ctx, fr_time_delta_t lifetime,
+						   fr_time_delta_t negative_lifetime, uint32_t max_entries);
+
+int rlm_ldap_group_cache_dn2name_find(TALLOC_CTX *ctx, char **out, rlm_ldap_group_cache_t *cache, char const *dn);
+
+void rlm_ldap_group_cache_dn2name_insert(rlm_ldap_group_cache_t *cache, char const *dn, char const *name, size_t len);
+
+int rlm_ldap_group_cache_membership_find(TALLOC_CTX *ctx, char ***out, rlm_ldap_group_cache_t *cache,
+					 char const *base_dn, int scope, char const *filter);
+
+void rlm_ldap_group_cache_membership_insert(rlm_ldap_group_cache_t *cache, char const *base_dn, int scope,
+					    char const *filter, char const *user_dn, char * const *groups);
+
+uint64_t rlm_ldap_group_cache_invalidate(rlm_ldap_group_cache_t *cache, char const *dn);
+
+void rlm_ldap_group_cache_stats(rlm_ldap_group_cache_stats_t *stats, rlm_ldap_group_cache_t *cache);
+
+/*
+ *	profile.c - Profile functions.
+ */
 unlang_action_t rlm_ldap_map_profile(fr_ldap_result_code_t *ret,
 				     rlm_ldap_t const *inst, request_t *request, fr_ldap_thread_trunk_t *ttrunk,
 				     char const *dn, int scope, char const *filter, fr_ldap_map_exp_t const *expanded);
@@ -187,17 +187,17 @@ unlang_action_t rlm_ldap_find_user_async(TALLOC_CTX *ctx, rlm_ldap_t const *inst
  *
  * @param[in] inst rlm_ldap configuration.
  * @param[in] request Current request.
- * @param[in] entry retrieved by rlm_ldap_find_user or fr_ldap_search.
+ * @param[in] autz_ctx holding the user object retrieved from the directory or the replica.
  * @return
  *	- #RLM_MODULE_DISALLOW if the user was denied access.
  *	- #RLM_MODULE_OK otherwise.
  */
-ldap_access_state_t rlm_ldap_check_access(rlm_ldap_t const *inst, request_t *request, LDAPMessage *entry)
+ldap_access_state_t rlm_ldap_check_access(rlm_ldap_t const *inst, request_t *request, ldap_autz_ctx_t const *autz_ctx)
 {
 	ldap_access_state_t ret = LDAP_ACCESS_ALLOWED;
 	struct berval **values = NULL;
 
-	values = ldap_get_values_len(fr_ldap_handle_thread_local(), entry, inst->user.obj_access_attr);
+	values = rlm_ldap_autz_values(autz_ctx, inst->user.obj_access_attr);
 	if (values) {
 		size_t negate_value_len = talloc_array_length(inst->user.access_value_negate) - 1;
 		if (inst->user.access_positive) {
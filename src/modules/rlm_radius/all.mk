@@ -1,2 +1,2 @@
-SUBMAKEFILES := rlm_radius.mk rlm_radius_udp.mk
+SUBMAKEFILES := rlm_radius.mk rlm_radius_udp.mk rlm_radius_tcp.mk track_tests.mk
 
@@ -0,0 +1,1787 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_radius_tcp.c
+ * @brief RADIUS TCP transport
+ *
+ * Many requests are multiplexed over each connection, and all of the
+ * packets which are ready to go are coalesced into one write().  The
+ * socket is managed by an fd bio, see src/lib/bio/fd.c.
+ *
+ * As per RFC 6613, packets are never retransmitted over the same
+ * connection.  The retransmission timers only serve to detect dead
+ * connections, and move the requests to a different one.
+ *
+ * @copyright 2024 Network RADIUS SAS (legal@networkradius.com)
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/bio/fd.h>
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/io/pair.h>
+#include <freeradius-devel/missing.h>
+#include <freeradius-devel/server/connection.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/heap.h>
+
+#include <sys/socket.h>
+
+#include "rlm_radius.h"
+#include "track.h"
+
+/** Static configuration for the module.
+ *
+ */
+typedef struct {
+	rlm_radius_t		*parent;		//!< rlm_radius instance.
+	CONF_SECTION		*config;
+
+	fr_ipaddr_t		dst_ipaddr;		//!< IP of the home server.
+	fr_ipaddr_t		src_ipaddr;		//!< IP we open our socket on.
+	uint16_t		dst_port;		//!< Port of the home server.
+	char const		*secret;		//!< Shared secret.
+
+	char const		*interface;		//!< Interface to bind to.
+
+	uint32_t		recv_buff;		//!< How big the kernel's receive buffer should be.
+	uint32_t		send_buff;		//!< How big the kernel's send buffer should be.
+
+	uint32_t		max_packet_size;	//!< Maximum packet size.
+	uint16_t		max_send_coalesce;	//!< Maximum number of packets to coalesce into one write() call.
+
+	bool			recv_buff_is_set;	//!< Whether we were provided with a recv_buf
+	bool			send_buff_is_set;	//!< Whether we were provided with a send_buf
+
+	fr_trunk_conf_t		trunk_conf;		//!< trunk configuration
+} rlm_radius_tcp_t;
+
+typedef struct {
+	fr_event_list_t		*el;			//!< Event list.
+
+	rlm_radius_tcp_t const	*inst;			//!< our instance
+
+	fr_trunk_t		*trunk;			//!< trunk handler
+} tcp_thread_t;
+
+typedef struct {
+	fr_trunk_request_t	*treq;
+	rlm_rcode_t		rcode;			//!< from the transport
+} tcp_result_t;
+
+typedef struct tcp_request_s tcp_request_t;
+
+typedef struct {
+	uint8_t			*read;			//!< where we read data from
+	uint8_t			*write;			//!< where we write data to
+	uint8_t			*end;			//!< end of the buffer
+	uint8_t			*data;			//!< actual data
+} tcp_buffer_t;
+
+/** Track the handle, which is tightly correlated with the FD
+ *
+ */
+typedef struct {
+	char const     		*name;			//!< From IP PORT to IP PORT.
+	char const		*module_name;		//!< the module that opened the connection
+
+	fr_bio_t		*bio;			//!< fd bio for the socket.
+	fr_bio_fd_info_t const	*fd_info;		//!< state of the socket.
+	fr_bio_fd_config_t	fd_config;		//!< how the socket was opened.
+	int			fd;			//!< File descriptor, from fd_info.
+
+	fr_trunk_request_t     	**coalesced;		//!< Outbound coalesced requests.
+
+	size_t			send_buff_actual;	//!< What we believe the maximum SO_SNDBUF size to be.
+							///< We don't try and encode more packet data than this
+							///< in one go.
+
+	rlm_radius_tcp_t const	*inst;			//!< Our module instance.
+	tcp_thread_t		*thread;
+
+	uint32_t		max_packet_size;	//!< Our max packet size. may be different from the parent.
+
+	tcp_buffer_t		recv;			//!< receive buffer
+	tcp_buffer_t		send;			//!< send buffer
+
+	radius_track_t		*tt;			//!< RADIUS ID tracking structure.
+	bool			ids_exhausted;		//!< All 256 IDs are in use.  The connection has
+							///< been marked inactive.
+
+	fr_time_t		mrs_time;		//!< Most recent sent time which had a reply.
+	fr_time_t		last_reply;		//!< When we last received a reply.
+	fr_time_t		first_sent;		//!< first time we sent a packet since going idle
+	fr_time_t		last_sent;		//!< last time we sent a packet.
+	fr_time_t		last_idle;		//!< last time we had nothing to do
+
+	fr_event_timer_t const	*zombie_ev;		//!< Zombie timeout.
+} tcp_handle_t;
+
+
+/** Connect request_t to local tracking structure
+ *
+ */
+struct tcp_request_s {
+	uint32_t		priority;		//!< copied from request->async->priority
+	fr_time_t		recv_time;		//!< copied from request->async->recv_time
+
+	bool			require_ma;		//!< saved from the original packet.
+
+	fr_pair_list_t		extra;			//!< VPs for debugging, like Proxy-State.
+
+	uint8_t			code;			//!< Packet code.
+	uint8_t			id;			//!< Last ID assigned to this packet.
+	uint8_t			*packet;		//!< Packet in the connection's send buffer.
+	size_t			packet_len;		//!< Length of the packet.
+
+	radius_track_entry_t	*rr;			//!< ID tracking, resend count, etc.
+	fr_event_timer_t const	*ev;			//!< timer for retransmissions
+	fr_retry_t		retry;			//!< retransmission timers
+};
+
+static const conf_parser_t module_config[] = {
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipaddr", FR_TYPE_COMBO_IP_ADDR, 0, rlm_radius_tcp_t, dst_ipaddr), },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv4addr", FR_TYPE_IPV4_ADDR, 0, rlm_radius_tcp_t, dst_ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv6addr", FR_TYPE_IPV6_ADDR, 0, rlm_radius_tcp_t, dst_ipaddr) },
+
+	{ FR_CONF_OFFSET("port", rlm_radius_tcp_t, dst_port) },
+
+	{ FR_CONF_OFFSET_FLAGS("secret", CONF_FLAG_REQUIRED, rlm_radius_tcp_t, secret) },
+
+	{ FR_CONF_OFFSET("interface", rlm_radius_tcp_t, interface) },
+
+	{ FR_CONF_OFFSET_IS_SET("recv_buff", FR_TYPE_UINT32, 0, rlm_radius_tcp_t, recv_buff) },
+	{ FR_CONF_OFFSET_IS_SET("send_buff", FR_TYPE_UINT32, 0, rlm_radius_tcp_t, send_buff) },
+
+	{ FR_CONF_OFFSET("max_packet_size", rlm_radius_tcp_t, max_packet_size), .dflt = "4096" },
+	{ FR_CONF_OFFSET("max_send_coalesce", rlm_radius_tcp_t, max_send_coalesce), .dflt = "1024" },
+
+	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipaddr", FR_TYPE_COMBO_IP_ADDR, 0, rlm_radius_tcp_t, src_ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipv4addr", FR_TYPE_IPV4_ADDR, 0, rlm_radius_tcp_t, src_ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipv6addr", FR_TYPE_IPV6_ADDR, 0, rlm_radius_tcp_t, src_ipaddr) },
+
+	CONF_PARSER_TERMINATOR
+};
+
+static fr_dict_t const *dict_radius;
+
+extern fr_dict_autoload_t rlm_radius_tcp_dict[];
+fr_dict_autoload_t rlm_radius_tcp_dict[] = {
+	{ .out = &dict_radius, .proto = "radius" },
+	{ NULL }
+};
+
+static fr_dict_attr_t const *attr_acct_delay_time;
+static fr_dict_attr_t const *attr_message_authenticator;
+static fr_dict_attr_t const *attr_proxy_state;
+static fr_dict_attr_t const *attr_packet_type;
+
+extern fr_dict_attr_autoload_t rlm_radius_tcp_dict_attr[];
+fr_dict_attr_autoload_t rlm_radius_tcp_dict_attr[] = {
+	{ .out = &attr_acct_delay_time, .name = "Acct-Delay-Time", .type = FR_TYPE_UINT32, .dict = &dict_radius},
+	{ .out = &attr_message_authenticator, .name = "Message-Authenticator", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
+	{ .out = &attr_proxy_state, .name = "Proxy-State", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
+	{ .out = &attr_packet_type, .name = "Packet-Type", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ NULL }
+};
+
+/** Turn a reply code into a module rcode;
+ *
+ */
+static rlm_rcode_t radius_code_to_rcode[FR_RADIUS_CODE_MAX] = {
+	[FR_RADIUS_CODE_ACCESS_ACCEPT]		= RLM_MODULE_OK,
+	[FR_RADIUS_CODE_ACCESS_CHALLENGE]	= RLM_MODULE_UPDATED,
+	[FR_RADIUS_CODE_ACCESS_REJECT]		= RLM_MODULE_REJECT,
+
+	[FR_RADIUS_CODE_ACCOUNTING_RESPONSE]	= RLM_MODULE_OK,
+
+	[FR_RADIUS_CODE_COA_ACK]		= RLM_MODULE_OK,
+	[FR_RADIUS_CODE_COA_NAK]		= RLM_MODULE_REJECT,
+
+	[FR_RADIUS_CODE_DISCONNECT_ACK]	= RLM_MODULE_OK,
+	[FR_RADIUS_CODE_DISCONNECT_NAK]	= RLM_MODULE_REJECT,
+
+	[FR_RADIUS_CODE_PROTOCOL_ERROR]	= RLM_MODULE_HANDLED,
+};
+
+#ifndef NDEBUG
+/** Log additional information about a tracking entry
+ *
+ * @param[in] te	Tracking entry we're logging information for.
+ * @param[in] log	destination.
+ * @param[in] log_type	Type of log message.
+ * @param[in] file	the logging request was made in.
+ * @param[in] line 	logging request was made on.
+ */
+static void tcp_tracking_entry_log(fr_log_t const *log, fr_log_type_t log_type, char const *file, int line,
+				   radius_track_entry_t *te)
+{
+	request_t			*request;
+
+	if (!te->request) return;	/* Free entry */
+
+	request = talloc_get_type_abort(te->request, request_t);
+
+	fr_log(log, log_type, file, line, "request %s, allocated %s:%u", request->name,
+	       request->alloc_file, request->alloc_line);
+
+	fr_trunk_request_state_log(log, log_type, file, line, talloc_get_type_abort(te->uctx, fr_trunk_request_t));
+}
+#endif
+
+/** Clear out any connection specific resources from a tcp request
+ *
+ * The packet lives in the connection's send buffer, so we just
+ * forget about it.
+ */
+static void tcp_request_reset(tcp_request_t *u)
+{
+	u->packet = NULL;
+	fr_pair_list_free(&u->extra);
+
+	if (u->rr) radius_track_entry_release(&u->rr);
+	if (u->ev) (void) fr_event_timer_delete(&u->ev);
+}
+
+/** Free a connection handle, closing associated resources
+ *
+ */
+static int _tcp_handle_free(tcp_handle_t *h)
+{
+	fr_assert(h->fd >= 0);
+
+	fr_event_fd_delete(h->thread->el, h->fd, FR_EVENT_FILTER_IO);
+
+	/*
+	 *	Closes the socket.
+	 */
+	if ((fr_bio_shutdown(h->bio) < 0) || (fr_bio_free(h->bio) < 0)) {
+		DEBUG3("%s - Failed closing connection %s: %s",
+		       h->module_name, h->name, fr_strerror());
+	}
+
+	h->fd = -1;
+
+	DEBUG("%s - Connection closed - %s", h->module_name, h->name);
+
+	return 0;
+}
+
+/** Initialise a new outbound connection
+ *
+ * @param[out] h_out	Where to write the new file descriptor.
+ * @param[in] conn	to initialise.
+ * @param[in] uctx	A #tcp_thread_t
+ */
+static fr_connection_state_t conn_init(void **h_out, fr_connection_t *conn, void *uctx)
+{
+	tcp_handle_t		*h;
+	tcp_thread_t		*thread = talloc_get_type_abort(uctx, tcp_thread_t);
+
+	MEM(h = talloc_zero(conn, tcp_handle_t));
+	h->thread = thread;
+	h->inst = thread->inst;
+	h->module_name = h->inst->parent->name;
+	h->max_packet_size = h->inst->max_packet_size;
+	h->last_idle = fr_time();
+	h->fd = -1;
+
+	/*
+	 *	Initialize the buffer of coalesced packets we're going to write.
+	 */
+	h->coalesced = talloc_zero_array(h, fr_trunk_request_t *, h->inst->max_send_coalesce);
+
+	MEM(h->tt = radius_track_alloc(h));
+
+	/*
+	 *	Open the outgoing socket.  The bio does a non-blocking
+	 *	connect(), and the connection is signalled as open
+	 *	once the socket becomes writable.
+	 */
+	h->fd_config = (fr_bio_fd_config_t) {
+		.type = FR_BIO_FD_CONNECTED,
+		.socket_type = SOCK_STREAM,
+		.src_ipaddr = h->inst->src_ipaddr,
+		.dst_ipaddr = h->inst->dst_ipaddr,
+		.dst_port = h->inst->dst_port,
+		.interface = h->inst->interface,
+		.recv_buff = h->inst->recv_buff_is_set ? h->inst->recv_buff : 0,
+		.send_buff = h->inst->send_buff_is_set ? h->inst->send_buff : 0,
+		.async = true,
+	};
+
+	h->bio = fr_bio_fd_alloc(h, &h->fd_config, 0);
+	if (!h->bio) {
+		PERROR("%s - Failed opening socket", h->module_name);
+		talloc_free(h);
+		return FR_CONNECTION_STATE_FAILED;
+	}
+
+	h->fd_info = fr_bio_fd_info(h->bio);
+	fr_assert(h->fd_info != NULL);
+
+	h->fd = h->fd_info->socket.fd;
+
+	/*
+	 *	Set the connection name.
+	 */
+	h->name = fr_asprintf(h, "proto tcp local %pV port %u remote %pV port %u",
+			      fr_box_ipaddr(h->fd_info->socket.inet.src_ipaddr), h->fd_info->socket.inet.src_port,
+			      fr_box_ipaddr(h->inst->dst_ipaddr), h->inst->dst_port);
+
+	talloc_set_destructor(h, _tcp_handle_free);
+
+#ifdef SO_SNDBUF
+	{
+		int opt;
+		socklen_t socklen = sizeof(int);
+
+		if (getsockopt(h->fd, SOL_SOCKET, SO_SNDBUF, &opt, &socklen) < 0) {
+			WARN("%s - Failed getting 'SO_SNDBUF', write performance may be sub-optimal: %s",
+			     h->module_name, fr_syserror(errno));
+
+			/*
+			 *	This controls how many packets we attempt
+			 *	to send at once.  Nothing bad happens if
+			 *	we get it wrong.  There are at most 255
+			 *	packets on a connection, so don't set this
+			 *	too large.
+			 */
+			if (h->inst->send_buff_is_set) {
+				h->send_buff_actual = h->inst->send_buff;
+			} else {
+				h->send_buff_actual = h->max_packet_size * h->inst->max_send_coalesce;
+				if (h->send_buff_actual > 256*1024) h->send_buff_actual = 256*1024;
+			}
+
+			WARN("%s - Max coalesced outbound data will be %zu bytes", h->module_name,
+			     h->send_buff_actual);
+		} else {
+#ifdef __linux__
+			/*
+			 *	Linux doubles the buffer when you set it
+			 *	to account for "overhead".
+			 */
+			h->send_buff_actual = ((size_t)opt) / 2;
+#else
+			h->send_buff_actual = (size_t)opt;
+#endif
+		}
+	}
+#else
+	h->send_buff_actual = h->inst->send_buff_is_set ?
+			      h->inst->send_buff : h->max_packet_size * h->inst->max_send_coalesce;
+
+	WARN("%s - Modifying 'SO_SNDBUF' value is not supported on this system, "
+	     "write performance may be sub-optimal", h->module_name);
+	WARN("%s - Max coalesced outbound data will be %zu bytes", h->module_name, h->send_buff_actual);
+#endif
+
+	/*
+	 *	We always need room for at least one max-sized packet,
+	 *	otherwise request_mux() will never encode anything.
+	 */
+	if (h->send_buff_actual < h->max_packet_size) h->send_buff_actual = h->max_packet_size;
+
+	/*
+	 *	Allow receiving of 2 max-sized packets.  In practice, most packets will be less than this.
+	 */
+	MEM(h->recv.data = talloc_array(h, uint8_t, h->max_packet_size * 2));
+	h->recv.read = h->recv.write = h->recv.data;
+	h->recv.end = h->recv.data + h->max_packet_size * 2;
+
+	/*
+	 *	Use the system SO_SNDBUF for how many packets to send at once.
+	 */
+	MEM(h->send.data = talloc_array(h, uint8_t, h->send_buff_actual));
+	h->send.read = h->send.write = h->send.data;
+	h->send.end = h->send.data + h->send_buff_actual;
+
+	/*
+	 *	Signal the connection
+	 *	as open as soon as it becomes writable.
+	 */
+	fr_connection_signal_on_fd(conn, h->fd);
+
+	*h_out = h;
+
+	return FR_CONNECTION_STATE_CONNECTING;
+}
+
+/** Finish the non-blocking connect()
+ *
+ * The socket is writable, so tell the bio to check the result of
+ * connect(), and to start using the normal read / write functions.
+ */
+static fr_connection_state_t conn_open(UNUSED fr_event_list_t *el, void *handle, UNUSED void *uctx)
+{
+	tcp_handle_t	*h = talloc_get_type_abort(handle, tcp_handle_t);
+
+	if (fr_bio_fd_connect(h->bio) < 0) {
+		PERROR("%s - Failed connecting %s", h->module_name, h->name);
+		return FR_CONNECTION_STATE_FAILED;
+	}
+
+	DEBUG("%s - Connection open - %s", h->module_name, h->name);
+
+	return FR_CONNECTION_STATE_CONNECTED;
+}
+
+/** Shutdown/close a file descriptor
+ *
+ */
+static void conn_close(UNUSED fr_event_list_t *el, void *handle, UNUSED void *uctx)
+{
+	tcp_handle_t *h = talloc_get_type_abort(handle, tcp_handle_t);
+
+	/*
+	 *	There's tracking entries still allocated
+	 *	this is bad, they should have all been
+	 *	released.
+	 */
+	if (h->tt && (h->tt->num_requests != 0)) {
+#ifndef NDEBUG
+		radius_track_state_log(&default_log, L_ERR, __FILE__, __LINE__, h->tt, tcp_tracking_entry_log);
+#endif
+		fr_assert_fail("%u tracking entries still allocated at conn close", h->tt->num_requests);
+	}
+
+	DEBUG4("Freeing rlm_radius_tcp handle %p", handle);
+
+	talloc_free(h);
+}
+
+static fr_connection_t *thread_conn_alloc(fr_trunk_connection_t *tconn, fr_event_list_t *el,
+					  fr_connection_conf_t const *conf,
+					  char const *log_prefix, void *uctx)
+{
+	fr_connection_t		*conn;
+	tcp_thread_t		*thread = talloc_get_type_abort(uctx, tcp_thread_t);
+
+	conn = fr_connection_alloc(tconn, el,
+				   &(fr_connection_funcs_t){
+					.init = conn_init,
+					.open = conn_open,
+					.close = conn_close,
+				   },
+				   conf,
+				   log_prefix,
+				   thread);
+	if (!conn) {
+		PERROR("%s - Failed allocating state handler for new connection", thread->inst->parent->name);
+		return NULL;
+	}
+
+	return conn;
+}
+
+/** Connection errored
+ *
+ * We were signalled by the event loop that a fatal error occurred on this connection.
+ *
+ * @param[in] el	The event list signalling.
+ * @param[in] fd	that errored.
+ * @param[in] flags	El flags.
+ * @param[in] fd_errno	The nature of the error.
+ * @param[in] uctx	The trunk connection handle (tconn).
+ */
+static void conn_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	fr_trunk_connection_t	*tconn = talloc_get_type_abort(uctx, fr_trunk_connection_t);
+	fr_connection_t		*conn = tconn->conn;
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+
+	ERROR("%s - Connection %s failed: %s", h->module_name, h->name, fr_syserror(fd_errno));
+
+	fr_connection_signal_reconnect(conn, FR_CONNECTION_FAILED);
+}
+
+static void thread_conn_notify(fr_trunk_connection_t *tconn, fr_connection_t *conn,
+			       fr_event_list_t *el,
+			       fr_trunk_connection_event_t notify_on, UNUSED void *uctx)
+{
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+	fr_event_fd_cb_t	read_fn = NULL;
+	fr_event_fd_cb_t	write_fn = NULL;
+
+	switch (notify_on) {
+	case FR_TRUNK_CONN_EVENT_NONE:
+		return;
+
+	case FR_TRUNK_CONN_EVENT_READ:
+		read_fn = fr_trunk_connection_callback_readable;
+		break;
+
+	case FR_TRUNK_CONN_EVENT_WRITE:
+		write_fn = fr_trunk_connection_callback_writable;
+		break;
+
+	case FR_TRUNK_CONN_EVENT_BOTH:
+		read_fn = fr_trunk_connection_callback_readable;
+		write_fn = fr_trunk_connection_callback_writable;
+		break;
+
+	}
+
+	if (fr_event_fd_insert(h, NULL, el, h->fd,
+			       read_fn,
+			       write_fn,
+			       conn_error,
+			       tconn) < 0) {
+		PERROR("%s - Failed inserting FD event", h->module_name);
+
+		/*
+		 *	May free the connection!
+		 */
+		fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+	}
+}
+
+/*
+ *  Return negative numbers to put 'a' at the top of the heap.
+ *  Return positive numbers to put 'b' at the top of the heap.
+ *
+ *  We want the value with the lowest timestamp to be prioritized at
+ *  the top of the heap.
+ */
+static int8_t request_prioritise(void const *one, void const *two)
+{
+	tcp_request_t const *a = one;
+	tcp_request_t const *b = two;
+	int8_t ret;
+
+	/*
+	 *	Larger priority is more important.
+	 */
+	ret = CMP(a->priority, b->priority);
+	if (ret != 0) return ret;
+
+	/*
+	 *	Smaller timestamp (i.e. earlier) is more important.
+	 */
+	return CMP_PREFER_SMALLER(fr_time_unwrap(a->recv_time), fr_time_unwrap(b->recv_time));
+}
+
+/** Decode response packet data, extracting relevant information and validating the packet
+ *
+ * @param[in] ctx			to allocate pairs in.
+ * @param[out] reply			Pointer to head of pair list to add reply attributes to.
+ * @param[out] response_code		The type of response packet.
+ * @param[in] h				connection handle.
+ * @param[in] request			the request.
+ * @param[in] u				TCP request.
+ * @param[in] request_authenticator	from the original request.
+ * @param[in] data			to decode.
+ * @param[in] data_len			Length of input data.
+ * @return
+ *	- DECODE_FAIL_NONE on success.
+ *	- DECODE_FAIL_* on failure.
+ */
+static decode_fail_t decode(TALLOC_CTX *ctx, fr_pair_list_t *reply, uint8_t *response_code,
+			    tcp_handle_t *h, request_t *request, tcp_request_t *u,
+			    uint8_t const request_authenticator[static RADIUS_AUTH_VECTOR_LENGTH],
+			    uint8_t *data, size_t data_len)
+{
+	rlm_radius_tcp_t const *inst = h->inst;
+	uint8_t			code;
+	fr_radius_ctx_t		common_ctx;
+	fr_radius_decode_ctx_t	decode_ctx;
+
+	*response_code = 0;	/* Initialise to keep the rest of the code happy */
+
+	RHEXDUMP3(data, data_len, "Read packet");
+
+	common_ctx = (fr_radius_ctx_t) {
+		.secret = inst->secret,
+		.secret_length = talloc_array_length(inst->secret) - 1,
+	};
+
+	decode_ctx = (fr_radius_decode_ctx_t) {
+		.common = &common_ctx,
+		.request_code = u->code,
+		.request_authenticator = request_authenticator,
+		.tmp_ctx = talloc(ctx, uint8_t),
+		.end = data + data_len,
+		.verify = true,
+	};
+
+	if (fr_radius_decode(ctx, reply, data, data_len, &decode_ctx) < 0) {
+		talloc_free(decode_ctx.tmp_ctx);
+		RPEDEBUG("Failed reading packet");
+		return DECODE_FAIL_UNKNOWN;
+	}
+	talloc_free(decode_ctx.tmp_ctx);
+
+	code = data[0];
+
+	RDEBUG("Received %s ID %d length %ld reply packet on connection %s",
+	       fr_radius_packet_name[code], data[1], data_len, h->name);
+	log_request_pair_list(L_DBG_LVL_2, request, NULL, reply, NULL);
+
+	*response_code = code;
+
+	/*
+	 *	Fixup retry times
+	 */
+	if (fr_time_gt(u->retry.start, h->mrs_time)) h->mrs_time = u->retry.start;
+
+	return DECODE_FAIL_NONE;
+}
+
+/** Encode a packet directly into the connection's send buffer
+ *
+ * The caller has already checked that there's room for at least
+ * max_packet_size bytes.
+ */
+static int encode(tcp_handle_t *h, request_t *request, tcp_request_t *u, uint8_t id)
+{
+	rlm_radius_tcp_t const	*inst = h->inst;
+	ssize_t			packet_len;
+	uint8_t			*msg = NULL;
+	int			message_authenticator = u->require_ma * (RADIUS_MESSAGE_AUTHENTICATOR_LENGTH + 2);
+	int			proxy_state = 6;
+
+	fr_assert(inst->parent->allowed[u->code]);
+	fr_assert(!u->packet);
+	fr_assert((size_t) (h->send.end - h->send.write) >= inst->max_packet_size);
+
+	u->packet = h->send.write;
+	u->packet_len = inst->max_packet_size;
+
+	/*
+	 *	All proxied Access-Request packets MUST have a
+	 *	Message-Authenticator, otherwise they're insecure.
+	 *
+	 *	And we set the authentication vector to a random
+	 *	number...
+	 */
+	if (u->code == FR_RADIUS_CODE_ACCESS_REQUEST) {
+		size_t i;
+		uint32_t hash, base;
+
+		message_authenticator = RADIUS_MESSAGE_AUTHENTICATOR_LENGTH + 2;
+
+		base = fr_rand();
+		for (i = 0; i < RADIUS_AUTH_VECTOR_LENGTH; i += sizeof(uint32_t)) {
+			hash = fr_rand() ^ base;
+			memcpy(u->packet + RADIUS_AUTH_VECTOR_OFFSET + i, &hash, sizeof(hash));
+		}
+	}
+
+	/*
+	 *	We're originating packets instead of proxying
+	 *	them.  We don't add a Proxy-State attribute.
+	 */
+	if (inst->parent->originate) proxy_state = 0;
+
+	/*
+	 *	Encode it, leaving room for Proxy-State and
+	 *	Message-Authenticator if necessary.
+	 */
+	packet_len = fr_radius_encode(u->packet, u->packet_len - (proxy_state + message_authenticator), NULL,
+				      inst->secret, talloc_array_length(inst->secret) - 1,
+				      u->code, id, &request->request_pairs);
+	if (fr_pair_encode_is_error(packet_len)) {
+		RPERROR("Failed encoding packet");
+
+	error:
+		u->packet = NULL;
+		fr_pair_list_free(&u->extra);
+		return -1;
+	}
+
+	if (packet_len < 0) {
+		size_t have;
+		size_t need;
+
+		have = u->packet_len - (proxy_state + message_authenticator);
+		need = have - packet_len;
+
+		if (need > RADIUS_MAX_PACKET_SIZE) {
+			RERROR("Failed encoding packet.  Have %zu bytes of buffer, need %zu bytes",
+			       have, need);
+		} else {
+			RERROR("Failed encoding packet.  Have %zu bytes of buffer, need %zu bytes.  "
+			       "Increase 'max_packet_size'", have, need);
+		}
+
+		goto error;
+	}
+
+	/*
+	 *	Add Proxy-State to the tail end of the packet.
+	 *
+	 *	We need to add it here, and NOT in
+	 *	request->request_pairs, because multiple modules
+	 *	may be sending the packets at the same time.
+	 */
+	if (proxy_state) {
+		uint8_t		*attr = u->packet + packet_len;
+		fr_pair_t	*vp;
+
+		attr[0] = (uint8_t)attr_proxy_state->attr;
+		attr[1] = 6;
+		memcpy(attr + 2, &inst->parent->proxy_state, 4);
+		packet_len += 6;
+
+		MEM(vp = fr_pair_afrom_da(u, attr_proxy_state));
+		fr_pair_value_memdup(vp, attr + 2, 4, true);
+		fr_pair_append(&u->extra, vp);
+	}
+
+	/*
+	 *	Add Message-Authenticator manually.
+	 */
+	if (message_authenticator) {
+		msg = u->packet + packet_len;
+
+		msg[0] = (uint8_t) attr_message_authenticator->attr;
+		msg[1] = RADIUS_MESSAGE_AUTHENTICATOR_LENGTH + 2;
+		memset(msg + 2, 0,  RADIUS_MESSAGE_AUTHENTICATOR_LENGTH);
+
+		packet_len += msg[1];
+	}
+
+	/*
+	 *	Update the packet header based on the new attributes.
+	 */
+	u->packet[2] = (packet_len >> 8) & 0xff;
+	u->packet[3] = packet_len & 0xff;
+	u->packet_len = packet_len;
+
+	/*
+	 *	Ensure that we update the Acct-Delay-Time based on the
+	 *	time difference between now, and when we originally
+	 *	received the request.
+	 */
+	if ((u->code == FR_RADIUS_CODE_ACCOUNTING_REQUEST) &&
+	    (fr_pair_find_by_da(&request->request_pairs, NULL, attr_acct_delay_time) != NULL)) {
+		uint8_t *attr, *end;
+		uint32_t delay;
+
+		end = u->packet + packet_len;
+
+		for (attr = u->packet + RADIUS_HEADER_LENGTH;
+		     attr < end;
+		     attr += attr[1]) {
+			if (attr[0] != attr_acct_delay_time->attr) continue;
+			if (attr[1] != 6) continue;
+
+			delay = fr_nbo_to_uint32(attr + 2);
+			delay += fr_time_delta_to_sec(fr_time_sub(u->retry.updated, u->recv_time));
+			fr_nbo_from_uint32(attr + 2, delay);
+			break;
+		}
+	}
+
+	/*
+	 *	Only certain types of packet, and those with a
+	 *	message_authenticator need signing.
+	 */
+	if (message_authenticator) goto sign;
+	switch (u->code) {
+	case FR_RADIUS_CODE_ACCOUNTING_REQUEST:
+	case FR_RADIUS_CODE_DISCONNECT_REQUEST:
+	case FR_RADIUS_CODE_COA_REQUEST:
+	sign:
+		/*
+		 *	Now that we're done mangling the packet, sign it.
+		 */
+		if (fr_radius_sign(u->packet, NULL, (uint8_t const *) inst->secret,
+				   talloc_array_length(inst->secret) - 1) < 0) {
+			RERROR("Failed signing packet");
+			goto error;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/** Revive a connection after "revive_interval"
+ *
+ */
+static void revive_timeout(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	fr_trunk_connection_t	*tconn = talloc_get_type_abort(uctx, fr_trunk_connection_t);
+	tcp_handle_t	 	*h = talloc_get_type_abort(tconn->conn->h, tcp_handle_t);
+
+	INFO("%s - Reviving connection %s", h->module_name, h->name);
+	fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+}
+
+/** Mark a connection dead after "zombie_interval"
+ *
+ */
+static void zombie_timeout(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_trunk_connection_t	*tconn = talloc_get_type_abort(uctx, fr_trunk_connection_t);
+	tcp_handle_t	 	*h = talloc_get_type_abort(tconn->conn->h, tcp_handle_t);
+
+	INFO("%s - No replies during 'zombie_period', marking connection %s as dead", h->module_name, h->name);
+
+	/*
+	 *	Don't use this connection, and re-queue all of its
+	 *	requests onto other connections.
+	 */
+	fr_trunk_connection_signal_inactive(tconn);
+	(void) fr_trunk_connection_requests_requeue(tconn, FR_TRUNK_REQUEST_STATE_ALL, 0, false);
+
+	/*
+	 *	Revive the connection after a time.
+	 */
+	if (fr_event_timer_at(h, el, &h->zombie_ev,
+			      fr_time_add(now, h->inst->parent->revive_interval), revive_timeout, tconn) < 0) {
+		ERROR("Failed inserting revive timeout for connection");
+		fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+	}
+}
+
+/** See if the connection is zombied.
+ *
+ * TCP connections don't do Status-Server checks.  If the home server
+ * stops answering, we stop sending new packets on the connection,
+ * and after "zombie_period" we move all of its requests elsewhere.
+ *
+ * @return
+ *	- true if the connection is zombie.
+ *	- false if the connection is not zombie.
+ */
+static bool check_for_zombie(fr_event_list_t *el, fr_trunk_connection_t *tconn, fr_time_t now, fr_time_t last_sent)
+{
+	tcp_handle_t	*h = talloc_get_type_abort(tconn->conn->h, tcp_handle_t);
+
+	/*
+	 *	If we're already zombie, don't go to zombie
+	 */
+	if (h->zombie_ev) return true;
+
+	if (fr_time_eq(now, fr_time_wrap(0))) now = fr_time();
+
+	/*
+	 *	We received a reply since this packet was sent, the connection isn't zombie.
+	 */
+	if (fr_time_gteq(h->last_reply, last_sent)) return false;
+
+	/*
+	 *	If we've seen ANY response in the allowed window, then the connection is still alive.
+	 */
+	if (fr_time_gt(last_sent, fr_time_wrap(0)) &&
+	    (fr_time_lt(fr_time_add(last_sent, h->inst->parent->response_window), now))) return false;
+
+	/*
+	 *	Mark the connection as inactive, but keep the
+	 *	outstanding packets on it.
+	 */
+	WARN("%s - Entering Zombie state - connection %s", h->module_name, h->name);
+	fr_trunk_connection_signal_inactive(tconn);
+
+	if (fr_event_timer_at(h, el, &h->zombie_ev, fr_time_add(now, h->inst->parent->zombie_period),
+			      zombie_timeout, tconn) < 0) {
+		ERROR("Failed inserting zombie timeout for connection");
+		fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+	}
+
+	return true;
+}
+
+/** Handle retries.
+ *
+ * With TCP we never retransmit a packet on the same connection.
+ * The timer just tracks MRC / MRD, and lets us notice that the
+ * connection has stopped responding.  zombie_timeout() then moves
+ * the request to a different connection.
+ */
+static void request_retry(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_trunk_request_t	*treq = talloc_get_type_abort(uctx, fr_trunk_request_t);
+	tcp_request_t		*u = talloc_get_type_abort(treq->preq, tcp_request_t);
+	tcp_result_t		*r = talloc_get_type_abort(treq->rctx, tcp_result_t);
+	request_t		*request = treq->request;
+	fr_trunk_connection_t	*tconn = treq->tconn;
+
+	fr_assert((treq->state == FR_TRUNK_REQUEST_STATE_SENT) ||
+		  (treq->state == FR_TRUNK_REQUEST_STATE_PARTIAL));	/* No other states should be timing out */
+	fr_assert(treq->preq);						/* Must still have a protocol request */
+	fr_assert(u->rr);
+	fr_assert(tconn);
+
+	switch (fr_retry_next(&u->retry, now)) {
+	case FR_RETRY_CONTINUE:
+		if (fr_event_timer_at(u, el, &u->ev, u->retry.next, request_retry, treq) < 0) {
+			RERROR("Failed inserting retransmit timeout for connection");
+			break;
+		}
+
+		check_for_zombie(el, tconn, now, u->retry.start);
+		return;
+
+	case FR_RETRY_MRD:
+		REDEBUG("Reached maximum_retransmit_duration (%pVs > %pVs), failing request",
+			fr_box_time_delta(fr_time_sub(now, u->retry.start)), fr_box_time_delta(u->retry.config->mrd));
+		break;
+
+	case FR_RETRY_MRC:
+		REDEBUG("Reached maximum_retransmit_count (%u > %u), failing request",
+		        u->retry.count, u->retry.config->mrc);
+		break;
+	}
+
+	r->rcode = RLM_MODULE_FAIL;
+	fr_trunk_request_signal_complete(treq);
+
+	check_for_zombie(el, tconn, now, u->retry.start);
+}
+
+static void request_mux(fr_event_list_t *el,
+			fr_trunk_connection_t *tconn, fr_connection_t *conn, UNUSED void *uctx)
+{
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+	rlm_radius_tcp_t const	*inst = h->inst;
+	ssize_t			sent;
+	uint16_t		i, queued;
+	uint8_t const		*written;
+	uint8_t			*partial;
+	bool			ids_exhausted = false;
+
+	/*
+	 *	Encode multiple packets into the send buffer, in
+	 *	preparation for transmission with one write().
+	 */
+	for (i = 0, queued = 0; (i < inst->max_send_coalesce); i++) {
+		fr_trunk_request_t	*treq;
+		tcp_request_t		*u;
+		request_t		*request;
+
+ 		if (unlikely(fr_trunk_connection_pop_request(&treq, tconn) < 0)) return;
+
+		/*
+		 *	No more requests to send
+		 */
+		if (!treq) break;
+
+		/*
+		 *	The partial write MUST be the first one popped off of the request list.
+		 *
+		 *	If we have a partial packet, then we know that there's partial data in the output
+		 *	buffer.  However, the request MAY still be freed or timed out before we can write the
+		 *	data.  As a result, we ignore the tcp_request_t, and just keep writing the data.
+		 */
+		if (treq->state == FR_TRUNK_REQUEST_STATE_PARTIAL) {
+			fr_assert(h->send.read == h->send.data);
+			fr_assert(h->send.write > h->send.read);
+
+			fr_assert(i == 0);
+
+			h->coalesced[0] = treq;
+			goto next;
+		}
+
+		/*
+		 *	The request must still be pending.
+		 */
+ 		fr_assert(treq->state == FR_TRUNK_REQUEST_STATE_PENDING);
+
+		request = treq->request;
+		u = talloc_get_type_abort(treq->preq, tcp_request_t);
+
+		/*
+		 *	Not enough room for a full-sized packet, stop encoding packets
+		 */
+		if ((size_t) (h->send.end - h->send.write) < inst->max_packet_size) break;
+
+		/*
+		 *	All 256 IDs are in use.  Stop using this
+		 *	connection until replies free some of them.
+		 */
+		if (unlikely(radius_track_entry_reserve(&u->rr, treq, h->tt, request, u->code, treq) < 0)) {
+			ids_exhausted = true;
+			break;
+		}
+		u->id = u->rr->id;
+
+		/*
+		 *	Start retransmissions from when the socket is writable.
+		 */
+		fr_retry_init(&u->retry, fr_time(), &inst->parent->retry[u->code]);
+		fr_assert(fr_time_delta_ispos(u->retry.rt));
+		fr_assert(fr_time_gt(u->retry.next, fr_time_wrap(0)));
+
+		if (encode(h, request, u, u->id) < 0) {
+			/*
+			 *	Need to do this because request_conn_release
+			 *	may not be called.
+			 */
+			tcp_request_reset(u);
+			fr_trunk_request_signal_fail(treq);
+			continue;
+		}
+		RHEXDUMP3(u->packet, u->packet_len, "Encoded packet");
+
+		/*
+		 *	Remember the authentication vector, which now has the
+		 *	packet signature.
+		 */
+		(void) radius_track_entry_update(u->rr, u->packet + RADIUS_AUTH_VECTOR_OFFSET);
+
+		RDEBUG("Sending %s ID %d length %ld over connection %s",
+		       fr_radius_packet_name[u->code], u->id, u->packet_len, h->name);
+		log_request_pair_list(L_DBG_LVL_2, request, NULL, &request->request_pairs, NULL);
+		if (!fr_pair_list_empty(&u->extra)) log_request_pair_list(L_DBG_LVL_2, request, NULL, &u->extra, NULL);
+
+		/*
+		 *	Remember that we've encoded this packet.
+		 */
+		h->coalesced[queued] = treq;
+		h->send.write += u->packet_len;
+
+		fr_assert(h->send.write <= h->send.end);
+
+	next:
+		/*
+		 *	Tell the trunk API that this request is now in
+		 *	the "sent" state.  And we don't want to see
+		 *	this request again. The request hasn't actually
+		 *	been sent, but it's the only way to get at the
+		 *	next entry in the heap.
+		 */
+		fr_trunk_request_signal_sent(treq);
+		queued++;
+	}
+
+	if (ids_exhausted) {
+		DEBUG("%s - All IDs in use on connection %s", h->module_name, h->name);
+
+		h->ids_exhausted = true;
+		fr_trunk_connection_signal_inactive(tconn);
+		(void) fr_trunk_connection_requests_requeue(tconn, FR_TRUNK_REQUEST_STATE_PENDING, 0, false);
+	}
+
+	if (queued == 0) return;	/* No work */
+
+	/*
+	 *	Verify nothing accidentally freed the connection handle
+	 */
+	(void)talloc_get_type_abort(h, tcp_handle_t);
+
+	/*
+	 *	Send the packets as one system call.
+	 */
+	sent = fr_bio_write(h->bio, NULL, h->send.read, h->send.write - h->send.read);
+	if (sent < 0) {
+		/*
+		 *	Temporary conditions
+		 */
+		if (sent == fr_bio_error(IO_WOULD_BLOCK)) {
+			sent = 0;
+
+		/*
+		 *	Will re-queue any 'sent' requests, so we don't
+		 *	have to do any cleanup.
+		 */
+		} else {
+			ERROR("%s - Failed sending data over connection %s: %s",
+			      h->module_name, h->name, fr_bio_strerror(sent));
+			fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+			return;
+		}
+	}
+
+	written = h->send.read + sent;
+	partial = h->send.read;
+
+	/*
+	 *	For all messages that were actually sent by write()
+	 *	start the request timer.
+	 */
+	for (i = 0; i < queued; i++) {
+		fr_trunk_request_t	*treq = h->coalesced[i];
+		tcp_request_t		*u;
+		request_t		*request;
+
+		/*
+		 *	We *think* we sent this, but we might not had :(
+		 */
+		fr_assert(treq->state == FR_TRUNK_REQUEST_STATE_SENT);
+
+		request = treq->request;
+		u = talloc_get_type_abort(treq->preq, tcp_request_t);
+
+		/*
+		 *	This packet ends before the piece we've
+		 *	written, so we've written all of it.
+		 */
+		if (u->packet + u->packet_len <= written) {
+			h->last_sent = u->retry.start;
+			if (fr_time_lteq(h->first_sent, h->last_idle)) h->first_sent = h->last_sent;
+
+			if (!u->ev && (fr_event_timer_at(u, el, &u->ev, u->retry.next, request_retry, treq) < 0)) {
+				RERROR("Failed inserting retransmit timeout for connection");
+				fr_trunk_request_signal_fail(treq);
+			}
+			continue;
+		}
+
+		/*
+		 *	The packet starts before the piece we've written, BUT ends after the written piece.
+		 *
+		 *	We only wrote part of this packet, remember the partial packet we wrote.  Note that
+		 *	we only track the packet data, and not the tcp_request_t.  The underlying request (and
+		 *	u) may disappear at any time, even if there's still data in the buffer.
+		 *
+		 *	Then, signal that isn't a partial packet, and stop processing the queue, as we know
+		 *	that the next packet wasn't written.
+		 */
+		if (u->packet < written) {
+			size_t skip = written - u->packet;
+			size_t left = u->packet_len - skip;
+
+			fr_assert(u->packet + u->packet_len > written);
+
+			memmove(h->send.data, u->packet + skip, left);
+
+			fr_assert(h->send.read == h->send.data);
+			partial = h->send.data + left;
+
+			/*
+			 *	The packet is committed to the stream, so
+			 *	start timing it.
+			 */
+			if (fr_event_timer_at(u, el, &u->ev, u->retry.next, request_retry, treq) < 0) {
+				RERROR("Failed inserting retransmit timeout for connection");
+			}
+
+			u->packet = h->send.data;
+			u->packet_len = left;
+
+			fr_trunk_request_signal_partial(h->coalesced[i]);
+			continue;
+		}
+
+		/*
+		 *	The packet starts after the piece we've written, so we haven't written any of it.
+		 *
+		 *	Requests that weren't sent get re-enqueued.  Which means that they get re-encoded, but
+		 *	oh well.
+		 *
+		 *	The cancel logic runs as per-normal and cleans up
+		 *	the request ready for sending again...
+		 */
+		fr_trunk_request_requeue(h->coalesced[i]);
+		fr_assert(!u->packet); /* must have called tcp_request_reset() */
+	}
+
+	/*
+	 *	Remember where to write the next packet.  Either at the start of the buffer, or after the one
+	 *	which was partially written.
+	 */
+	h->send.write = partial;
+}
+
+static void request_demux(UNUSED fr_event_list_t *el, fr_trunk_connection_t *tconn, fr_connection_t *conn, UNUSED void *uctx)
+{
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+	bool			do_read = true;
+
+	DEBUG3("%s - Reading data for connection %s", h->module_name, h->name);
+
+	while (true) {
+		ssize_t			slen;
+		size_t			available, used, packet_len;
+
+		fr_trunk_request_t	*treq;
+		request_t		*request;
+		tcp_request_t		*u;
+		tcp_result_t		*r;
+		radius_track_entry_t	*rr;
+		uint8_t			code = 0;
+		fr_pair_list_t		reply;
+
+		/*
+		 *	Ensure that we can read at least one max-sized packet.
+		 *
+		 *	If not, move the trailing bytes to the start of the buffer, and reset the read/write
+		 *	pointers to the start of the buffer.  Note that the read buffer has to be at least 2x
+		 *	max_packet_size.
+		 */
+		available = h->recv.end - h->recv.read;
+		if (available < h->max_packet_size) {
+			used = h->recv.write - h->recv.read;
+
+			memmove(h->recv.data, h->recv.read, used);
+			h->recv.read = h->recv.data;
+			h->recv.write = h->recv.read + used;
+		}
+
+		/*
+		 *	Read as much data as possible.
+		 *
+		 *	We don't need to call read() on every round through the loop.  Instead, we call it
+		 *	only when this function first gets called, OR if the read stopped at the end of the
+		 *	buffer.
+		 *
+		 *	This allows us to read a large amount of data at once, and then process multiple
+		 *	packets without calling read() too many times.
+		 */
+		if (do_read) {
+			slen = fr_bio_read(h->bio, NULL, h->recv.write, h->recv.end - h->recv.write);
+			if (slen == 0) return;
+
+			if (slen < 0) {
+				if (slen == fr_bio_error(IO_WOULD_BLOCK)) return;
+
+				ERROR("%s - Failed reading response from connection %s: %s",
+				      h->module_name, h->name, fr_bio_strerror(slen));
+				fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+				return;
+			}
+
+			h->recv.write += slen;
+			do_read = (h->recv.write == h->recv.end);
+		}
+
+		used = h->recv.write - h->recv.read;
+
+		/*
+		 *	We haven't received a full header, read more or return.
+		 */
+		if (used < RADIUS_HEADER_LENGTH) {
+			if (do_read) continue;
+			return;
+		}
+
+		packet_len = fr_nbo_to_uint16(h->recv.read + 2);
+
+		/*
+		 *	There's no way to resynchronise a stream which
+		 *	contains garbage.  Close the connection.
+		 */
+		if ((packet_len < RADIUS_HEADER_LENGTH) || (packet_len > h->max_packet_size)) {
+			ERROR("%s - Invalid packet length %zu received on connection %s",
+			      h->module_name, packet_len, h->name);
+			fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+			return;
+		}
+
+		/*
+		 *	We haven't received the full packet, read more or return.
+		 */
+		if (used < packet_len) {
+			if (do_read) continue;
+			return;
+		}
+
+		fr_assert(h->recv.read + packet_len <= h->recv.end);
+
+		if (!fr_radius_ok(h->recv.read, &packet_len, h->inst->parent->max_attributes, false, NULL)) {
+			PERROR("%s - Malformed packet received on connection %s", h->module_name, h->name);
+			fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+			return;
+		}
+
+		/*
+		 *	Note that we don't care about packet codes.  All
+		 *	packet codes share the same ID space.
+		 */
+		rr = radius_track_entry_find(h->tt, h->recv.read[1], NULL);
+		if (!rr) {
+			WARN("%s - Ignoring reply with ID %i that arrived too late",
+			     h->module_name, h->recv.read[1]);
+
+			h->recv.read += packet_len;
+			continue;
+		}
+
+		treq = talloc_get_type_abort(rr->uctx, fr_trunk_request_t);
+		request = treq->request;
+		fr_assert(request != NULL);
+		u = talloc_get_type_abort(treq->preq, tcp_request_t);
+		r = talloc_get_type_abort(treq->rctx, tcp_result_t);
+
+		fr_pair_list_init(&reply);
+
+		/*
+		 *	Validate and decode the incoming packet.  A bad
+		 *	Response Authenticator means a reply to a packet
+		 *	which has since been released.  It's not fatal.
+		 */
+		if (decode(request->reply_ctx, &reply, &code, h, request, u, rr->vector,
+			   h->recv.read, packet_len) != DECODE_FAIL_NONE) {
+			h->recv.read += packet_len;
+			continue;
+		}
+		h->recv.read += packet_len;
+
+		/*
+		 *	Only valid packets are processed.
+		 */
+		h->last_reply = fr_time();
+
+		/*
+		 *	We stopped using the connection because we ran
+		 *	out of IDs.  This reply frees one.
+		 */
+		if (h->ids_exhausted) {
+			h->ids_exhausted = false;
+			fr_trunk_connection_signal_active(tconn);
+		}
+
+		/*
+		 *	Mark up the request as being an Access-Challenge, if
+		 *	required.
+		 */
+		if ((u->code == FR_RADIUS_CODE_ACCESS_REQUEST) && (code == FR_RADIUS_CODE_ACCESS_CHALLENGE)) {
+			fr_pair_t	*vp;
+
+			vp = fr_pair_find_by_da(&request->reply_pairs, NULL, attr_packet_type);
+			if (!vp) {
+				MEM(vp = fr_pair_afrom_da(request->reply_ctx, attr_packet_type));
+				vp->vp_uint32 = FR_RADIUS_CODE_ACCESS_CHALLENGE;
+				fr_pair_append(&request->reply_pairs, vp);
+			}
+		}
+
+		/*
+		 *	Delete Proxy-State attributes from the reply.
+		 */
+		fr_pair_delete_by_da(&reply, attr_proxy_state);
+
+		/*
+		 *	If the reply has Message-Authenticator, delete
+		 *	it from the proxy reply so that it isn't
+		 *	copied over to our reply.  But also create a
+		 *	reply.Message-Authenticator attribute, so that
+		 *	it ends up in our reply.
+		 */
+		if (fr_pair_find_by_da(&reply, NULL, attr_message_authenticator)) {
+			fr_pair_t *vp;
+
+			fr_pair_delete_by_da(&reply, attr_message_authenticator);
+
+			MEM(vp = fr_pair_afrom_da(request->reply_ctx, attr_message_authenticator));
+			(void) fr_pair_value_memdup(vp, (uint8_t const *) "", 1, false);
+			fr_pair_append(&request->reply_pairs, vp);
+		}
+
+		treq->request->reply->code = code;
+		r->rcode = radius_code_to_rcode[code];
+		fr_pair_list_append(&request->reply_pairs, &reply);
+		fr_trunk_request_signal_complete(treq);
+	}
+}
+
+/** Remove the request from any tracking structures
+ *
+ * Frees encoded packets if the request is being moved to a new connection
+ */
+static void request_cancel(UNUSED fr_connection_t *conn, void *preq_to_reset,
+			   fr_trunk_cancel_reason_t reason, UNUSED void *uctx)
+{
+	tcp_request_t	*u = talloc_get_type_abort(preq_to_reset, tcp_request_t);
+
+	/*
+	 *	Request has been requeued.  TCP doesn't retransmit on
+	 *	the same connection, so the packet will be encoded
+	 *	again with a new ID.
+	 */
+	if (reason == FR_TRUNK_CANCEL_REASON_REQUEUE) tcp_request_reset(u);
+
+	/*
+	 *      Other cancellations are dealt with by
+	 *      request_conn_release as the request is removed
+	 *	from the trunk.
+	 */
+}
+
+/** Clear out anything associated with the handle from the request
+ *
+ */
+static void request_conn_release(fr_connection_t *conn, void *preq_to_reset, UNUSED void *uctx)
+{
+	tcp_request_t		*u = talloc_get_type_abort(preq_to_reset, tcp_request_t);
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+
+	tcp_request_reset(u);
+
+	/*
+	 *	If there are no outstanding tracking entries
+	 *	allocated then the connection is "idle".
+	 */
+	if (!h->tt || (h->tt->num_requests == 0)) h->last_idle = fr_time();
+}
+
+/** Write out a canned failure
+ *
+ */
+static void request_fail(request_t *request, NDEBUG_UNUSED void *preq, void *rctx,
+			 NDEBUG_UNUSED fr_trunk_request_state_t state, UNUSED void *uctx)
+{
+	tcp_result_t		*r = talloc_get_type_abort(rctx, tcp_result_t);
+#ifndef NDEBUG
+	tcp_request_t		*u = talloc_get_type_abort(preq, tcp_request_t);
+#endif
+
+	fr_assert(!u->rr && !u->packet && fr_pair_list_empty(&u->extra) && !u->ev);	/* Dealt with by request_conn_release */
+
+	fr_assert(state != FR_TRUNK_REQUEST_STATE_INIT);
+
+	r->rcode = RLM_MODULE_FAIL;
+	r->treq = NULL;
+
+	unlang_interpret_mark_runnable(request);
+}
+
+/** Response has already been written to the rctx at this point
+ *
+ */
+static void request_complete(request_t *request, NDEBUG_UNUSED void *preq, void *rctx, UNUSED void *uctx)
+{
+	tcp_result_t		*r = talloc_get_type_abort(rctx, tcp_result_t);
+#ifndef NDEBUG
+	tcp_request_t		*u = talloc_get_type_abort(preq, tcp_request_t);
+#endif
+
+	fr_assert(!u->rr && !u->packet && fr_pair_list_empty(&u->extra) && !u->ev);	/* Dealt with by request_conn_release */
+
+	r->treq = NULL;
+
+	unlang_interpret_mark_runnable(request);
+}
+
+/** Explicitly free resources associated with the protocol request
+ *
+ */
+static void request_free(UNUSED request_t *request, void *preq_to_free, UNUSED void *uctx)
+{
+	tcp_request_t		*u = talloc_get_type_abort(preq_to_free, tcp_request_t);
+
+	fr_assert(!u->rr && !u->packet && fr_pair_list_empty(&u->extra) && !u->ev);	/* Dealt with by request_conn_release */
+
+	talloc_free(u);
+}
+
+/** Resume execution of the request, returning the rcode set during trunk execution
+ *
+ */
+static unlang_action_t mod_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx, UNUSED request_t *request)
+{
+	tcp_result_t	*r = talloc_get_type_abort(mctx->rctx, tcp_result_t);
+	rlm_rcode_t	rcode = r->rcode;
+
+	talloc_free(r);
+
+	RETURN_MODULE_RCODE(rcode);
+}
+
+static void mod_signal(module_ctx_t const *mctx, UNUSED request_t *request, fr_signal_t action)
+{
+	tcp_result_t		*r = talloc_get_type_abort(mctx->rctx, tcp_result_t);
+
+	/*
+	 *	If we don't have a treq associated with the
+	 *	rctx it's likely because the request was
+	 *	scheduled, but hasn't yet been resumed, and
+	 *	has received a signal, OR has been resumed
+	 *	and immediately cancelled as the event loop
+	 *	is exiting, in which case
+	 *	unlang_request_is_scheduled will return false
+	 *	(don't use it).
+	 */
+	if (!r->treq) {
+		talloc_free(r);
+		return;
+	}
+
+	switch (action) {
+	/*
+	 *	The request is being cancelled, tell the
+	 *	trunk so it can clean up the treq.
+	 */
+	case FR_SIGNAL_CANCEL:
+		fr_trunk_request_signal_cancel(r->treq);
+		r->treq = NULL;
+		talloc_free(r);		/* Should be freed soon anyway, but better to be explicit */
+		return;
+
+	/*
+	 *	TCP is reliable, so there's no point in
+	 *	retransmitting on a DUP.  If the connection dies,
+	 *	the request will be moved to a new one.
+	 */
+	case FR_SIGNAL_DUP:
+	default:
+		return;
+	}
+}
+
+#ifndef NDEBUG
+/** Free a tcp_result_t
+ *
+ * Allows us to set break points for debugging.
+ */
+static int _tcp_result_free(tcp_result_t *r)
+{
+	fr_trunk_request_t	*treq;
+	tcp_request_t		*u;
+
+	if (!r->treq) return 0;
+
+	treq = talloc_get_type_abort(r->treq, fr_trunk_request_t);
+	u = talloc_get_type_abort(treq->preq, tcp_request_t);
+
+	fr_assert_msg(!u->ev, "tcp_result_t freed with active timer");
+
+	return 0;
+}
+#endif
+
+/** Free a tcp_request_t
+ */
+static int _tcp_request_free(tcp_request_t *u)
+{
+	if (u->ev) (void) fr_event_timer_delete(&u->ev);
+
+	fr_assert(u->rr == NULL);
+
+	return 0;
+}
+
+static unlang_action_t mod_enqueue(rlm_rcode_t *p_result, void **rctx_out, UNUSED void *instance, void *thread, request_t *request)
+{
+	tcp_thread_t			*t = talloc_get_type_abort(thread, tcp_thread_t);
+	tcp_result_t			*r;
+	tcp_request_t			*u;
+	fr_trunk_request_t		*treq;
+
+	fr_assert(request->packet->code > 0);
+	fr_assert(request->packet->code < FR_RADIUS_CODE_MAX);
+
+	if (request->packet->code == FR_RADIUS_CODE_STATUS_SERVER) {
+		RWDEBUG("Status-Server is reserved for internal use, and cannot be sent manually.");
+		RETURN_MODULE_NOOP;
+	}
+
+	treq = fr_trunk_request_alloc(t->trunk, request);
+	if (!treq) RETURN_MODULE_FAIL;
+
+	MEM(r = talloc_zero(request, tcp_result_t));
+#ifndef NDEBUG
+	talloc_set_destructor(r, _tcp_result_free);
+#endif
+
+	/*
+	 *	Can't use compound literal - const issues.
+	 */
+	MEM(u = talloc_zero(treq, tcp_request_t));
+	u->code = request->packet->code;
+	u->priority = request->async->priority;
+	u->recv_time = request->async->recv_time;
+	fr_pair_list_init(&u->extra);
+
+	r->rcode = RLM_MODULE_FAIL;
+
+	/*
+	 *	If the caller asked for a Message-Authenticator,
+	 *	delete theirs (which has a bad value), and remember to
+	 *	add one manually when we encode the packet.
+	 */
+	if (fr_pair_find_by_da(&request->request_pairs, NULL, attr_message_authenticator)) {
+		u->require_ma = true;
+		pair_delete_request(attr_message_authenticator);
+	}
+
+	switch(fr_trunk_request_enqueue(&treq, t->trunk, request, u, r)) {
+	case FR_TRUNK_ENQUEUE_OK:
+	case FR_TRUNK_ENQUEUE_IN_BACKLOG:
+		break;
+
+	case FR_TRUNK_ENQUEUE_NO_CAPACITY:
+		REDEBUG("Unable to queue packet - connections at maximum capacity");
+	fail:
+		fr_assert(!u->rr && !u->packet);	/* Should not have been fed to the muxer */
+		fr_trunk_request_free(&treq);		/* Return to the free list */
+		talloc_free(r);
+		RETURN_MODULE_FAIL;
+
+	case FR_TRUNK_ENQUEUE_DST_UNAVAILABLE:
+		REDEBUG("All destinations are down - cannot send packet");
+		goto fail;
+
+	case FR_TRUNK_ENQUEUE_FAIL:
+		REDEBUG("Unable to queue packet");
+		goto fail;
+	}
+
+	r->treq = treq;	/* Remember for signalling purposes */
+
+	talloc_set_destructor(u, _tcp_request_free);
+
+	*rctx_out = r;
+
+	return UNLANG_ACTION_YIELD;
+}
+
+/** Instantiate thread data for the submodule.
+ *
+ */
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_radius_tcp_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_radius_tcp_t);
+	tcp_thread_t			*thread = talloc_get_type_abort(mctx->thread, tcp_thread_t);
+
+	static fr_trunk_io_funcs_t	io_funcs = {
+						.connection_alloc = thread_conn_alloc,
+						.connection_notify = thread_conn_notify,
+						.request_prioritise = request_prioritise,
+						.request_mux = request_mux,
+						.request_demux = request_demux,
+						.request_conn_release = request_conn_release,
+						.request_complete = request_complete,
+						.request_fail = request_fail,
+						.request_cancel = request_cancel,
+						.request_free = request_free
+					};
+
+	thread->el = mctx->el;
+	thread->inst = inst;
+	thread->trunk = fr_trunk_alloc(thread, mctx->el, &io_funcs,
+				       &inst->trunk_conf, inst->parent->name, thread, false);
+	if (!thread->trunk) return -1;
+
+	return 0;
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_radius_t		*parent = talloc_get_type_abort(mctx->mi->parent->data, rlm_radius_t);
+	rlm_radius_tcp_t	*inst = talloc_get_type_abort(mctx->mi->data, rlm_radius_tcp_t);
+	CONF_SECTION		*conf = mctx->mi->conf;
+
+	if (!parent) {
+		ERROR("IO module cannot be instantiated directly");
+		return -1;
+	}
+
+	inst->parent = parent;
+
+	/*
+	 *	Replication is fire and forget, which makes no sense
+	 *	over a reliable transport.
+	 */
+	if (parent->replicate) {
+		cf_log_err(conf, "'replicate' is not supported with 'transport = tcp'");
+		return -1;
+	}
+
+	if (parent->status_check) {
+		cf_log_warn(conf, "'status_check' is ignored with 'transport = tcp'.  Dead connections "
+			    "are detected via 'zombie_period'");
+	}
+
+	/*
+	 *	Always need at least one packet per write
+	 */
+	if (inst->max_send_coalesce == 0) inst->max_send_coalesce = 1;
+
+	/*
+	 *	Ensure that we have a destination address.
+	 */
+	if (inst->dst_ipaddr.af == AF_UNSPEC) {
+		cf_log_err(conf, "A value must be given for 'ipaddr'");
+		return -1;
+	}
+
+	/*
+	 *	If src_ipaddr isn't set, make sure it's INADDR_ANY, of
+	 *	the same address family as dst_ipaddr.
+	 */
+	if (inst->src_ipaddr.af == AF_UNSPEC) {
+		memset(&inst->src_ipaddr, 0, sizeof(inst->src_ipaddr));
+
+		inst->src_ipaddr.af = inst->dst_ipaddr.af;
+
+		if (inst->src_ipaddr.af == AF_INET) {
+			inst->src_ipaddr.prefix = 32;
+		} else {
+			inst->src_ipaddr.prefix = 128;
+		}
+	}
+
+	else if (inst->src_ipaddr.af != inst->dst_ipaddr.af) {
+		cf_log_err(conf, "The 'ipaddr' and 'src_ipaddr' configuration items must "
+			   "be both of the same address family");
+		return -1;
+	}
+
+	if (!inst->dst_port) {
+		cf_log_err(conf, "A value must be given for 'port'");
+		return -1;
+	}
+
+	/*
+	 *	Clamp max_packet_size first before checking recv_buff and send_buff
+	 */
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 64);
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65535);
+
+	if (inst->recv_buff_is_set) {
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, >=, inst->max_packet_size);
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, <=, (1 << 30));
+	}
+
+	if (inst->send_buff_is_set) {
+		FR_INTEGER_BOUND_CHECK("send_buff", inst->send_buff, >=, inst->max_packet_size);
+		FR_INTEGER_BOUND_CHECK("send_buff", inst->send_buff, <=, (1 << 30));
+	}
+
+	memcpy(&inst->trunk_conf, &inst->parent->trunk_conf, sizeof(inst->trunk_conf));
+
+	/*
+	 *	The 8-bit ID is the only thing which identifies a
+	 *	packet on a connection.
+	 */
+	FR_INTEGER_BOUND_CHECK("trunk.per_connection_max", inst->trunk_conf.max_req_per_conn, <=, 255);
+	FR_INTEGER_BOUND_CHECK("trunk.per_connection_target", inst->trunk_conf.target_req_per_conn, <=, inst->trunk_conf.max_req_per_conn);
+
+	inst->trunk_conf.req_pool_headers = 3;	/* One for the request, one for the tracking binding, one for Proxy-State VP */
+	inst->trunk_conf.req_pool_size = sizeof(tcp_request_t) + sizeof(radius_track_entry_t ***) + sizeof(fr_pair_t) + 20;
+
+	return 0;
+}
+
+extern rlm_radius_io_t rlm_radius_tcp;
+rlm_radius_io_t rlm_radius_tcp = {
+	.common = {
+		.magic			= MODULE_MAGIC_INIT,
+		.name			= "radius_tcp",
+		.inst_size		= sizeof(rlm_radius_tcp_t),
+
+		.thread_inst_size	= sizeof(tcp_thread_t),
+		.thread_inst_type	= "tcp_thread_t",
+
+		.config			= module_config,
+		.instantiate		= mod_instantiate,
+		.thread_instantiate 	= mod_thread_instantiate,
+	},
+	.enqueue		= mod_enqueue,
+	.signal			= mod_signal,
+	.resume			= mod_resume,
+};
@@ -68,6 +68,9 @@ typedef struct {
 	bool			recv_buff_is_set;	//!< Whether we were provided with a recv_buf
 	bool			send_buff_is_set;	//!< Whether we were provided with a send_buf
 	bool			replicate;		//!< Copied from parent->replicate
+	bool			use_request_authenticator;	//!< Send Original-Request-Authenticator, and
+								///< track packets by ID and Request Authenticator
+								///< if the home server echoes it back.
 
 	fr_trunk_conf_t		trunk_conf;		//!< trunk configuration
 } rlm_radius_udp_t;
@@ -126,6 +129,9 @@ typedef struct {
 	size_t			buflen;			//!< Receive buffer length.
 
 	radius_track_t		*tt;			//!< RADIUS ID tracking structure.
+	bool			ids_exhausted;		//!< All 256 IDs are in use, and the home server hasn't
+							///< agreed to use Original-Request-Authenticator.
+							///< The connection has been marked inactive.
 
 	fr_time_t		mrs_time;		//!< Most recent sent time which had a reply.
 	fr_time_t		last_reply;		//!< When we last received a reply.
@@ -185,6 +191,8 @@ static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("max_packet_size", rlm_radius_udp_t, max_packet_size), .dflt = "4096" },
 	{ FR_CONF_OFFSET("max_send_coalesce", rlm_radius_udp_t, max_send_coalesce), .dflt = "1024" },
 
+	{ FR_CONF_OFFSET("use_request_authenticator", rlm_radius_udp_t, use_request_authenticator) },
+
 	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipaddr", FR_TYPE_COMBO_IP_ADDR, 0, rlm_radius_udp_t, src_ipaddr) },
 	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipv4addr", FR_TYPE_IPV4_ADDR, 0, rlm_radius_udp_t, src_ipaddr) },
 	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipv6addr", FR_TYPE_IPV6_ADDR, 0, rlm_radius_udp_t, src_ipaddr) },
@@ -207,6 +215,7 @@ static fr_dict_attr_t const *attr_extended_attribute_1;
 static fr_dict_attr_t const *attr_message_authenticator;
 static fr_dict_attr_t const *attr_nas_identifier;
 static fr_dict_attr_t const *attr_original_packet_code;
+static fr_dict_attr_t const *attr_original_request_authenticator;
 static fr_dict_attr_t const *attr_proxy_state;
 static fr_dict_attr_t const *attr_response_length;
 static fr_dict_attr_t const *attr_user_password;
@@ -221,6 +230,7 @@ fr_dict_attr_autoload_t rlm_radius_udp_dict_attr[] = {
 	{ .out = &attr_message_authenticator, .name = "Message-Authenticator", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
 	{ .out = &attr_nas_identifier, .name = "NAS-Identifier", .type = FR_TYPE_STRING, .dict = &dict_radius},
 	{ .out = &attr_original_packet_code, .name = "Extended-Attribute-1.Original-Packet-Code", .type = FR_TYPE_UINT32, .dict = &dict_radius},
+	{ .out = &attr_original_request_authenticator, .name = "Vendor-Specific.FreeRADIUS.Original-Request-Authenticator", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
 	{ .out = &attr_proxy_state, .name = "Proxy-State", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
 	{ .out = &attr_response_length, .name = "Extended-Attribute-1.Response-Length", .type = FR_TYPE_UINT32, .dict = &dict_radius },
 	{ .out = &attr_user_password, .name = "User-Password", .type = FR_TYPE_STRING, .dict = &dict_radius},
@@ -419,6 +429,72 @@ static void CC_HINT(nonnull) status_check_alloc(udp_handle_t *h)
 	h->status_request = request;
 }
 
+/** Find the Original-Request-Authenticator in a reply
+ *
+ * This is called before the packet has been verified, as we need the
+ * Request Authenticator to find the request the reply belongs to.  So
+ * we're careful not to trust any of the lengths.
+ *
+ * @param[in] h		the handle the reply was received on.
+ * @param[in] data_len	how much data was read.
+ * @return
+ *	- NULL if the reply didn't contain an Original-Request-Authenticator.
+ *	- The value of the first Original-Request-Authenticator.
+ */
+static uint8_t const *reply_original_request_authenticator(udp_handle_t const *h, size_t data_len)
+{
+	uint8_t const	*attr, *end;
+	size_t		packet_len;
+
+	if (!h->inst->use_request_authenticator) return NULL;
+
+	packet_len = fr_nbo_to_uint16(h->buffer + 2);
+	if (packet_len > data_len) packet_len = data_len;
+	end = h->buffer + packet_len;
+
+	for (attr = h->buffer + RADIUS_HEADER_LENGTH;
+	     (attr + 2) <= end;
+	     attr += attr[1]) {
+		if (attr[1] < 2) return NULL;
+
+		/*
+		 *	Vendor-Specific, with one sub-attribute which
+		 *	is a 16 octet Original-Request-Authenticator.
+		 */
+		if (attr[0] != FR_VENDOR_SPECIFIC) continue;
+		if (attr[1] != (RADIUS_AUTH_VECTOR_LENGTH + 8)) continue;
+		if ((attr + attr[1]) > end) return NULL;
+
+		if (fr_nbo_to_uint32(attr + 2) != attr_original_request_authenticator->parent->attr) continue;
+		if (attr[6] != (uint8_t)attr_original_request_authenticator->attr) continue;
+		if (attr[7] != (RADIUS_AUTH_VECTOR_LENGTH + 2)) continue;
+
+		return attr + 8;
+	}
+
+	return NULL;
+}
+
+/** The home server echoed Original-Request-Authenticator, so we can use it
+ *
+ * Only call this after the reply has been verified, otherwise anyone
+ * could change how we track packets.
+ */
+static void use_request_authenticator(udp_handle_t *h, fr_trunk_connection_t *tconn)
+{
+	if (h->tt->use_authenticator) return;
+
+	DEBUG("%s - Home server supports Original-Request-Authenticator, allowing more than 256 "
+	      "outstanding packets on connection %s", h->module_name, h->name);
+
+	radius_track_use_authenticator(h->tt, true);
+
+	if (tconn && h->ids_exhausted) {
+		h->ids_exhausted = false;
+		fr_trunk_connection_signal_active(tconn);
+	}
+}
+
 /** Connection errored
  *
  * We were signalled by the event loop that a fatal error occurred on this connection.
@@ -571,6 +647,12 @@ static void conn_readable_status_check(fr_event_list_t *el, UNUSED int fd, UNUSE
 
 	fr_pair_list_free(&reply);	/* FIXME - Do something with these... */
 
+	/*
+	 *	Negotiate Original-Request-Authenticator before the
+	 *	trunk starts sending us packets.
+	 */
+	if (h->tt && reply_original_request_authenticator(h, slen)) use_request_authenticator(h, NULL);
+
 	/*
 	 *	Process the error, and count this as a success.
 	 *	This is usually used for dynamic configuration
@@ -1199,6 +1281,7 @@ static int encode(rlm_radius_udp_t const *inst, request_t *request, udp_request_
 	uint8_t			*msg = NULL;
 	int			message_authenticator = u->require_ma * (RADIUS_MESSAGE_AUTHENTICATOR_LENGTH + 2);
 	int			proxy_state = 6;
+	int			original_request_authenticator = inst->use_request_authenticator * (RADIUS_AUTH_VECTOR_LENGTH + 8);
 
 	fr_assert(inst->parent->allowed[u->code]);
 	fr_assert(!u->packet);
@@ -1272,13 +1355,13 @@ static int encode(rlm_radius_udp_t const *inst, request_t *request, udp_request_
 	 *	We should have at minimum 64-byte packets, so don't
 	 *	bother doing run-time checks here.
 	 */
-	fr_assert(u->packet_len >= (size_t) (RADIUS_HEADER_LENGTH + proxy_state + message_authenticator));
+	fr_assert(u->packet_len >= (size_t) (RADIUS_HEADER_LENGTH + proxy_state + original_request_authenticator + message_authenticator));
 
 	/*
 	 *	Encode it, leaving room for Proxy-State and
 	 *	Message-Authenticator if necessary.
 	 */
-	packet_len = fr_radius_encode(u->packet, u->packet_len - (proxy_state + message_authenticator), NULL,
+	packet_len = fr_radius_encode(u->packet, u->packet_len - (proxy_state + original_request_authenticator + message_authenticator), NULL,
 				      inst->secret, talloc_array_length(inst->secret) - 1,
 				      u->code, id, &request->request_pairs);
 	if (fr_pair_encode_is_error(packet_len)) {
@@ -1293,7 +1376,7 @@ static int encode(rlm_radius_udp_t const *inst, request_t *request, udp_request_
 		size_t have;
 		size_t need;
 
-		have = u->packet_len - (proxy_state + message_authenticator);
+		have = u->packet_len - (proxy_state + original_request_authenticator + message_authenticator);
 		need = have - packet_len;
 
 		if (need > RADIUS_MAX_PACKET_SIZE) {
@@ -1309,7 +1392,7 @@ static int encode(rlm_radius_udp_t const *inst, request_t *request, udp_request_
 	/*
 	 *	The encoded packet should NOT over-run the input buffer.
 	 */
-	fr_assert((size_t) (packet_len + proxy_state + message_authenticator) <= u->packet_len);
+	fr_assert((size_t) (packet_len + proxy_state + original_request_authenticator + message_authenticator) <= u->packet_len);
 
 	/*
 	 *	Add Proxy-State to the tail end of the packet.
@@ -1359,6 +1442,31 @@ static int encode(rlm_radius_udp_t const *inst, request_t *request, udp_request_
 		fr_pair_append(&u->extra, vp);
 	}
 
+	/*
+	 *	Add Original-Request-Authenticator manually, for the
+	 *	same reasons as Proxy-State.  It tells the home server
+	 *	that we can track multiple packets with the same ID,
+	 *	and asks it to echo back the Request Authenticator of
+	 *	the packet it's replying to.
+	 *
+	 *	The value is the Request Authenticator for
+	 *	Access-Request and Status-Server.  For other packets
+	 *	the authenticator is calculated over the packet
+	 *	contents, so we can't know it yet.  The home server
+	 *	ignores the value anyway.
+	 */
+	if (original_request_authenticator) {
+		uint8_t		*attr = u->packet + packet_len;
+
+		attr[0] = FR_VENDOR_SPECIFIC;
+		attr[1] = original_request_authenticator;
+		fr_nbo_from_uint32(attr + 2, attr_original_request_authenticator->parent->attr);
+		attr[6] = (uint8_t)attr_original_request_authenticator->attr;
+		attr[7] = RADIUS_AUTH_VECTOR_LENGTH + 2;
+		memcpy(attr + 8, u->packet + RADIUS_AUTH_VECTOR_OFFSET, RADIUS_AUTH_VECTOR_LENGTH);
+		packet_len += attr[1];
+	}
+
 	/*
 	 *	Add Message-Authenticator manually.
 	 *
@@ -1715,6 +1823,7 @@ static void request_mux(fr_event_list_t *el,
 	int			sent;
 	uint16_t		i, queued;
 	size_t			total_len = 0;
+	bool			ids_exhausted = false;
 
 	/*
 	 *	Encode multiple packets in preparation
@@ -1761,6 +1870,18 @@ static void request_mux(fr_event_list_t *el,
 			fr_assert(!u->rr);
 
 			if (unlikely(radius_track_entry_reserve(&u->rr, treq, h->tt, request, u->code, treq) < 0)) {
+				/*
+				 *	per_connection_max can be larger than
+				 *	256 when we're using the Request
+				 *	Authenticator.  But until the home
+				 *	server agrees, we only have 256 IDs.
+				 *	Stop using this connection, and move
+				 *	the remaining packets elsewhere.
+				 */
+				if (inst->use_request_authenticator && !h->tt->use_authenticator) {
+					ids_exhausted = true;
+					break;
+				}
 #ifndef NDEBUG
 				radius_track_state_log(&default_log, L_ERR, __FILE__, __LINE__,
 						       h->tt, udp_tracking_entry_log);
@@ -1827,6 +1948,16 @@ static void request_mux(fr_event_list_t *el,
 		fr_trunk_request_signal_sent(treq);
 		queued++;
 	}
+
+	if (ids_exhausted) {
+		DEBUG("%s - All IDs in use on connection %s, and home server has not negotiated "
+		      "Original-Request-Authenticator", h->module_name, h->name);
+
+		h->ids_exhausted = true;
+		fr_trunk_connection_signal_inactive(tconn);
+		(void) fr_trunk_connection_requests_requeue(tconn, FR_TRUNK_REQUEST_STATE_PENDING, 0, false);
+	}
+
 	if (queued == 0) return;	/* No work */
 
 	/*
@@ -2296,6 +2427,7 @@ static void request_demux(UNUSED fr_event_list_t *el, fr_trunk_connection_t *tco
 		radius_track_entry_t	*rr;
 		decode_fail_t		reason;
 		uint8_t			code = 0;
+		uint8_t const		*original;
 		fr_pair_list_t		reply;
 
 		fr_time_t		now;
@@ -2327,8 +2459,13 @@ static void request_demux(UNUSED fr_event_list_t *el, fr_trunk_connection_t *tco
 		/*
 		 *	Note that we don't care about packet codes.  All
 		 *	packet codes share the same ID space.
+		 *
+		 *	If the home server echoed the Request
+		 *	Authenticator, then the ID isn't unique, and we
+		 *	need both to find the request.
 		 */
-		rr = radius_track_entry_find(h->tt, h->buffer[1], NULL);
+		original = reply_original_request_authenticator(h, (size_t)slen);
+		rr = radius_track_entry_find(h->tt, h->buffer[1], original);
 		if (!rr) {
 			WARN("%s - Ignoring reply with ID %i that arrived too late",
 			     h->module_name, h->buffer[1]);
@@ -2362,6 +2499,17 @@ static void request_demux(UNUSED fr_event_list_t *el, fr_trunk_connection_t *tco
 		 */
 		h->last_reply = now = fr_time();
 
+		if (original) use_request_authenticator(h, tconn);
+
+		/*
+		 *	We stopped using the connection because we ran
+		 *	out of IDs.  This reply frees one.
+		 */
+		if (h->ids_exhausted) {
+			h->ids_exhausted = false;
+			fr_trunk_connection_signal_active(tconn);
+		}
+
 		/*
 		 *	Status-Server can have any reply code, we don't care
 		 *	what it is.  So long as it's signed properly, we
@@ -2413,9 +2561,11 @@ static void request_demux(UNUSED fr_event_list_t *el, fr_trunk_connection_t *tco
 		}
 
 		/*
-		 *	Delete Proxy-State attributes from the reply.
+		 *	Delete Proxy-State and Original-Request-Authenticator
+		 *	attributes from the reply.
 		 */
 		fr_pair_delete_by_da(&reply, attr_proxy_state);
+		fr_pair_delete_by_da(&reply, attr_original_request_authenticator);
 
 		/*
 		 *	If the reply has Message-Authenticator, delete
@@ -2880,6 +3030,16 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	}
 
 	memcpy(&inst->trunk_conf, &inst->parent->trunk_conf, sizeof(inst->trunk_conf));
+
+	/*
+	 *	Without Original-Request-Authenticator, the 8-bit ID
+	 *	is the only thing which identifies a packet.
+	 */
+	if (!inst->use_request_authenticator) {
+		FR_INTEGER_BOUND_CHECK("trunk.per_connection_max", inst->trunk_conf.max_req_per_conn, <=, 255);
+		FR_INTEGER_BOUND_CHECK("trunk.per_connection_target", inst->trunk_conf.target_req_per_conn, <=, inst->trunk_conf.max_req_per_conn / 2);
+	}
+
 	inst->trunk_conf.req_pool_headers = 4;	/* One for the request, one for the buffer, one for the tracking binding, one for Proxy-State VP */
 	inst->trunk_conf.req_pool_size = sizeof(udp_request_t) + inst->max_packet_size + sizeof(radius_track_entry_t ***) + sizeof(fr_pair_t) + 20;
 
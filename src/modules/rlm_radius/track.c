@@ -243,7 +243,7 @@ int radius_track_entry_release(
 		 *	This entry MAY be in a subtree.  If so, delete
 		 *	it.
 		 */
-		if (tt->subtree[te->id]) (void) fr_rb_delete(tt->subtree[te->id], te);
+		if (tt->subtree[te->id]) (void) fr_rb_remove_by_inline_node(tt->subtree[te->id], &te->node);
 
 		goto done;
 	}
@@ -257,7 +257,7 @@ int radius_track_entry_release(
 	 *	Delete it from the tracking subtree.
 	 */
 	fr_assert(tt->subtree[te->id] != NULL);
-	(void) fr_rb_delete(tt->subtree[te->id], te);
+	(void) fr_rb_remove_by_inline_node(tt->subtree[te->id], &te->node);
 
 	/*
 	 *	Try to free memory if the system gets idle.  If the
@@ -299,7 +299,7 @@ int radius_track_entry_update(radius_track_entry_t *te, uint8_t const *vector)
 	/*
 	 *	The authentication vector may have changed.
 	 */
-	if (tt->subtree[te->id]) (void) fr_rb_delete(tt->subtree[te->id], te);
+	if (tt->subtree[te->id]) (void) fr_rb_remove_by_inline_node(tt->subtree[te->id], &te->node);
 
 	memcpy(te->vector, vector, sizeof(te->vector));
 
@@ -320,8 +320,19 @@ int radius_track_entry_update(radius_track_entry_t *te, uint8_t const *vector)
 	 *	We do this even if it was allocated from the static
 	 *	array.  That way if the server responds with
 	 *	Original-Request-Authenticator, we can easily find it.
+	 *
+	 *	Static entries which were allocated before we started
+	 *	using the Request Authenticator won't have a subtree.
 	 */
-	if (!fr_rb_insert(tt->subtree[te->id], te)) return -1;
+	if (!tt->subtree[te->id]) {
+		MEM(tt->subtree[te->id] = fr_rb_inline_talloc_alloc(tt, radius_track_entry_t, node,
+								    te_cmp, NULL));
+	}
+
+	if (!fr_rb_insert(tt->subtree[te->id], te)) {
+		fr_strerror_printf("Duplicate Request Authenticator for ID %u", te->id);
+		return -1;
+	}
 
 	return 0;
 }
@@ -364,7 +375,7 @@ radius_track_entry_t *radius_track_entry_find(radius_track_t *tt, uint8_t packet
 	 */
 	memcpy(&my_te.vector, vector, sizeof(my_te.vector));
 
-	te = fr_rb_find(tt->subtree[packet_id], &my_te);
+	te = tt->subtree[packet_id] ? fr_rb_find(tt->subtree[packet_id], &my_te) : NULL;
 
 	/*
 	 *	Not found, the packet MAY have been allocated in the
@@ -0,0 +1,162 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for RADIUS client packet tracking
+ *
+ * @file src/modules/rlm_radius/track_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "track.c"
+
+/*
+ *	Entries only need a non-NULL request to be considered in use.
+ */
+static request_t *test_request = (request_t *)(uintptr_t)1;
+
+static void test_vector_init(uint8_t vector[static RADIUS_AUTH_VECTOR_LENGTH], uint8_t seed)
+{
+	size_t i;
+
+	for (i = 0; i < RADIUS_AUTH_VECTOR_LENGTH; i++) vector[i] = seed + i;
+}
+
+/** A static entry reserved before the Request Authenticator was used has no subtree
+ *
+ */
+static void test_update_allocates_subtree(void)
+{
+	radius_track_t		*tt;
+	radius_track_entry_t	*te = NULL;
+	uint8_t			vector[RADIUS_AUTH_VECTOR_LENGTH];
+
+	tt = radius_track_alloc(NULL);
+	TEST_CHECK(radius_track_entry_reserve(&te, NULL, tt, test_request, FR_RADIUS_CODE_ACCESS_REQUEST, NULL) == 0);
+	TEST_ASSERT(te != NULL);
+	TEST_CHECK(te == &tt->id[te->id]);
+	TEST_CHECK(tt->subtree[te->id] == NULL);
+
+	radius_track_use_authenticator(tt, true);
+
+	test_vector_init(vector, 0x10);
+	TEST_CHECK(radius_track_entry_update(te, vector) == 0);
+	TEST_MSG("Expected subtree to be allocated for ID %u", te->id);
+	TEST_CHECK(tt->subtree[te->id] != NULL);
+
+	TEST_CHECK(radius_track_entry_find(tt, te->id, vector) == te);
+
+	/*
+	 *	Updating again replaces the entry in the subtree.
+	 */
+	test_vector_init(vector, 0x20);
+	TEST_CHECK(radius_track_entry_update(te, vector) == 0);
+	TEST_CHECK(fr_rb_num_elements(tt->subtree[te->id]) == 1);
+	TEST_CHECK(radius_track_entry_find(tt, te->id, vector) == te);
+
+	TEST_CHECK(radius_track_entry_release(&te) == 0);
+	TEST_CHECK(te == NULL);
+
+	talloc_free(tt);
+}
+
+/** Lookups by Request Authenticator for IDs without a subtree must not crash
+ *
+ */
+static void test_find_no_subtree(void)
+{
+	radius_track_t		*tt;
+	radius_track_entry_t	*te = NULL;
+	uint8_t			vector[RADIUS_AUTH_VECTOR_LENGTH];
+	uint8_t			other_id;
+
+	tt = radius_track_alloc(NULL);
+	radius_track_use_authenticator(tt, true);
+
+	test_vector_init(vector, 0x30);
+
+	/*
+	 *	Nothing in use.
+	 */
+	TEST_CHECK(tt->subtree[0] == NULL);
+	TEST_CHECK(radius_track_entry_find(tt, 0, vector) == NULL);
+
+	TEST_CHECK(radius_track_entry_reserve(&te, NULL, tt, test_request, FR_RADIUS_CODE_ACCESS_REQUEST, NULL) == 0);
+	TEST_ASSERT(te != NULL);
+	TEST_CHECK(radius_track_entry_update(te, vector) == 0);
+
+	/*
+	 *	A different ID, with no subtree and no entry in use.
+	 */
+	other_id = te->id + 1;
+	TEST_CHECK(tt->subtree[other_id] == NULL);
+	TEST_CHECK(radius_track_entry_find(tt, other_id, vector) == NULL);
+
+	/*
+	 *	The right ID, with the wrong Request Authenticator.
+	 */
+	test_vector_init(vector, 0x40);
+	TEST_CHECK(radius_track_entry_find(tt, te->id, vector) == NULL);
+
+	TEST_CHECK(radius_track_entry_release(&te) == 0);
+
+	talloc_free(tt);
+}
+
+/** More than 256 outstanding entries can be tracked using the Request Authenticator
+ *
+ */
+static void test_more_than_256(void)
+{
+	radius_track_t		*tt;
+	radius_track_entry_t	*te[512];
+	uint8_t			vector[RADIUS_AUTH_VECTOR_LENGTH];
+	size_t			i;
+
+	tt = radius_track_alloc(NULL);
+	radius_track_use_authenticator(tt, true);
+
+	for (i = 0; i < NUM_ELEMENTS(te); i++) {
+		te[i] = NULL;
+		TEST_CHECK(radius_track_entry_reserve(&te[i], NULL, tt, test_request,
+						      FR_RADIUS_CODE_ACCESS_REQUEST, NULL) == 0);
+		TEST_ASSERT(te[i] != NULL);
+
+		test_vector_init(vector, i);
+		vector[0] = i >> 8;
+		TEST_CHECK(radius_track_entry_update(te[i], vector) == 0);
+	}
+
+	for (i = 0; i < NUM_ELEMENTS(te); i++) {
+		test_vector_init(vector, i);
+		vector[0] = i >> 8;
+		TEST_MSG("Expected to find entry %zu", i);
+		TEST_CHECK(radius_track_entry_find(tt, te[i]->id, vector) == te[i]);
+	}
+
+	for (i = 0; i < NUM_ELEMENTS(te); i++) TEST_CHECK(radius_track_entry_release(&te[i]) == 0);
+
+	talloc_free(tt);
+}
+
+TEST_LIST = {
+	{ "update_allocates_subtree",	test_update_allocates_subtree },
+	{ "find_no_subtree",		test_find_no_subtree },
+	{ "more_than_256",		test_more_than_256 },
+	{ NULL }
+};
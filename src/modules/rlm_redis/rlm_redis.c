@@ -308,6 +308,52 @@ static xlat_action_t redis_remap_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
 	return XLAT_ACTION_DONE;
 }
 
+static xlat_arg_parser_t const redis_stats_xlat_args[] = {
+	{ .required = true, .single = true, .type = FR_TYPE_STRING },
+	XLAT_ARG_PARSER_TERMINATOR
+};
+
+/** Return one of the cluster map maintenance counters
+ *
+ * Valid counters are "remaps", "moved" and "asked".
+ *
+@verbatim
+%redis.stats(<counter>)
+@endverbatim
+ *
+ * @ingroup xlat_functions
+ */
+static xlat_action_t redis_stats_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
+				      xlat_ctx_t const *xctx,
+				      request_t *request, fr_value_box_list_t *in)
+{
+	rlm_redis_t const		*inst = talloc_get_type_abort_const(xctx->mctx->mi->data, rlm_redis_t);
+	fr_redis_cluster_stats_t	stats;
+	fr_value_box_t			*vb;
+	fr_value_box_t			*name = fr_value_box_list_head(in);
+	uint64_t			value;
+
+	fr_redis_cluster_stats(&stats, inst->cluster);
+
+	if (strcmp(name->vb_strvalue, "remaps") == 0) {
+		value = stats.remaps;
+	} else if (strcmp(name->vb_strvalue, "moved") == 0) {
+		value = stats.moved;
+	} else if (strcmp(name->vb_strvalue, "asked") == 0) {
+		value = stats.asked;
+	} else {
+		REDEBUG("Unknown counter \"%s\", expected one of \"remaps\", \"moved\" or \"asked\"",
+			name->vb_strvalue);
+		return XLAT_ACTION_FAIL;
+	}
+
+	MEM(vb = fr_value_box_alloc(ctx, FR_TYPE_UINT64, NULL));
+	vb->vb_uint64 = value;
+	fr_dcursor_append(out, vb);
+
+	return XLAT_ACTION_DONE;
+}
+
 static xlat_arg_parser_t const redis_node_xlat_args[] = {
 	{ .required = true, .single = true, .type = FR_TYPE_STRING },
 	{ .single = true, .type = FR_TYPE_UINT32 },
@@ -875,6 +921,12 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 	if (unlikely((xlat = xlat_func_register_module(mctx->mi->boot, mctx, "remap", redis_remap_xlat, FR_TYPE_STRING)) == NULL)) return -1;
 	xlat_func_args_set(xlat, redis_remap_xlat_args);
 
+	/*
+	 *	%redis.stats(<counter>)
+	 */
+	if (unlikely((xlat = xlat_func_register_module(mctx->mi->boot, mctx, "stats", redis_stats_xlat, FR_TYPE_UINT64)) == NULL)) return -1;
+	xlat_func_args_set(xlat, redis_stats_xlat_args);
+
 	/*
 	 *	Loop over the lua functions, registering an xlat
 	 *	that'll call that function specifically.
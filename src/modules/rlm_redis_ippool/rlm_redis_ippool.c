@@ -55,6 +55,17 @@ RCSID("$Id$")
 
 #include "redis_ippool.h"
 
+/** Local lease reservation configuration
+ *
+ */
+typedef struct {
+	uint32_t		size;		//!< Number of free leases each worker reserves from a pool.
+						//!< 0 disables reservations.
+
+	fr_time_delta_t		time;		//!< How long reserved leases are held in Redis before
+						//!< they return to the pool.
+} rlm_redis_ippool_reserve_conf_t;
+
 /** rlm_redis module instance
  *
  */
@@ -75,9 +86,64 @@ typedef struct {
 	bool			copy_on_update; //!< Copy the address provided by ip_address to the
 						//!< allocated_address_attr if updates are successful.
 
+	rlm_redis_ippool_reserve_conf_t	reserve;	//!< Local lease reservation configuration.
+
+	char			reserve_owner[sizeof("reserved:") + 16];	//!< Device identifier written to
+										///< leases reserved by this instance.
+
 	fr_redis_cluster_t	*cluster;	//!< Redis cluster.
 } rlm_redis_ippool_t;
 
+typedef struct rlm_redis_ippool_thread_s rlm_redis_ippool_thread_t;
+
+/** A lease reserved from Redis, which can be handed out without a round trip
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;		//!< Entry in the pool's list of free, or offered leases.
+	fr_rb_node_t		node;		//!< Entry in the pool's tree of offered leases.
+
+	char			*address;	//!< Address, as it appears in the pool.
+	char			*range;		//!< Range identifier, may be NULL.
+	char			*owner;		//!< Owner the lease was offered to, NULL if still free.
+	size_t			owner_len;	//!< Length of the owner identifier.
+
+	fr_time_t		expires;	//!< When the reservation lapses in Redis.
+} ippool_reserved_lease_t;
+
+/** Leases reserved from a single pool by a worker
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;		//!< Entry in the thread's tree of pools.
+
+	char			*name;		//!< Pool name.
+	size_t			name_len;	//!< Length of the pool name.
+
+	fr_dlist_head_t		free;		//!< Reserved leases which have not been offered.
+	fr_dlist_head_t		offered_list;	//!< Reserved leases which have been offered, oldest first.
+	fr_rb_tree_t		*offered;	//!< Reserved leases which have been offered, by owner.
+
+	fr_event_timer_t const	*refill_ev;	//!< Pending refill.
+
+	rlm_redis_ippool_thread_t	*thread;	//!< Thread this pool belongs to.
+} ippool_reserve_pool_t;
+
+/** rlm_redis_ippool thread instance
+ *
+ */
+struct rlm_redis_ippool_thread_s {
+	rlm_redis_ippool_t const	*inst;		//!< Module instance.
+	fr_event_list_t			*el;		//!< Event list used to schedule refills.
+	fr_rb_tree_t			*pools;		//!< Pools we have reserved leases from.
+};
+
+static conf_parser_t reserve_config[] = {
+	{ FR_CONF_OFFSET("size", rlm_redis_ippool_reserve_conf_t, size), .dflt = "0" },
+	{ FR_CONF_OFFSET("time", rlm_redis_ippool_reserve_conf_t, time), .dflt = "60" },
+	CONF_PARSER_TERMINATOR
+};
+
 static conf_parser_t redis_config[] = {
 	REDIS_COMMON_CONFIG,
 	CONF_PARSER_TERMINATOR
@@ -94,6 +160,8 @@ static conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("ipv4_integer", rlm_redis_ippool_t, ipv4_integer) },
 	{ FR_CONF_OFFSET("copy_on_update", rlm_redis_ippool_t, copy_on_update), .dflt = "yes", .quote = T_BARE_WORD },
 
+	{ FR_CONF_OFFSET_SUBSECTION("reserve", 0, rlm_redis_ippool_t, reserve, reserve_config) },
+
 	/*
 	 *	Split out to allow conversion to universal ippool module with
 	 *	minimum of config changes.
@@ -338,6 +406,9 @@ static char lua_alloc_digest[(SHA1_DIGEST_LENGTH * 2) + 1];
  * - ARGV[3] IP address to update.
  * - ARGV[4] Lease owner identifier.
  * - ARGV[5] (optional) Gateway identifier.
+ * - ARGV[6] (optional) Reservation identifier.  If the lease is reserved
+ *   under this identifier, it's claimed by the lease owner.  If set, any
+ *   other lease the owner holds is released.
  *
  * Returns @verbatim array { <rcode>[, <range>] } @endverbatim
  * - IPPOOL_RCODE_SUCCESS lease updated..
@@ -352,30 +423,62 @@ static char lua_update_cmd[] =
 	"local pool_key" EOL								/* 3 */
 	"local address_key" EOL								/* 4 */
 	"local owner_key" EOL								/* 5 */
+	"local claimed = false" EOL							/* 6 */
 
 	/*
 	 *	We either need to know that the IP was last allocated to the
 	 *	same device, or that the lease on the IP has NOT expired.
 	 */
-	"address_key = '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. ARGV[3]" EOL	/* 6 */
-	"found = redis.call('HMGET', address_key, 'range', 'device', 'gateway', 'counter' )" EOL	/* 7 */
+	"address_key = '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. ARGV[3]" EOL	/* 7 */
+	"found = redis.call('HMGET', address_key, 'range', 'device', 'gateway', 'counter' )" EOL	/* 8 */
 	/*
 	 *	Range may be nil (if not used), so we use the device key
 	 */
-	"if not found[2] then" EOL							/* 8 */
-	"  return {" STRINGIFY(_IPPOOL_RCODE_NOT_FOUND) "}" EOL				/* 9 */
-	"end" EOL									/* 10 */
-	"if found[2] ~= ARGV[4] then" EOL						/* 11 */
-	"  return {" STRINGIFY(_IPPOOL_RCODE_DEVICE_MISMATCH) ", found[2]}" EOL		/* 12 */
-	"end" EOL									/* 13 */
+	"if not found[2] then" EOL							/* 9 */
+	"  return {" STRINGIFY(_IPPOOL_RCODE_NOT_FOUND) "}" EOL				/* 10 */
+	"end" EOL									/* 11 */
+	"if found[2] ~= ARGV[4] then" EOL						/* 12 */
+	"  if not ARGV[6] or ARGV[6] == '' or found[2] ~= ARGV[6] then" EOL		/* 13 */
+	"    return {" STRINGIFY(_IPPOOL_RCODE_DEVICE_MISMATCH) ", found[2]}" EOL	/* 14 */
+	"  end" EOL									/* 15 */
+
+	/*
+	 *	Lease was reserved by a worker and offered
+	 *	locally, so it now belongs to this device.
+	 */
+	"  redis.call('HSET', address_key, 'device', ARGV[4])" EOL			/* 16 */
+	"  found[4] = redis.call('HINCRBY', address_key, 'counter', 1)" EOL		/* 17 */
+	"  claimed = true" EOL								/* 18 */
+	"end" EOL									/* 19 */
+
+	/*
+	 *	With reservations, a device may be offered leases
+	 *	by more than one worker.  Whichever lease it updates
+	 *	becomes its lease, and any other lease it holds is
+	 *	returned to the pool, so it only ever holds one.
+	 */
+	"pool_key = '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"'" EOL			/* 20 */
+	"owner_key = '{' .. KEYS[1] .. '}:"IPPOOL_OWNER_KEY":' .. ARGV[4]" EOL		/* 21 */
+	"if ARGV[6] and ARGV[6] ~= '' then" EOL						/* 22 */
+	"  local previous = redis.call('GET', owner_key)" EOL				/* 23 */
+	"  if previous and previous ~= ARGV[3] then" EOL				/* 24 */
+	"    local previous_key = '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. previous" EOL	/* 25 */
+	"    local previous_expires = tonumber(redis.call('ZSCORE', pool_key, previous))" EOL	/* 26 */
+	"    if previous_expires and (previous_expires < " STRINGIFY(IPPOOL_STATIC_BIT) ") and" EOL	/* 27 */
+	"       (redis.call('HGET', previous_key, 'device') == ARGV[4]) then" EOL	/* 28 */
+	"      redis.call('ZADD', pool_key, 'XX', ARGV[1] - 1, previous)" EOL		/* 29 */
+	"      redis.call('HINCRBY', previous_key, 'counter', 1)" EOL			/* 30 */
+	"    end" EOL									/* 31 */
+	"    claimed = true" EOL							/* 32 */
+	"  end" EOL									/* 33 */
+	"end" EOL									/* 34 */
 
 	/*
 	 *	Update the expiry time
 	 */
-	"pool_key = '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"'" EOL			/* 14 */
-	"local expires = tonumber(redis.call('ZSCORE', pool_key, ARGV[3]))" EOL		/* 15 */
-	"local static = expires > " STRINGIFY(IPPOOL_STATIC_BIT) EOL			/* 16 */
-	"redis.call('ZADD', pool_key, 'XX', ARGV[1] + ARGV[2] + (static and " STRINGIFY(IPPOOL_STATIC_BIT) " or 0), ARGV[3])" EOL	/* 17 */
+	"local expires = tonumber(redis.call('ZSCORE', pool_key, ARGV[3]))" EOL		/* 35 */
+	"local static = expires > " STRINGIFY(IPPOOL_STATIC_BIT) EOL			/* 36 */
+	"redis.call('ZADD', pool_key, 'XX', ARGV[1] + ARGV[2] + (static and " STRINGIFY(IPPOOL_STATIC_BIT) " or 0), ARGV[3])" EOL	/* 37 */
 
 	/*
 	 *	The device key should usually exist, but
@@ -383,19 +486,18 @@ static char lua_update_cmd[] =
 	 *	of a lease being expired, it may have been
 	 *	removed.
 	 */
-	"owner_key = '{' .. KEYS[1] .. '}:"IPPOOL_OWNER_KEY":' .. ARGV[4]" EOL		/* 18 */
-	"if not static and (redis.call('EXPIRE', owner_key, ARGV[2]) == 0) then" EOL	/* 19 */
-	"  redis.call('SET', owner_key, ARGV[3])" EOL					/* 20 */
-	"  redis.call('EXPIRE', owner_key, ARGV[2])" EOL				/* 21 */
-	"end" EOL									/* 22 */
+	"if not static and (claimed or (redis.call('EXPIRE', owner_key, ARGV[2]) == 0)) then" EOL	/* 38 */
+	"  redis.call('SET', owner_key, ARGV[3])" EOL					/* 39 */
+	"  redis.call('EXPIRE', owner_key, ARGV[2])" EOL				/* 40 */
+	"end" EOL									/* 41 */
 
 	/*
 	 *	Update the gateway address
 	 */
-	"if ARGV[5] ~= found[3] then" EOL						/* 23 */
-	"  redis.call('HSET', address_key, 'gateway', ARGV[5])" EOL			/* 24 */
-	"end" EOL									/* 25 */
-	"return { " STRINGIFY(_IPPOOL_RCODE_SUCCESS) ", found[1], found[4] }"EOL;	/* 26 */
+	"if ARGV[5] ~= found[3] then" EOL						/* 42 */
+	"  redis.call('HSET', address_key, 'gateway', ARGV[5])" EOL			/* 43 */
+	"end" EOL									/* 44 */
+	"return { " STRINGIFY(_IPPOOL_RCODE_SUCCESS) ", found[1], found[4] }"EOL;	/* 45 */
 static char lua_update_digest[(SHA1_DIGEST_LENGTH * 2) + 1];
 
 /** Lua script for releasing leases
@@ -455,9 +557,43 @@ static char lua_release_cmd[] =
 	"}";										/* 25 */
 static char lua_release_digest[(SHA1_DIGEST_LENGTH * 2) + 1];
 
+/** Lua script for reserving free leases
+ *
+ * - KEYS[1] The pool name.
+ * - ARGV[1] Wall time (seconds since epoch).
+ * - ARGV[2] Reserve for (seconds).
+ * - ARGV[3] Maximum number of leases to reserve.
+ * - ARGV[4] Reservation identifier.
+ *
+ * Reserves the leases which expired the longest time ago, by setting their
+ * expiry time to now + ARGV[2] and their device to the reservation
+ * identifier.  The lua_update_cmd script transfers a reserved lease to
+ * its real owner.
+ *
+ * Returns @verbatim array { <rcode>[, <ip>, <range>]... } @endverbatim
+ * - IPPOOL_RCODE_SUCCESS zero or more leases reserved.
+ */
+static char lua_reserve_cmd[] =
+	"local pool_key" EOL								/* 1 */
+	"local address_key" EOL								/* 2 */
+	"local found" EOL								/* 3 */
+	"local ret = { " STRINGIFY(_IPPOOL_RCODE_SUCCESS) " }" EOL			/* 4 */
+
+	"pool_key = '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"'" EOL			/* 5 */
+	"found = redis.call('ZRANGEBYSCORE', pool_key, '-inf', '(' .. ARGV[1], 'LIMIT', 0, ARGV[3])" EOL	/* 6 */
+	"for _, ip in ipairs(found) do" EOL						/* 7 */
+	"  address_key = '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. ip" EOL		/* 8 */
+	"  redis.call('ZADD', pool_key, 'XX', ARGV[1] + ARGV[2], ip)" EOL		/* 9 */
+	"  redis.call('HSET', address_key, 'device', ARGV[4])" EOL			/* 10 */
+	"  ret[#ret + 1] = ip" EOL							/* 11 */
+	"  ret[#ret + 1] = redis.call('HGET', address_key, 'range')" EOL		/* 12 */
+	"end" EOL									/* 13 */
+	"return ret";									/* 14 */
+static char lua_reserve_digest[(SHA1_DIGEST_LENGTH * 2) + 1];
+
 /** Check the requisite number of slaves replicated the lease info
  *
- * @param request The current request.
+ * @param request The current request, may be NULL.
  * @param wait_num Number of slaves required.
  * @param reply we got from the server.
  * @return
@@ -469,13 +605,13 @@ static inline int ippool_wait_check(request_t *request, uint32_t wait_num, redis
 	if (!wait_num) return 0;
 
 	if (reply->type != REDIS_REPLY_INTEGER) {
-		REDEBUG("WAIT result is wrong type, expected integer got %s",
-			fr_table_str_by_value(redis_reply_types, reply->type, "<UNKNOWN>"));
+		ROPTIONAL(REDEBUG, ERROR, "WAIT result is wrong type, expected integer got %s",
+			  fr_table_str_by_value(redis_reply_types, reply->type, "<UNKNOWN>"));
 		return -1;
 	}
 	if (reply->integer < wait_num) {
-		REDEBUG("Too few slaves acknowledged allocation, needed %i, got %lli",
-			wait_num, reply->integer);
+		ROPTIONAL(REDEBUG, ERROR, "Too few slaves acknowledged allocation, needed %i, got %lli",
+			  wait_num, reply->integer);
 		return -1;
 	}
 	return 0;
@@ -543,7 +679,7 @@ static void ippool_action_print(request_t *request, ippool_action_t action,
  * @note All replies will be freed on error.
  *
  * @param[out] out		Where to write Redis reply object resulting from the command.
- * @param[in] request		The current request.
+ * @param[in] request		The current request, may be NULL.
  * @param[in] cluster		configuration.
  * @param[in] key		to use to determine the cluster node.
  * @param[in] key_len		length of the key.
@@ -585,7 +721,7 @@ static fr_redis_rcode_t ippool_script(redisReply **out, request_t *request, fr_r
 	     s_ret = fr_redis_cluster_state_next(&state, &conn, cluster, request, status, &replies[0])) {
 	     	va_list	copy;
 
-	     	RDEBUG3("Calling script 0x%s", digest);
+	     	ROPTIONAL(RDEBUG3, DEBUG3, "Calling script 0x%s", digest);
 	     	va_copy(copy, ap);	/* copy or segv */
 		redisvAppendCommand(conn->handle, cmd, copy);
 		va_end(copy);
@@ -609,7 +745,7 @@ static fr_redis_rcode_t ippool_script(redisReply **out, request_t *request, fr_r
 		 *	we have to send the Lua script up to the node
 		 *	so it can be cached.
 		 */
-	     	RDEBUG3("Loading script 0x%s", digest);
+	     	ROPTIONAL(RDEBUG3, DEBUG3, "Loading script 0x%s", digest);
 		redisAppendCommand(conn->handle, "MULTI");
 		redisAppendCommand(conn->handle, "SCRIPT LOAD %s", script);
 	     	va_copy(copy, ap);	/* copy or segv */
@@ -626,31 +762,31 @@ static fr_redis_rcode_t ippool_script(redisReply **out, request_t *request, fr_r
 						     replies, NUM_ELEMENTS(replies),
 						     conn);
 		if (status == REDIS_RCODE_SUCCESS) {
-			if (RDEBUG_ENABLED3) for (i = 0; i < reply_cnt; i++) {
+			if (ROPTIONAL_ENABLED(RDEBUG_ENABLED3, DEBUG_ENABLED3)) for (i = 0; i < reply_cnt; i++) {
 				fr_redis_reply_print(L_DBG_LVL_3, replies[i], request, i);
 			}
 
 			if (replies[3]->type != REDIS_REPLY_ARRAY) {
-				RERROR("Bad response to EXEC, expected array got %s",
-				       fr_table_str_by_value(redis_reply_types, replies[3]->type, "<UNKNOWN>"));
+				ROPTIONAL(RERROR, ERROR, "Bad response to EXEC, expected array got %s",
+					  fr_table_str_by_value(redis_reply_types, replies[3]->type, "<UNKNOWN>"));
 			error:
 				fr_redis_pipeline_free(replies, reply_cnt);
 				status = REDIS_RCODE_ERROR;
 				goto finish;
 			}
 			if (replies[3]->elements != 2) {
-				RERROR("Bad response to EXEC, expected 2 result elements, got %zu",
-				       replies[3]->elements);
+				ROPTIONAL(RERROR, ERROR, "Bad response to EXEC, expected 2 result elements, got %zu",
+					  replies[3]->elements);
 				goto error;
 			}
 			if (replies[3]->element[0]->type != REDIS_REPLY_STRING) {
-				RERROR("Bad response to SCRIPT LOAD, expected string got %s",
-				       fr_table_str_by_value(redis_reply_types, replies[3]->element[0]->type, "<UNKNOWN>"));
+				ROPTIONAL(RERROR, ERROR, "Bad response to SCRIPT LOAD, expected string got %s",
+					  fr_table_str_by_value(redis_reply_types, replies[3]->element[0]->type, "<UNKNOWN>"));
 				goto error;
 			}
 			if (strcmp(replies[3]->element[0]->str, digest) != 0) {
-				RWDEBUG("Incorrect SHA1 from SCRIPT LOAD, expected %s, got %s",
-					digest, replies[3]->element[0]->str);
+				ROPTIONAL(RWDEBUG, WARN, "Incorrect SHA1 from SCRIPT LOAD, expected %s, got %s",
+					  digest, replies[3]->element[0]->str);
 				goto error;
 			}
 		}
@@ -872,6 +1008,243 @@ finish:
 	return ret;
 }
 
+/** Compare reserved lease pools by name
+ *
+ */
+static int8_t ippool_reserve_pool_cmp(void const *one, void const *two)
+{
+	ippool_reserve_pool_t const *a = one, *b = two;
+
+	MEMCMP_RETURN(a, b, name, name_len);
+	return 0;
+}
+
+/** Compare offered leases by owner
+ *
+ */
+static int8_t ippool_reserved_lease_cmp(void const *one, void const *two)
+{
+	ippool_reserved_lease_t const *a = one, *b = two;
+
+	MEMCMP_RETURN(a, b, owner, owner_len);
+	return 0;
+}
+
+/** Top up the leases a worker has reserved from a pool
+ *
+ * @param[in] inst	Module instance.
+ * @param[in] request	The current request, or NULL if called from a timer.
+ * @param[in] pool	to refill.
+ * @return
+ *	- 0 on success, even if no leases were available.
+ *	- -1 on failure.
+ */
+static int ippool_reserve_refill(rlm_redis_ippool_t const *inst, request_t *request, ippool_reserve_pool_t *pool)
+{
+	struct timeval		now;
+	fr_time_t		expires;
+	redisReply		*reply = NULL;
+	uint32_t		want;
+	size_t			i;
+	int			ret = -1;
+
+	want = inst->reserve.size - fr_dlist_num_elements(&pool->free);
+	if (want == 0) return 0;
+
+	/*
+	 *	Err on the side of caution, the reservation
+	 *	is held from when the script runs.
+	 */
+	expires = fr_time_add(fr_time(), inst->reserve.time);
+	now = fr_time_to_timeval(fr_time());
+
+	if (ippool_script(&reply, request, inst->cluster,
+			  (uint8_t const *)pool->name, pool->name_len,
+			  inst->wait_num, inst->wait_timeout,
+			  lua_reserve_digest, lua_reserve_cmd,
+			  "EVALSHA %s 1 %b %u %u %u %s",
+			  lua_reserve_digest,
+			  (uint8_t const *)pool->name, pool->name_len,
+			  (unsigned int)now.tv_sec, (unsigned int)fr_time_delta_to_sec(inst->reserve.time),
+			  want, inst->reserve_owner) != REDIS_RCODE_SUCCESS) return -1;
+
+	fr_assert(reply);
+	if ((reply->type != REDIS_REPLY_ARRAY) || (reply->elements == 0) ||
+	    (reply->element[0]->type != REDIS_REPLY_INTEGER)) {
+		ROPTIONAL(REDEBUG, ERROR, "Unexpected result reserving leases from pool \"%s\"", pool->name);
+		goto finish;
+	}
+
+	for (i = 1; (i + 1) < reply->elements; i += 2) {
+		ippool_reserved_lease_t *lease;
+
+		if (reply->element[i]->type != REDIS_REPLY_STRING) {
+			ROPTIONAL(REDEBUG, ERROR, "Server returned unexpected type \"%s\" for reserved IP element",
+				  fr_table_str_by_value(redis_reply_types, reply->element[i]->type, "<UNKNOWN>"));
+			goto finish;
+		}
+
+		MEM(lease = talloc_zero(pool, ippool_reserved_lease_t));
+		MEM(lease->address = talloc_bstrndup(lease, reply->element[i]->str, reply->element[i]->len));
+		if (reply->element[i + 1]->type == REDIS_REPLY_STRING) {
+			MEM(lease->range = talloc_bstrndup(lease, reply->element[i + 1]->str,
+							    reply->element[i + 1]->len));
+		}
+		lease->expires = expires;
+		fr_dlist_insert_tail(&pool->free, lease);
+	}
+
+	ROPTIONAL(RDEBUG2, DEBUG2, "Reserved %zu of %u requested leases from pool \"%s\"",
+		  (reply->elements - 1) / 2, want, pool->name);
+	ret = 0;
+
+finish:
+	fr_redis_reply_free(&reply);
+
+	return ret;
+}
+
+/** Refill reserved leases outside of the request which used them
+ *
+ */
+static void _ippool_reserve_refill(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	ippool_reserve_pool_t *pool = talloc_get_type_abort(uctx, ippool_reserve_pool_t);
+
+	(void) ippool_reserve_refill(pool->thread->inst, NULL, pool);
+}
+
+/** Allocate a lease from the leases this worker has reserved
+ *
+ * The lease is only recorded against its owner in Redis when it's
+ * updated, which for DHCP happens when the Request is acknowledged.
+ * Until then the lease is held by the reservation, and offered again
+ * if the same owner asks for a lease.
+ *
+ * @return
+ *	- IPPOOL_RCODE_SUCCESS if a reserved lease was allocated.
+ *	- IPPOOL_RCODE_POOL_EMPTY if no reserved leases were available.
+ *	- IPPOOL_RCODE_FAIL on error.
+ */
+static ippool_rcode_t redis_ippool_allocate_reserved(rlm_redis_ippool_t const *inst, rlm_redis_ippool_thread_t *t,
+						     request_t *request, redis_ippool_alloc_call_env_t *env,
+						     uint32_t lease_time)
+{
+	ippool_reserve_pool_t	*pool;
+	ippool_reserved_lease_t	*lease;
+	fr_time_t		now = fr_time();
+	fr_time_t		valid_until = fr_time_add(now, fr_time_delta_from_sec(lease_time));
+
+	pool = fr_rb_find(t->pools, &(ippool_reserve_pool_t){
+				.name = UNCONST(char *, env->pool_name.vb_strvalue),
+				.name_len = env->pool_name.vb_length
+			  });
+	if (!pool) {
+		MEM(pool = talloc_zero(t, ippool_reserve_pool_t));
+		MEM(pool->name = talloc_bstrndup(pool, env->pool_name.vb_strvalue, env->pool_name.vb_length));
+		pool->name_len = env->pool_name.vb_length;
+		pool->thread = t;
+		fr_dlist_talloc_init(&pool->free, ippool_reserved_lease_t, entry);
+		fr_dlist_talloc_init(&pool->offered_list, ippool_reserved_lease_t, entry);
+		MEM(pool->offered = fr_rb_inline_talloc_alloc(pool, ippool_reserved_lease_t, node,
+							      ippool_reserved_lease_cmp, NULL));
+		fr_rb_insert(t->pools, pool);
+	}
+
+	/*
+	 *	Forget about offers whose reservations have lapsed
+	 */
+	while ((lease = fr_dlist_head(&pool->offered_list)) && fr_time_lt(lease->expires, now)) {
+		fr_dlist_remove(&pool->offered_list, lease);
+		fr_rb_delete(pool->offered, lease);
+		talloc_free(lease);
+	}
+
+	/*
+	 *	Retransmission, or the device asked again
+	 *	before claiming the lease.
+	 */
+	lease = fr_rb_find(pool->offered, &(ippool_reserved_lease_t){
+				.owner = UNCONST(char *, env->owner.vb_strvalue),
+				.owner_len = env->owner.vb_length
+			   });
+	if (lease) {
+		if (fr_time_gteq(lease->expires, valid_until)) goto done;
+
+		/*
+		 *	The reservation would lapse before the offer.
+		 *	The device may have claimed the lease since, in
+		 *	which case it's recorded against the device in
+		 *	Redis, so let the normal allocation find it
+		 *	rather than offering a second lease.
+		 */
+		fr_dlist_remove(&pool->offered_list, lease);
+		fr_rb_delete(pool->offered, lease);
+		talloc_free(lease);
+		return IPPOOL_RCODE_POOL_EMPTY;
+	}
+
+	/*
+	 *	First use of the pool, or the last refill
+	 *	didn't keep up.
+	 */
+	if (fr_dlist_empty(&pool->free)) (void) ippool_reserve_refill(inst, request, pool);
+
+	while ((lease = fr_dlist_pop_head(&pool->free))) {
+		if (fr_time_gteq(lease->expires, valid_until)) break;
+		talloc_free(lease);	/* Reservation would lapse before the offer */
+	}
+	if (!lease) return IPPOOL_RCODE_POOL_EMPTY;
+
+	MEM(lease->owner = talloc_bstrndup(lease, env->owner.vb_strvalue, env->owner.vb_length));
+	lease->owner_len = env->owner.vb_length;
+	fr_dlist_insert_tail(&pool->offered_list, lease);
+	fr_rb_insert(pool->offered, lease);
+
+	/*
+	 *	Top up once half the reserved leases have gone,
+	 *	so later requests don't have to wait for Redis.
+	 */
+	if (!pool->refill_ev && (fr_dlist_num_elements(&pool->free) <= (inst->reserve.size / 2)) &&
+	    (fr_event_timer_in(pool, t->el, &pool->refill_ev, fr_time_delta_wrap(0), _ippool_reserve_refill, pool) < 0)) {
+		RPWDEBUG("Failed scheduling refill of reserved leases");
+	}
+
+done:
+	RDEBUG2("Offering reserved lease %s", lease->address);
+
+	{
+		tmpl_t	ip_rhs;
+		map_t	ip_map = { .lhs = env->allocated_address_attr, .op = T_OP_SET, .rhs = &ip_rhs };
+
+		tmpl_init_shallow(&ip_rhs, TMPL_TYPE_DATA, T_BARE_WORD, "", 0, NULL);
+		fr_value_box_bstrndup_shallow(&ip_map.rhs->data.literal, NULL,
+					      lease->address, talloc_array_length(lease->address) - 1, false);
+		if (map_to_request(request, &ip_map, map_to_vp, NULL) < 0) return IPPOOL_RCODE_FAIL;
+	}
+
+	if (lease->range) {
+		tmpl_t	range_rhs;
+		map_t	range_map = { .lhs = env->range_attr, .op = T_OP_SET, .rhs = &range_rhs };
+
+		tmpl_init_shallow(&range_rhs, TMPL_TYPE_DATA, T_DOUBLE_QUOTED_STRING, "", 0, NULL);
+		fr_value_box_bstrndup_shallow(&range_map.rhs->data.literal, NULL,
+					      lease->range, talloc_array_length(lease->range) - 1, true);
+		if (map_to_request(request, &range_map, map_to_vp, NULL) < 0) return IPPOOL_RCODE_FAIL;
+	}
+
+	if (env->expiry_attr) {
+		tmpl_t	expiry_rhs;
+		map_t	expiry_map = { .lhs = env->expiry_attr, .op = T_OP_SET, .rhs = &expiry_rhs };
+
+		tmpl_init_shallow(&expiry_rhs, TMPL_TYPE_DATA, T_DOUBLE_QUOTED_STRING, "", 0, NULL);
+		fr_value_box(&expiry_map.rhs->data.literal, lease_time, true);
+		if (map_to_request(request, &expiry_map, map_to_vp, NULL) < 0) return IPPOOL_RCODE_FAIL;
+	}
+
+	return IPPOOL_RCODE_SUCCESS;
+}
+
 /** Update an existing IP address in a pool
  *
  */
@@ -888,6 +1261,12 @@ static ippool_rcode_t redis_ippool_update(rlm_redis_ippool_t const *inst, reques
 	fr_redis_rcode_t	status;
 	ippool_rcode_t		ret = IPPOOL_RCODE_SUCCESS;
 
+	/*
+	 *	Allows leases offered from this instance's
+	 *	reservations to be claimed by their owner.
+	 */
+	char const		*reserve_owner = inst->reserve.size ? inst->reserve_owner : "";
+
 	now = fr_time_to_timeval(fr_time());
 
 	if ((ip->af == AF_INET) && inst->ipv4_integer) {
@@ -895,13 +1274,14 @@ static ippool_rcode_t redis_ippool_update(rlm_redis_ippool_t const *inst, reques
 				       (uint8_t const *)env->pool_name.vb_strvalue, env->pool_name.vb_length,
 				       inst->wait_num, inst->wait_timeout,
 				       lua_update_digest, lua_update_cmd,
-				       "EVALSHA %s 1 %b %u %u %u %b %b",
+				       "EVALSHA %s 1 %b %u %u %u %b %b %s",
 				       lua_update_digest,
 				       (uint8_t const *)env->pool_name.vb_strvalue, env->pool_name.vb_length,
 				       (unsigned int)now.tv_sec, expires,
 				       htonl(ip->addr.v4.s_addr),
 				       (uint8_t const *)owner->vb_strvalue, owner->vb_length,
-				       (uint8_t const *)gateway_id->vb_strvalue, gateway_id->vb_length);
+				       (uint8_t const *)gateway_id->vb_strvalue, gateway_id->vb_length,
+				       reserve_owner);
 	} else {
 		char ip_buff[FR_IPADDR_PREFIX_STRLEN];
 
@@ -910,13 +1290,14 @@ static ippool_rcode_t redis_ippool_update(rlm_redis_ippool_t const *inst, reques
 				       (uint8_t const *)env->pool_name.vb_strvalue, env->pool_name.vb_length,
 				       inst->wait_num, inst->wait_timeout,
 				       lua_update_digest, lua_update_cmd,
-				       "EVALSHA %s 1 %b %u %u %s %b %b",
+				       "EVALSHA %s 1 %b %u %u %s %b %b %s",
 				       lua_update_digest,
 				       (uint8_t const *)env->pool_name.vb_strvalue, env->pool_name.vb_length,
 				       (unsigned int)now.tv_sec, expires,
 				       ip_buff,
 				       (uint8_t const *)owner->vb_strvalue, owner->vb_length,
-				       (uint8_t const *)gateway_id->vb_strvalue, gateway_id->vb_length);
+				       (uint8_t const *)gateway_id->vb_strvalue, gateway_id->vb_length,
+				       reserve_owner);
 	}
 	if (status != REDIS_RCODE_SUCCESS) {
 		ret = IPPOOL_RCODE_FAIL;
@@ -1114,6 +1495,26 @@ static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_
 			env->offer_time.vb_uint32 : env->lease_time.vb_uint32;
 	ippool_action_print(request, POOL_ACTION_ALLOCATE, L_DBG_LVL_2, &env->pool_name, NULL,
 			    &env->owner, &env->gateway_id, lease_time);
+
+	/*
+	 *	Try the leases this worker reserved first,
+	 *	falling back to allocating from Redis.
+	 */
+	if (inst->reserve.size) {
+		switch (redis_ippool_allocate_reserved(inst, talloc_get_type_abort(mctx->thread, rlm_redis_ippool_thread_t),
+						       request, env, lease_time)) {
+		case IPPOOL_RCODE_SUCCESS:
+			RDEBUG2("IP address lease allocated from reserved leases");
+			RETURN_MODULE_UPDATED;
+
+		case IPPOOL_RCODE_POOL_EMPTY:
+			break;
+
+		default:
+			RETURN_MODULE_FAIL;
+		}
+	}
+
 	switch (redis_ippool_allocate(inst, request, env, lease_time)) {
 	case IPPOOL_RCODE_SUCCESS:
 		RDEBUG2("IP address lease allocated");
@@ -1269,8 +1670,37 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		fr_sha1_update(&sha1_ctx, (uint8_t const *)lua_release_cmd, sizeof(lua_release_cmd) - 1);
 		fr_sha1_final(digest, &sha1_ctx);
 		fr_base16_encode(&FR_SBUFF_OUT(lua_release_digest, sizeof(lua_release_digest)), &FR_DBUFF_TMP(digest, sizeof(digest)));
+
+		fr_sha1_init(&sha1_ctx);
+		fr_sha1_update(&sha1_ctx, (uint8_t const *)lua_reserve_cmd, sizeof(lua_reserve_cmd) - 1);
+		fr_sha1_final(digest, &sha1_ctx);
+		fr_base16_encode(&FR_SBUFF_OUT(lua_reserve_digest, sizeof(lua_reserve_digest)), &FR_DBUFF_TMP(digest, sizeof(digest)));
 	}
 
+	/*
+	 *	Leases are reserved under an identifier unique to
+	 *	this instance, so that only leases we reserved can
+	 *	be claimed by the devices we offered them to.
+	 */
+	if (inst->reserve.size) {
+		if (fr_time_delta_lt(inst->reserve.time, fr_time_delta_from_sec(1))) {
+			cf_log_err(mctx->mi->conf, "reserve.time must be at least 1s");
+			return -1;
+		}
+		snprintf(inst->reserve_owner, sizeof(inst->reserve_owner), "reserved:%08x%08x", fr_rand(), fr_rand());
+	}
+
+	return 0;
+}
+
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_redis_ippool_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_redis_ippool_thread_t);
+
+	t->inst = talloc_get_type_abort_const(mctx->mi->data, rlm_redis_ippool_t);
+	t->el = mctx->el;
+	MEM(t->pools = fr_rb_inline_talloc_alloc(t, ippool_reserve_pool_t, node, ippool_reserve_pool_cmp, NULL));
+
 	return 0;
 }
 
@@ -1289,7 +1719,11 @@ module_rlm_t rlm_redis_ippool = {
 		.inst_size	= sizeof(rlm_redis_ippool_t),
 		.config		= module_config,
 		.onload		= mod_load,
-		.instantiate	= mod_instantiate
+		.instantiate	= mod_instantiate,
+
+		.thread_inst_size	= sizeof(rlm_redis_ippool_thread_t),
+		.thread_inst_type	= "rlm_redis_ippool_thread_t",
+		.thread_instantiate	= mod_thread_instantiate
 	},
 	.bindings = (module_method_binding_t[]){
 		{ .section = SECTION_NAME("recv", "Access-Request"), .method = mod_alloc, .method_env = &redis_ippool_alloc_method_env },			/* radius */
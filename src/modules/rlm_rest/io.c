@@ -34,16 +34,10 @@ void rest_io_module_signal(module_ctx_t const *mctx, request_t *request, UNUSED
 {
 	fr_curl_io_request_t	*randle = talloc_get_type_abort(mctx->rctx, fr_curl_io_request_t);
 	rlm_rest_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_rest_thread_t);
-	CURLMcode		ret;
 
 	RDEBUG2("Forcefully cancelling pending REST request");
 
-	ret = curl_multi_remove_handle(t->mhandle->mandle, randle->candle);	/* Gracefully terminate the request */
-	if (ret != CURLM_OK) {
-		RERROR("Failed removing curl handle from multi-handle: %s (%i)", curl_multi_strerror(ret), ret);
-		/* Not much we can do */
-	}
-	t->mhandle->transfers--;
+	fr_curl_io_request_cancel(t->mhandle, randle);
 
 	rest_slab_release(randle);
 }
@@ -1729,6 +1729,7 @@ int rest_request_config(module_ctx_t const *mctx, rlm_rest_section_t const *sect
 			char const *uri, char const *body_data)
 {
 	rlm_rest_t const	*inst = talloc_get_type_abort(mctx->mi->data, rlm_rest_t);
+	rlm_rest_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_rest_thread_t);
 	rlm_rest_call_env_t 	*call_env = talloc_get_type_abort(mctx->env_data, rlm_rest_call_env_t);
 	rlm_rest_curl_context_t *ctx = talloc_get_type_abort(randle->uctx, rlm_rest_curl_context_t);
 	CURL			*candle = randle->candle;
@@ -1755,6 +1756,7 @@ int rest_request_config(module_ctx_t const *mctx, rlm_rest_section_t const *sect
 	 *	Setup any header options and generic headers.
 	 */
 	FR_CURL_REQUEST_SET_OPTION(CURLOPT_URL, uri);
+	fr_curl_io_request_endpoint_set(t->mhandle, randle, uri);
 #if CURL_AT_LEAST_VERSION(7,85,0)
 	FR_CURL_REQUEST_SET_OPTION(CURLOPT_PROTOCOLS_STR, "http,https");
 #else
@@ -1770,6 +1772,14 @@ int rest_request_config(module_ctx_t const *mctx, rlm_rest_section_t const *sect
 	FR_CURL_REQUEST_SET_OPTION(CURLOPT_NOSIGNAL, 1L);
 	FR_CURL_REQUEST_SET_OPTION(CURLOPT_USERAGENT, "FreeRADIUS " RADIUSD_VERSION_STRING);
 
+#ifdef CURLPIPE_MULTIPLEX
+	/*
+	 *	Wait for an existing connection to confirm it
+	 *	can multiplex, rather than opening a new one.
+	 */
+	if (inst->multiplex) FR_CURL_REQUEST_SET_OPTION(CURLOPT_PIPEWAIT, 1L);
+#endif
+
 	timeout = inst->conn_config.connect_timeout;
 	RDEBUG3("Connect timeout is %pVs, request timeout is %pVs",
 	        fr_box_time_delta(timeout), fr_box_time_delta(section->timeout));
@@ -159,6 +159,9 @@ typedef struct {
 
 	fr_curl_conn_config_t	conn_config;	//!< Configuration of slab allocated connection handles.
 
+	char const		**warm_uris;	//!< URIs of upstreams to keep connections established to.
+	fr_time_delta_t		warm_interval;	//!< How often to probe warm upstreams.
+
 	rlm_rest_section_t	xlat;		//!< Configuration specific to xlat.
 	rlm_rest_section_t	authorize;	//!< Configuration specific to authorisation.
 	rlm_rest_section_t	authenticate;	//!< Configuration specific to authentication.
@@ -172,6 +172,9 @@ static const conf_parser_t module_config[] = {
 
 	{ FR_CONF_OFFSET_SUBSECTION("connection", 0, rlm_rest_t, conn_config, fr_curl_conn_config) },
 
+	{ FR_CONF_OFFSET_FLAGS("warm", CONF_FLAG_MULTI, rlm_rest_t, warm_uris) },
+	{ FR_CONF_OFFSET("warm_interval", rlm_rest_t, warm_interval), .dflt = "30s" },
+
 #ifdef CURLPIPE_MULTIPLEX
 	{ FR_CONF_OFFSET("multiplex", rlm_rest_t, multiplex), .dflt = "yes" },
 #endif
@@ -495,6 +498,57 @@ finish:
 	return xa;
 }
 
+static xlat_arg_parser_t const rest_stats_xlat_args[] = {
+	{ .required = true, .single = true, .type = FR_TYPE_STRING },
+	{ .required = true, .single = true, .type = FR_TYPE_STRING },
+	XLAT_ARG_PARSER_TERMINATOR
+};
+
+/** Return one of the per-endpoint counters for the current thread
+ *
+ * Valid counters are "in_flight", "requests", "failed" and "latency" (in microseconds).
+ * Only the scheme://host[:port] portion of the URL is used to find the endpoint.
+ *
+@verbatim
+%rest.stats(<counter>, <url>)
+@endverbatim
+ *
+ * @ingroup xlat_functions
+ */
+static xlat_action_t rest_stats_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
+				     xlat_ctx_t const *xctx,
+				     request_t *request, fr_value_box_list_t *in)
+{
+	rlm_rest_thread_t		*t = talloc_get_type_abort(xctx->mctx->thread, rlm_rest_thread_t);
+	fr_curl_endpoint_t const	*ep;
+	fr_value_box_t			*vb;
+	fr_value_box_t			*name = fr_value_box_list_head(in);
+	fr_value_box_t			*url = fr_value_box_list_next(in, name);
+	uint64_t			value;
+
+	ep = fr_curl_io_endpoint_find(t->mhandle, url->vb_strvalue);
+
+	if (strcmp(name->vb_strvalue, "in_flight") == 0) {
+		value = ep ? ep->in_flight : 0;
+	} else if (strcmp(name->vb_strvalue, "requests") == 0) {
+		value = ep ? ep->requests : 0;
+	} else if (strcmp(name->vb_strvalue, "failed") == 0) {
+		value = ep ? ep->failed : 0;
+	} else if (strcmp(name->vb_strvalue, "latency") == 0) {
+		value = ep ? (uint64_t)fr_time_delta_to_usec(ep->latency) : 0;
+	} else {
+		REDEBUG("Unknown counter \"%s\", expected one of \"in_flight\", \"requests\", "
+			"\"failed\" or \"latency\"", name->vb_strvalue);
+		return XLAT_ACTION_FAIL;
+	}
+
+	MEM(vb = fr_value_box_alloc(ctx, FR_TYPE_UINT64, NULL));
+	vb->vb_uint64 = value;
+	fr_dcursor_append(out, vb);
+
+	return XLAT_ACTION_DONE;
+}
+
 static xlat_arg_parser_t const rest_xlat_args[] = {
 	{ .required = true, .safe_for = CURL_URI_SAFE_FOR, .type = FR_TYPE_STRING },
 	{ .variadic = XLAT_ARG_VARIADIC_EMPTY_KEEP, .type = FR_TYPE_STRING },
@@ -1233,6 +1287,7 @@ static int _rest_request_cleanup(fr_curl_io_request_t *randle, UNUSED void *uctx
 	ctx->response.header = NULL;	/* This is owned by the parsed call env and must not be freed */
 
 	randle->request = NULL;
+	randle->endpoint = NULL;
 	return 0;
 }
 
@@ -1290,11 +1345,22 @@ static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 		return -1;
 	}
 
-	mhandle = fr_curl_io_init(t, mctx->el, inst->multiplex);
+	mhandle = fr_curl_io_init(t, mctx->el, inst->multiplex, &inst->conn_config);
 	if (!mhandle) return -1;
 
 	t->mhandle = mhandle;
 
+	/*
+	 *	Establish connections to upstreams before any
+	 *	requests need them.  The xlat section's TLS
+	 *	config is used, so connections will only be
+	 *	reused by sections with matching TLS config.
+	 */
+	talloc_foreach(inst->warm_uris, uri) {
+		if (fr_curl_io_warm(mhandle, uri, &inst->conn_config, &inst->xlat.tls,
+				    inst->http_negotiation, inst->warm_interval) < 0) return -1;
+	}
+
 	return 0;
 }
 
@@ -1353,6 +1419,8 @@ static int instantiate(module_inst_ctx_t const *mctx)
 		return -1;
 	}
 
+	FR_TIME_DELTA_BOUND_CHECK("warm_interval", inst->warm_interval, >=, fr_time_delta_from_sec(1));
+
 	inst->conn_config.reuse.num_children = 1;
 	inst->conn_config.reuse.child_pool_size = sizeof(rlm_rest_curl_context_t);
 
@@ -1367,6 +1435,12 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 	xlat_func_args_set(xlat, rest_xlat_args);
 	xlat_func_call_env_set(xlat, &rest_call_env_xlat);
 
+	/*
+	 *	%rest.stats(<counter>, <url>)
+	 */
+	if (unlikely((xlat = xlat_func_register_module(mctx->mi->boot, mctx, "stats", rest_stats_xlat, FR_TYPE_UINT64)) == NULL)) return -1;
+	xlat_func_args_set(xlat, rest_stats_xlat_args);
+
 	return 0;
 }
 
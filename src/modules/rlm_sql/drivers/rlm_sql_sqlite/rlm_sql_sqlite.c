@@ -28,8 +28,12 @@ RCSID("$Id$")
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/util/debug.h>
 
+#include <freeradius-devel/io/atomic_queue.h>
+#include <freeradius-devel/io/schedule.h>
+
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include <sqlite3.h>
 
@@ -49,19 +53,83 @@ RCSID("$Id$")
 typedef sqlite_int64 sqlite3_int64;
 #endif
 
+/** A write statement queued for the writer thread
+ *
+ * One of these is embedded in each connection, so queueing a write
+ * never allocates memory.
+ */
+typedef struct {
+	char const		*query;			//!< Statement to execute.
+
+	int			status;			//!< SQLite status code of the statement, or of
+							///< the transaction it was grouped into.
+	int			changes;		//!< Number of rows modified by the statement.
+	bool			failed;			//!< Statement failed and won't be retried if the
+							///< batch has to be replayed.
+	char			error[256];		//!< Copy of the writer's error message.
+
+	bool			done;			//!< Writer has finished with this entry.
+	pthread_mutex_t		mutex;			//!< Protects done.
+	pthread_cond_t		cond;			//!< Signalled by the writer when done is set.
+} rlm_sql_sqlite_write_t;
+
+/** Dedicated writer thread and its connection
+ *
+ * Allocated outside of the instance data, as the instance data
+ * is read only after instantiation.
+ */
+typedef struct {
+	sqlite3			*db;			//!< The writer's own connection.
+	fr_atomic_queue_t	*queue;			//!< Writes waiting to be committed.
+	rlm_sql_sqlite_write_t	**batch;		//!< Scratch space for the current transaction.
+	uint32_t		max_batch;		//!< Maximum number of statements per transaction.
+
+	pthread_t		thread;			//!< Writer thread.
+	pthread_mutex_t		mutex;			//!< Used with cond to put the writer to sleep.
+	pthread_cond_t		cond;			//!< Signalled when work arrives, or on exit.
+	atomic_uint64_t		pending;		//!< Writes pushed but not yet popped.
+	atomic_bool		running;		//!< Cleared to make the writer exit.
+
+	atomic_uint64_t		statements;		//!< Statements executed by the writer.
+	atomic_uint64_t		transactions;		//!< Transactions committed by the writer.
+	atomic_uint64_t		overflows;		//!< Writes executed directly because the queue was full.
+} rlm_sql_sqlite_writer_t;
+
 typedef struct {
 	sqlite3 *db;
 	sqlite3_stmt *statement;
 	int col_count;
+
+	rlm_sql_sqlite_write_t	write;			//!< Queue entry for writes.
+	bool			written;		//!< Last query was executed by the writer thread.
 } rlm_sql_sqlite_conn_t;
 
 typedef struct {
-	char const	*filename;
-	bool		bootstrap;
+	bool			enabled;		//!< Send writes to a dedicated writer thread.
+	uint32_t		max_batch;		//!< Maximum number of statements per transaction.
+	uint32_t		queue_size;		//!< Maximum number of writes waiting to be committed.
+} rlm_sql_sqlite_writer_conf_t;
+
+typedef struct {
+	char const			*filename;
+	bool				bootstrap;
+	bool				wal;		//!< Switch the database to write-ahead logging.
+
+	rlm_sql_sqlite_writer_conf_t	writer_conf;	//!< Writer thread configuration.
+	rlm_sql_sqlite_writer_t		*writer;	//!< Writer thread, NULL if disabled.
 } rlm_sql_sqlite_t;
 
+static const conf_parser_t writer_config[] = {
+	{ FR_CONF_OFFSET("enable", rlm_sql_sqlite_writer_conf_t, enabled), .dflt = "no" },
+	{ FR_CONF_OFFSET("max_batch", rlm_sql_sqlite_writer_conf_t, max_batch), .dflt = "256" },
+	{ FR_CONF_OFFSET("queue_size", rlm_sql_sqlite_writer_conf_t, queue_size), .dflt = "4096" },
+	CONF_PARSER_TERMINATOR
+};
+
 static const conf_parser_t driver_config[] = {
 	{ FR_CONF_OFFSET_FLAGS("filename", CONF_FLAG_FILE_OUTPUT | CONF_FLAG_REQUIRED, rlm_sql_sqlite_t, filename) },
+	{ FR_CONF_OFFSET("wal", rlm_sql_sqlite_t, wal), .dflt = "no" },
+	{ FR_CONF_OFFSET_SUBSECTION("writer", 0, rlm_sql_sqlite_t, writer_conf, writer_config) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -375,6 +443,9 @@ static int _sql_socket_destructor(rlm_sql_sqlite_conn_t *conn)
 					      sqlite3_errmsg(conn->db));
 	}
 
+	pthread_mutex_destroy(&conn->write.mutex);
+	pthread_cond_destroy(&conn->write.cond);
+
 	return 0;
 }
 
@@ -393,62 +464,300 @@ static void _sql_greatest(sqlite3_context *ctx, int num_values, sqlite3_value **
 	sqlite3_result_int64(ctx, max);
 }
 
-static sql_rcode_t CC_HINT(nonnull) sql_socket_init(rlm_sql_handle_t *handle, rlm_sql_config_t const *config,
-					    UNUSED fr_time_delta_t timeout)
+/** Execute a single statement on the writer's connection
+ *
+ * Any rows produced (i.e. by a RETURNING clause) are discarded, the
+ * caller only gets the status and the number of rows changed.
+ */
+static void sql_writer_exec(sqlite3 *db, rlm_sql_sqlite_write_t *w)
 {
-	rlm_sql_sqlite_conn_t	*conn;
-	rlm_sql_sqlite_t	*inst = talloc_get_type_abort(handle->inst->driver_submodule->data, rlm_sql_sqlite_t);
+	sqlite3_stmt	*statement = NULL;
+	char const	*z_tail;
+	int		status;
 
-	int status;
+#ifdef HAVE_SQLITE3_PREPARE_V2
+	status = sqlite3_prepare_v2(db, w->query, strlen(w->query), &statement, &z_tail);
+#else
+	status = sqlite3_prepare(db, w->query, strlen(w->query), &statement, &z_tail);
+#endif
+	if ((status == SQLITE_OK) && statement) {
+		do {
+			status = sqlite3_step(statement);
+		} while ((status & 0xff) == SQLITE_ROW);
+	}
 
-	MEM(conn = handle->conn = talloc_zero(handle, rlm_sql_sqlite_conn_t));
-	talloc_set_destructor(conn, _sql_socket_destructor);
+	w->changes = 0;
+	w->status = status;
+	switch (status & 0xff) {
+	case SQLITE_OK:
+	case SQLITE_DONE:
+		w->changes = sqlite3_changes(db);
+		w->error[0] = '\0';
+		break;
+
+	default:
+		strlcpy(w->error, sqlite3_errmsg(db), sizeof(w->error));
+		break;
+	}
+
+	if (statement) (void) sqlite3_finalize(statement);
+}
+
+/** Record a transaction level failure against every statement in a batch
+ *
+ */
+static void sql_writer_batch_fail(sqlite3 *db, rlm_sql_sqlite_write_t **batch, uint32_t count, int status)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		if (batch[i]->failed) continue;
+
+		batch[i]->status = status;
+		batch[i]->changes = 0;
+		strlcpy(batch[i]->error, sqlite3_errmsg(db), sizeof(batch[i]->error));
+	}
+}
+
+/** Execute a batch of statements as a single transaction
+ *
+ * Statements which fail without aborting the transaction (constraint
+ * violations, for instance) only affect the statement that failed.
+ *
+ * If a failure causes SQLite to roll back the whole transaction, the
+ * statement responsible is marked as failed and the rest of the batch
+ * is replayed in a new transaction.  Each replay removes at least one
+ * statement from the batch, so this always terminates.
+ */
+static void sql_writer_commit(rlm_sql_sqlite_writer_t *writer, rlm_sql_sqlite_write_t **batch, uint32_t count)
+{
+	uint32_t	i;
+	int		status;
+
+	for (i = 0; i < count; i++) batch[i]->failed = false;
+
+again:
+	status = sqlite3_exec(writer->db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+	if (status != SQLITE_OK) {
+		sql_print_error(writer->db, status, "Writer failed starting transaction");
+		sql_writer_batch_fail(writer->db, batch, count, status);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (batch[i]->failed) continue;
+
+		sql_writer_exec(writer->db, batch[i]);
+		if (sql_error_to_rcode(batch[i]->status) == RLM_SQL_OK) continue;
+
+		/*
+		 *	Statement level error, the rest of the
+		 *	transaction is unaffected.
+		 */
+		if (!sqlite3_get_autocommit(writer->db)) continue;
+
+		/*
+		 *	SQLite rolled back the transaction, so everything
+		 *	we'd already done in this batch has been lost.
+		 */
+		batch[i]->failed = true;
+		goto again;
+	}
+
+	status = sqlite3_exec(writer->db, "COMMIT", NULL, NULL, NULL);
+	if (status != SQLITE_OK) {
+		sql_print_error(writer->db, status, "Writer failed committing transaction");
+		sql_writer_batch_fail(writer->db, batch, count, status);
+		if (!sqlite3_get_autocommit(writer->db)) (void) sqlite3_exec(writer->db, "ROLLBACK", NULL, NULL, NULL);
+		return;
+	}
+
+	atomic_fetch_add_explicit(&writer->statements, count, memory_order_relaxed);
+	atomic_fetch_add_explicit(&writer->transactions, 1, memory_order_relaxed);
+}
+
+/** Main loop of the writer thread
+ *
+ * Drains the queue in batches of up to max_batch statements, committing
+ * each batch in a single transaction.  While a transaction is being
+ * committed, more writes accumulate in the queue, so the batch size
+ * follows the write load.
+ */
+static void *sql_writer_thread(void *uctx)
+{
+	rlm_sql_sqlite_writer_t	*writer = talloc_get_type_abort(uctx, rlm_sql_sqlite_writer_t);
+	rlm_sql_sqlite_write_t	*w;
+	uint32_t		count, i;
+
+	DEBUG2("Writer thread started");
+
+	for (;;) {
+		pthread_mutex_lock(&writer->mutex);
+		while ((atomic_load(&writer->pending) == 0) && atomic_load(&writer->running)) {
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		}
+		pthread_mutex_unlock(&writer->mutex);
+
+		for (count = 0; count < writer->max_batch; count++) {
+			if (!fr_atomic_queue_pop(writer->queue, (void **)&w)) break;
+			atomic_fetch_sub(&writer->pending, 1);
+			writer->batch[count] = w;
+		}
+
+		if (count == 0) {
+			if (!atomic_load(&writer->running)) break;
+			continue;
+		}
+
+		sql_writer_commit(writer, writer->batch, count);
+
+		/*
+		 *	Wake up the workers waiting on the results.
+		 */
+		for (i = 0; i < count; i++) {
+			w = writer->batch[i];
+
+			pthread_mutex_lock(&w->mutex);
+			w->done = true;
+			pthread_cond_signal(&w->cond);
+			pthread_mutex_unlock(&w->mutex);
+		}
+	}
+
+	DEBUG2("Writer thread exiting");
+
+	return NULL;
+}
+
+/** Whether a query can be handed to the writer thread
+ *
+ * Statements belonging to a transaction the caller opened explicitly
+ * must run on the caller's own connection, as must the statements
+ * which start and end that transaction.
+ */
+static bool sql_writer_eligible(rlm_sql_sqlite_conn_t *conn, char const *query)
+{
+	static char const *txn_keywords[] = { "BEGIN", "START", "COMMIT", "END", "ROLLBACK", "SAVEPOINT", "RELEASE" };
+	char const	*p = query;
+	size_t		i, len;
+
+	if (!sqlite3_get_autocommit(conn->db)) return false;
+
+	fr_skip_whitespace(p);
+	for (i = 0; i < NUM_ELEMENTS(txn_keywords); i++) {
+		len = strlen(txn_keywords[i]);
+
+		if ((strncasecmp(p, txn_keywords[i], len) == 0) && !isalpha((uint8_t)p[len])) return false;
+	}
+
+	return true;
+}
+
+/** Pass a write to the writer thread, and wait for it to be committed
+ *
+ * @return
+ *	- 0 if the write was executed by the writer.
+ *	- -1 if the queue was full, and the caller should execute the write itself.
+ */
+static int sql_writer_submit(rlm_sql_sqlite_writer_t *writer, rlm_sql_sqlite_conn_t *conn, char const *query)
+{
+	rlm_sql_sqlite_write_t *w = &conn->write;
+
+	w->query = query;
+	w->done = false;
+
+	if (!fr_atomic_queue_push(writer->queue, w)) {
+		atomic_fetch_add_explicit(&writer->overflows, 1, memory_order_relaxed);
+		return -1;
+	}
+
+	/*
+	 *	Only the first write into an empty queue needs
+	 *	to wake the writer.
+	 */
+	if (atomic_fetch_add(&writer->pending, 1) == 0) {
+		pthread_mutex_lock(&writer->mutex);
+		pthread_cond_signal(&writer->cond);
+		pthread_mutex_unlock(&writer->mutex);
+	}
+
+	pthread_mutex_lock(&w->mutex);
+	while (!w->done) pthread_cond_wait(&w->cond, &w->mutex);
+	pthread_mutex_unlock(&w->mutex);
+
+	conn->written = true;
+
+	return 0;
+}
+
+/** Open a connection, and apply the settings common to all connections
+ *
+ */
+static int sql_db_open(sqlite3 **out, rlm_sql_sqlite_t const *inst, rlm_sql_config_t const *config)
+{
+	int status;
 
-	INFO("Opening SQLite database \"%s\"", inst->filename);
 #ifdef HAVE_SQLITE3_OPEN_V2
-	status = sqlite3_open_v2(inst->filename, &(conn->db), SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL);
+	status = sqlite3_open_v2(inst->filename, out, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL);
 #else
-	status = sqlite3_open(inst->filename, &(conn->db));
+	status = sqlite3_open(inst->filename, out);
 #endif
 
-	if (!conn->db || (sql_check_error(conn->db, status) != RLM_SQL_OK)) {
-		sql_print_error(conn->db, status, "Error opening SQLite database \"%s\"", inst->filename);
+	if (!*out || (sql_check_error(*out, status) != RLM_SQL_OK)) {
+		sql_print_error(*out, status, "Error opening SQLite database \"%s\"", inst->filename);
 #ifdef HAVE_SQLITE3_OPEN_V2
 		if (!inst->bootstrap) {
 			INFO("Use the sqlite driver 'bootstrap' option to automatically create the database file");
 		}
 #endif
-		return RLM_SQL_ERROR;
+		return -1;
 	}
-	status = sqlite3_busy_timeout(conn->db, fr_time_delta_to_sec(config->query_timeout));
-	if (sql_check_error(conn->db, status) != RLM_SQL_OK) {
-		sql_print_error(conn->db, status, "Error setting busy timeout");
-		return RLM_SQL_ERROR;
+	status = sqlite3_busy_timeout(*out, fr_time_delta_to_msec(config->query_timeout));
+	if (sql_check_error(*out, status) != RLM_SQL_OK) {
+		sql_print_error(*out, status, "Error setting busy timeout");
+		return -1;
 	}
 
 	/*
 	 *	Enable extended return codes for extra debugging info.
 	 */
 #ifdef HAVE_SQLITE3_EXTENDED_RESULT_CODES
-	status = sqlite3_extended_result_codes(conn->db, 1);
-	if (sql_check_error(conn->db, status) != RLM_SQL_OK) {
-		sql_print_error(conn->db, status, "Error enabling extended result codes");
-		return RLM_SQL_ERROR;
+	status = sqlite3_extended_result_codes(*out, 1);
+	if (sql_check_error(*out, status) != RLM_SQL_OK) {
+		sql_print_error(*out, status, "Error enabling extended result codes");
+		return -1;
 	}
 #endif
 
 #ifdef HAVE_SQLITE3_CREATE_FUNCTION_V2
-	status = sqlite3_create_function_v2(conn->db, "GREATEST", -1, SQLITE_ANY, NULL,
+	status = sqlite3_create_function_v2(*out, "GREATEST", -1, SQLITE_ANY, NULL,
 					    _sql_greatest, NULL, NULL, NULL);
 #else
-	status = sqlite3_create_function(conn->db, "GREATEST", -1, SQLITE_ANY, NULL,
+	status = sqlite3_create_function(*out, "GREATEST", -1, SQLITE_ANY, NULL,
 					 _sql_greatest, NULL, NULL);
 #endif
-	if (sql_check_error(conn->db, status) != RLM_SQL_OK) {
-		sql_print_error(conn->db, status, "Failed registering 'GREATEST' sql function");
-		return RLM_SQL_ERROR;
+	if (sql_check_error(*out, status) != RLM_SQL_OK) {
+		sql_print_error(*out, status, "Failed registering 'GREATEST' sql function");
+		return -1;
 	}
 
+	return 0;
+}
+
+static sql_rcode_t CC_HINT(nonnull) sql_socket_init(rlm_sql_handle_t *handle, rlm_sql_config_t const *config,
+					    UNUSED fr_time_delta_t timeout)
+{
+	rlm_sql_sqlite_conn_t	*conn;
+	rlm_sql_sqlite_t	*inst = talloc_get_type_abort(handle->inst->driver_submodule->data, rlm_sql_sqlite_t);
+
+	MEM(conn = handle->conn = talloc_zero(handle, rlm_sql_sqlite_conn_t));
+	pthread_mutex_init(&conn->write.mutex, NULL);
+	pthread_cond_init(&conn->write.cond, NULL);
+	talloc_set_destructor(conn, _sql_socket_destructor);
+
+	INFO("Opening SQLite database \"%s\"", inst->filename);
+	if (sql_db_open(&conn->db, inst, config) < 0) return RLM_SQL_ERROR;
+
 	return RLM_SQL_OK;
 }
 
@@ -458,6 +767,8 @@ static sql_rcode_t sql_select_query(rlm_sql_handle_t *handle, UNUSED rlm_sql_con
 	char const		*z_tail;
 	int			status;
 
+	conn->written = false;
+
 #ifdef HAVE_SQLITE3_PREPARE_V2
 	status = sqlite3_prepare_v2(conn->db, query, strlen(query), &conn->statement, &z_tail);
 #else
@@ -475,9 +786,20 @@ static sql_rcode_t sql_query(rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t c
 
 	sql_rcode_t		rcode;
 	rlm_sql_sqlite_conn_t	*conn = handle->conn;
+	rlm_sql_sqlite_t const	*inst = talloc_get_type_abort_const(handle->inst->driver_submodule->data,
+								    rlm_sql_sqlite_t);
 	char const		*z_tail;
 	int			status;
 
+	conn->written = false;
+
+	/*
+	 *	Writes go through the writer thread where possible,
+	 *	so they're grouped into larger transactions.
+	 */
+	if (inst->writer && sql_writer_eligible(conn, query) &&
+	    (sql_writer_submit(inst->writer, conn, query) == 0)) return sql_error_to_rcode(conn->write.status);
+
 #ifdef HAVE_SQLITE3_PREPARE_V2
 	status = sqlite3_prepare_v2(conn->db, query, strlen(query), &conn->statement, &z_tail);
 #else
@@ -644,6 +966,15 @@ static size_t sql_error(UNUSED TALLOC_CTX *ctx, sql_log_entry_t out[], NDEBUG_UN
 
 	fr_assert(outlen > 0);
 
+	if (conn->written) {
+		if (conn->write.error[0] == '\0') return 0;
+
+		out[0].type = L_ERR;
+		out[0].msg = conn->write.error;
+
+		return 1;
+	}
+
 	error = sqlite3_errmsg(conn->db);
 	if (!error) return 0;
 
@@ -663,11 +994,128 @@ static int sql_affected_rows(rlm_sql_handle_t *handle,
 {
 	rlm_sql_sqlite_conn_t *conn = handle->conn;
 
+	if (conn->written) return conn->write.changes;
 	if (conn->db) return sqlite3_changes(conn->db);
 
 	return -1;
 }
 
+static int _sql_writer_free(rlm_sql_sqlite_writer_t *writer)
+{
+	if (atomic_load(&writer->running)) {
+		pthread_mutex_lock(&writer->mutex);
+		atomic_store(&writer->running, false);
+		pthread_cond_signal(&writer->cond);
+		pthread_mutex_unlock(&writer->mutex);
+
+		pthread_join(writer->thread, NULL);
+
+		INFO("Writer committed %" PRIu64 " statements in %" PRIu64 " transactions, "
+		     "%" PRIu64 " writes bypassed the full queue",
+		     atomic_load(&writer->statements), atomic_load(&writer->transactions),
+		     atomic_load(&writer->overflows));
+	}
+
+	pthread_mutex_destroy(&writer->mutex);
+	pthread_cond_destroy(&writer->cond);
+
+	if (writer->db) (void) sqlite3_close(writer->db);
+	fr_atomic_queue_free(&writer->queue);
+
+	return 0;
+}
+
+/** Open the writer's connection and start the writer thread
+ *
+ */
+static int sql_writer_start(rlm_sql_sqlite_t *inst, rlm_sql_config_t const *config)
+{
+	rlm_sql_sqlite_writer_t *writer;
+
+	FR_INTEGER_BOUND_CHECK("writer.max_batch", inst->writer_conf.max_batch, >=, 1);
+	FR_INTEGER_BOUND_CHECK("writer.queue_size", inst->writer_conf.queue_size, >=, inst->writer_conf.max_batch);
+
+	MEM(writer = talloc_zero(NULL, rlm_sql_sqlite_writer_t));
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+	talloc_set_destructor(writer, _sql_writer_free);
+
+	writer->max_batch = inst->writer_conf.max_batch;
+	MEM(writer->batch = talloc_array(writer, rlm_sql_sqlite_write_t *, writer->max_batch));
+	MEM(writer->queue = fr_atomic_queue_alloc(writer, inst->writer_conf.queue_size));
+
+	if (sql_db_open(&writer->db, inst, config) < 0) {
+	error:
+		talloc_free(writer);
+		return -1;
+	}
+
+	atomic_store(&writer->running, true);
+	if (fr_schedule_pthread_create(&writer->thread, sql_writer_thread, writer) < 0) {
+		PERROR("Failed starting writer thread");
+		atomic_store(&writer->running, false);
+		goto error;
+	}
+
+	inst->writer = writer;
+
+	return 0;
+}
+
+/** Switch the database to write-ahead logging
+ *
+ * The journal mode is persistent, so this only needs to be done once
+ * by any connection.  In WAL mode readers don't block the writer, and
+ * the writer doesn't block readers.
+ */
+static int sql_wal_enable(rlm_sql_sqlite_t const *inst, rlm_sql_config_t const *config)
+{
+	sqlite3		*db = NULL;
+	sqlite3_stmt	*statement;
+	char const	*mode;
+	int		status;
+	int		ret = -1;
+
+	if (sql_db_open(&db, inst, config) < 0) goto finish;
+
+#ifdef HAVE_SQLITE3_PREPARE_V2
+	status = sqlite3_prepare_v2(db, "PRAGMA journal_mode=WAL", -1, &statement, NULL);
+#else
+	status = sqlite3_prepare(db, "PRAGMA journal_mode=WAL", -1, &statement, NULL);
+#endif
+	if (sql_check_error(db, status) != RLM_SQL_OK) {
+		sql_print_error(db, status, "Failed preparing journal mode change");
+		goto finish;
+	}
+
+	status = sqlite3_step(statement);
+	if (status != SQLITE_ROW) {
+		sql_print_error(db, status, "Failed changing journal mode");
+		sqlite3_finalize(statement);
+		goto finish;
+	}
+
+	/*
+	 *	SQLite returns the journal mode actually in
+	 *	effect, which may not be the one we asked for.
+	 */
+	mode = (char const *)sqlite3_column_text(statement, 0);
+	if (!mode || (strcasecmp(mode, "wal") != 0)) {
+		ERROR("Database \"%s\" refused to switch to WAL mode, journal mode is \"%s\"",
+		      inst->filename, mode ? mode : "unknown");
+		sqlite3_finalize(statement);
+		goto finish;
+	}
+	sqlite3_finalize(statement);
+
+	ret = 0;
+
+finish:
+	if (db) (void) sqlite3_close(db);
+
+	return ret;
+}
+
 static int mod_instantiate(module_inst_ctx_t const *mctx)
 {
 	rlm_sql_t const		*parent = talloc_get_type_abort(mctx->mi->parent->data, rlm_sql_t);
@@ -796,6 +1244,24 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	}
 
 	close(fd);
+
+	if (inst->wal && (sql_wal_enable(inst, config) < 0)) return -1;
+
+	if (inst->writer_conf.enabled) {
+		if (!inst->wal) WARN("Writer thread enabled without 'wal = yes', writes will block readers");
+
+		if (sql_writer_start(inst, config) < 0) return -1;
+	}
+
+	return 0;
+}
+
+static int mod_detach(module_detach_ctx_t const *mctx)
+{
+	rlm_sql_sqlite_t *inst = talloc_get_type_abort(mctx->mi->data, rlm_sql_sqlite_t);
+
+	TALLOC_FREE(inst->writer);
+
 	return 0;
 }
 
@@ -819,7 +1285,8 @@ rlm_sql_driver_t rlm_sql_sqlite = {
 		.inst_size			= sizeof(rlm_sql_sqlite_t),
 		.config				= driver_config,
 		.onload				= mod_load,
-		.instantiate			= mod_instantiate
+		.instantiate			= mod_instantiate,
+		.detach				= mod_detach
 	},
 	.flags				= RLM_SQL_RCODE_FLAGS_ALT_QUERY,
 	.sql_socket_init		= sql_socket_init,
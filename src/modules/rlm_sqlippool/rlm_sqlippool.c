@@ -41,9 +41,25 @@ typedef struct {
 	char const      *name;
 	char const	*sql_name;
 
+	uint32_t	alloc_batch_size;		//!< Maximum number of allocations to group into
+							///< a single transaction.  0 disables batching.
+
 	rlm_sql_t const	*sql;
 } rlm_sqlippool_t;
 
+/** Per-thread batching state
+ *
+ */
+typedef struct {
+	rlm_sqlippool_t const	*inst;			//!< Module instance.
+	fr_event_list_t		*el;			//!< To schedule batches in.
+	fr_event_timer_t const	*ev;			//!< Pending batch execution.
+	fr_dlist_head_t		pending;		//!< Allocations waiting for the next batch.
+
+	uint64_t		batches;		//!< Number of batches executed.
+	uint64_t		allocations;		//!< Number of allocation queries executed in batches.
+} rlm_sqlippool_thread_t;
+
 /**  Call environment used by module alloc method
  */
 typedef struct {
@@ -59,6 +75,7 @@ typedef struct {
 	tmpl_t		*update;			//!< tmpl to expand as query for updating the found IP.
 	tmpl_t		*pool_check;			//!< tmpl to expand as query for checking for existence of the pool.
 	fr_value_box_t	commit;				//!< SQL query to commit transaction.
+	fr_value_box_t	rollback;			//!< SQL query to roll back a failed batch.
 } ippool_alloc_call_env_t;
 
 /**  Call environment used by all other module methods
@@ -74,6 +91,7 @@ typedef enum {
 	IPPOOL_ALLOC_EXISTING,			//!< Expanding the "existing" query
 	IPPOOL_ALLOC_REQUESTED,			//!< Expanding the "requested" query
 	IPPOOL_ALLOC_FIND,			//!< Expanding the "find" query
+	IPPOOL_ALLOC_BATCH,			//!< Waiting for the "find" query to be executed in a batch
 	IPPOOL_ALLOC_POOL_CHECK,		//!< Expanding the "pool_check" query
 	IPPOOL_ALLOC_UPDATE			//!< Expanding the "update" query
 } ippool_alloc_status_t;
@@ -87,10 +105,20 @@ typedef struct {
 	rlm_sql_handle_t	*handle;	//!< SQL handle being used for queries.
 	rlm_sql_t const		*sql;		//!< SQL module instance.
 	fr_value_box_list_t	values;		//!< Where to put the expanded queries ready for execution.
+
+	bool			batched;	//!< Allocation is grouped with those of other requests, so
+						///< the transaction is managed by the batch.
+	rlm_sqlippool_thread_t	*thread;	//!< Thread the batch is executed in.
+	fr_dlist_t		entry;		//!< Entry in the thread's pending list, or in a batch.
+	fr_value_box_t		*query;		//!< "find" query waiting to be executed.
+	char			allocation[FR_MAX_STRING_LEN];	//!< Result of the "find" query.
+	int			allocation_len;	//!< Length of allocation, 0 if nothing was
+						///< allocated, < 0 on error.
 } ippool_alloc_ctx_t;
 
 static conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("sql_module_instance", rlm_sqlippool_t, sql_name), .dflt = "sql" },
+	{ FR_CONF_OFFSET("alloc_batch_size", rlm_sqlippool_t, alloc_batch_size), .dflt = "0" },
 
 	CONF_PARSER_TERMINATOR
 };
@@ -176,6 +204,9 @@ static int sqlippool_command(char const *query, rlm_sql_handle_t **handle,
 
 /*
  * Query the database expecting a single result row
+ *
+ * Returns the length of the value written to out, 0 if there was no
+ * result, or < 0 if the query failed.
  */
 static int CC_HINT(nonnull (1, 3, 4, 5)) sqlippool_query1(char *out, int outlen, char const *query,
 							  rlm_sql_handle_t **handle, rlm_sql_t const *sql,
@@ -190,11 +221,12 @@ static int CC_HINT(nonnull (1, 3, 4, 5)) sqlippool_query1(char *out, int outlen,
 
 	if ((retval != 0) || !*handle) {
 		REDEBUG("database query error on '%s'", query);
-		return 0;
+		return -1;
 	}
 
 	if (sql->fetch_row(&row, sql, request, handle) < 0) {
 		REDEBUG("Failed fetching query result");
+		retval = -1;
 		goto finish;
 	}
 
@@ -259,10 +291,32 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	return 0;
 }
 
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_sqlippool_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_sqlippool_thread_t);
+
+	t->inst = talloc_get_type_abort_const(mctx->mi->data, rlm_sqlippool_t);
+	t->el = mctx->el;
+	fr_dlist_init(&t->pending, ippool_alloc_ctx_t, entry);
+
+	return 0;
+}
+
+static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_sqlippool_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_sqlippool_t);
+	rlm_sqlippool_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_sqlippool_thread_t);
+
+	if (t->batches) DEBUG("Executed %" PRIu64 " allocations in %" PRIu64 " batches", t->allocations, t->batches);
+
+	return 0;
+}
+
 /** Release SQL pool connections when alloc context is freed.
  */
 static int sqlippool_alloc_ctx_free(ippool_alloc_ctx_t *to_free)
 {
+	if (fr_dlist_entry_in_list(&to_free->entry)) fr_dlist_remove(&to_free->thread->pending, to_free);
 	(void) request_data_get(to_free->request, (void *)sql_escape_uctx_alloc, 0);
 	if (to_free->handle) fr_pool_connection_release(to_free->sql->pool, to_free->request, to_free->handle);
 	return 0;
@@ -270,6 +324,108 @@ static int sqlippool_alloc_ctx_free(ippool_alloc_ctx_t *to_free)
 
 #define REPEAT_MOD_ALLOC_RESUME if (unlang_function_repeat_set(request, mod_alloc_resume) < 0) RETURN_MODULE_FAIL
 
+/** Execute the "find" queries of queued allocations in a single transaction
+ *
+ * Runs from the event loop, so every request which reached its "find" query
+ * in the same pass through the worker's event loop is part of the batch.
+ * Each query is logged against the request it belongs to, but all of them
+ * are executed on the connection reserved by the first request in the
+ * batch, as they must share a transaction.
+ *
+ * If a query, or the commit, fails, the transaction is rolled back and every
+ * allocation in the batch fails.  Without an alloc_begin query each statement
+ * is committed as it's executed, so only the failed allocation, and those
+ * after it which were never executed, fail.
+ */
+static void sqlippool_batch_exec(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	rlm_sqlippool_thread_t		*t = talloc_get_type_abort(uctx, rlm_sqlippool_thread_t);
+	rlm_sqlippool_t const		*inst = t->inst;
+	ippool_alloc_ctx_t		*first, *alloc_ctx = NULL;
+	ippool_alloc_call_env_t const	*env;
+	rlm_sql_t const			*sql = inst->sql;
+	rlm_sql_handle_t		*handle;
+	request_t			*request;
+	fr_dlist_head_t			batch;
+	bool				in_txn = false;
+
+	fr_dlist_init(&batch, ippool_alloc_ctx_t, entry);
+	while ((fr_dlist_num_elements(&batch) < inst->alloc_batch_size) &&
+	       (alloc_ctx = fr_dlist_pop_head(&t->pending))) {
+		alloc_ctx->allocation_len = -1;
+		fr_dlist_insert_tail(&batch, alloc_ctx);
+	}
+
+	/*
+	 *	More than a batch worth of allocations are
+	 *	queued, run the rest on the next pass.
+	 */
+	if ((fr_dlist_num_elements(&t->pending) > 0) &&
+	    (fr_event_timer_in(t, t->el, &t->ev, fr_time_delta_wrap(0), sqlippool_batch_exec, t) < 0)) {
+		PERROR("Failed scheduling next batch");
+	}
+
+	first = fr_dlist_head(&batch);
+	if (!first) return;
+
+	request = first->request;
+	env = first->env;
+	handle = first->handle;
+
+	t->batches++;
+	t->allocations += fr_dlist_num_elements(&batch);
+
+	RDEBUG2("Executing batch of %u allocations", fr_dlist_num_elements(&batch));
+
+	if (env->begin.type == FR_TYPE_STRING) {
+		if (sqlippool_command(env->begin.vb_strvalue, &handle, sql, request) < 0) goto error;
+		in_txn = true;
+	}
+
+	alloc_ctx = NULL;
+	while ((alloc_ctx = fr_dlist_next(&batch, alloc_ctx))) {
+		alloc_ctx->allocation_len = sqlippool_query1(alloc_ctx->allocation, sizeof(alloc_ctx->allocation),
+							     alloc_ctx->query->vb_strvalue, &handle, sql, alloc_ctx->request);
+		TALLOC_FREE(alloc_ctx->query);
+		if ((alloc_ctx->allocation_len < 0) || !handle) goto error;
+	}
+
+	if ((env->commit.type == FR_TYPE_STRING) &&
+	    (sqlippool_command(env->commit.vb_strvalue, &handle, sql, request) < 0)) goto error;
+
+	goto done;
+
+error:
+	REDEBUG("Batch of %u allocations failed", fr_dlist_num_elements(&batch));
+
+	if (in_txn) {
+		if (handle && (env->rollback.type == FR_TYPE_STRING)) {
+			(void) sqlippool_command(env->rollback.vb_strvalue, &handle, sql, request);
+		}
+
+		alloc_ctx = NULL;
+		while ((alloc_ctx = fr_dlist_next(&batch, alloc_ctx))) alloc_ctx->allocation_len = -1;
+	}
+
+done:
+	first->handle = handle;
+
+	while ((alloc_ctx = fr_dlist_pop_head(&batch))) {
+		TALLOC_FREE(alloc_ctx->query);
+		unlang_interpret_mark_runnable(alloc_ctx->request);
+	}
+}
+
+/** Remove a cancelled allocation from the batch it's waiting for
+ *
+ */
+static void sqlippool_batch_signal(UNUSED request_t *request, UNUSED fr_signal_t action, void *uctx)
+{
+	ippool_alloc_ctx_t	*alloc_ctx = talloc_get_type_abort(uctx, ippool_alloc_ctx_t);
+
+	if (fr_dlist_entry_in_list(&alloc_ctx->entry)) fr_dlist_remove(&alloc_ctx->thread->pending, alloc_ctx);
+}
+
 /** Resume function called after each IP allocation query is expanded
  *
  * Executes the query and, if appropriate, pushes the next tmpl for expansion
@@ -336,20 +492,57 @@ static unlang_action_t mod_alloc_resume(rlm_rcode_t *p_result, UNUSED int *prior
 		return UNLANG_ACTION_PUSHED_CHILD;
 
 	case IPPOOL_ALLOC_FIND:
+	case IPPOOL_ALLOC_BATCH:
 	{
 		tmpl_t	ip_rhs;
 		map_t	ip_map;
 
-		allocation_len = sqlippool_query1(allocation, sizeof(allocation), query->vb_strvalue, &handle,
-						  alloc_ctx->sql, request);
-		talloc_free(query);
-		if (!handle) goto error;
+		if (alloc_ctx->status == IPPOOL_ALLOC_BATCH) {
+			/*
+			 *	We were part of a batch which has now
+			 *	been executed, see what we got.
+			 */
+			if ((alloc_ctx->allocation_len < 0) || !handle) {
+				REDEBUG("Batched allocation failed");
+				goto error;
+			}
+
+			allocation_len = alloc_ctx->allocation_len;
+			memcpy(allocation, alloc_ctx->allocation, allocation_len + 1);
+
+		} else if (alloc_ctx->batched) {
+			rlm_sqlippool_thread_t *t = alloc_ctx->thread;
+
+			/*
+			 *	Queue the query for the next batch, and
+			 *	yield until the batch has been executed.
+			 */
+			alloc_ctx->query = query;
+			fr_dlist_insert_tail(&t->pending, alloc_ctx);
+
+			if (!t->ev && (fr_event_timer_in(t, t->el, &t->ev, fr_time_delta_wrap(0),
+							 sqlippool_batch_exec, t) < 0)) {
+				RPERROR("Failed scheduling batch");
+				goto error;
+			}
 
-		if (allocation_len == 0) {
+			alloc_ctx->status = IPPOOL_ALLOC_BATCH;
+			REPEAT_MOD_ALLOC_RESUME;
+			if (unlang_function_signal_set(request, sqlippool_batch_signal, ~FR_SIGNAL_CANCEL) < 0) goto error;
+			return UNLANG_ACTION_YIELD;
+
+		} else {
+			allocation_len = sqlippool_query1(allocation, sizeof(allocation), query->vb_strvalue, &handle,
+							  alloc_ctx->sql, request);
+			talloc_free(query);
+			if (!handle) goto error;
+		}
+
+		if (allocation_len <= 0) {
 			/*
 			 *  Nothing found
 			 */
-			DO_PART(commit);
+			if (!alloc_ctx->batched) DO_PART(commit);
 
 			/*
 			 *  Should we perform pool-check?
@@ -379,7 +572,7 @@ static unlang_action_t mod_alloc_resume(rlm_rcode_t *p_result, UNUSED int *prior
 		tmpl_init_shallow(&ip_rhs, TMPL_TYPE_DATA, T_BARE_WORD, "", 0, NULL);
 		fr_value_box_bstrndup_shallow(&ip_map.rhs->data.literal, NULL, allocation, allocation_len, false);
 		if (map_to_request(request, &ip_map, map_to_vp, NULL) < 0) {
-			DO_PART(commit);
+			if (!alloc_ctx->batched) DO_PART(commit);
 
 			REDEBUG("Invalid IP address [%s] returned from database query.", allocation);
 			goto error;
@@ -411,7 +604,7 @@ static unlang_action_t mod_alloc_resume(rlm_rcode_t *p_result, UNUSED int *prior
 			talloc_free(query);
 			if (!handle) RETURN_MODULE_FAIL;
 
-			if (allocation_len) {
+			if (allocation_len > 0) {
 				/*
 				 *	Pool exists after all... So,
 				 *	the failure to allocate the IP
@@ -443,7 +636,7 @@ static unlang_action_t mod_alloc_resume(rlm_rcode_t *p_result, UNUSED int *prior
 		}
 
 	finish:
-		DO_PART(commit);
+		if (!alloc_ctx->batched) DO_PART(commit);
 
 		talloc_free(alloc_ctx);
 		RETURN_MODULE_UPDATED;
@@ -473,6 +666,7 @@ static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_
 	rlm_sql_t const		*sql = inst->sql;
 	rlm_sql_handle_t	*handle;
 	ippool_alloc_ctx_t	*alloc_ctx = NULL;
+	bool			batched;
 
 	/*
 	 *	If the allocated IP attribute already exists, do nothing
@@ -490,7 +684,13 @@ static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_
 	RESERVE_CONNECTION(handle, inst->sql->pool, request);
 	request_data_add(request, (void *)sql_escape_uctx_alloc, 0, handle, false, false, false);
 
-	DO_PART(begin);
+	/*
+	 *	Allocations can only be batched if "find" does
+	 *	all the work in a single statement.  The batch
+	 *	then takes care of the transaction.
+	 */
+	batched = (inst->alloc_batch_size > 1) && !env->existing && !env->requested && !env->update;
+	if (!batched) DO_PART(begin);
 
 	MEM(alloc_ctx = talloc(unlang_interpret_frame_talloc_ctx(request), ippool_alloc_ctx_t));
 	*alloc_ctx = (ippool_alloc_ctx_t) {
@@ -498,7 +698,10 @@ static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_
 		.handle = handle,
 		.sql = inst->sql,
 		.request = request,
+		.batched = batched,
+		.thread = talloc_get_type_abort(mctx->thread, rlm_sqlippool_thread_t)
 	};
+	fr_dlist_entry_init(&alloc_ctx->entry);
 	talloc_set_destructor(alloc_ctx, sqlippool_alloc_ctx_free);
 	fr_value_box_list_init(&alloc_ctx->values);
 	if (unlang_function_push(request, NULL, mod_alloc_resume, NULL, 0, UNLANG_SUB_FRAME, alloc_ctx) < 0 ) {
@@ -650,6 +853,9 @@ static const call_env_method_t sqlippool_alloc_method_env = {
 		{ FR_CALL_ENV_OFFSET("alloc_commit", FR_TYPE_STRING, CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_NULLABLE,
 				     ippool_alloc_call_env_t, commit), QUERY_ESCAPE,
 				     .pair.dflt = "COMMIT", .pair.dflt_quote = T_SINGLE_QUOTED_STRING },
+		{ FR_CALL_ENV_OFFSET("alloc_rollback", FR_TYPE_STRING, CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_NULLABLE,
+				     ippool_alloc_call_env_t, rollback), QUERY_ESCAPE,
+				     .pair.dflt = "ROLLBACK", .pair.dflt_quote = T_SINGLE_QUOTED_STRING },
 		CALL_ENV_TERMINATOR
 	}
 };
@@ -708,7 +914,10 @@ module_rlm_t rlm_sqlippool = {
 		.name		= "sqlippool",
 		.inst_size	= sizeof(rlm_sqlippool_t),
 		.config		= module_config,
-		.instantiate	= mod_instantiate
+		.instantiate	= mod_instantiate,
+		.thread_inst_size	= sizeof(rlm_sqlippool_thread_t),
+		.thread_instantiate	= mod_thread_instantiate,
+		.thread_detach		= mod_thread_detach
 	},
 	.bindings = (module_method_binding_t[]){
 		/*
@@ -113,6 +113,7 @@ typedef struct {
 typedef struct {
 	rlm_test_t	*inst;
 	pthread_t	value;
+	uint64_t	calls;		//!< Number of times the counter xlats have been called.
 } rlm_test_thread_t;
 
 /*
@@ -416,6 +417,58 @@ static xlat_action_t test_xlat_fail(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t
 }
 
 
+static xlat_arg_parser_t const test_xlat_counter_args[] = {
+	{ .required = true, .concat = true, .type = FR_TYPE_STRING },
+	XLAT_ARG_PARSER_TERMINATOR
+};
+
+
+/** Return how many times the counter xlats have been called in this thread
+ *
+ * Registered as cacheable, so tests can check whether a call was memoised.
+ */
+static xlat_action_t test_xlat_counter(TALLOC_CTX *ctx, fr_dcursor_t *out,
+				       xlat_ctx_t const *xctx, UNUSED request_t *request,
+				       UNUSED fr_value_box_list_t *in)
+{
+	rlm_test_thread_t	*t = talloc_get_type_abort(xctx->mctx->thread, rlm_test_thread_t);
+	fr_value_box_t		*vb;
+
+	MEM(vb = fr_value_box_alloc(ctx, FR_TYPE_UINT64, NULL));
+	vb->vb_uint64 = ++t->calls;
+	fr_dcursor_append(out, vb);
+
+	return XLAT_ACTION_DONE;
+}
+
+static void test_xlat_yield_counter_done(UNUSED xlat_ctx_t const *xctx, request_t *request, UNUSED fr_time_t fired)
+{
+	unlang_interpret_mark_runnable(request);
+}
+
+static xlat_action_t test_xlat_yield_counter_resume(TALLOC_CTX *ctx, fr_dcursor_t *out,
+						    xlat_ctx_t const *xctx, request_t *request,
+						    fr_value_box_list_t *in)
+{
+	return test_xlat_counter(ctx, out, xctx, request, in);
+}
+
+/** As test_xlat_counter, but yields before returning the count
+ *
+ */
+static xlat_action_t test_xlat_yield_counter(UNUSED TALLOC_CTX *ctx, UNUSED fr_dcursor_t *out,
+					     UNUSED xlat_ctx_t const *xctx, request_t *request,
+					     UNUSED fr_value_box_list_t *in)
+{
+	if (unlang_xlat_timeout_add(request, test_xlat_yield_counter_done, NULL, fr_time()) < 0) {
+		RPEDEBUG("Adding event failed");
+		return XLAT_ACTION_FAIL;
+	}
+
+	return unlang_xlat_yield(request, test_xlat_yield_counter_resume, NULL, 0, NULL);
+}
+
+
 static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 {
 	rlm_test_t *inst = talloc_get_type_abort(mctx->mi->data, rlm_test_t);
@@ -486,6 +539,14 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 	if (!(xlat = xlat_func_register_module(mctx->mi->boot, mctx, "fail", test_xlat_fail, FR_TYPE_VOID))) return -1;
 	xlat_func_args_set(xlat, test_xlat_fail_args);
 
+	if (!(xlat = xlat_func_register_module(mctx->mi->boot, mctx, "counter", test_xlat_counter, FR_TYPE_UINT64))) return -1;
+	xlat_func_args_set(xlat, test_xlat_counter_args);
+	xlat_func_flags_set(xlat, XLAT_FUNC_FLAG_CACHEABLE);
+
+	if (!(xlat = xlat_func_register_module(mctx->mi->boot, mctx, "yield_counter", test_xlat_yield_counter, FR_TYPE_UINT64))) return -1;
+	xlat_func_args_set(xlat, test_xlat_counter_args);
+	xlat_func_flags_set(xlat, XLAT_FUNC_FLAG_CACHEABLE);
+
 	return 0;
 }
 
@@ -67,7 +67,7 @@ ifeq "$(PACKAGE_TEST)" ""
 #
 #  Ensure that we run
 #
-$(OUTPUT)/${1}.ok:  $(patsubst %,rlm_eap_%.la,$(subst -,_,${1}))
+$(OUTPUT)/${1}.ok:  $(filter $(patsubst %,rlm_eap_%.la,$(subst -,_,${1})),$(EAP_TARGETS))
 endif
 
 endef
@@ -78,8 +78,20 @@ ifeq "$(PACKAGE_TEST)" ""
 #  The EAP-MSCHAPv2 module calls MSCHAP to do the dirty work.
 #
 $(OUTPUT)/mschapv2.ok: rlm_mschap.la
+
+#
+#  Variants of a method, with their own configuration.
+#
+$(OUTPUT)/tls-memory.ok: rlm_eap_tls.la
 endif
 
+#
+#  Re-authenticate, and check that the second authentication
+#  resumed the session from the in-memory cache.
+#
+$(OUTPUT)/tls-memory.ok: EAPOL_TEST_ARGS := -r 1
+$(OUTPUT)/tls-memory.ok: EAPOL_TEST_RESUME := yes
+
 #
 #  Generic rules to start / stop the radius service.
 #
@@ -91,9 +103,9 @@ $(OUTPUT)/${1}:
 endef
 
 #
-#  Setup rules to spawn a different RADIUSD instance for each EAP type
+#  Setup rules to spawn a different RADIUSD instance for each EAP test
 #
-$(foreach TEST,$(addprefix test., $(subst _,-,$(EAP_TYPES))),$(eval $(call RADIUSD_SERVICE,servers,$(OUTPUT)/$(TEST)))$(eval $(call ADD_TEST_EAP_OUTPUT,$(TEST))))
+$(foreach TEST,$(addprefix test., $(patsubst $(DIR)/%.conf,%,$(EAPOL_TEST_FILES))),$(eval $(call RADIUSD_SERVICE,servers,$(OUTPUT)/$(TEST)))$(eval $(call ADD_TEST_EAP_OUTPUT,$(TEST))))
 
 #  Reset
 TEST := test.eap
@@ -123,7 +135,7 @@ $(OUTPUT)/%.ok: $(DIR)/%.conf $(if $(POST_INSTALL_MAKEFILE_ARG),,$(BUILD_DIR)/li
 	@echo "EAPOL-TEST $(METHOD)"
 	${Q}$(MAKE) $(POST_INSTALL_MAKEFILE_ARG) --no-print-directory test.$(METHOD).radiusd_kill
 	${Q}$(MAKE) $(POST_INSTALL_MAKEFILE_ARG) --no-print-directory test.$(METHOD).radiusd_start $(POST_INSTALL_RADIUSD_BIN_ARG)
-	${Q}if ! $(EAPOL_TEST) -t 10 -c $< -p $(TEST_PORT) -s $(SECRET) $(KEY) > $(EAPOL_TEST_LOG) 2>&1; then	\
+	${Q}if ! $(EAPOL_TEST) -t 10 -c $< -p $(TEST_PORT) -s $(SECRET) $(KEY) $(EAPOL_TEST_ARGS) > $(EAPOL_TEST_LOG) 2>&1; then	\
 		echo "Last entries in supplicant log ($(EAPOL_TEST_LOG)):";	\
 		tail -n 40 "$(EAPOL_TEST_LOG)";							\
 		echo "--------------------------------------------------";		\
@@ -131,12 +143,21 @@ $(OUTPUT)/%.ok: $(DIR)/%.conf $(if $(POST_INSTALL_MAKEFILE_ARG),,$(BUILD_DIR)/li
 		echo "Last entries in server log ($(RADIUS_LOG)):";			\
 		echo "--------------------------------------------------";		\
 		echo "RADIUSD :  OUTPUT=$(dir $@) TESTDIR=$(dir $<) TEST=$(METHOD) TEST_PORT=$(TEST_PORT) $(RADIUSD_BIN) -fxxx -n servers -d $(dir $<)config -D $(DICT_PATH) -lstdout -f"; \
-		echo "EAPOL   :  $(EAPOL_TEST) -c \"$<\" -p $(TEST_PORT) -s $(SECRET) $(KEY) "; \
+		echo "EAPOL   :  $(EAPOL_TEST) -c \"$<\" -p $(TEST_PORT) -s $(SECRET) $(KEY) $(EAPOL_TEST_ARGS) "; \
 		echo "           log is in $(OUT)"; \
 		rm -f $(BUILD_DIR)/tests/test.eap;                                      \
 		$(MAKE) $(POST_INSTALL_MAKEFILE_ARG) --no-print-directory test.$(METHOD).radiusd_kill;			\
 		exit 1;\
 	fi
+	${Q}if [ "$(EAPOL_TEST_RESUME)" = "yes" ] && ! grep -q 'Reply-Message = "Session resumed"' "$(RADIUS_LOG)"; then	\
+		echo "EAPOL-TEST $(METHOD) - session was not resumed";		\
+		echo "Last entries in server log ($(RADIUS_LOG)):";			\
+		echo "--------------------------------------------------";		\
+		tail -n 40 "$(RADIUS_LOG)";						\
+		rm -f $(BUILD_DIR)/tests/test.eap;                                      \
+		$(MAKE) $(POST_INSTALL_MAKEFILE_ARG) --no-print-directory test.$(METHOD).radiusd_kill;			\
+		exit 1;\
+	fi
 	${Q}$(MAKE) $(POST_INSTALL_MAKEFILE_ARG) --no-print-directory test.$(METHOD).radiusd_stop
 	${Q}touch $@
 
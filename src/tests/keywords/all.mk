@@ -26,7 +26,7 @@ endif
 #  Some tests require PCRE or PCRE2
 #
 ifeq "$(AC_HAVE_REGEX_PCRE)$(AC_HAVE_REGEX_PCRE2)" ""
-FILES := $(filter-out if-regex-match-named,$(FILES))
+FILES := $(filter-out if-regex-match-named if-regex-anchored-escape,$(FILES))
 endif
 
 $(eval $(call TEST_BOOTSTRAP))
@@ -93,6 +93,9 @@ $(foreach x,$(FILES),$(eval $(call KEYWORD_TEST,$x)))
 #  For each file, look for precursor test.
 #  Ensure that each test depends on its precursors.
 #
+#  "PROTOCOL: foo" runs the test with "-p foo", and
+#  "FLAGS: foo=yes" runs it with "-S foo=yes".
+#
 -include $(OUTPUT)/depends.mk
 
 export OPENSSL_LIBS
@@ -112,6 +115,12 @@ $(OUTPUT)/depends.mk: $(addprefix $(DIR)/,$(sort $(FILES))) | $(OUTPUT)
 			z=`echo $$x | sed 's,src/tests/keywords/,,;s/-/_/g'`; \
 			echo "UNIT_TEST_KEYWORD_ARGS.$$z=-p $$y" >> $@; \
 			echo "" >> $@; \
+		fi; \
+		y=`grep 'FLAGS: ' $$x | sed 's/.*://;s/^ *//;s/ *$$//;s/  */ -S /g'`; \
+		if [ "$$y" != "" ]; then \
+			z=`echo $$x | sed 's,src/tests/keywords/,,;s/-/_/g'`; \
+			echo "UNIT_TEST_KEYWORD_ARGS.$$z+=-S $$y" >> $@; \
+			echo "" >> $@; \
 		fi \
 	done
 
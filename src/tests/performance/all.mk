@@ -0,0 +1,13 @@
+#
+#  The benchmarks are run manually, and aren't built by default,
+#  as they can need libraries which the server doesn't.
+#
+#	make sqlippool_bench
+#
+.PHONY: sqlippool_bench
+sqlippool_bench: $(BUILD_DIR)/bin/sqlippool_bench
+
+$(BUILD_DIR)/bin/sqlippool_bench: $(DIR)/sqlippool_bench.c
+	@echo CC $<
+	${Q}mkdir -p $(dir $@)
+	${Q}$(CC) $(CFLAGS) -Wformat-nonliteral $(LDFLAGS) -o $@ $< -lsqlite3 -lpthread
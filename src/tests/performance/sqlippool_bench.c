@@ -0,0 +1,389 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Stand-in benchmark for rlm_sqlippool allocation strategies
+ *
+ * Replays the SQLite ippool queries from several threads, the way
+ * concurrent workers would during a DHCP storm, and reports
+ * allocations/s for:
+ *
+ * - multi	- the default alloc_begin, alloc_existing, alloc_find,
+ *		  alloc_update, alloc_commit sequence.
+ * - single	- a single UPDATE ... RETURNING statement per allocation.
+ * - batch	- single statements grouped into transactions of up to
+ *		  alloc_batch_size allocations, as rlm_sqlippool does.
+ *
+ * Build with:
+ *
+ *	make sqlippool_bench
+ *
+ * @file src/tests/performance/sqlippool_bench.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#define POOL_NAME "bench"
+
+static char const *schema =
+	"CREATE TABLE IF NOT EXISTS fr_ippool_status ("
+	"	status_id int PRIMARY KEY,"
+	"	status varchar(10) NOT NULL);"
+	"INSERT OR IGNORE INTO fr_ippool_status (status_id, status) VALUES"
+	"	(1, 'dynamic'), (2, 'static'), (3, 'declined'), (4, 'disabled');"
+	"CREATE TABLE IF NOT EXISTS fr_ippool ("
+	"	id INTEGER PRIMARY KEY,"
+	"	pool_name varchar(30) NOT NULL,"
+	"	address varchar(43) NOT NULL,"
+	"	owner varchar(128) NOT NULL DEFAULT '',"
+	"	gateway varchar(128) NOT NULL DEFAULT '',"
+	"	expiry_time DATETIME NOT NULL default (DATETIME('now')),"
+	"	status_id int NOT NULL DEFAULT 1,"
+	"	counter int NOT NULL DEFAULT 0);"
+	"CREATE INDEX IF NOT EXISTS fr_ippool_poolname_expire ON fr_ippool(pool_name, expiry_time);"
+	"CREATE INDEX IF NOT EXISTS fr_ippool_address ON fr_ippool(address);"
+	"CREATE INDEX IF NOT EXISTS fr_ippool_poolname_poolkey ON fr_ippool(pool_name, owner, address);";
+
+/*
+ *	Copies of the queries in raddb/mods-config/sql/ippool/sqlite/queries.conf
+ *	with the expansions already done.  These are macros so that
+ *	they can be checked as format strings.
+ */
+#define ALLOC_EXISTING \
+	"SELECT address FROM fr_ippool JOIN fr_ippool_status ON fr_ippool.status_id = fr_ippool_status.status_id " \
+	"WHERE pool_name = '" POOL_NAME "' AND owner = '%s' AND status IN ('dynamic', 'static') " \
+	"ORDER BY expiry_time DESC LIMIT 1"
+
+#define ALLOC_FIND \
+	"SELECT address FROM fr_ippool JOIN fr_ippool_status ON fr_ippool.status_id = fr_ippool_status.status_id " \
+	"WHERE pool_name = '" POOL_NAME "' AND expiry_time < datetime('now') AND status = 'dynamic' " \
+	"ORDER BY expiry_time LIMIT 1"
+
+#define ALLOC_UPDATE \
+	"UPDATE fr_ippool SET gateway = '127.0.0.1', owner = '%s', " \
+	"expiry_time = datetime(strftime('%%s', 'now') + 30, 'unixepoch') " \
+	"WHERE address = '%s' AND pool_name = '" POOL_NAME "'"
+
+#define ALLOC_SINGLE \
+	"UPDATE fr_ippool SET gateway = '127.0.0.1', owner = '%s', " \
+	"expiry_time = datetime(strftime('%%s', 'now') + 30, 'unixepoch') " \
+	"WHERE id = COALESCE(" \
+	"(SELECT id FROM fr_ippool INDEXED BY fr_ippool_poolname_poolkey JOIN fr_ippool_status ON fr_ippool.status_id = fr_ippool_status.status_id " \
+	"WHERE pool_name = '" POOL_NAME "' AND owner = '%s' AND status IN ('dynamic', 'static') " \
+	"ORDER BY expiry_time DESC LIMIT 1), " \
+	"(SELECT id FROM fr_ippool JOIN fr_ippool_status ON fr_ippool.status_id = fr_ippool_status.status_id " \
+	"WHERE pool_name = '" POOL_NAME "' AND expiry_time < datetime('now') AND status = 'dynamic' " \
+	"ORDER BY expiry_time LIMIT 1)) " \
+	"RETURNING address"
+
+typedef enum {
+	MODE_MULTI = 0,
+	MODE_SINGLE,
+	MODE_BATCH
+} bench_mode_t;
+
+static char const *mode_names[] = { "multi", "single", "batch" };
+
+typedef struct batch_entry_s batch_entry_t;
+struct batch_entry_s {
+	batch_entry_t	*next;
+	char		query[1024];
+	bool		ok;
+	bool		done;
+};
+
+/*
+ *	Same leader/follower scheme as sqlippool_batch_query1()
+ */
+static pthread_mutex_t	batch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	batch_cond = PTHREAD_COND_INITIALIZER;
+static batch_entry_t	*batch_head, **batch_tail = &batch_head;
+static bool		batch_running;
+static uint64_t		batch_count;
+
+static char const	*db_file = "sqlippool_bench.db";
+static bool		wal = false;
+static unsigned int	num_threads = 8;
+static unsigned int	num_allocs = 20000;
+static unsigned int	batch_size = 32;
+
+typedef struct {
+	unsigned int	id;
+	bench_mode_t	mode;
+	unsigned int	allocs;
+	unsigned int	failed;
+} thread_ctx_t;
+
+static int exec_row(sqlite3 *db, char const *query, char *out, size_t outlen)
+{
+	sqlite3_stmt	*stmt;
+	int		status, ret = 0;
+
+	if (sqlite3_prepare_v2(db, query, -1, &stmt, NULL) != SQLITE_OK) {
+		fprintf(stderr, "prepare failed: %s\n", sqlite3_errmsg(db));
+		return -1;
+	}
+
+	while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {
+		if (ret) continue;
+		if (out) snprintf(out, outlen, "%s", (char const *)sqlite3_column_text(stmt, 0));
+		ret = 1;
+	}
+	if (status != SQLITE_DONE) {
+		fprintf(stderr, "step failed: %s\n", sqlite3_errmsg(db));
+		ret = -1;
+	}
+	sqlite3_finalize(stmt);
+
+	return ret;
+}
+
+static bool alloc_multi(sqlite3 *db, char const *owner)
+{
+	char	query[1024], address[64];
+	int	ret;
+
+	if (exec_row(db, "BEGIN EXCLUSIVE", NULL, 0) < 0) return false;
+
+	snprintf(query, sizeof(query), ALLOC_EXISTING, owner);
+	ret = exec_row(db, query, address, sizeof(address));
+	if (ret == 0) ret = exec_row(db, ALLOC_FIND, address, sizeof(address));
+	if (ret > 0) {
+		snprintf(query, sizeof(query), ALLOC_UPDATE, owner, address);
+		ret = exec_row(db, query, NULL, 0);
+	}
+
+	if (exec_row(db, "COMMIT", NULL, 0) < 0) return false;
+
+	return (ret >= 0);
+}
+
+static bool alloc_batch(sqlite3 *db, char const *query)
+{
+	batch_entry_t	self = { .ok = false };
+	batch_entry_t	*batch, *entry;
+	unsigned int	count;
+	bool		ok;
+
+	snprintf(self.query, sizeof(self.query), "%s", query);
+
+	pthread_mutex_lock(&batch_mutex);
+	*batch_tail = &self;
+	batch_tail = &self.next;
+
+	while (!self.done) {
+		if (batch_running) {
+			pthread_cond_wait(&batch_cond, &batch_mutex);
+			continue;
+		}
+
+		batch_running = true;
+		batch = batch_head;
+		for (count = 1, entry = batch; entry->next && (count < batch_size); count++) entry = entry->next;
+		batch_head = entry->next;
+		entry->next = NULL;
+		if (!batch_head) batch_tail = &batch_head;
+		batch_count++;
+		pthread_mutex_unlock(&batch_mutex);
+
+		ok = (exec_row(db, "BEGIN EXCLUSIVE", NULL, 0) >= 0);
+		for (entry = batch; ok && entry; entry = entry->next) ok = (exec_row(db, entry->query, NULL, 0) > 0);
+		if (exec_row(db, "COMMIT", NULL, 0) < 0) ok = false;
+
+		pthread_mutex_lock(&batch_mutex);
+		for (entry = batch; entry; entry = batch) {
+			batch = entry->next;
+			entry->ok = ok;
+			entry->done = true;
+		}
+		batch_running = false;
+		pthread_cond_broadcast(&batch_cond);
+	}
+	pthread_mutex_unlock(&batch_mutex);
+
+	return self.ok;
+}
+
+static void *bench_thread(void *uctx)
+{
+	thread_ctx_t	*t = uctx;
+	sqlite3		*db;
+	char		owner[64], query[1024];
+	unsigned int	i;
+	bool		ok;
+
+	if (sqlite3_open_v2(db_file, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK) {
+		fprintf(stderr, "Failed opening %s\n", db_file);
+		exit(EXIT_FAILURE);
+	}
+	sqlite3_busy_timeout(db, 60000);
+
+	for (i = 0; i < t->allocs; i++) {
+		snprintf(owner, sizeof(owner), "%02x:%02x:%02x:%02x:%02x:%02x",
+			 t->mode, t->id, (i >> 24) & 0xff, (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+
+		switch (t->mode) {
+		case MODE_MULTI:
+			ok = alloc_multi(db, owner);
+			break;
+
+		case MODE_SINGLE:
+			snprintf(query, sizeof(query), ALLOC_SINGLE, owner, owner);
+			ok = (exec_row(db, query, NULL, 0) > 0);
+			break;
+
+		case MODE_BATCH:
+		default:
+			snprintf(query, sizeof(query), ALLOC_SINGLE, owner, owner);
+			ok = alloc_batch(db, query);
+			break;
+		}
+		if (!ok) t->failed++;
+	}
+
+	sqlite3_close(db);
+
+	return NULL;
+}
+
+static void pool_reset(sqlite3 *db)
+{
+	if (exec_row(db, "UPDATE fr_ippool SET owner = '', gateway = '', "
+		     "expiry_time = datetime('now', '-1 day')", NULL, 0) < 0) exit(EXIT_FAILURE);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: sqlippool_bench [options]\n");
+	fprintf(stderr, "  -f <file>     SQLite database to create (default %s).\n", db_file);
+	fprintf(stderr, "  -t <threads>  Number of concurrent workers (default %u).\n", num_threads);
+	fprintf(stderr, "  -n <allocs>   Total allocations per mode (default %u).\n", num_allocs);
+	fprintf(stderr, "  -b <size>     Maximum allocations per batch (default %u).\n", batch_size);
+	fprintf(stderr, "  -w            Use WAL journal mode.\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	sqlite3		*db;
+	int		c;
+	unsigned int	i, mode, failed;
+	char		query[256];
+	pthread_t	*threads;
+	thread_ctx_t	*ctx;
+	struct timespec	start, end;
+	double		elapsed;
+
+	while ((c = getopt(argc, argv, "b:f:hn:t:w")) != -1) switch (c) {
+		case 'b':
+			batch_size = atoi(optarg);
+			break;
+
+		case 'f':
+			db_file = optarg;
+			break;
+
+		case 'n':
+			num_allocs = atoi(optarg);
+			break;
+
+		case 't':
+			num_threads = atoi(optarg);
+			break;
+
+		case 'w':
+			wal = true;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+	if (!num_threads || !num_allocs || !batch_size) usage();
+
+	unlink(db_file);
+	if (sqlite3_open(db_file, &db) != SQLITE_OK) {
+		fprintf(stderr, "Failed creating %s\n", db_file);
+		exit(EXIT_FAILURE);
+	}
+	if (sqlite3_exec(db, schema, NULL, NULL, NULL) != SQLITE_OK) {
+		fprintf(stderr, "Failed creating schema: %s\n", sqlite3_errmsg(db));
+		exit(EXIT_FAILURE);
+	}
+	if (wal && (sqlite3_exec(db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL) != SQLITE_OK)) {
+		fprintf(stderr, "Failed enabling WAL: %s\n", sqlite3_errmsg(db));
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 *	One address per allocation, so the pool never runs dry.
+	 */
+	sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+	for (i = 0; i < num_allocs; i++) {
+		snprintf(query, sizeof(query), "INSERT INTO fr_ippool (pool_name, address) VALUES ('" POOL_NAME "', '10.%u.%u.%u')",
+			 (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+		sqlite3_exec(db, query, NULL, NULL, NULL);
+	}
+	sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+
+	threads = calloc(num_threads, sizeof(*threads));
+	ctx = calloc(num_threads, sizeof(*ctx));
+
+	printf("%u threads, %u allocations, batch size %u, journal mode %s\n",
+	       num_threads, num_allocs, batch_size, wal ? "wal" : "delete");
+
+	for (mode = MODE_MULTI; mode <= MODE_BATCH; mode++) {
+		pool_reset(db);
+		batch_count = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < num_threads; i++) {
+			ctx[i] = (thread_ctx_t) {
+				.id = i,
+				.mode = mode,
+				.allocs = (num_allocs / num_threads) + (i < (num_allocs % num_threads))
+			};
+			pthread_create(&threads[i], NULL, bench_thread, &ctx[i]);
+		}
+
+		for (i = 0, failed = 0; i < num_threads; i++) {
+			pthread_join(threads[i], NULL);
+			failed += ctx[i].failed;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1e9);
+		printf("%-8s %10.0f allocations/s (%.3fs, %u failed", mode_names[mode],
+		       (num_allocs - failed) / elapsed, elapsed, failed);
+		if (mode == MODE_BATCH) printf(", %.1f allocations per batch", (double)num_allocs / batch_count);
+		printf(")\n");
+	}
+
+	sqlite3_close(db);
+	free(threads);
+	free(ctx);
+
+	return EXIT_SUCCESS;
+}
@@ -49,6 +49,29 @@ $(OUTPUT)/depends.mk: $(addprefix $(DIR)/,$(FILES)) | $(OUTPUT)
 	done
 -include $(OUTPUT)/depends.mk
 
+#
+#  The per-instruction statistics are only written once the worker
+#  has run some unlang, so send a packet first.  The values vary
+#  from run to run, so only check that the export isn't empty.
+#
+#  The packet changes the other stats, so those tests are run first.
+#
+$(OUTPUT)/stats-worker-0-unlang.txt: $(DIR)/stats-worker-0-unlang.txt $(BUILD_DIR)/bin/radclient$(E) | $(TEST).radiusd_kill $(TEST).radiusd_start \
+				     $(OUTPUT)/stats-network-0-self.txt $(OUTPUT)/stats-worker-0-self.txt
+	@echo "RADMIN-TEST $(notdir $@)"
+	${Q} [ -f $(dir $@)/radiusd.pid ] || exit 1
+	${Q}echo 'User-Name = "bob"' | $(TEST_BIN)/radclient -q -D share/dictionary 127.0.0.1:$(radmin_port) auth testing123 > /dev/null 2>&1 || true
+	${Q}if ! $(TEST_BIN)/radmin -q -f $(RADMIN_SOCKET_FILE) < $< > $(patsubst %.txt,%.out,$@) 2>&1 || \
+	    ! grep -q 'recv Access-Request' $(patsubst %.txt,%.out,$@); then \
+		echo "RADMIN FAILED $@"; \
+		cat $(patsubst %.txt,%.out,$@); \
+		echo "RADMIN : $(TEST_BIN)/radmin -q -f $(RADMIN_SOCKET_FILE) < $<"; \
+		rm -f $(BUILD_DIR)/tests/test.radmin; \
+		$(MAKE) --no-print-directory test.radmin.radiusd_kill; \
+		exit 1; \
+	fi
+	${Q}touch $@
+
 #
 #	Run the radmin commands against the radiusd.
 #